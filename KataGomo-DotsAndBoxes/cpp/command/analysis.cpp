@@ -30,6 +30,7 @@ struct AnalyzeRequest {
   int analysisPVLen;
   bool includePolicy;
   bool includePVVisits;
+  bool includeSearchProfile;
 
   bool reportDuringSearch;
   double reportDuringSearchEvery;
@@ -38,6 +39,11 @@ struct AnalyzeRequest {
   vector<int> avoidMoveUntilByLocBlack;
   vector<int> avoidMoveUntilByLocWhite;
 
+  //Search tree files to continue the search from and to save it to afterwards, empty if none
+  string loadTreeFile;
+  string saveTreeFile;
+  bool saveTreeNNOutputs;
+
   //Starts with STATUS_IN_QUEUE.
   //Thread that grabs it from queue it changes it to STATUS_POPPED
   //Once search is fully started thread sticks in its own thread index
@@ -129,8 +135,9 @@ int MainCmds::analysis(const vector<string>& args) {
   NNEvaluator* nnEval;
   {
     Setup::initializeSession(cfg);
-    const int maxConcurrentEvals = numAnalysisThreads * defaultParams.numThreads * 2 + 16; // * 2 + 16 just to give plenty of headroom
-    const int expectedConcurrentEvals = numAnalysisThreads * defaultParams.numThreads;
+    const int numLeavesInFlight = numAnalysisThreads * defaultParams.numThreads * defaultParams.numLeavesPerSearchThread;
+    const int maxConcurrentEvals = numLeavesInFlight * 2 + 16; // * 2 + 16 just to give plenty of headroom
+    const int expectedConcurrentEvals = numLeavesInFlight;
     const bool defaultRequireExactNNLen = false;
     const int defaultMaxBatchSize = -1;
     const bool disableFP16 = false;
@@ -242,6 +249,7 @@ int MainCmds::analysis(const vector<string>& args) {
       request->perspective,
       request->analysisPVLen, request->includePolicy,
       request->includePVVisits,
+      request->includeSearchProfile,
       ret
     );
 
@@ -251,7 +259,7 @@ int MainCmds::analysis(const vector<string>& args) {
   };
 
   auto analysisLoop = [
-    &logger,&toAnalyzeQueue,&reportAnalysis,&reportNoAnalysis,&logSearchInfo,&nnEval,&openRequestsMutex,&openRequests
+    &logger,&toAnalyzeQueue,&reportAnalysis,&reportNoAnalysis,&reportWarningForId,&logSearchInfo,&nnEval,&openRequestsMutex,&openRequests
   ](AsyncBot* bot, int threadIdx) {
     while(true) {
       std::pair<std::pair<int64_t,int64_t>,AnalyzeRequest*> analysisItem;
@@ -269,6 +277,17 @@ int MainCmds::analysis(const vector<string>& args) {
         bot->setPosition(request->nextPla,request->board,request->hist);
         bot->setParams(request->params);
         bot->setAvoidMoveUntilByLoc(request->avoidMoveUntilByLocBlack,request->avoidMoveUntilByLocWhite);
+        //Each bot handles one query at a time, so this makes the profile reported cover just this query
+        if(request->includeSearchProfile)
+          bot->getSearchStopAndWait()->clearSearchProfile();
+        if(request->loadTreeFile != "") {
+          try {
+            bot->getSearchStopAndWait()->loadTree(request->loadTreeFile);
+          }
+          catch(const StringError& e) {
+            reportWarningForId(request->id, "loadTreeFile", e.what());
+          }
+        }
 
         Player pla = request->nextPla;
         double searchFactor = 1.0;
@@ -320,6 +339,15 @@ int MainCmds::analysis(const vector<string>& args) {
               logger.write("Note: Search quitting due to no visits - this is normal and possible when shutting down but a bug under any other situation.");
           }
         }
+
+        if(request->saveTreeFile != "") {
+          try {
+            bot->getSearchStopAndWait()->saveTree(request->saveTreeFile, request->saveTreeNNOutputs);
+          }
+          catch(const StringError& e) {
+            reportWarningForId(request->id, "saveTreeFile", e.what());
+          }
+        }
       }
 
       //Free up bot resources in case it's a while before we do more search
@@ -497,12 +525,16 @@ int MainCmds::analysis(const vector<string>& args) {
       rbase.analysisPVLen = analysisPVLen;
       rbase.includePolicy = false;
       rbase.includePVVisits = false;
+      rbase.includeSearchProfile = false;
       rbase.reportDuringSearch = false;
       rbase.reportDuringSearchEvery = 1e30;
       rbase.firstReportDuringSearchAfter = 1e30;
       rbase.priority = 0;
       rbase.avoidMoveUntilByLocBlack.clear();
       rbase.avoidMoveUntilByLocWhite.clear();
+      rbase.loadTreeFile = "";
+      rbase.saveTreeFile = "";
+      rbase.saveTreeNNOutputs = false;
 
       auto parseInteger = [&rbase,&reportErrorForId](const json& dict, const char* field, int64_t& buf, int64_t min, int64_t max, const char* errorMessage) {
         try {
@@ -853,6 +885,11 @@ int MainCmds::analysis(const vector<string>& args) {
         if(!suc)
           continue;
       }
+      if(input.find("includeSearchProfile") != input.end()) {
+        bool suc = parseBoolean(input, "includeSearchProfile", rbase.includeSearchProfile, "Must be a boolean");
+        if(!suc)
+          continue;
+      }
       if(input.find("reportDuringSearchEvery") != input.end()) {
         bool suc = parseDouble(input, "reportDuringSearchEvery", rbase.reportDuringSearchEvery, 0.001, 1000000.0, "Must be number of seconds from 0.001 to 1000000.0");
         if(!suc)
@@ -877,6 +914,33 @@ int MainCmds::analysis(const vector<string>& args) {
           continue;
         rbase.priority = buf;
       }
+      auto parseTreeFile = [&rbase,&reportErrorForId,&input,&shouldAnalyze](const char* field, string& buf) {
+        if(!input[field].is_string()) {
+          reportErrorForId(rbase.id, field, "Must be a string");
+          return false;
+        }
+        if(std::count(shouldAnalyze.begin(),shouldAnalyze.end(),true) != 1) {
+          reportErrorForId(rbase.id, field, "Can only be used when analyzing a single turn");
+          return false;
+        }
+        buf = input[field].get<string>();
+        return true;
+      };
+      if(input.find("loadTreeFile") != input.end()) {
+        bool suc = parseTreeFile("loadTreeFile", rbase.loadTreeFile);
+        if(!suc)
+          continue;
+      }
+      if(input.find("saveTreeFile") != input.end()) {
+        bool suc = parseTreeFile("saveTreeFile", rbase.saveTreeFile);
+        if(!suc)
+          continue;
+      }
+      if(input.find("saveTreeNNOutputs") != input.end()) {
+        bool suc = parseBoolean(input, "saveTreeNNOutputs", rbase.saveTreeNNOutputs, "Must be a boolean");
+        if(!suc)
+          continue;
+      }
 
       bool hasAllowMoves = input.find("allowMoves") != input.end();
       bool hasAvoidMoves = input.find("avoidMoves") != input.end();
@@ -985,12 +1049,16 @@ int MainCmds::analysis(const vector<string>& args) {
           newRequest->analysisPVLen = rbase.analysisPVLen;
           newRequest->includePolicy = rbase.includePolicy;
           newRequest->includePVVisits = rbase.includePVVisits;
+          newRequest->includeSearchProfile = rbase.includeSearchProfile;
           newRequest->reportDuringSearch = rbase.reportDuringSearch;
           newRequest->reportDuringSearchEvery = rbase.reportDuringSearchEvery;
           newRequest->firstReportDuringSearchAfter = rbase.firstReportDuringSearchAfter;
           newRequest->priority = priority;
           newRequest->avoidMoveUntilByLocBlack = rbase.avoidMoveUntilByLocBlack;
           newRequest->avoidMoveUntilByLocWhite = rbase.avoidMoveUntilByLocWhite;
+          newRequest->loadTreeFile = rbase.loadTreeFile;
+          newRequest->saveTreeFile = rbase.saveTreeFile;
+          newRequest->saveTreeNNOutputs = rbase.saveTreeNNOutputs;
           newRequest->status.store(AnalyzeRequest::STATUS_IN_QUEUE,std::memory_order_release);
           newRequests.push_back(newRequest);
         }
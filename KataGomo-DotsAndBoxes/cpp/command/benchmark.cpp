@@ -1,6 +1,7 @@
 #include "../core/global.h"
 #include "../core/config_parser.h"
 #include "../core/fileutils.h"
+#include "../core/threadplacement.h"
 #include "../core/timer.h"
 #include "../dataio/sgf.h"
 #include "../search/asyncbot.h"
@@ -28,7 +29,8 @@ static vector<PlayUtils::BenchmarkResults> doFixedTuneThreads(
   Logger& logger,
   double secondsPerGameMove,
   vector<int> numThreadsToTest,
-  bool printElo
+  bool printElo,
+  bool comparePendingVisits
 );
 static vector<PlayUtils::BenchmarkResults> doAutoTuneThreads(
   const SearchParams& params,
@@ -61,6 +63,9 @@ int MainCmds::benchmark(const vector<string>& args) {
   int numPositionsPerGame;
   bool autoTuneThreads;
   double secondsPerGameMove;
+  bool comparePendingVisits;
+  bool compareThreadPlacement;
+  bool printProfile;
   try {
     KataGoCommandLine cmd("Benchmark with gtp config to test speed with different numbers of threads.");
     cmd.addConfigFileArg(KataGoCommandLine::defaultGtpConfigFileName(),"gtp_example.cfg");
@@ -84,6 +89,20 @@ int MainCmds::benchmark(const vector<string>& args) {
       Global::doubleToString(defaultSecondsPerGameMove) + ")",
       false,defaultSecondsPerGameMove,"SECONDS"
     );
+    TCLAP::SwitchArg comparePendingVisitsArg(
+      "","compare-pending-visits",
+      "For each number of threads, benchmark both virtual losses and pending visits (usePendingVisits), "
+      "and compare how often each picks the same move as the search with the first number of threads and virtual losses"
+    );
+    TCLAP::SwitchArg compareThreadPlacementArg(
+      "","compare-thread-placement",
+      "Benchmark each number of threads both without and with the thread affinity and NUMA settings in the config, "
+      "and compare their speed"
+    );
+    TCLAP::SwitchArg printProfileArg(
+      "","profile",
+      "For each number of threads, also print how long the search threads spent in each phase of the search"
+    );
     cmd.add(visitsArg);
     cmd.add(threadsArg);
     cmd.add(numPositionsPerGameArg);
@@ -96,6 +115,9 @@ int MainCmds::benchmark(const vector<string>& args) {
     cmd.add(boardSizeArg);
     cmd.add(autoTuneThreadsArg);
     cmd.add(secondsPerGameMoveArg);
+    cmd.add(comparePendingVisitsArg);
+    cmd.add(compareThreadPlacementArg);
+    cmd.add(printProfileArg);
     cmd.parseArgs(args);
 
     modelFile = cmd.getModelFile();
@@ -106,6 +128,9 @@ int MainCmds::benchmark(const vector<string>& args) {
     numPositionsPerGame = numPositionsPerGameArg.getValue();
     autoTuneThreads = autoTuneThreadsArg.getValue();
     secondsPerGameMove = secondsPerGameMoveArg.getValue();
+    comparePendingVisits = comparePendingVisitsArg.getValue();
+    compareThreadPlacement = compareThreadPlacementArg.getValue();
+    printProfile = printProfileArg.getValue();
 
     if(boardSize != -1 && sgfFile != "")
       throw StringError("Cannot specify both -sgf and -boardsize at the same time");
@@ -119,6 +144,10 @@ int MainCmds::benchmark(const vector<string>& args) {
       throw StringError("Number of seconds per game move to assume: invalid value " + Global::doubleToString(secondsPerGameMove));
     if(desiredThreadsStr != "" && autoTuneThreads)
       throw StringError("Cannot both automatically tune threads and specify fixed exact numbers of threads to test");
+    if(comparePendingVisits && desiredThreadsStr == "")
+      throw StringError("Must specify the numbers of threads to test with -threads to compare pending visits");
+    if(compareThreadPlacement && desiredThreadsStr == "")
+      throw StringError("Must specify the numbers of threads to test with -threads to compare thread placement");
 
     //Apply default
     if(desiredThreadsStr == "")
@@ -186,11 +215,19 @@ int MainCmds::benchmark(const vector<string>& args) {
     nnEval = createNNEval(maxNumThreads, sgf, modelFile, logger, cfg, params);
   };
 
+  const string placementDescription = ThreadPlacement::getDescription();
+  if(compareThreadPlacement && !ThreadPlacement::isActive())
+    throw StringError("Must configure searchThreadAffinity, nnServerThreadAffinity or interleaveSharedTables to compare thread placement");
+
+  int maxThreads = 1;
+  for(int i = 0; i<numThreadsToTest.size(); i++) {
+    maxThreads = std::max(maxThreads,numThreadsToTest[i]);
+  }
+  //Turned off for the first half of the comparison, the nnEval has to be created again once turned on
+  if(compareThreadPlacement)
+    ThreadPlacement::setEnabled(false);
+
   if(!autoTuneThreads) {
-    int maxThreads = 1;
-    for(int i = 0; i<numThreadsToTest.size(); i++) {
-      maxThreads = std::max(maxThreads,numThreadsToTest[i]);
-    }
     reallocateNNEvalWithEnoughBatchSize(maxThreads);
   }
   else
@@ -229,15 +266,48 @@ int MainCmds::benchmark(const vector<string>& args) {
 #endif
   cout << endl;
   cout << "Your GTP config is currently set to use numSearchThreads = " << params.numThreads << endl;
+  cout << "Thread placement: " << placementDescription << endl;
+
+  vector<PlayUtils::BenchmarkResults> unplacedResults;
+  if(compareThreadPlacement) {
+    cout << endl;
+    cout << "Without thread placement:" << endl;
+    unplacedResults = doFixedTuneThreads(params,sgf,numPositionsPerGame,nnEval,logger,secondsPerGameMove,numThreadsToTest,false,false);
+    ThreadPlacement::setEnabled(true);
+    reallocateNNEvalWithEnoughBatchSize(maxThreads);
+    cout << "With thread placement:" << endl;
+  }
 
   vector<PlayUtils::BenchmarkResults> results;
   if(!autoTuneThreads) {
-    results = doFixedTuneThreads(params,sgf,numPositionsPerGame,nnEval,logger,secondsPerGameMove,numThreadsToTest,true);
+    results = doFixedTuneThreads(params,sgf,numPositionsPerGame,nnEval,logger,secondsPerGameMove,numThreadsToTest,true,comparePendingVisits);
   }
   else {
     results = doAutoTuneThreads(params,sgf,numPositionsPerGame,nnEval,logger,secondsPerGameMove,reallocateNNEvalWithEnoughBatchSize);
   }
 
+  if(compareThreadPlacement) {
+    cout << "Thread placement " << placementDescription << " vs none:" << endl;
+    for(int i = 0; i<results.size(); i++) {
+      double placedSpeed = results[i].totalNodes / results[i].totalSeconds;
+      double unplacedSpeed = unplacedResults[i].totalNodes / unplacedResults[i].totalSeconds;
+      cout << "numSearchThreads = " << Global::strprintf("%2d",results[i].numThreads) << ":"
+           << " nodes/s = " << Global::strprintf("%.2f",placedSpeed)
+           << " vs " << Global::strprintf("%.2f",unplacedSpeed)
+           << Global::strprintf(" (%+.1f%%)",100.0 * (placedSpeed / unplacedSpeed - 1.0))
+           << endl;
+    }
+    cout << endl;
+  }
+
+  if(printProfile) {
+    for(const PlayUtils::BenchmarkResults& result: results) {
+      cout << "Search profile for numSearchThreads = " << result.numThreads << ", seconds summed over all threads:" << endl;
+      result.profile.print(cout);
+      cout << endl;
+    }
+  }
+
   if(numThreadsToTest.size() > 1 || autoTuneThreads) {
     PlayUtils::BenchmarkResults::printEloComparison(results,secondsPerGameMove);
 
@@ -280,9 +350,10 @@ static void warmStartNNEval(const CompactSgf* sgf, Logger& logger, const SearchP
 }
 
 static NNEvaluator* createNNEval(int maxNumThreads, CompactSgf* sgf, const string& modelFile, Logger& logger, ConfigParser& cfg, const SearchParams& params) {
-  const int maxConcurrentEvals = maxNumThreads * 2 + 16; // * 2 + 16 just to give plenty of headroom
-  int expectedConcurrentEvals = maxNumThreads;
-  const int defaultMaxBatchSize = std::max(8,((maxNumThreads+3)/4)*4);
+  const int numLeavesInFlight = maxNumThreads * params.numLeavesPerSearchThread;
+  const int maxConcurrentEvals = numLeavesInFlight * 2 + 16; // * 2 + 16 just to give plenty of headroom
+  int expectedConcurrentEvals = numLeavesInFlight;
+  const int defaultMaxBatchSize = std::max(8,((numLeavesInFlight+3)/4)*4);
 
   Rand seedRand;
 
@@ -346,9 +417,11 @@ static vector<PlayUtils::BenchmarkResults> doFixedTuneThreads(
   Logger& logger,
   double secondsPerGameMove,
   vector<int> numThreadsToTest,
-  bool printElo
+  bool printElo,
+  bool comparePendingVisits
 ) {
   vector<PlayUtils::BenchmarkResults> results;
+  vector<PlayUtils::BenchmarkResults> pendingVisitsResults;
 
   if(numThreadsToTest.size() > 1)
     cout << "Testing different numbers of threads (board size " << sgf->xSize << "x" << sgf->ySize << "): " << endl;
@@ -359,6 +432,8 @@ static vector<PlayUtils::BenchmarkResults> doFixedTuneThreads(
     const PlayUtils::BenchmarkResults* baseline = (i == 0) ? NULL : &results[0];
     SearchParams thisParams = params;
     setNumThreads(thisParams,nnEval,logger,numThreadsToTest[i],sgf);
+    if(comparePendingVisits)
+      thisParams.usePendingVisits = false;
     PlayUtils::BenchmarkResults result = PlayUtils::benchmarkSearchOnPositionsAndPrint(
       thisParams,
       sgf,
@@ -369,8 +444,38 @@ static vector<PlayUtils::BenchmarkResults> doFixedTuneThreads(
       printElo
     );
     results.push_back(result);
+
+    if(comparePendingVisits) {
+      thisParams.usePendingVisits = true;
+      PlayUtils::BenchmarkResults pendingVisitsResult = PlayUtils::benchmarkSearchOnPositionsAndPrint(
+        thisParams,
+        sgf,
+        numPositionsPerGame,
+        nnEval,
+        (i == 0) ? NULL : &results[0],
+        secondsPerGameMove,
+        printElo
+      );
+      pendingVisitsResults.push_back(pendingVisitsResult);
+    }
   }
   cout << endl;
+
+  if(comparePendingVisits) {
+    //Searches with the same number of visits should pick the same moves, the less often they do with more threads, the
+    //more the threads are hurting the search.
+    cout << "Virtual losses vs pending visits, with the same move as numSearchThreads = " << results[0].numThreads << " with virtual losses in: " << endl;
+    for(int i = 0; i<results.size(); i++) {
+      cout << "numSearchThreads = " << Global::strprintf("%2d",results[i].numThreads) << ":"
+           << " virtual losses " << Global::strprintf("%5.1f%%",100.0 * results[i].fractionSameBestMoves(results[0]))
+           << " nodes/s = " << Global::strprintf("%.2f",results[i].totalNodes / results[i].totalSeconds)
+           << ", pending visits " << Global::strprintf("%5.1f%%",100.0 * pendingVisitsResults[i].fractionSameBestMoves(results[0]))
+           << " nodes/s = " << Global::strprintf("%.2f",pendingVisitsResults[i].totalNodes / pendingVisitsResults[i].totalSeconds)
+           << endl;
+    }
+    cout << "Even the same search differs somewhat from run to run with several threads or nnRandomize, so use many positions (-numpositions) for a meaningful comparison." << endl;
+    cout << endl;
+  }
   return results;
 }
 
@@ -883,7 +988,7 @@ int MainCmds::genconfig(const vector<string>& args, const string& firstCommand)
       cout << "Running quick initial benchmark at 16 threads!" << endl;
       vector<int> numThreads = {16};
       reallocateNNEvalWithEnoughBatchSize(std::max(16,ternarySearchInitialMax));
-      vector<PlayUtils::BenchmarkResults> results = doFixedTuneThreads(params,sgf,3,nnEval,logger,secondsPerGameMove,numThreads,false);
+      vector<PlayUtils::BenchmarkResults> results = doFixedTuneThreads(params,sgf,3,nnEval,logger,secondsPerGameMove,numThreads,false,false);
       double visitsPerSecond = results[0].totalVisits / (results[0].totalSeconds + 0.00001);
       //Make tests use about 2 seconds each
       maxVisits = (int64_t)round(2.0 * visitsPerSecond/100.0) * 100;
@@ -112,7 +112,41 @@ int MainCmds::testgpuerror(const vector<string>& args) {
   if(nnEval32 != nnEval)
     delete nnEval32;
   delete nnEval;
+
+  //Boards smaller than the nn buffer skip some work for the padding in some backends, so also check them against a
+  //buffer of exactly the board size.
+  bool paddedSuccess = true;
+  if(boardSize < NNPos::MAX_BOARD_LEN) {
+    logger.write("Initializing nneval with nn buffer of exactly the board size...");
+    ConfigParser cfgExact(cfg);
+    cfgExact.overrideKey("maxBoardXSizeForNNBuffer", Global::intToString(boardSize));
+    cfgExact.overrideKey("maxBoardYSizeForNNBuffer", Global::intToString(boardSize));
+    cfgExact.overrideKey("requireMaxBoardSize", "true");
+    NNEvaluator* nnEvalExact = Setup::initializeNNEvaluator(
+      modelFile,modelFile,expectedSha256,cfgExact,logger,seedRand,maxConcurrentEvals,expectedConcurrentEvals,
+      boardSize,boardSize,maxBatchSize,true,false,
+      Setup::SETUP_FOR_BENCHMARK
+    );
+    logger.write("Initializing nneval with larger nn buffer...");
+    ConfigParser cfgPadded(cfg);
+    cfgPadded.overrideKey("maxBoardXSizeForNNBuffer", Global::intToString(NNPos::MAX_BOARD_LEN));
+    cfgPadded.overrideKey("maxBoardYSizeForNNBuffer", Global::intToString(NNPos::MAX_BOARD_LEN));
+    cfgPadded.overrideKey("requireMaxBoardSize", "false");
+    NNEvaluator* nnEvalPadded = Setup::initializeNNEvaluator(
+      modelFile,modelFile,expectedSha256,cfgPadded,logger,seedRand,maxConcurrentEvals,expectedConcurrentEvals,
+      NNPos::MAX_BOARD_LEN,NNPos::MAX_BOARD_LEN,maxBatchSize,false,false,
+      Setup::SETUP_FOR_BENCHMARK
+    );
+    paddedSuccess = Tests::runPaddedNNLenTest(nnEvalPadded,nnEvalExact,logger,boardSize,verbose);
+    logger.write(string("Padded nn buffer test ") + (paddedSuccess ? "passed" : "FAILED"));
+    delete nnEvalPadded;
+    delete nnEvalExact;
+  }
   NeuralNet::globalCleanup();
 
-  return 0;
+  //Independent of the net, but cheap, and catches game rule changes that the search would silently play through
+  bool endgameSolverSuccess = Tests::runEndgameSolverTest(logger,boardSize,verbose);
+  logger.write(string("Endgame solver test ") + (endgameSolverSuccess ? "passed" : "FAILED"));
+
+  return (paddedSuccess && endgameSolverSuccess) ? 0 : 1;
 }
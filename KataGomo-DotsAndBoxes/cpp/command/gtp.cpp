@@ -10,6 +10,7 @@
 #include "../program/setup.h"
 #include "../program/playutils.h"
 #include "../program/play.h"
+#include "../program/rootparallel.h"
 #include "../tests/tests.h"
 #include "../command/commandline.h"
 #include "../main.h"
@@ -71,6 +72,10 @@ static const vector<string> knownCommands = {
   "loadsgf",
   "printsgf",
 
+  //Save the search tree to a file, or load one saved for the current position and continue searching from it
+  "kata-save-tree",
+  "kata-load-tree",
+
   //GTP extensions for board analysis
   // "genmove_analyze",
   "lz-genmove_analyze",
@@ -86,6 +91,7 @@ static const vector<string> knownCommands = {
   "cputime",
   "gomill-cpu_time",
   "kata-benchmark",
+  "kata-search-profile",
 
   //Some debug commands
   "kata-debug-print-tc",
@@ -222,11 +228,16 @@ struct GTPEngine {
 
   double genmoveTimeSum;
 
+  //Worker processes searching alongside us for genmoves, owned by the engine, or NULL if not configured
+  RootParallelCoordinator* rootParallel;
+  double rootParallelStopTimeout;
+
   GTPEngine(
     const string& modelFile, SearchParams initialParams, Rules initialRules,
     double staticPDA,
     double genmoveWRN, double analysisWRN,
-    Player persp, int pvLen
+    Player persp, int pvLen,
+    RootParallelCoordinator* rootPar, double rootParStopTimeout
   )
     :nnModelFile(modelFile),
      analysisPVLen(pvLen),
@@ -245,12 +256,15 @@ struct GTPEngine {
      recentWinLossValues(),
      lastSearchFactor(1.0),
      perspective(persp),
-     genmoveTimeSum(0.0)
+     genmoveTimeSum(0.0),
+     rootParallel(rootPar),
+     rootParallelStopTimeout(rootParStopTimeout)
   {
   }
 
   ~GTPEngine() {
     stopAndWait();
+    delete rootParallel;
     delete bot;
     delete nnEval;
   }
@@ -288,9 +302,10 @@ struct GTPEngine {
       wasDefault = true;
     }
 
-    const int maxConcurrentEvals = params.numThreads * 2 + 16; // * 2 + 16 just to give plenty of headroom
-    const int expectedConcurrentEvals = params.numThreads;
-    const int defaultMaxBatchSize = std::max(8,((params.numThreads+3)/4)*4);
+    const int numLeavesInFlight = params.numThreads * params.numLeavesPerSearchThread;
+    const int maxConcurrentEvals = numLeavesInFlight * 2 + 16; // * 2 + 16 just to give plenty of headroom
+    const int expectedConcurrentEvals = numLeavesInFlight;
+    const int defaultMaxBatchSize = std::max(8,((numLeavesInFlight+3)/4)*4);
     bool defaultRequireExactNNLen = true;
     int nnLenX = boardXSize;
     int nnLenY = boardYSize;
@@ -706,6 +721,12 @@ struct GTPEngine {
 
     Loc moveLoc;
     bot->setAvoidMoveUntilByLoc(args.avoidMoveUntilByLocBlack,args.avoidMoveUntilByLocWhite);
+    //Workers aren't told about avoided moves, so search alone when there are any
+    const bool useRootParallel =
+      rootParallel != NULL && rootParallel->getNumWorkers() > 0 &&
+      args.avoidMoveUntilByLocBlack.size() <= 0 && args.avoidMoveUntilByLocWhite.size() <= 0;
+    if(useRootParallel)
+      rootParallel->beginSearch(bot->getRootHist(), pla, searchFactor);
     if(args.analyzing) {
       std::function<void(const Search* search)> callback = getAnalyzeCallback(pla,args);
       moveLoc = bot->genMoveSynchronousAnalyze(pla, tc, searchFactor, args.secondsPerReport, args.secondsPerReport, callback);
@@ -716,6 +737,31 @@ struct GTPEngine {
       moveLoc = bot->genMoveSynchronous(pla,tc,searchFactor);
     }
 
+    if(useRootParallel) {
+      vector<vector<RootParallel::MoveStats>> allStats = rootParallel->endSearch(rootParallelStopTimeout);
+      const int numWorkersReported = (int)allStats.size();
+      vector<RootParallel::MoveStats> merged = RootParallel::merge(allStats);
+      vector<Loc> workerLocs;
+      vector<double> workerVisits;
+      int64_t mergedVisits = 0;
+      for(const RootParallel::MoveStats& s: merged) {
+        workerLocs.push_back(s.move);
+        workerVisits.push_back((double)s.visits);
+        mergedVisits += s.visits;
+      }
+      //Go through the usual play selection so that solved moves, temperature, and lcb still apply
+      Loc mergedMoveLoc = bot->getSearchStopAndWait()->getChosenMoveLoc(workerLocs,workerVisits);
+      if(logSearchInfo) {
+        logger.write(
+          "Root parallel: merged " + Global::intToString(numWorkersReported) + " worker(s), " +
+          Global::int64ToString(mergedVisits) + " worker root child visits, chose " + Location::toString(mergedMoveLoc,bot->getRootBoard()) +
+          " over own choice " + Location::toString(moveLoc,bot->getRootBoard())
+        );
+      }
+      if(mergedMoveLoc != Board::NULL_LOC)
+        moveLoc = mergedMoveLoc;
+    }
+
     bool isLegal = bot->isLegalStrict(moveLoc,pla);
     if(moveLoc == Board::NULL_LOC || !isLegal) {
       responseIsError = true;
@@ -1220,11 +1266,18 @@ int MainCmds::gtp(const vector<string>& args) {
 
   Player perspective = Setup::parseReportAnalysisWinrates(cfg,C_EMPTY);
 
+  RootParallelCoordinator* rootParallel = NULL;
+  if(cfg.contains("rootParallelSocket"))
+    rootParallel = new RootParallelCoordinator(cfg.getString("rootParallelSocket"), &logger);
+  const double rootParallelStopTimeout =
+    cfg.contains("rootParallelStopTimeout") ? cfg.getDouble("rootParallelStopTimeout",0.0,60.0) : 2.0;
+
   GTPEngine* engine = new GTPEngine(
     nnModelFile,initialParams,initialRules,
     staticPlayoutDoublingAdvantage,
     genmoveWideRootNoise,analysisWideRootNoise,
-    perspective,analysisPVLen
+    perspective,analysisPVLen,
+    rootParallel,rootParallelStopTimeout
   );
   engine->setOrResetBoardSize(cfg,logger,seedRand,defaultBoardXSize,defaultBoardYSize,logger.isLoggingToStderr());
 
@@ -2041,6 +2094,37 @@ int MainCmds::gtp(const vector<string>& args) {
     else if(command == "clear_cache") {
       engine->clearCache();
     }
+    else if(command == "kata-save-tree") {
+      if(pieces.size() != 1 && !(pieces.size() == 2 && pieces[1] == "nnoutputs")) {
+        responseIsError = true;
+        response = "Expected FILENAME and optionally 'nnoutputs' for kata-save-tree but got '" + Global::concat(pieces," ") + "'";
+      }
+      else {
+        bool includeNNOutputs = pieces.size() == 2;
+        try {
+          engine->bot->getSearchStopAndWait()->saveTree(pieces[0], includeNNOutputs);
+        }
+        catch(const StringError& e) {
+          responseIsError = true;
+          response = e.what();
+        }
+      }
+    }
+    else if(command == "kata-load-tree") {
+      if(pieces.size() != 1) {
+        responseIsError = true;
+        response = "Expected one argument for kata-load-tree but got '" + Global::concat(pieces," ") + "'";
+      }
+      else {
+        try {
+          engine->bot->getSearchStopAndWait()->loadTree(pieces[0]);
+        }
+        catch(const StringError& e) {
+          responseIsError = true;
+          response = e.what();
+        }
+      }
+    }
     else if(command == "showboard") {
       ostringstream sout;
       engine->bot->getRootHist().printBasicInfo(sout, engine->bot->getRootBoard());
@@ -2361,6 +2445,21 @@ int MainCmds::gtp(const vector<string>& args) {
       }
     }
 
+    else if(command == "kata-search-profile") {
+      if(pieces.size() > 1 || (pieces.size() == 1 && pieces[0] != "clear")) {
+        responseIsError = true;
+        response = "Expected no arguments or 'clear' for kata-search-profile but got '" + Global::concat(pieces," ") + "'";
+      }
+      else if(pieces.size() == 1) {
+        engine->bot->getSearchStopAndWait()->clearSearchProfile();
+      }
+      else {
+        ostringstream sout;
+        engine->bot->getSearch()->getSearchProfile().print(sout);
+        response = Global::trim(sout.str());
+      }
+    }
+
     else if(command == "stop") {
       //Stop any ongoing ponder or analysis
       engine->stopAndWait();
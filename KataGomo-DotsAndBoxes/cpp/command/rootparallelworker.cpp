@@ -0,0 +1,86 @@
+#include "../core/global.h"
+#include "../core/config_parser.h"
+#include "../search/asyncbot.h"
+#include "../program/setup.h"
+#include "../program/rootparallel.h"
+#include "../command/commandline.h"
+#include "../main.h"
+
+using namespace std;
+
+int MainCmds::rootparallelworker(const vector<string>& args) {
+  Board::initHash();
+  Rand seedRand;
+
+  ConfigParser cfg;
+  string modelFile;
+  string socketPath;
+  try {
+    KataGoCommandLine cmd("Search positions for a gtp engine using root parallel search, reporting root results back to it.");
+    cmd.addConfigFileArg(KataGoCommandLine::defaultGtpConfigFileName(),"gtp_example.cfg");
+    cmd.addModelFileArg();
+    cmd.setShortUsageArgLimit();
+    cmd.addOverrideConfigArg();
+
+    TCLAP::ValueArg<string> socketArg("","socket","Unix socket the gtp engine listens on, defaults to rootParallelSocket in the config",false,string(),"PATH");
+    cmd.add(socketArg);
+    cmd.parseArgs(args);
+
+    modelFile = cmd.getModelFile();
+    socketPath = socketArg.getValue();
+
+    cmd.getConfig(cfg);
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+  if(socketPath == "") {
+    if(!cfg.contains("rootParallelSocket"))
+      throw StringError("Specify the socket to connect to with -socket or rootParallelSocket in the config");
+    socketPath = cfg.getString("rootParallelSocket");
+  }
+  const double reportPeriod =
+    cfg.contains("rootParallelReportPeriod") ? cfg.getDouble("rootParallelReportPeriod",0.01,60.0) : 0.5;
+
+  Logger logger(&cfg);
+  logger.write("Root parallel worker starting...");
+  logger.write(Version::getKataGoVersionForHelp());
+
+  SearchParams params = Setup::loadSingleParams(cfg,Setup::SETUP_FOR_GTP);
+  logger.write("Using " + Global::intToString(params.numThreads) + " CPU thread(s) for search");
+
+  NNEvaluator* nnEval;
+  {
+    Setup::initializeSession(cfg);
+    const int numLeavesInFlight = params.numThreads * params.numLeavesPerSearchThread;
+    const int maxConcurrentEvals = numLeavesInFlight * 2 + 16; // * 2 + 16 just to give plenty of headroom
+    const int expectedConcurrentEvals = numLeavesInFlight;
+    const int defaultMaxBatchSize = std::max(8,((numLeavesInFlight+3)/4)*4);
+    //The coordinator may change the board size at any time, so don't fix the nn size to any one of them
+    const bool defaultRequireExactNNLen = false;
+    const bool disableFP16 = false;
+    const string expectedSha256 = "";
+    nnEval = Setup::initializeNNEvaluator(
+      modelFile,modelFile,expectedSha256,cfg,logger,seedRand,maxConcurrentEvals,expectedConcurrentEvals,
+      NNPos::MAX_BOARD_LEN,NNPos::MAX_BOARD_LEN,defaultMaxBatchSize,defaultRequireExactNNLen,disableFP16,
+      Setup::SETUP_FOR_GTP
+    );
+  }
+
+  //Ignore searchRandSeed - workers started from the same config would otherwise all search exactly alike
+  const string searchRandSeed = Global::uint64ToString(seedRand.nextUInt64());
+  AsyncBot* bot = new AsyncBot(params, nnEval, &logger, searchRandSeed);
+
+  //No cfg.warnUnusedKeys - workers usually share the gtp engine's config, which has many keys only it uses
+  logger.write("Loaded config " + cfg.getFileName());
+  logger.write("Loaded model " + modelFile);
+
+  RootParallel::runWorker(socketPath, bot, reportPeriod, logger);
+
+  delete bot;
+  delete nnEval;
+  NeuralNet::globalCleanup();
+  logger.write("All cleaned up, quitting");
+  return 0;
+}
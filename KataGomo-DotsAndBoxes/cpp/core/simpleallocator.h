@@ -43,11 +43,10 @@ struct SizedBuf {
   SizedBuf(SimpleAllocator<T>* alloc, size_t s)
     : size(s),buf(),allocator(alloc)
   {
-    const std::vector<T> vec = allocator->buffers[size];
-    if(vec.size() <= 0)
+    std::vector<T>& buffers = allocator->buffers[size];
+    if(buffers.size() <= 0)
       buf = allocator->allocateFunc(size);
     else {
-      std::vector<T>& buffers = allocator->buffers[size];
       buf = buffers.back();
       buffers.pop_back();
     }
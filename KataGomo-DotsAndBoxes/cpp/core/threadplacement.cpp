@@ -0,0 +1,265 @@
+#include "../core/threadplacement.h"
+
+#include <atomic>
+
+#include "../core/os.h"
+
+#if defined(OS_IS_UNIX_OR_APPLE) && defined(__linux__)
+#define THREADPLACEMENT_IS_LINUX
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+namespace {
+  struct Node {
+    int id;
+    vector<int> cpus;
+  };
+
+  int searchAffinity = ThreadPlacement::AFFINITY_NONE;
+  int serverAffinity = ThreadPlacement::AFFINITY_NONE;
+  bool interleave = false;
+  //Nodes in use, each with the cpus on it that the process may run on, and those cpus node by node
+  vector<Node> nodes;
+  vector<int> allCpus;
+  std::atomic<bool> enabled(true);
+  std::atomic<int64_t> numSearchThreadsReserved(0);
+}
+
+int ThreadPlacement::parseAffinity(const string& s) {
+  string str = Global::toLower(Global::trim(s));
+  if(str == "none")
+    return AFFINITY_NONE;
+  if(str == "numa")
+    return AFFINITY_NUMA;
+  if(str == "cores")
+    return AFFINITY_CORES;
+  throw StringError("Unknown thread affinity, expected none, numa or cores: " + s);
+}
+
+static const char* affinityToString(int affinity) {
+  switch(affinity) {
+  case ThreadPlacement::AFFINITY_NONE: return "none";
+  case ThreadPlacement::AFFINITY_NUMA: return "numa";
+  case ThreadPlacement::AFFINITY_CORES: return "cores";
+  default: ASSERT_UNREACHABLE; return "";
+  }
+}
+
+void ThreadPlacement::setEnabled(bool b) {
+  enabled.store(b, std::memory_order_release);
+}
+
+bool ThreadPlacement::isActive() {
+  return enabled.load(std::memory_order_acquire) &&
+    (searchAffinity != AFFINITY_NONE || serverAffinity != AFFINITY_NONE || interleave);
+}
+
+string ThreadPlacement::getDescription() {
+  if(!isActive())
+    return "none";
+  string s = string("search threads ") + affinityToString(searchAffinity) + ", nn server threads " + affinityToString(serverAffinity);
+  if(interleave)
+    s += ", shared tables interleaved";
+  s += ", nodes";
+  for(const Node& node: nodes)
+    s += " " + Global::intToString(node.id) + " (" + Global::intToString((int)node.cpus.size()) + " cpus)";
+  return s;
+}
+
+#ifdef THREADPLACEMENT_IS_LINUX
+
+//From linux/mempolicy.h, which isn't always installed
+static constexpr int MEMPOLICY_DEFAULT = 0;
+static constexpr int MEMPOLICY_INTERLEAVE = 3;
+
+//Parses the kernel's cpu list format, such as "0-3,8-11"
+static vector<int> parseCpuList(const string& s) {
+  vector<int> cpus;
+  for(const string& piece: Global::split(Global::trim(s),',')) {
+    string p = Global::trim(piece);
+    if(p == "")
+      continue;
+    vector<string> range = Global::split(p,'-');
+    int lo;
+    int hi;
+    if(range.size() == 1 && Global::tryStringToInt(range[0],lo))
+      hi = lo;
+    else if(range.size() != 2 || !Global::tryStringToInt(range[0],lo) || !Global::tryStringToInt(range[1],hi))
+      throw StringError("Could not parse cpu list: " + s);
+    for(int cpu = lo; cpu <= hi; cpu++)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+void ThreadPlacement::configure(int searchThreadAffinity, int nnServerThreadAffinity, const vector<int>& numaNodes, bool interleaveSharedTables) {
+  searchAffinity = searchThreadAffinity;
+  serverAffinity = nnServerThreadAffinity;
+  interleave = interleaveSharedTables;
+  nodes.clear();
+  allCpus.clear();
+  if(searchAffinity == AFFINITY_NONE && serverAffinity == AFFINITY_NONE && !interleave)
+    return;
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    throw StringError("Could not get the cpus the process is allowed to run on");
+
+  vector<Node> allNodes;
+  DIR* dir = opendir("/sys/devices/system/node");
+  if(dir != NULL) {
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL) {
+      string name = entry->d_name;
+      int id;
+      if(name.size() <= 4 || name.substr(0,4) != "node" || !Global::tryStringToInt(name.substr(4),id))
+        continue;
+      std::ifstream in("/sys/devices/system/node/" + name + "/cpulist");
+      string line;
+      if(!in.good() || !std::getline(in,line))
+        continue;
+      Node node;
+      node.id = id;
+      node.cpus = parseCpuList(line);
+      allNodes.push_back(node);
+    }
+    closedir(dir);
+  }
+  //Without NUMA information, treat the whole machine as one node
+  if(allNodes.size() <= 0) {
+    Node node;
+    node.id = 0;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      node.cpus.push_back(cpu);
+    allNodes.push_back(node);
+  }
+  std::sort(allNodes.begin(), allNodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+
+  for(const Node& node: allNodes) {
+    if(numaNodes.size() > 0 && std::find(numaNodes.begin(), numaNodes.end(), node.id) == numaNodes.end())
+      continue;
+    Node usable;
+    usable.id = node.id;
+    for(int cpu: node.cpus) {
+      if(cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+        usable.cpus.push_back(cpu);
+    }
+    if(usable.cpus.size() > 0)
+      nodes.push_back(usable);
+  }
+  for(int id: numaNodes) {
+    if(std::find_if(nodes.begin(), nodes.end(), [id](const Node& node) { return node.id == id; }) == nodes.end())
+      throw StringError("NUMA node " + Global::intToString(id) + " doesn't exist or has no cpus this process may run on");
+  }
+  if(nodes.size() <= 0)
+    throw StringError("Found no cpus to place threads on");
+  for(const Node& node: nodes)
+    allCpus.insert(allCpus.end(), node.cpus.begin(), node.cpus.end());
+}
+
+static void pinToCpus(const vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(int cpu: cpus)
+    CPU_SET(cpu, &set);
+  //Failing just leaves the thread where it was, which is harmless
+  (void)sched_setaffinity(0, sizeof(set), &set);
+}
+
+static void pin(int affinity, int nodeIdx, int cpuIdx) {
+  if(affinity == ThreadPlacement::AFFINITY_NUMA)
+    pinToCpus(nodes[nodeIdx].cpus);
+  else if(affinity == ThreadPlacement::AFFINITY_CORES)
+    pinToCpus(vector<int>(1, allCpus[cpuIdx]));
+}
+
+int ThreadPlacement::reserveSearchThreads(int numThreads) {
+  assert(numThreads > 0);
+  int64_t offset = numSearchThreadsReserved.fetch_add(numThreads, std::memory_order_acq_rel);
+  return allCpus.size() <= 0 ? 0 : (int)(offset % (int64_t)allCpus.size());
+}
+
+void ThreadPlacement::pinSearchThread(int threadIdx, int numThreads, int offset) {
+  if(!enabled.load(std::memory_order_acquire) || searchAffinity == AFFINITY_NONE)
+    return;
+  assert(threadIdx >= 0 && threadIdx < numThreads);
+  //The block of nodes starts at the node holding the offset's cpu, and wraps around
+  int firstNodeIdx = (int)((int64_t)offset * (int64_t)nodes.size() / (int64_t)allCpus.size());
+  int nodeIdx = (firstNodeIdx + (int)((int64_t)threadIdx * (int64_t)nodes.size() / numThreads)) % (int)nodes.size();
+  pin(searchAffinity, nodeIdx, (offset + threadIdx) % (int)allCpus.size());
+}
+
+void ThreadPlacement::pinNNServerThread(int serverThreadIdx, int numServerThreads) {
+  if(!enabled.load(std::memory_order_acquire) || serverAffinity == AFFINITY_NONE)
+    return;
+  assert(serverThreadIdx >= 0 && serverThreadIdx < numServerThreads);
+  (void)numServerThreads;
+  int nodeIdx = serverThreadIdx % (int)nodes.size();
+  //Take cpus from the end of the node so that they overlap with search threads, which fill nodes from the start, last
+  const vector<int>& cpus = nodes[nodeIdx].cpus;
+  int cpuInNode = (int)cpus.size() - 1 - (serverThreadIdx / (int)nodes.size()) % (int)cpus.size();
+  int cpuIdx = (int)(std::find(allCpus.begin(), allCpus.end(), cpus[cpuInNode]) - allCpus.begin());
+  pin(serverAffinity, nodeIdx, cpuIdx);
+}
+
+ThreadPlacement::InterleavedAllocation::InterleavedAllocation()
+  :isInterleaving(false)
+{
+  if(!enabled.load(std::memory_order_acquire) || !interleave || nodes.size() <= 1)
+    return;
+  const int bitsPerWord = 8 * (int)sizeof(unsigned long);
+  int maxNodeId = 0;
+  for(const Node& node: nodes)
+    maxNodeId = std::max(maxNodeId, node.id);
+  vector<unsigned long> mask(maxNodeId / bitsPerWord + 1, 0);
+  for(const Node& node: nodes)
+    mask[node.id / bitsPerWord] |= 1UL << (node.id % bitsPerWord);
+  //Without libnuma, through the raw system call. May fail such as in containers that forbid it, then we just don't.
+  isInterleaving = syscall(SYS_set_mempolicy, MEMPOLICY_INTERLEAVE, mask.data(), (unsigned long)(mask.size() * bitsPerWord + 1)) == 0;
+}
+
+ThreadPlacement::InterleavedAllocation::~InterleavedAllocation() {
+  if(isInterleaving)
+    (void)syscall(SYS_set_mempolicy, MEMPOLICY_DEFAULT, NULL, 0UL);
+}
+
+#else
+
+void ThreadPlacement::configure(int searchThreadAffinity, int nnServerThreadAffinity, const vector<int>& numaNodes, bool interleaveSharedTables) {
+  if(searchThreadAffinity != AFFINITY_NONE || nnServerThreadAffinity != AFFINITY_NONE || numaNodes.size() > 0 || interleaveSharedTables)
+    throw StringError("Thread affinity and NUMA placement are only supported on Linux");
+}
+
+int ThreadPlacement::reserveSearchThreads(int numThreads) {
+  (void)numThreads;
+  return 0;
+}
+
+void ThreadPlacement::pinSearchThread(int threadIdx, int numThreads, int offset) {
+  (void)threadIdx;
+  (void)numThreads;
+  (void)offset;
+}
+
+void ThreadPlacement::pinNNServerThread(int serverThreadIdx, int numServerThreads) {
+  (void)serverThreadIdx;
+  (void)numServerThreads;
+}
+
+ThreadPlacement::InterleavedAllocation::InterleavedAllocation()
+  :isInterleaving(false)
+{}
+
+ThreadPlacement::InterleavedAllocation::~InterleavedAllocation() {
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef CORE_THREADPLACEMENT_H_
+#define CORE_THREADPLACEMENT_H_
+
+#include "../core/global.h"
+
+//Pinning of search and neural net server threads to cpus and NUMA nodes, configured once per process.
+//Threads that are pinned before they allocate their own buffers also get those buffers on their own node, since
+//Linux places memory on the node of the thread that first touches it. Shared tables touched by every thread can
+//instead be interleaved across the nodes, so that no one node's memory bandwidth is the bottleneck.
+//Only implemented on Linux, elsewhere configuring anything other than the defaults is an error.
+namespace ThreadPlacement {
+  static constexpr int AFFINITY_NONE = 0; //Leave threads wherever the OS puts them
+  static constexpr int AFFINITY_NUMA = 1; //Pin each thread to all the cpus of one NUMA node
+  static constexpr int AFFINITY_CORES = 2; //Pin each thread to a single cpu
+
+  //Use the given affinities, restricted to the given NUMA nodes, or all of them if empty. Only the cpus that the
+  //process is already allowed to run on are used, so this combines with taskset or numactl.
+  void configure(int searchThreadAffinity, int nnServerThreadAffinity, const std::vector<int>& numaNodes, bool interleaveSharedTables);
+  int parseAffinity(const std::string& s);
+
+  //Temporarily turn placement off and on again, such as to compare performance with and without it. Only affects
+  //threads started and tables allocated afterwards.
+  void setEnabled(bool b);
+  bool isActive();
+  std::string getDescription();
+
+  //Called once for each set of numThreads search threads, such as by every search, to get the offset to pin them
+  //with. Sets reserved one after another start at successive cpus, so that searches running at the same time, such as
+  //the games of a match, are not all pinned to the same cpus.
+  int reserveSearchThreads(int numThreads);
+  //Called by each thread as it starts, before allocating its own buffers.
+  //Search threads are pinned in blocks, so that threads of one search fill one node before the next.
+  //Neural net server threads are spread round robin over the nodes, so that multiple gpus go to different nodes.
+  void pinSearchThread(int threadIdx, int numThreads, int offset);
+  void pinNNServerThread(int serverThreadIdx, int numServerThreads);
+
+  //While in scope, memory first touched by this thread is interleaved across the nodes, if so configured.
+  struct InterleavedAllocation {
+    InterleavedAllocation();
+    ~InterleavedAllocation();
+    InterleavedAllocation(const InterleavedAllocation&) = delete;
+    InterleavedAllocation& operator=(const InterleavedAllocation&) = delete;
+   private:
+    bool isInterleaving;
+  };
+}
+
+#endif  // CORE_THREADPLACEMENT_H_
@@ -127,6 +127,63 @@ Color GameLogic::checkWinnerAfterPlayed(
   return C_WALL;
 }
 
+static int numSidesDrawn(const Board& board, Loc box) {
+  int n = 0;
+  for(int i = 0; i < 4; i++)
+    n += board.colors[box + board.adj_offsets[i]] == C_BLACK;
+  return n;
+}
+
+Loc GameLogic::getForcedCaptureLoc(const Board& board) {
+  for(int y = 1; y < board.y_size; y += 2) {
+    for(int x = 1; x < board.x_size; x += 2) {
+      Loc box = Location::getLoc(x, y, board.x_size);
+      if(numSidesDrawn(board, box) != 3)
+        continue;
+      Loc captureLoc = Board::NULL_LOC;
+      for(int i = 0; i < 4; i++) {
+        if(board.colors[box + board.adj_offsets[i]] == C_EMPTY)
+          captureLoc = box + board.adj_offsets[i];
+      }
+
+      //Walk the run of boxes that taking this one would make capturable in turn, each one having exactly two sides
+      //drawn before, until the run ends at the border, at a box that won't become capturable, or at a box that is
+      //already capturable from its other side (as in an opened loop, or a chain that was opened in its middle).
+      int runLength = 1;
+      bool endsCapturable = false;
+      Loc cur = box;
+      Loc edge = captureLoc;
+      while(true) {
+        Loc next = edge + (edge - cur);
+        if(!board.isOnBoard(next))
+          break;
+        int sides = numSidesDrawn(board, next);
+        if(sides == 3) {
+          endsCapturable = true;
+          break;
+        }
+        if(sides != 2)
+          break;
+        runLength++;
+        Loc nextEdge = Board::NULL_LOC;
+        for(int i = 0; i < 4; i++) {
+          Loc loc = next + board.adj_offsets[i];
+          if(loc != edge && board.colors[loc] == C_EMPTY)
+            nextEdge = loc;
+        }
+        cur = next;
+        edge = nextEdge;
+      }
+
+      //A lone box, or two completed by the same edge, is always taken. A longer run is taken while enough of it
+      //remains afterward to still double-deal at its end.
+      if(runLength == 1 || runLength >= (endsCapturable ? 4 : 3))
+        return captureLoc;
+    }
+  }
+  return Board::NULL_LOC;
+}
+
 GameLogic::ResultsBeforeNN::ResultsBeforeNN() {
   inited = false;
   winner = C_WALL;
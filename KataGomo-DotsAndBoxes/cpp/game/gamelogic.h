@@ -28,6 +28,15 @@ namespace GameLogic {
   //C_EMPTY = draw, C_WALL = not finished 
   Color checkWinnerAfterPlayed(const Board& board, const BoardHistory& hist, Player pla, Loc loc);
 
+  //An edge completing a box that the player to move can take with no possible loss, or NULL_LOC if there is none.
+  //Declining a box only ever helps with the last two boxes of a chain or the last four of a loop, which can be given
+  //away to keep control (double-dealing), so those are never returned, the choice there is left to the player.
+  Loc getForcedCaptureLoc(const Board& board);
+
+  //Whether some sequence of moves can lead back to an earlier position. Never here, every move other than pass
+  //draws an edge and pass ends the game.
+  static constexpr bool POSITIONS_CAN_REPEAT = false;
+
 
   //some results calculated before calculating NN
   //part of NN input, and then change policy/value according to this
@@ -36,6 +36,7 @@ match : Run self-play match games based on a config, more efficient than gtp due
 version : Print version and exit.
 
 analysis : Runs an engine designed to analyze entire games in parallel.
+rootparallelworker : Search alongside a gtp engine configured with rootParallelSocket, merging root results with it.
 tuner : (OpenCL only) Run tuning to find and optimize parameters that work on your GPU.
 
 ---Selfplay training subcommands---------
@@ -74,6 +75,8 @@ static int handleSubcommand(const string& subcommand, const vector<string>& args
     return MainCmds::match(subArgs);
   else if(subcommand == "matchauto")
     return MainCmds::matchauto(subArgs);
+  else if(subcommand == "rootparallelworker")
+    return MainCmds::rootparallelworker(subArgs);
   else if(subcommand == "selfplay")
     return MainCmds::selfplay(subArgs);
   else if(subcommand == "testgpuerror")
@@ -2134,6 +2134,7 @@ ComputeContext* NeuralNet::createComputeContext(
   const string& openCLTunerFile,
   const string& homeDataDirOverride,
   bool openCLReTunePerBoardSize,
+  int eigenDirectConvMaxBatchSize,
   enabled_t useFP16Mode,
   enabled_t useNHWCMode,
   const LoadedModel* loadedModel
@@ -2143,6 +2144,7 @@ ComputeContext* NeuralNet::createComputeContext(
   (void)openCLTunerFile;
   (void)homeDataDirOverride;
   (void)openCLReTunePerBoardSize;
+  (void)eigenDirectConvMaxBatchSize;
   (void)loadedModel;
 
   ComputeContext* context = new ComputeContext();
@@ -21,6 +21,7 @@ ComputeContext* NeuralNet::createComputeContext(
   const string& openCLTunerFile,
   const string& homeDataDirOverride,
   bool openCLReTunePerBoardSize,
+  int eigenDirectConvMaxBatchSize,
   enabled_t useFP16Mode,
   enabled_t useNHWCMode,
   const LoadedModel* loadedModel
@@ -32,6 +33,7 @@ ComputeContext* NeuralNet::createComputeContext(
   (void)openCLTunerFile;
   (void)homeDataDirOverride;
   (void)openCLReTunePerBoardSize;
+  (void)eigenDirectConvMaxBatchSize;
   (void)useFP16Mode;
   (void)useNHWCMode;
   (void)loadedModel;
@@ -3,6 +3,7 @@
 /** Eigen3 backend.
  *
  * Only supports float32 computation with NHWC memory layout (at runtime and as input).
+ * With useFP16, convolution and matmul weights are stored in float16 and widened to float32 right before use.
  */
 
 //TODO someday - not sure how to make thread pool work with TensorMap. It works with Tensor, but TensorMap doesn't seem to have a device(...) method.
@@ -10,6 +11,9 @@
 
 #include "../neuralnet/nninterface.h"
 
+#include <mutex>
+#include <unordered_map>
+
 #include <Eigen/Dense>
 #include <unsupported/Eigen/CXX11/Tensor>
 
@@ -19,11 +23,23 @@
 #include "../neuralnet/nneval.h"
 #include "../neuralnet/activations.h"
 
-#include "../core/simpleallocator.h"
+#include "../core/os.h"
+#include "../core/timer.h"
+
+#include "../external/half-2.2.0/include/half.hpp"
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#ifdef OS_IS_UNIX_OR_APPLE
+#include <sys/mman.h>
+#endif
 
 using namespace std;
 using Eigen::Tensor;
 using Eigen::TensorMap;
+using half_t = half_float::half;
 
 //Eigen doesn't seem to have a way to make a const tensor map out of a const float* ??
 //So we have to cast away qualifiers to build it.
@@ -185,22 +201,86 @@ static size_t roundUpToMultiple(size_t size, size_t ofThis) {
   return (size + ofThis - 1) / ofThis * ofThis;
 }
 
+static vector<half_t> floatsToHalf(const float* src, size_t n) {
+  vector<half_t> dst(n);
+  for(size_t i = 0; i < n; i++)
+    dst[i] = half_float::half_cast<half_t>(src[i]);
+  return dst;
+}
+
+static void widenHalfToFloat(const half_t* src, float* dst, size_t n) {
+  size_t i = 0;
+#ifdef __F16C__
+  for(; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+#endif
+  for(; i < n; i++)
+    dst[i] = (float)src[i];
+}
+
+// Weights of a 3x3 conv packed for direct convolution, one column-major outChannels x inChannels matrix per kernel tap.
+// Only one of the float or half versions is populated, depending on useFP16.
+struct DirectConvKernel {
+  vector<float> weights;
+  vector<half_t> weightsHalf;
+
+  DirectConvKernel(const ConvLayerDesc& desc, bool useFP16) {
+    const int inChannels = desc.inChannels;
+    const int outChannels = desc.outChannels;
+    vector<float> packedWeights(9 * inChannels * outChannels);
+    for(int oc = 0; oc < outChannels; oc++) {
+      for(int ic = 0; ic < inChannels; ic++) {
+        for(int tap = 0; tap < 9; tap++)
+          packedWeights[(tap * inChannels + ic) * outChannels + oc] = desc.weights[(oc * inChannels + ic) * 9 + tap];
+      }
+    }
+    if(useFP16)
+      weightsHalf = floatsToHalf(packedWeights.data(), packedWeights.size());
+    else
+      weights = std::move(packedWeights);
+  }
+};
+
 // --------------------------------------------------------------------------------------------------------------
 
 struct ComputeContext {
   const int nnXLen;
   const int nnYLen;
+  const bool useFP16;
+
+  // The direct kernels of every 3x3 conv in the model, packed once and shared by all compute handles.
+  // Empty when direct convolution is not used.
+  std::unordered_map<const ConvLayerDesc*, DirectConvKernel> directConvKernels;
+  // Batches of at most this size use direct 3x3 convolution, 0 means never, and -1 means that the first compute
+  // handle created times it for all of them. Protected by directConvMutex until then.
+  int directConvMaxBatchSize;
+  std::mutex directConvMutex;
 
   ComputeContext() = delete;
   ComputeContext(const ComputeContext&) = delete;
   ComputeContext& operator=(const ComputeContext&) = delete;
 
-  ComputeContext(int nnX, int nnY)
+  ComputeContext(int nnX, int nnY, bool useF16)
     : nnXLen(nnX),
-      nnYLen(nnY)
+      nnYLen(nnY),
+      useFP16(useF16),
+      directConvKernels(),
+      directConvMaxBatchSize(0),
+      directConvMutex()
   {}
   ~ComputeContext()
   {}
+
+  void initDirectConv(const ModelDesc& modelDesc, int maxBatchSize) {
+    directConvMaxBatchSize = maxBatchSize;
+    directConvKernels.clear();
+    if(maxBatchSize == 0)
+      return;
+    modelDesc.iterConvLayers([this](const ConvLayerDesc& desc) {
+      if(desc.convXSize == 3 && desc.convYSize == 3 && desc.dilationX == 1 && desc.dilationY == 1)
+        directConvKernels.emplace(&desc, DirectConvKernel(desc, useFP16));
+    });
+  }
 };
 
 // --------------------------------------------------------------------------------------------------------------
@@ -213,22 +293,107 @@ struct ComputeHandleInternal {
   const int nnXLen;
   const int nnYLen;
 
-  ComputeHandleInternal(const ComputeContext* ctx)
+  // When boards may be smaller than nnXLen x nnYLen, we track the bounding box of the mask for each batch row
+  // so that convolutions can skip winograd tiles lying entirely off the board.
+  const bool useBoardExtents;
+  std::vector<int> boardXMin;
+  std::vector<int> boardXMax;
+  std::vector<int> boardYMin;
+  std::vector<int> boardYMax;
+  // Reused across conv layers, holds the indices of the tiles that overlap the board in the current batch.
+  std::vector<int> activeTiles;
+
+  // For tiny batches the winograd transforms dominate the cost of 3x3 convs, so batches of at most this size use
+  // direct convolution instead. Copied from the context once the compute handle is created, 0 means never.
+  int directConvMaxBatchSize;
+  // Whether the current evaluation uses direct 3x3 convolution, set per batch.
+  bool useDirectConv;
+  const std::unordered_map<const ConvLayerDesc*, DirectConvKernel>* directConvKernels;
+
+  ComputeHandleInternal(const ComputeContext* ctx, bool requireExactNNLen)
     :
     nnXLen(ctx->nnXLen),
-    nnYLen(ctx->nnYLen)
+    nnYLen(ctx->nnYLen),
+    useBoardExtents(!requireExactNNLen),
+    directConvMaxBatchSize(0),
+    useDirectConv(false),
+    directConvKernels(&ctx->directConvKernels)
   {}
+
+  // Mask should be in 'NHW' format (no "C" channel).
+  void computeBoardExtents(CONSTTENSORMAP3* mask) {
+    if(!useBoardExtents)
+      return;
+    const int batchSize = mask->dimension(2);
+    boardXMin.resize(batchSize);
+    boardXMax.resize(batchSize);
+    boardYMin.resize(batchSize);
+    boardYMax.resize(batchSize);
+    for(int n = 0; n < batchSize; n++) {
+      int xMin = nnXLen;
+      int xMax = -1;
+      int yMin = nnYLen;
+      int yMax = -1;
+      for(int y = 0; y < nnYLen; y++) {
+        for(int x = 0; x < nnXLen; x++) {
+          if((*mask)(x,y,n) != 0.0f) {
+            xMin = std::min(xMin,x);
+            xMax = std::max(xMax,x);
+            yMin = std::min(yMin,y);
+            yMax = std::max(yMax,y);
+          }
+        }
+      }
+      boardXMin[n] = xMin;
+      boardXMax[n] = xMax;
+      boardYMin[n] = yMin;
+      boardYMax[n] = yMax;
+    }
+  }
+
+  // Fills activeTiles with the indices (n * numTilesY * numTilesX + yTile * numTilesX + xTile) of all
+  // tiles whose output region overlaps the board, and returns how many there are.
+  int computeActiveTiles(int batchSize, int numTilesX, int numTilesY, int outTileXSize, int outTileYSize) {
+    activeTiles.resize((size_t)batchSize * numTilesY * numTilesX);
+    int numActive = 0;
+    for(int n = 0; n < batchSize; n++) {
+      for(int yTile = 0; yTile < numTilesY; yTile++) {
+        for(int xTile = 0; xTile < numTilesX; xTile++) {
+          if(useBoardExtents) {
+            int x0 = xTile * outTileXSize;
+            int y0 = yTile * outTileYSize;
+            if(x0 > boardXMax[n] || x0 + outTileXSize <= boardXMin[n] || y0 > boardYMax[n] || y0 + outTileYSize <= boardYMin[n])
+              continue;
+          }
+          activeTiles[numActive] = n * numTilesY * numTilesX + yTile * numTilesX + xTile;
+          numActive++;
+        }
+      }
+    }
+    return numActive;
+  }
 };
 
 
 //--------------------------------------------------------------
 
+// All intermediate tensors of a single model evaluation live in one arena. Scratch buffers are always acquired and
+// released in strictly nested scopes, so each one gets a deterministic offset equal to the sum of the sizes of the
+// buffers still live when it is acquired. The arena size is planned once per (model, max batch size) by the
+// requiredScratchBytes methods below, mirroring requiredConvWorkspaceElts, so the per-layer path is just a bump of
+// an offset with no lookups or allocation.
 struct ScratchBuffers {
+  static constexpr size_t ARENA_ALIGN_BYTES = 64;
+  static constexpr size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
 
   const size_t batchXYBytes;
   const size_t batchBytes;
 
-  SimpleAllocator<float*>* allocator;
+  size_t arenaBytes;
+  float* arena;
+  size_t arenaTop;
+  size_t arenaPeak;
+  bool arenaUsesHugePages;
 
   ScratchBuffers() = delete;
   ScratchBuffers(const ScratchBuffers&) = delete;
@@ -236,28 +401,92 @@ struct ScratchBuffers {
 
   ScratchBuffers(int maxBatchSize, int nnXLen, int nnYLen)
     : batchXYBytes((size_t)maxBatchSize * nnXLen * nnYLen * sizeof(float)),
-      batchBytes((size_t)maxBatchSize * sizeof(float))
-  {
-    std::function<float*(size_t)> allocateFunc = [this](size_t size) {
-      return new float[size/sizeof(float)];
-    };
-    std::function<void(float*)> releaseFunc = [this](float* buf) {
-      delete[] buf;
-    };
-
-    allocator = new SimpleAllocator<float*>(allocateFunc, releaseFunc);
-  }
+      batchBytes((size_t)maxBatchSize * sizeof(float)),
+      arenaBytes(0),
+      arena(NULL),
+      arenaTop(0),
+      arenaPeak(0),
+      arenaUsesHugePages(false)
+  {}
   ~ScratchBuffers() {
-    delete allocator;
+    freeArena();
   }
 
   size_t getBufSizeXY(int channels) const {
-    return channels * batchXYBytes;
+    return roundUpToMultiple(channels * batchXYBytes, ARENA_ALIGN_BYTES);
   }
   size_t getBufSize(int channels) const {
-    return channels * batchBytes;
+    return roundUpToMultiple(channels * batchBytes, ARENA_ALIGN_BYTES);
+  }
+
+  void allocateArena(size_t bytes, bool tryHugePages) {
+    freeArena();
+    arenaBytes = roundUpToMultiple(std::max(bytes,(size_t)1), ARENA_ALIGN_BYTES);
+    size_t alignment = ARENA_ALIGN_BYTES;
+    if(tryHugePages && arenaBytes >= HUGE_PAGE_BYTES) {
+      arenaBytes = roundUpToMultiple(arenaBytes, HUGE_PAGE_BYTES);
+      alignment = HUGE_PAGE_BYTES;
+    }
+#ifdef OS_IS_WINDOWS
+    arena = (float*)_aligned_malloc(arenaBytes, alignment);
+    if(arena == NULL)
+      throw StringError("Eigen backend: failed to allocate scratch arena of " + Global::uint64ToString(arenaBytes) + " bytes");
+#else
+    void* ptr = NULL;
+    if(posix_memalign(&ptr, alignment, arenaBytes) != 0)
+      throw StringError("Eigen backend: failed to allocate scratch arena of " + Global::uint64ToString(arenaBytes) + " bytes");
+    arena = (float*)ptr;
+#ifdef MADV_HUGEPAGE
+    if(alignment == HUGE_PAGE_BYTES)
+      arenaUsesHugePages = madvise(ptr, arenaBytes, MADV_HUGEPAGE) == 0;
+#endif
+#endif
+    arenaTop = 0;
+    arenaPeak = 0;
+  }
+
+  void freeArena() {
+    if(arena == NULL)
+      return;
+#ifdef OS_IS_WINDOWS
+    _aligned_free(arena);
+#else
+    free(arena);
+#endif
+    arena = NULL;
+    arenaBytes = 0;
+    arenaUsesHugePages = false;
   }
+};
 
+// Scoped view of the next free region of the scratch arena, released on destruction.
+// Must be destroyed in reverse order of construction, which C++ scoping guarantees for locals.
+struct ScratchBuf {
+  ScratchBuffers* scratch;
+  const size_t offset;
+  const size_t size;
+  float* buf;
+
+  ScratchBuf(ScratchBuffers* s, size_t bytes)
+    : scratch(s),
+      offset(s->arenaTop),
+      size(bytes),
+      buf((float*)((char*)s->arena + s->arenaTop))
+  {
+    assert(bytes % ScratchBuffers::ARENA_ALIGN_BYTES == 0);
+    if(offset + size > scratch->arenaBytes)
+      throw StringError("Eigen backend: scratch arena overflow, memory plan does not match model");
+    scratch->arenaTop = offset + size;
+    scratch->arenaPeak = std::max(scratch->arenaPeak, scratch->arenaTop);
+  }
+  ~ScratchBuf() {
+    assert(scratch->arenaTop == offset + size);
+    scratch->arenaTop = offset;
+  }
+
+  ScratchBuf() = delete;
+  ScratchBuf(const ScratchBuf&) = delete;
+  ScratchBuf& operator=(const ScratchBuf&) = delete;
 };
 
 // Layers --------------------------------------------------------------------------------------------------------------
@@ -271,9 +500,15 @@ struct ConvLayer {
   const int outChannels;
   const int nnXLen;
   const int nnYLen;
+  const bool useFP16;
 
+  // Only one of the float or half versions of each kernel is populated, depending on useFP16.
   TENSOR2 imagePatchKernel;
   TENSOR3 winogradKernel;
+  vector<half_t> imagePatchKernelHalf;
+  vector<half_t> winogradKernelHalf;
+  // Finds the kernel for the direct path among the compute context's, for 3x3 convs.
+  const ConvLayerDesc* const sourceDesc;
 
   int imagePatchSize;
 
@@ -286,14 +521,16 @@ struct ConvLayer {
   ConvLayer(const ConvLayer&) = delete;
   ConvLayer& operator=(const ConvLayer&) = delete;
 
-  ConvLayer(const ConvLayerDesc& desc, int nnX, int nnY)
+  ConvLayer(const ConvLayerDesc& desc, int nnX, int nnY, bool useF16)
     : name(desc.name),
       convYSize(desc.convYSize),
       convXSize(desc.convXSize),
       inChannels(desc.inChannels),
       outChannels(desc.outChannels),
       nnXLen(nnX),
-      nnYLen(nnY)
+      nnYLen(nnY),
+      useFP16(useF16),
+      sourceDesc(&desc)
   {
     //Currently eigen impl doesn't support dilated convs
     int dilationY = desc.dilationY;
@@ -380,8 +617,11 @@ struct ConvLayer {
         }
       }
 
-      winogradKernel = TensorMap<const Tensor<const SCALAR, 3>>(
-        transWeights.data(), outChannels, inChannels, inTileXSize * inTileYSize);
+      if(useFP16)
+        winogradKernelHalf = floatsToHalf(transWeights.data(), transWeights.size());
+      else
+        winogradKernel = TensorMap<const Tensor<const SCALAR, 3>>(
+          transWeights.data(), outChannels, inChannels, inTileXSize * inTileYSize);
     }
 
     else {
@@ -395,6 +635,10 @@ struct ConvLayer {
       Eigen::array<Eigen::Index, 4> dimensionPermutatation = {3, 2, 0, 1};
       Eigen::array<Eigen::Index, 2> newShape = {outChannels, imagePatchSize};
       imagePatchKernel = kernel.shuffle(dimensionPermutatation).reshape(newShape);
+      if(useFP16) {
+        imagePatchKernelHalf = floatsToHalf(imagePatchKernel.data(), imagePatchKernel.size());
+        imagePatchKernel = TENSOR2();
+      }
     }
   }
 
@@ -405,20 +649,90 @@ struct ConvLayer {
       size_t totalChannelsRounded = roundUpToMultiple(inChannels,32) + roundUpToMultiple(outChannels,32);
       size_t sizeForTransforms = totalChannelsRounded * maxBatchSize * numTilesY * numTilesX * inTileXSize * inTileYSize;
       size_t sizeForTileBufs = 2 * inTileXSize * inTileYSize * roundUpToMultiple(std::max(inChannels,outChannels),32);
-      return sizeForTransforms + sizeForTileBufs;
+      size_t sizeForWidenedKernel = useFP16 ? roundUpToMultiple((size_t)inChannels * outChannels,32) : 0;
+      size_t winogradElts = sizeForTransforms + sizeForTileBufs + sizeForWidenedKernel;
+      if(convXSize == 3 && convYSize == 3)
+        return std::max(winogradElts, requiredDirectWorkspaceElts(maxBatchSize));
+      return winogradElts;
+    }
+    return useFP16 ? (size_t)outChannels * imagePatchSize : 0;
+  }
+
+  size_t requiredDirectWorkspaceElts(size_t maxBatchSize) const {
+    size_t numCols = maxBatchSize * (nnXLen + 2) * (nnYLen + 2);
+    size_t slackCols = 2 * (nnXLen + 2) + 2;
+    return inChannels * (numCols + slackCols) + outChannels * numCols + (useFP16 ? (size_t)inChannels * outChannels : 0);
+  }
+
+  // Direct 3x3 convolution for small batches. The input is copied into a zero-padded buffer whose rows are
+  // nnXLen+2 wide, so that each kernel tap is a single GEMM over every position of the batch, with the input
+  // columns shifted by the tap offset. The output columns that land on the padding are computed and dropped.
+  void applyDirect3x3(
+    const ComputeHandleInternal* handle, CONSTTENSORMAP4* input, TENSORMAP4* output, float* convWorkspace, bool accumulate
+  ) const {
+    auto kernelIter = handle->directConvKernels->find(sourceDesc);
+    assert(kernelIter != handle->directConvKernels->end());
+    const DirectConvKernel& kernel = kernelIter->second;
+    const int batchSize = input->dimension(3);
+    const int paddedXLen = nnXLen + 2;
+    const int paddedYLen = nnYLen + 2;
+    const size_t numCols = (size_t)batchSize * paddedXLen * paddedYLen;
+    const size_t slackCols = 2 * paddedXLen + 2;
+    float* paddedIn = convWorkspace;
+    float* paddedOut = paddedIn + inChannels * (numCols + slackCols);
+    float* widenedKernel = paddedOut + outChannels * numCols;
+
+    std::fill(paddedIn, paddedIn + inChannels * (numCols + slackCols), 0.0f);
+    for(int n = 0; n < batchSize; n++) {
+      for(int y = 0; y < nnYLen; y++) {
+        const float* src = input->data() + ((size_t)(n * nnYLen + y) * nnXLen) * inChannels;
+        std::copy(src, src + nnXLen * inChannels, paddedIn + ((size_t)(n * paddedYLen + y + 1) * paddedXLen + 1) * inChannels);
+      }
+    }
+
+    auto outMap = Eigen::Map<Eigen::Matrix<SCALAR,Eigen::Dynamic,Eigen::Dynamic,Eigen::ColMajor>>(paddedOut, outChannels, numCols);
+    for(int tap = 0; tap < 9; tap++) {
+      const size_t colOffset = (tap / 3) * paddedXLen + (tap % 3);
+      const float* kernelData;
+      if(useFP16) {
+        widenHalfToFloat(kernel.weightsHalf.data() + tap * outChannels * inChannels, widenedKernel, (size_t)outChannels * inChannels);
+        kernelData = widenedKernel;
+      }
+      else
+        kernelData = kernel.weights.data() + tap * outChannels * inChannels;
+      auto kernelMap = Eigen::Map<const Eigen::Matrix<SCALAR,Eigen::Dynamic,Eigen::Dynamic,Eigen::ColMajor>>(kernelData, outChannels, inChannels);
+      auto inMap = Eigen::Map<const Eigen::Matrix<SCALAR,Eigen::Dynamic,Eigen::Dynamic,Eigen::ColMajor>>(paddedIn + colOffset * inChannels, inChannels, numCols);
+      if(tap == 0)
+        outMap.noalias() = kernelMap * inMap;
+      else
+        outMap.noalias() += kernelMap * inMap;
+    }
+
+    for(int n = 0; n < batchSize; n++) {
+      for(int y = 0; y < nnYLen; y++) {
+        const float* src = paddedOut + ((size_t)(n * paddedYLen + y) * paddedXLen) * outChannels;
+        float* dst = output->data() + ((size_t)(n * nnYLen + y) * nnXLen) * outChannels;
+        if(accumulate) {
+          for(int i = 0; i < nnXLen * outChannels; i++)
+            dst[i] += src[i];
+        }
+        else
+          std::copy(src, src + nnXLen * outChannels, dst);
+      }
     }
-    return 0;
   }
 
   void apply(ComputeHandleInternal* handle, CONSTTENSORMAP4* input, TENSORMAP4* output, float* convWorkspace, bool accumulate) const {
-    (void)handle;
     assert(output->dimension(0) == outChannels);
     assert(input->dimension(0) == inChannels);
     assert(input->dimension(1) == nnXLen);
     assert(input->dimension(2) == nnYLen);
     const int batchSize = input->dimension(3);
 
-    if((convXSize == 3 && convYSize == 3) || (convXSize == 5 && convYSize == 5)) {
+    if(convXSize == 3 && convYSize == 3 && handle->useDirectConv) {
+      applyDirect3x3(handle, input, output, convWorkspace, accumulate);
+    }
+    else if((convXSize == 3 && convYSize == 3) || (convXSize == 5 && convYSize == 5)) {
       constexpr int inTileXSize = 6;
       constexpr int inTileYSize = 6;
       const int inTileXOffset = convXSize == 5 ? -2 : -1;
@@ -426,84 +740,89 @@ struct ConvLayer {
       const int outTileXSize = convXSize == 5 ? 2 : 4;
       const int outTileYSize = convYSize == 5 ? 2 : 4;
 
+      // Only tiles overlapping the board get transformed and multiplied, packed densely in the order of activeTiles.
+      const int numActiveTiles = handle->computeActiveTiles(batchSize, numTilesX, numTilesY, outTileXSize, outTileYSize);
+      const int* activeTiles = handle->activeTiles.data();
+      if(numActiveTiles < batchSize * numTilesY * numTilesX && !accumulate)
+        output->setZero();
+
       float* tile = convWorkspace;
       float* tile2 = tile + inTileXSize * inTileYSize * roundUpToMultiple(std::max(inChannels,outChannels),32);
-      float* convWorkspaceIn = tile2 + inTileXSize * inTileYSize * roundUpToMultiple(std::max(inChannels,outChannels),32);
+      float* widenedKernel = tile2 + inTileXSize * inTileYSize * roundUpToMultiple(std::max(inChannels,outChannels),32);
+      float* convWorkspaceIn = widenedKernel + (useFP16 ? roundUpToMultiple((size_t)inChannels * outChannels,32) : 0);
       float* convWorkspaceOut = convWorkspaceIn + roundUpToMultiple(inChannels,32) * batchSize * numTilesY * numTilesX * inTileXSize * inTileYSize;
-      TENSORMAP3 transformedInput(convWorkspaceIn, inChannels, batchSize * numTilesY * numTilesX, inTileXSize * inTileYSize);
-      TENSORMAP3 transformedOutput(convWorkspaceOut, outChannels, batchSize * numTilesY * numTilesX, inTileXSize * inTileYSize);
-      for(int n = 0; n < batchSize; n++) {
-        for(int yTile = 0; yTile < numTilesY; yTile++) {
-          for(int xTile = 0; xTile < numTilesX; xTile++) {
-            for(int dy = 0; dy < inTileYSize; dy++) {
-              for(int dx = 0; dx < inTileXSize; dx++) {
-                int x = xTile*outTileXSize+dx+inTileXOffset;
-                int y = yTile*outTileYSize+dy+inTileYOffset;
-                int subTileIdx = dy * inTileXSize + dx;
-                if(x < 0 || y < 0 || x >= nnXLen || y >= nnYLen) {
-                  std::fill(tile + subTileIdx * inChannels, tile + (subTileIdx+1) * inChannels, 0.0f);
-                }
-                else {
-                  for(int ic = 0; ic < inChannels; ic++) {
-                    float z = (*input)(ic,x,y,n);
-                    tile[subTileIdx * inChannels + ic] = z;
-                  }
-                }
-              }
+      TENSORMAP3 transformedInput(convWorkspaceIn, inChannels, numActiveTiles, inTileXSize * inTileYSize);
+      TENSORMAP3 transformedOutput(convWorkspaceOut, outChannels, numActiveTiles, inTileXSize * inTileYSize);
+      for(int tileIdx = 0; tileIdx < numActiveTiles; tileIdx++) {
+        const int n = activeTiles[tileIdx] / (numTilesY * numTilesX);
+        const int yTile = (activeTiles[tileIdx] / numTilesX) % numTilesY;
+        const int xTile = activeTiles[tileIdx] % numTilesX;
+        for(int dy = 0; dy < inTileYSize; dy++) {
+          for(int dx = 0; dx < inTileXSize; dx++) {
+            int x = xTile*outTileXSize+dx+inTileXOffset;
+            int y = yTile*outTileYSize+dy+inTileYOffset;
+            int subTileIdx = dy * inTileXSize + dx;
+            if(x < 0 || y < 0 || x >= nnXLen || y >= nnYLen) {
+              std::fill(tile + subTileIdx * inChannels, tile + (subTileIdx+1) * inChannels, 0.0f);
             }
-
-            for(int subY = 0; subY < inTileYSize; subY++) {
-              float* __restrict t0 = &tile[(subY*inTileXSize+0)*inChannels];
-              float* __restrict t1 = &tile[(subY*inTileXSize+1)*inChannels];
-              float* __restrict t2 = &tile[(subY*inTileXSize+2)*inChannels];
-              float* __restrict t3 = &tile[(subY*inTileXSize+3)*inChannels];
-              float* __restrict t4 = &tile[(subY*inTileXSize+4)*inChannels];
-              float* __restrict t5 = &tile[(subY*inTileXSize+5)*inChannels];
-              for(int ic = 0; ic < inChannels; ic++) {
-                float z0 = t0[ic];
-                float z1 = t1[ic];
-                float z2 = t2[ic];
-                float z3 = t3[ic];
-                float z4 = t4[ic];
-                float z5 = t5[ic];
-                t0[ic] = 4.0f*z0 - 5.0f*z2 + z4;
-                t1[ic] = - 4.0f*z1 - 4.0f*z2 + z3 + z4;
-                t2[ic] =   4.0f*z1 - 4.0f*z2 - z3 + z4;
-                t3[ic] = - 2.0f*z1 - z2 + 2.0f*z3 + z4;
-                t4[ic] =   2.0f*z1 - z2 - 2.0f*z3 + z4;
-                t5[ic] = 4.0f*z1 - 5.0f*z3 + z5;
-              }
-            }
-            for(int subX = 0; subX < inTileXSize; subX++) {
-              float* __restrict t0 = &tile[(0*inTileXSize+subX)*inChannels];
-              float* __restrict t1 = &tile[(1*inTileXSize+subX)*inChannels];
-              float* __restrict t2 = &tile[(2*inTileXSize+subX)*inChannels];
-              float* __restrict t3 = &tile[(3*inTileXSize+subX)*inChannels];
-              float* __restrict t4 = &tile[(4*inTileXSize+subX)*inChannels];
-              float* __restrict t5 = &tile[(5*inTileXSize+subX)*inChannels];
+            else {
               for(int ic = 0; ic < inChannels; ic++) {
-                float z0 = t0[ic];
-                float z1 = t1[ic];
-                float z2 = t2[ic];
-                float z3 = t3[ic];
-                float z4 = t4[ic];
-                float z5 = t5[ic];
-                t0[ic] = 4.0f*z0 - 5.0f*z2 + z4;
-                t1[ic] = - 4.0f*z1 - 4.0f*z2 + z3 + z4;
-                t2[ic] =   4.0f*z1 - 4.0f*z2 - z3 + z4;
-                t3[ic] = - 2.0f*z1 - z2 + 2.0f*z3 + z4;
-                t4[ic] =   2.0f*z1 - z2 - 2.0f*z3 + z4;
-                t5[ic] = 4.0f*z1 - 5.0f*z3 + z5;
+                float z = (*input)(ic,x,y,n);
+                tile[subTileIdx * inChannels + ic] = z;
               }
             }
-            int batchTileXTileY = n * numTilesY * numTilesX + yTile * numTilesX + xTile;
-            for(int dy = 0; dy < inTileYSize; dy++) {
-              for(int dx = 0; dx < inTileXSize; dx++) {
-                for(int ic = 0; ic < inChannels; ic++) {
-                  int subTileIdx = dy * inTileXSize + dx;
-                  transformedInput(ic, batchTileXTileY, subTileIdx) = tile[subTileIdx*inChannels+ic];
-                }
-              }
+          }
+        }
+
+        for(int subY = 0; subY < inTileYSize; subY++) {
+          float* __restrict t0 = &tile[(subY*inTileXSize+0)*inChannels];
+          float* __restrict t1 = &tile[(subY*inTileXSize+1)*inChannels];
+          float* __restrict t2 = &tile[(subY*inTileXSize+2)*inChannels];
+          float* __restrict t3 = &tile[(subY*inTileXSize+3)*inChannels];
+          float* __restrict t4 = &tile[(subY*inTileXSize+4)*inChannels];
+          float* __restrict t5 = &tile[(subY*inTileXSize+5)*inChannels];
+          for(int ic = 0; ic < inChannels; ic++) {
+            float z0 = t0[ic];
+            float z1 = t1[ic];
+            float z2 = t2[ic];
+            float z3 = t3[ic];
+            float z4 = t4[ic];
+            float z5 = t5[ic];
+            t0[ic] = 4.0f*z0 - 5.0f*z2 + z4;
+            t1[ic] = - 4.0f*z1 - 4.0f*z2 + z3 + z4;
+            t2[ic] =   4.0f*z1 - 4.0f*z2 - z3 + z4;
+            t3[ic] = - 2.0f*z1 - z2 + 2.0f*z3 + z4;
+            t4[ic] =   2.0f*z1 - z2 - 2.0f*z3 + z4;
+            t5[ic] = 4.0f*z1 - 5.0f*z3 + z5;
+          }
+        }
+        for(int subX = 0; subX < inTileXSize; subX++) {
+          float* __restrict t0 = &tile[(0*inTileXSize+subX)*inChannels];
+          float* __restrict t1 = &tile[(1*inTileXSize+subX)*inChannels];
+          float* __restrict t2 = &tile[(2*inTileXSize+subX)*inChannels];
+          float* __restrict t3 = &tile[(3*inTileXSize+subX)*inChannels];
+          float* __restrict t4 = &tile[(4*inTileXSize+subX)*inChannels];
+          float* __restrict t5 = &tile[(5*inTileXSize+subX)*inChannels];
+          for(int ic = 0; ic < inChannels; ic++) {
+            float z0 = t0[ic];
+            float z1 = t1[ic];
+            float z2 = t2[ic];
+            float z3 = t3[ic];
+            float z4 = t4[ic];
+            float z5 = t5[ic];
+            t0[ic] = 4.0f*z0 - 5.0f*z2 + z4;
+            t1[ic] = - 4.0f*z1 - 4.0f*z2 + z3 + z4;
+            t2[ic] =   4.0f*z1 - 4.0f*z2 - z3 + z4;
+            t3[ic] = - 2.0f*z1 - z2 + 2.0f*z3 + z4;
+            t4[ic] =   2.0f*z1 - z2 - 2.0f*z3 + z4;
+            t5[ic] = 4.0f*z1 - 5.0f*z3 + z5;
+          }
+        }
+        for(int dy = 0; dy < inTileYSize; dy++) {
+          for(int dx = 0; dx < inTileXSize; dx++) {
+            for(int ic = 0; ic < inChannels; ic++) {
+              int subTileIdx = dy * inTileXSize + dx;
+              transformedInput(ic, tileIdx, subTileIdx) = tile[subTileIdx*inChannels+ic];
             }
           }
         }
@@ -517,143 +836,148 @@ struct ConvLayer {
         for(int dx = 0; dx < inTileXSize; dx++) {
           int subTileIdx = dy * inTileXSize + dx;
           auto transformedInputMap = Eigen::Map<Eigen::Matrix<SCALAR,Eigen::Dynamic,Eigen::Dynamic,Eigen::ColMajor>>(
-            (float*)transformedInput.data() + subTileIdx * batchSize * numTilesY * numTilesX * inChannels,
+            (float*)transformedInput.data() + subTileIdx * numActiveTiles * inChannels,
             inChannels,
-            batchSize * numTilesY * numTilesX
+            numActiveTiles
           );
+          const float* kernelData;
+          if(useFP16) {
+            widenHalfToFloat(winogradKernelHalf.data() + subTileIdx * outChannels * inChannels, widenedKernel, (size_t)outChannels * inChannels);
+            kernelData = widenedKernel;
+          }
+          else
+            kernelData = winogradKernel.data() + subTileIdx * outChannels * inChannels;
           auto winogradKernelMap = Eigen::Map<Eigen::Matrix<SCALAR,Eigen::Dynamic,Eigen::Dynamic,Eigen::ColMajor>>(
-            (float*)winogradKernel.data() + subTileIdx * outChannels * inChannels,
+            (float*)kernelData,
             outChannels,
             inChannels
           );
           auto transformedOutputMap = Eigen::Map<Eigen::Matrix<SCALAR,Eigen::Dynamic,Eigen::Dynamic,Eigen::ColMajor>>(
-            (float*)transformedOutput.data() + subTileIdx * batchSize * numTilesY * numTilesX * outChannels,
+            (float*)transformedOutput.data() + subTileIdx * numActiveTiles * outChannels,
             outChannels,
-            batchSize * numTilesY * numTilesX
+            numActiveTiles
           );
           transformedOutputMap = winogradKernelMap * transformedInputMap;
         }
       }
 
-      for(int n = 0; n < batchSize; n++) {
-        for(int yTile = 0; yTile < numTilesY; yTile++) {
-          for(int xTile = 0; xTile < numTilesX; xTile++) {
-            int batchTileXTileY = n * numTilesY * numTilesX + yTile * numTilesX + xTile;
-            for(int dy = 0; dy < inTileYSize; dy++) {
-              for(int dx = 0; dx < inTileXSize; dx++) {
-                int subTileIdx = dy * inTileXSize + dx;
-                for(int oc = 0; oc < outChannels; oc++) {
-                  tile[subTileIdx*outChannels+oc] = transformedOutput(oc, batchTileXTileY, subTileIdx);
-                }
-              }
+      for(int tileIdx = 0; tileIdx < numActiveTiles; tileIdx++) {
+        const int n = activeTiles[tileIdx] / (numTilesY * numTilesX);
+        const int yTile = (activeTiles[tileIdx] / numTilesX) % numTilesY;
+        const int xTile = activeTiles[tileIdx] % numTilesX;
+        for(int dy = 0; dy < inTileYSize; dy++) {
+          for(int dx = 0; dx < inTileXSize; dx++) {
+            int subTileIdx = dy * inTileXSize + dx;
+            for(int oc = 0; oc < outChannels; oc++) {
+              tile[subTileIdx*outChannels+oc] = transformedOutput(oc, tileIdx, subTileIdx);
             }
+          }
+        }
 
-            if(convXSize == 5 && convYSize == 5) {
-              for(int subY = 0; subY < inTileYSize; subY++) {
-                float* __restrict t0 = &tile[(subY*inTileXSize+0)*outChannels];
-                float* __restrict t1 = &tile[(subY*inTileXSize+1)*outChannels];
-                float* __restrict t2 = &tile[(subY*inTileXSize+2)*outChannels];
-                float* __restrict t3 = &tile[(subY*inTileXSize+3)*outChannels];
-                float* __restrict t4 = &tile[(subY*inTileXSize+4)*outChannels];
-                float* __restrict t5 = &tile[(subY*inTileXSize+5)*outChannels];
-                for(int oc = 0; oc < outChannels; oc++) {
-                  float z0 = t0[oc];
-                  float z1 = t1[oc];
-                  float z2 = t2[oc];
-                  float z3 = t3[oc];
-                  float z4 = t4[oc];
-                  float z5 = t5[oc];
-                  t0[oc] = z0 + z1 + z2 + z3 + z4;
-                  t1[oc] = (z1-z2) + 2.0f*(z3-z4) + z5;
-                }
-              }
-              for(int subX = 0; subX < outTileXSize; subX++) {
-                float* __restrict t0 = &tile[(0*inTileXSize+subX)*outChannels];
-                float* __restrict t1 = &tile[(1*inTileXSize+subX)*outChannels];
-                float* __restrict t2 = &tile[(2*inTileXSize+subX)*outChannels];
-                float* __restrict t3 = &tile[(3*inTileXSize+subX)*outChannels];
-                float* __restrict t4 = &tile[(4*inTileXSize+subX)*outChannels];
-                float* __restrict t5 = &tile[(5*inTileXSize+subX)*outChannels];
-                for(int oc = 0; oc < outChannels; oc++) {
-                  float z0 = t0[oc];
-                  float z1 = t1[oc];
-                  float z2 = t2[oc];
-                  float z3 = t3[oc];
-                  float z4 = t4[oc];
-                  float z5 = t5[oc];
-                  t0[oc] = z0 + z1 + z2 + z3 + z4;
-                  t1[oc] = (z1-z2) + 2.0f*(z3-z4) + z5;
-                }
-              }
+        if(convXSize == 5 && convYSize == 5) {
+          for(int subY = 0; subY < inTileYSize; subY++) {
+            float* __restrict t0 = &tile[(subY*inTileXSize+0)*outChannels];
+            float* __restrict t1 = &tile[(subY*inTileXSize+1)*outChannels];
+            float* __restrict t2 = &tile[(subY*inTileXSize+2)*outChannels];
+            float* __restrict t3 = &tile[(subY*inTileXSize+3)*outChannels];
+            float* __restrict t4 = &tile[(subY*inTileXSize+4)*outChannels];
+            float* __restrict t5 = &tile[(subY*inTileXSize+5)*outChannels];
+            for(int oc = 0; oc < outChannels; oc++) {
+              float z0 = t0[oc];
+              float z1 = t1[oc];
+              float z2 = t2[oc];
+              float z3 = t3[oc];
+              float z4 = t4[oc];
+              float z5 = t5[oc];
+              t0[oc] = z0 + z1 + z2 + z3 + z4;
+              t1[oc] = (z1-z2) + 2.0f*(z3-z4) + z5;
             }
-            else {
-              for(int subY = 0; subY < inTileYSize; subY++) {
-                float* __restrict t0 = &tile[(subY*inTileXSize+0)*outChannels];
-                float* __restrict t1 = &tile[(subY*inTileXSize+1)*outChannels];
-                float* __restrict t2 = &tile[(subY*inTileXSize+2)*outChannels];
-                float* __restrict t3 = &tile[(subY*inTileXSize+3)*outChannels];
-                float* __restrict t4 = &tile[(subY*inTileXSize+4)*outChannels];
-                float* __restrict t5 = &tile[(subY*inTileXSize+5)*outChannels];
-                for(int oc = 0; oc < outChannels; oc++) {
-                  float z0 = t0[oc];
-                  float z1 = t1[oc];
-                  float z2 = t2[oc];
-                  float z3 = t3[oc];
-                  float z4 = t4[oc];
-                  float z5 = t5[oc];
-                  t0[oc] = z0 + z1 + z2 + z3 + z4;
-                  t1[oc] = (z1-z2) + 2.0f*(z3-z4);
-                  t2[oc] = (z1+z2) + 4.0f*(z3+z4);
-                  t3[oc] = (z1-z2) + 8.0f*(z3-z4) + z5;
-                }
-              }
-              for(int subX = 0; subX < outTileXSize; subX++) {
-                float* __restrict t0 = &tile[(0*inTileXSize+subX)*outChannels];
-                float* __restrict t1 = &tile[(1*inTileXSize+subX)*outChannels];
-                float* __restrict t2 = &tile[(2*inTileXSize+subX)*outChannels];
-                float* __restrict t3 = &tile[(3*inTileXSize+subX)*outChannels];
-                float* __restrict t4 = &tile[(4*inTileXSize+subX)*outChannels];
-                float* __restrict t5 = &tile[(5*inTileXSize+subX)*outChannels];
-                for(int oc = 0; oc < outChannels; oc++) {
-                  float z0 = t0[oc];
-                  float z1 = t1[oc];
-                  float z2 = t2[oc];
-                  float z3 = t3[oc];
-                  float z4 = t4[oc];
-                  float z5 = t5[oc];
-                  t0[oc] = z0 + z1 + z2 + z3 + z4;
-                  t1[oc] = (z1-z2) + 2.0f*(z3-z4);
-                  t2[oc] = (z1+z2) + 4.0f*(z3+z4);
-                  t3[oc] = (z1-z2) + 8.0f*(z3-z4) + z5;
-                }
-              }
+          }
+          for(int subX = 0; subX < outTileXSize; subX++) {
+            float* __restrict t0 = &tile[(0*inTileXSize+subX)*outChannels];
+            float* __restrict t1 = &tile[(1*inTileXSize+subX)*outChannels];
+            float* __restrict t2 = &tile[(2*inTileXSize+subX)*outChannels];
+            float* __restrict t3 = &tile[(3*inTileXSize+subX)*outChannels];
+            float* __restrict t4 = &tile[(4*inTileXSize+subX)*outChannels];
+            float* __restrict t5 = &tile[(5*inTileXSize+subX)*outChannels];
+            for(int oc = 0; oc < outChannels; oc++) {
+              float z0 = t0[oc];
+              float z1 = t1[oc];
+              float z2 = t2[oc];
+              float z3 = t3[oc];
+              float z4 = t4[oc];
+              float z5 = t5[oc];
+              t0[oc] = z0 + z1 + z2 + z3 + z4;
+              t1[oc] = (z1-z2) + 2.0f*(z3-z4) + z5;
+            }
+          }
+        }
+        else {
+          for(int subY = 0; subY < inTileYSize; subY++) {
+            float* __restrict t0 = &tile[(subY*inTileXSize+0)*outChannels];
+            float* __restrict t1 = &tile[(subY*inTileXSize+1)*outChannels];
+            float* __restrict t2 = &tile[(subY*inTileXSize+2)*outChannels];
+            float* __restrict t3 = &tile[(subY*inTileXSize+3)*outChannels];
+            float* __restrict t4 = &tile[(subY*inTileXSize+4)*outChannels];
+            float* __restrict t5 = &tile[(subY*inTileXSize+5)*outChannels];
+            for(int oc = 0; oc < outChannels; oc++) {
+              float z0 = t0[oc];
+              float z1 = t1[oc];
+              float z2 = t2[oc];
+              float z3 = t3[oc];
+              float z4 = t4[oc];
+              float z5 = t5[oc];
+              t0[oc] = z0 + z1 + z2 + z3 + z4;
+              t1[oc] = (z1-z2) + 2.0f*(z3-z4);
+              t2[oc] = (z1+z2) + 4.0f*(z3+z4);
+              t3[oc] = (z1-z2) + 8.0f*(z3-z4) + z5;
+            }
+          }
+          for(int subX = 0; subX < outTileXSize; subX++) {
+            float* __restrict t0 = &tile[(0*inTileXSize+subX)*outChannels];
+            float* __restrict t1 = &tile[(1*inTileXSize+subX)*outChannels];
+            float* __restrict t2 = &tile[(2*inTileXSize+subX)*outChannels];
+            float* __restrict t3 = &tile[(3*inTileXSize+subX)*outChannels];
+            float* __restrict t4 = &tile[(4*inTileXSize+subX)*outChannels];
+            float* __restrict t5 = &tile[(5*inTileXSize+subX)*outChannels];
+            for(int oc = 0; oc < outChannels; oc++) {
+              float z0 = t0[oc];
+              float z1 = t1[oc];
+              float z2 = t2[oc];
+              float z3 = t3[oc];
+              float z4 = t4[oc];
+              float z5 = t5[oc];
+              t0[oc] = z0 + z1 + z2 + z3 + z4;
+              t1[oc] = (z1-z2) + 2.0f*(z3-z4);
+              t2[oc] = (z1+z2) + 4.0f*(z3+z4);
+              t3[oc] = (z1-z2) + 8.0f*(z3-z4) + z5;
             }
+          }
+        }
 
-            if(accumulate) {
-              for(int dy = 0; dy < outTileYSize; dy++) {
-                for(int dx = 0; dx < outTileXSize; dx++) {
-                  int x = xTile*outTileXSize+dx;
-                  int y = yTile*outTileYSize+dy;
-                  if(!(x < 0 || y < 0 || x >= nnXLen || y >= nnYLen)) {
-                    int subTileIdx = dy * inTileXSize + dx;
-                    for(int oc = 0; oc < outChannels; oc++) {
-                      (*output)(oc,x,y,n) += tile[subTileIdx*outChannels+oc];
-                    }
-                  }
+        if(accumulate) {
+          for(int dy = 0; dy < outTileYSize; dy++) {
+            for(int dx = 0; dx < outTileXSize; dx++) {
+              int x = xTile*outTileXSize+dx;
+              int y = yTile*outTileYSize+dy;
+              if(!(x < 0 || y < 0 || x >= nnXLen || y >= nnYLen)) {
+                int subTileIdx = dy * inTileXSize + dx;
+                for(int oc = 0; oc < outChannels; oc++) {
+                  (*output)(oc,x,y,n) += tile[subTileIdx*outChannels+oc];
                 }
               }
             }
-            else {
-              for(int dy = 0; dy < outTileYSize; dy++) {
-                for(int dx = 0; dx < outTileXSize; dx++) {
-                  int x = xTile*outTileXSize+dx;
-                  int y = yTile*outTileYSize+dy;
-                  if(!(x < 0 || y < 0 || x >= nnXLen || y >= nnYLen)) {
-                    int subTileIdx = dy * inTileXSize + dx;
-                    for(int oc = 0; oc < outChannels; oc++) {
-                      (*output)(oc,x,y,n) = tile[subTileIdx*outChannels+oc];
-                    }
-                  }
+          }
+        }
+        else {
+          for(int dy = 0; dy < outTileYSize; dy++) {
+            for(int dx = 0; dx < outTileXSize; dx++) {
+              int x = xTile*outTileXSize+dx;
+              int y = yTile*outTileYSize+dy;
+              if(!(x < 0 || y < 0 || x >= nnXLen || y >= nnYLen)) {
+                int subTileIdx = dy * inTileXSize + dx;
+                for(int oc = 0; oc < outChannels; oc++) {
+                  (*output)(oc,x,y,n) = tile[subTileIdx*outChannels+oc];
                 }
               }
             }
@@ -665,8 +989,16 @@ struct ConvLayer {
       Eigen::array<Eigen::Index, 2> imagePatchColVectorShape = {imagePatchSize, nnXLen*nnYLen*batchSize};
       Eigen::array<Eigen::IndexPair<int>, 1> contractionDims = {Eigen::IndexPair<int>(1, 0)};
       Eigen::array<Eigen::Index, 4> outputShape = {outChannels,nnXLen,nnYLen,batchSize};
+      const float* kernelData;
+      if(useFP16) {
+        widenHalfToFloat(imagePatchKernelHalf.data(), convWorkspace, imagePatchKernelHalf.size());
+        kernelData = convWorkspace;
+      }
+      else
+        kernelData = imagePatchKernel.data();
+      CONSTTENSORMAP2 kernel((float*)kernelData, outChannels, imagePatchSize);
       auto imagePatches = input->extract_image_patches(convXSize,convYSize).reshape(imagePatchColVectorShape);
-      auto convolution = imagePatchKernel.contract(imagePatches, contractionDims).reshape(outputShape);
+      auto convolution = kernel.contract(imagePatches, contractionDims).reshape(outputShape);
       if(accumulate)
         *output += convolution;
       else
@@ -770,25 +1102,43 @@ struct MatMulLayer {
   const string name;
   const int inChannels;
   const int outChannels;
+  const bool useFP16;
 
+  // Only one of the float or half versions is populated, depending on useFP16.
   TENSOR2 weights;
+  vector<half_t> weightsHalf;
 
   MatMulLayer() = delete;
   MatMulLayer(const MatMulLayer&) = delete;
   MatMulLayer& operator=(const MatMulLayer&) = delete;
 
-  MatMulLayer(const MatMulLayerDesc& desc)
+  MatMulLayer(const MatMulLayerDesc& desc, bool useF16)
     : name(desc.name),
       inChannels(desc.inChannels),
-      outChannels(desc.outChannels)
+      outChannels(desc.outChannels),
+      useFP16(useF16)
   {
-    weights = TENSOR2(desc.outChannels, desc.inChannels);
-    memcpy(weights.data(), desc.weights.data(), sizeof(SCALAR) * weights.size());
+    if(useFP16)
+      weightsHalf = floatsToHalf(desc.weights.data(), (size_t)outChannels * inChannels);
+    else {
+      weights = TENSOR2(desc.outChannels, desc.inChannels);
+      memcpy(weights.data(), desc.weights.data(), sizeof(SCALAR) * weights.size());
+    }
+  }
+
+  size_t requiredConvWorkspaceElts() const {
+    return useFP16 ? (size_t)outChannels * inChannels : 0;
   }
 
-  void apply(CONSTTENSORMAP2* in, TENSORMAP2* out) const {
+  void apply(CONSTTENSORMAP2* in, TENSORMAP2* out, float* convWorkspace) const {
     Eigen::array<Eigen::IndexPair<int>, 1> product_dims = { Eigen::IndexPair<int>(1, 0) };
-    *out = weights.contract(*in, product_dims);
+    if(useFP16) {
+      widenHalfToFloat(weightsHalf.data(), convWorkspace, weightsHalf.size());
+      CONSTTENSORMAP2 widenedWeights(convWorkspace, outChannels, inChannels);
+      *out = widenedWeights.contract(*in, product_dims);
+    }
+    else
+      *out = weights.contract(*in, product_dims);
   }
 };
 
@@ -833,10 +1183,11 @@ struct NormActConv {
     const ActivationLayerDesc& actDesc,
     const ConvLayerDesc& convDesc,
     int nnX,
-    int nnY
+    int nnY,
+    bool useFP16
   )
     : norm(normDesc,actDesc),
-      conv(convDesc,nnX,nnY),
+      conv(convDesc,nnX,nnY,useFP16),
       inChannels(convDesc.inChannels),
       outChannels(convDesc.outChannels)
   {}
@@ -877,6 +1228,7 @@ struct ResidualBlockIntf {
   ) const = 0;
 
   virtual size_t requiredConvWorkspaceElts(size_t maxBatchSize) const = 0;
+  virtual size_t requiredScratchBytes(const ScratchBuffers* scratch) const = 0;
 };
 
 // --------------------------------------------------------------------------------------------------------------
@@ -892,10 +1244,10 @@ struct ResidualBlock final : public ResidualBlockIntf {
 
   ~ResidualBlock(){}
 
-  ResidualBlock(const ResidualBlockDesc& desc, int nnX, int nnY)
+  ResidualBlock(const ResidualBlockDesc& desc, int nnX, int nnY, bool useFP16)
     : name(desc.name),
-      normActConv1(desc.preBN,desc.preActivation,desc.regularConv,nnX,nnY),
-      normActConv2(desc.midBN,desc.midActivation,desc.finalConv,nnX,nnY)
+      normActConv1(desc.preBN,desc.preActivation,desc.regularConv,nnX,nnY,useFP16),
+      normActConv2(desc.midBN,desc.midActivation,desc.finalConv,nnX,nnY,useFP16)
   {}
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const override {
@@ -905,6 +1257,10 @@ struct ResidualBlock final : public ResidualBlockIntf {
     );
   }
 
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const override {
+    return 2 * scratch->getBufSizeXY(normActConv1.outChannels);
+  }
+
   void apply(
     ComputeHandleInternal* handle,
     ScratchBuffers* scratch,
@@ -916,8 +1272,8 @@ struct ResidualBlock final : public ResidualBlockIntf {
   ) const override {
     (void)maskSum;
     int batchSize = trunk->dimension(3);
-    SizedBuf<float*> midInBuf(scratch->allocator, scratch->getBufSizeXY(normActConv1.outChannels));
-    SizedBuf<float*> midScratchBuf(scratch->allocator, scratch->getBufSizeXY(normActConv1.outChannels));
+    ScratchBuf midInBuf(scratch, scratch->getBufSizeXY(normActConv1.outChannels));
+    ScratchBuf midScratchBuf(scratch, scratch->getBufSizeXY(normActConv1.outChannels));
     TENSORMAP4 midIn(midInBuf.buf, normActConv1.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
     TENSORMAP4 midScratch(midScratchBuf.buf, normActConv1.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
 
@@ -943,24 +1299,33 @@ struct GlobalPoolingResidualBlock final : public ResidualBlockIntf {
 
   ~GlobalPoolingResidualBlock(){}
 
-  GlobalPoolingResidualBlock(const GlobalPoolingResidualBlockDesc& desc, int nnX, int nnY)
+  GlobalPoolingResidualBlock(const GlobalPoolingResidualBlockDesc& desc, int nnX, int nnY, bool useFP16)
     : name(desc.name),
       preBN(desc.preBN,desc.preActivation),
-      regularConv(desc.regularConv,nnX,nnY),
-      gpoolConv(desc.gpoolConv,nnX,nnY),
+      regularConv(desc.regularConv,nnX,nnY,useFP16),
+      gpoolConv(desc.gpoolConv,nnX,nnY,useFP16),
       gpoolBN(desc.gpoolBN,desc.gpoolActivation),
-      gpoolToBiasMul(desc.gpoolToBiasMul),
-      normActConv2(desc.midBN,desc.midActivation,desc.finalConv,nnX,nnY)
+      gpoolToBiasMul(desc.gpoolToBiasMul,useFP16),
+      normActConv2(desc.midBN,desc.midActivation,desc.finalConv,nnX,nnY,useFP16)
   {}
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const override {
     size_t maxElts = 0;
     maxElts = std::max(maxElts,regularConv.requiredConvWorkspaceElts(maxBatchSize));
     maxElts = std::max(maxElts,gpoolConv.requiredConvWorkspaceElts(maxBatchSize));
+    maxElts = std::max(maxElts,gpoolToBiasMul.requiredConvWorkspaceElts());
     maxElts = std::max(maxElts,normActConv2.requiredConvWorkspaceElts(maxBatchSize));
     return maxElts;
   }
 
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const override {
+    return
+      2 * scratch->getBufSizeXY(regularConv.outChannels) +
+      2 * scratch->getBufSizeXY(gpoolConv.outChannels) +
+      scratch->getBufSize(gpoolConv.outChannels*3) +
+      scratch->getBufSize(regularConv.outChannels);
+  }
+
   void apply(
     ComputeHandleInternal* handle,
     ScratchBuffers* scratch,
@@ -971,12 +1336,12 @@ struct GlobalPoolingResidualBlock final : public ResidualBlockIntf {
     float* convWorkspace
   ) const override {
     int batchSize = trunk->dimension(3);
-    SizedBuf<float*> regularOutBuf(scratch->allocator, scratch->getBufSizeXY(regularConv.outChannels));
-    SizedBuf<float*> regularScratchBuf(scratch->allocator, scratch->getBufSizeXY(regularConv.outChannels));
-    SizedBuf<float*> gpoolOutBuf(scratch->allocator, scratch->getBufSizeXY(gpoolConv.outChannels));
-    SizedBuf<float*> gpoolOut2Buf(scratch->allocator, scratch->getBufSizeXY(gpoolConv.outChannels));
-    SizedBuf<float*> gpoolConcatBuf(scratch->allocator, scratch->getBufSize(gpoolConv.outChannels*3));
-    SizedBuf<float*> gpoolBiasBuf(scratch->allocator, scratch->getBufSize(regularConv.outChannels));
+    ScratchBuf regularOutBuf(scratch, scratch->getBufSizeXY(regularConv.outChannels));
+    ScratchBuf regularScratchBuf(scratch, scratch->getBufSizeXY(regularConv.outChannels));
+    ScratchBuf gpoolOutBuf(scratch, scratch->getBufSizeXY(gpoolConv.outChannels));
+    ScratchBuf gpoolOut2Buf(scratch, scratch->getBufSizeXY(gpoolConv.outChannels));
+    ScratchBuf gpoolConcatBuf(scratch, scratch->getBufSize(gpoolConv.outChannels*3));
+    ScratchBuf gpoolBiasBuf(scratch, scratch->getBufSize(regularConv.outChannels));
 
     TENSORMAP4 regularOut(regularOutBuf.buf, regularConv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
     TENSORMAP4 regularScratch(regularScratchBuf.buf, regularConv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
@@ -996,7 +1361,7 @@ struct GlobalPoolingResidualBlock final : public ResidualBlockIntf {
     gpoolBN.apply(&gpoolOut, &gpoolOut2, mask);
     DTENSOR("gpoolOut2", &gpoolOut2);
     poolRowsGPool(&gpoolOut2, &gpoolConcat, mask, maskSum);
-    gpoolToBiasMul.apply(&gpoolConcat, &gpoolBias);
+    gpoolToBiasMul.apply(&gpoolConcat, &gpoolBias, convWorkspace);
     addNCBiasInplace(&regularOut, &gpoolBias);
     normActConv2.apply(handle, &regularOut, &regularScratch, trunk, mask, convWorkspace, true);
     DSHAPE("trunk", trunk);
@@ -1024,12 +1389,14 @@ struct BlockStack {
     const std::vector<std::pair<int, unique_ptr_void>>& descBlocks,
     int nBlocks,
     int nnX,
-    int nnY
+    int nnY,
+    bool useFP16
   );
 
   ~BlockStack();
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const;
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const;
 
   void apply(
     ComputeHandleInternal* handle,
@@ -1056,11 +1423,11 @@ struct NestedBottleneckResidualBlock final : public ResidualBlockIntf {
 
   ~NestedBottleneckResidualBlock(){}
 
-  NestedBottleneckResidualBlock(const NestedBottleneckResidualBlockDesc& desc, int nnX, int nnY)
+  NestedBottleneckResidualBlock(const NestedBottleneckResidualBlockDesc& desc, int nnX, int nnY, bool useFP16)
     : name(desc.name),
-      normActConv1(desc.preBN,desc.preActivation,desc.preConv,nnX,nnY),
-      blocks(desc.blocks,desc.numBlocks,nnX,nnY),
-      normActConv2(desc.postBN,desc.postActivation,desc.postConv,nnX,nnY)
+      normActConv1(desc.preBN,desc.preActivation,desc.preConv,nnX,nnY,useFP16),
+      blocks(desc.blocks,desc.numBlocks,nnX,nnY,useFP16),
+      normActConv2(desc.postBN,desc.postActivation,desc.postConv,nnX,nnY,useFP16)
   {}
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const override {
@@ -1073,6 +1440,10 @@ struct NestedBottleneckResidualBlock final : public ResidualBlockIntf {
     );
   }
 
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const override {
+    return 2 * scratch->getBufSizeXY(normActConv1.outChannels) + blocks.requiredScratchBytes(scratch);
+  }
+
   void apply(
     ComputeHandleInternal* handle,
     ScratchBuffers* scratch,
@@ -1084,8 +1455,8 @@ struct NestedBottleneckResidualBlock final : public ResidualBlockIntf {
   ) const override {
     (void)maskSum;
     int batchSize = trunk->dimension(3);
-    SizedBuf<float*> midInBuf(scratch->allocator, scratch->getBufSizeXY(normActConv1.outChannels));
-    SizedBuf<float*> midScratchBuf(scratch->allocator, scratch->getBufSizeXY(normActConv1.outChannels));
+    ScratchBuf midInBuf(scratch, scratch->getBufSizeXY(normActConv1.outChannels));
+    ScratchBuf midScratchBuf(scratch, scratch->getBufSizeXY(normActConv1.outChannels));
     TENSORMAP4 midIn(midInBuf.buf, normActConv1.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
     TENSORMAP4 midScratch(midScratchBuf.buf, normActConv1.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
 
@@ -1101,24 +1472,25 @@ BlockStack::BlockStack(
   const std::vector<std::pair<int, unique_ptr_void>>& descBlocks,
   int nBlocks,
   int nnX,
-  int nnY
+  int nnY,
+  bool useFP16
 ) :
   numBlocks(nBlocks)
 {
   for (int i = 0; i < numBlocks; ++i) {
     if (descBlocks[i].first == ORDINARY_BLOCK_KIND) {
       ResidualBlockDesc* blockDesc = (ResidualBlockDesc*)descBlocks[i].second.get();
-      std::unique_ptr<ResidualBlockIntf> block = std::make_unique<ResidualBlock>(*blockDesc,nnX,nnY);
+      std::unique_ptr<ResidualBlockIntf> block = std::make_unique<ResidualBlock>(*blockDesc,nnX,nnY,useFP16);
       blocks.push_back(make_pair(ORDINARY_BLOCK_KIND, std::move(block)));
     }
     else if (descBlocks[i].first == GLOBAL_POOLING_BLOCK_KIND) {
       GlobalPoolingResidualBlockDesc* blockDesc = (GlobalPoolingResidualBlockDesc*)descBlocks[i].second.get();
-      std::unique_ptr<GlobalPoolingResidualBlock> block = std::make_unique<GlobalPoolingResidualBlock>(*blockDesc,nnX,nnY);
+      std::unique_ptr<GlobalPoolingResidualBlock> block = std::make_unique<GlobalPoolingResidualBlock>(*blockDesc,nnX,nnY,useFP16);
       blocks.push_back(make_pair(GLOBAL_POOLING_BLOCK_KIND, std::move(block)));
     }
     else if (descBlocks[i].first == NESTED_BOTTLENECK_BLOCK_KIND) {
       NestedBottleneckResidualBlockDesc* blockDesc = (NestedBottleneckResidualBlockDesc*)descBlocks[i].second.get();
-      std::unique_ptr<NestedBottleneckResidualBlock> block = std::make_unique<NestedBottleneckResidualBlock>(*blockDesc,nnX,nnY);
+      std::unique_ptr<NestedBottleneckResidualBlock> block = std::make_unique<NestedBottleneckResidualBlock>(*blockDesc,nnX,nnY,useFP16);
       blocks.push_back(make_pair(NESTED_BOTTLENECK_BLOCK_KIND, std::move(block)));
     }
     else {
@@ -1138,6 +1510,14 @@ size_t BlockStack::requiredConvWorkspaceElts(size_t maxBatchSize) const {
   return maxElts;
 }
 
+size_t BlockStack::requiredScratchBytes(const ScratchBuffers* scratch) const {
+  size_t maxBytes = 0;
+  for(int i = 0; i<blocks.size(); i++) {
+    maxBytes = std::max(maxBytes,blocks[i].second->requiredScratchBytes(scratch));
+  }
+  return maxBytes;
+}
+
 void BlockStack::apply(
   ComputeHandleInternal* handle,
   ScratchBuffers* scratch,
@@ -1175,12 +1555,12 @@ struct Trunk {
   Trunk(const Trunk&) = delete;
   Trunk& operator=(const Trunk&) = delete;
 
-  Trunk(const TrunkDesc& desc, int nnX, int nnY)
+  Trunk(const TrunkDesc& desc, int nnX, int nnY, bool useFP16)
     : name(desc.name),
       version(desc.version),
-      initialConv(desc.initialConv,nnX,nnY),
-      initialMatMul(desc.initialMatMul),
-      blocks(desc.blocks,desc.numBlocks,nnX,nnY),
+      initialConv(desc.initialConv,nnX,nnY,useFP16),
+      initialMatMul(desc.initialMatMul,useFP16),
+      blocks(desc.blocks,desc.numBlocks,nnX,nnY,useFP16),
       trunkTipBN(desc.trunkTipBN,desc.trunkTipActivation)
   {
   }
@@ -1189,10 +1569,18 @@ struct Trunk {
   }
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const {
-    return std::max(
-      initialConv.requiredConvWorkspaceElts(maxBatchSize),
-      blocks.requiredConvWorkspaceElts(maxBatchSize)
-    );
+    size_t maxElts = 0;
+    maxElts = std::max(maxElts,initialConv.requiredConvWorkspaceElts(maxBatchSize));
+    maxElts = std::max(maxElts,initialMatMul.requiredConvWorkspaceElts());
+    maxElts = std::max(maxElts,blocks.requiredConvWorkspaceElts(maxBatchSize));
+    return maxElts;
+  }
+
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const {
+    return
+      scratch->getBufSizeXY(initialConv.outChannels) +
+      scratch->getBufSize(initialMatMul.outChannels) +
+      blocks.requiredScratchBytes(scratch);
   }
 
   void apply(
@@ -1206,13 +1594,13 @@ struct Trunk {
     float* convWorkspace
   ) const {
     int batchSize = trunk->dimension(3);
-    SizedBuf<float*> trunkScratchBuf(scratch->allocator, scratch->getBufSizeXY(initialConv.outChannels));
-    SizedBuf<float*> inputMatMulOutBuf(scratch->allocator, scratch->getBufSize(initialMatMul.outChannels));
+    ScratchBuf trunkScratchBuf(scratch, scratch->getBufSizeXY(initialConv.outChannels));
+    ScratchBuf inputMatMulOutBuf(scratch, scratch->getBufSize(initialMatMul.outChannels));
     TENSORMAP4 trunkScratch(trunkScratchBuf.buf, initialConv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
     TENSORMAP2 inputMatMulOut(inputMatMulOutBuf.buf, initialMatMul.outChannels, batchSize);
 
     initialConv.apply(handle, input, &trunkScratch, convWorkspace, false);
-    initialMatMul.apply(inputGlobal, &inputMatMulOut);
+    initialMatMul.apply(inputGlobal, &inputMatMulOut, convWorkspace);
     addNCBiasInplace(&trunkScratch, &inputMatMulOut);
 
     // Flip trunkBuf and trunkScratchBuf so that the result gets accumulated in trunkScratchBuf
@@ -1238,16 +1626,16 @@ struct PolicyHead {
   PolicyHead(const PolicyHead&) = delete;
   PolicyHead& operator=(const PolicyHead&) = delete;
 
-  PolicyHead(const PolicyHeadDesc& desc, int nnX, int nnY)
+  PolicyHead(const PolicyHeadDesc& desc, int nnX, int nnY, bool useFP16)
     : name(desc.name),
       version(desc.version),
-      p1Conv(desc.p1Conv,nnX,nnY),
-      g1Conv(desc.g1Conv,nnX,nnY),
+      p1Conv(desc.p1Conv,nnX,nnY,useFP16),
+      g1Conv(desc.g1Conv,nnX,nnY,useFP16),
       g1BN(desc.g1BN,desc.g1Activation),
-      gpoolToBiasMul(desc.gpoolToBiasMul),
+      gpoolToBiasMul(desc.gpoolToBiasMul,useFP16),
       p1BN(desc.p1BN,desc.p1Activation),
-      p2Conv(desc.p2Conv,nnX,nnY),
-      gpoolToPassMul(desc.gpoolToPassMul)
+      p2Conv(desc.p2Conv,nnX,nnY,useFP16),
+      gpoolToPassMul(desc.gpoolToPassMul,useFP16)
   {}
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const {
@@ -1255,9 +1643,19 @@ struct PolicyHead {
     maxElts = std::max(maxElts,p1Conv.requiredConvWorkspaceElts(maxBatchSize));
     maxElts = std::max(maxElts,g1Conv.requiredConvWorkspaceElts(maxBatchSize));
     maxElts = std::max(maxElts,p2Conv.requiredConvWorkspaceElts(maxBatchSize));
+    maxElts = std::max(maxElts,gpoolToBiasMul.requiredConvWorkspaceElts());
+    maxElts = std::max(maxElts,gpoolToPassMul.requiredConvWorkspaceElts());
     return maxElts;
   }
 
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const {
+    return
+      2 * scratch->getBufSizeXY(p1Conv.outChannels) +
+      2 * scratch->getBufSizeXY(g1Conv.outChannels) +
+      scratch->getBufSize(g1Conv.outChannels*3) +
+      scratch->getBufSize(p1Conv.outChannels);
+  }
+
   void apply(
     ComputeHandleInternal* handle,
     ScratchBuffers* scratch,
@@ -1269,12 +1667,12 @@ struct PolicyHead {
     float* convWorkspace
   ) const {
     int batchSize = trunk->dimension(3);
-    SizedBuf<float*> p1OutBuf(scratch->allocator, scratch->getBufSizeXY(p1Conv.outChannels));
-    SizedBuf<float*> p1Out2Buf(scratch->allocator, scratch->getBufSizeXY(p1Conv.outChannels));
-    SizedBuf<float*> g1OutBuf(scratch->allocator, scratch->getBufSizeXY(g1Conv.outChannels));
-    SizedBuf<float*> g1Out2Buf(scratch->allocator, scratch->getBufSizeXY(g1Conv.outChannels));
-    SizedBuf<float*> g1ConcatBuf(scratch->allocator, scratch->getBufSize(g1Conv.outChannels*3));
-    SizedBuf<float*> g1BiasBuf(scratch->allocator, scratch->getBufSize(p1Conv.outChannels));
+    ScratchBuf p1OutBuf(scratch, scratch->getBufSizeXY(p1Conv.outChannels));
+    ScratchBuf p1Out2Buf(scratch, scratch->getBufSizeXY(p1Conv.outChannels));
+    ScratchBuf g1OutBuf(scratch, scratch->getBufSizeXY(g1Conv.outChannels));
+    ScratchBuf g1Out2Buf(scratch, scratch->getBufSizeXY(g1Conv.outChannels));
+    ScratchBuf g1ConcatBuf(scratch, scratch->getBufSize(g1Conv.outChannels*3));
+    ScratchBuf g1BiasBuf(scratch, scratch->getBufSize(p1Conv.outChannels));
     TENSORMAP4 p1Out(p1OutBuf.buf, p1Conv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
     TENSORMAP4 p1Out2(p1Out2Buf.buf, p1Conv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
     TENSORMAP4 g1Out(g1OutBuf.buf, g1Conv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
@@ -1286,11 +1684,11 @@ struct PolicyHead {
     g1Conv.apply(handle, trunk, &g1Out, convWorkspace, false);
     g1BN.apply(&g1Out, &g1Out2, mask);
     poolRowsGPool(&g1Out2, &g1Concat, mask, maskSum);
-    gpoolToBiasMul.apply(&g1Concat, &g1Bias);
+    gpoolToBiasMul.apply(&g1Concat, &g1Bias, convWorkspace);
     addNCBiasInplace(&p1Out, &g1Bias);
     p1BN.apply(&p1Out, &p1Out2, mask);
     p2Conv.apply(handle, &p1Out2, policy, convWorkspace, false);
-    gpoolToPassMul.apply(&g1Concat, policyPass);
+    gpoolToPassMul.apply(&g1Concat, policyPass, convWorkspace);
   }
 };
 
@@ -1313,27 +1711,37 @@ struct ValueHead {
   ValueHead(const ValueHead&) = delete;
   ValueHead& operator=(const ValueHead&) = delete;
 
-  ValueHead(const ValueHeadDesc& desc, int nnX, int nnY)
+  ValueHead(const ValueHeadDesc& desc, int nnX, int nnY, bool useFP16)
     : name(desc.name),
       version(desc.version),
-      v1Conv(desc.v1Conv,nnX,nnY),
+      v1Conv(desc.v1Conv,nnX,nnY,useFP16),
       v1BN(desc.v1BN,desc.v1Activation),
-      v2Mul(desc.v2Mul),
+      v2Mul(desc.v2Mul,useFP16),
       v2Bias(desc.v2Bias),
       v2Activation(desc.v2Activation),
-      v3Mul(desc.v3Mul),
+      v3Mul(desc.v3Mul,useFP16),
       v3Bias(desc.v3Bias),
-      sv3Mul(desc.sv3Mul),
+      sv3Mul(desc.sv3Mul,useFP16),
       sv3Bias(desc.sv3Bias),
-      vOwnershipConv(desc.vOwnershipConv,nnX,nnY) {}
+      vOwnershipConv(desc.vOwnershipConv,nnX,nnY,useFP16) {}
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const {
     size_t maxElts = 0;
     maxElts = std::max(maxElts,v1Conv.requiredConvWorkspaceElts(maxBatchSize));
     maxElts = std::max(maxElts,vOwnershipConv.requiredConvWorkspaceElts(maxBatchSize));
+    maxElts = std::max(maxElts,v2Mul.requiredConvWorkspaceElts());
+    maxElts = std::max(maxElts,v3Mul.requiredConvWorkspaceElts());
+    maxElts = std::max(maxElts,sv3Mul.requiredConvWorkspaceElts());
     return maxElts;
   }
 
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const {
+    return
+      2 * scratch->getBufSizeXY(v1Conv.outChannels) +
+      scratch->getBufSize(v1Conv.outChannels*3) +
+      scratch->getBufSize(v2Mul.outChannels);
+  }
+
   void apply(
     ComputeHandleInternal* handle,
     ScratchBuffers* scratch,
@@ -1346,10 +1754,10 @@ struct ValueHead {
     float* convWorkspace
   ) const {
     int batchSize = trunk->dimension(3);
-    SizedBuf<float*> v1OutBuf(scratch->allocator, scratch->getBufSizeXY(v1Conv.outChannels));
-    SizedBuf<float*> v1Out2Buf(scratch->allocator, scratch->getBufSizeXY(v1Conv.outChannels));
-    SizedBuf<float*> v1MeanBuf(scratch->allocator, scratch->getBufSize(v1Conv.outChannels*3));
-    SizedBuf<float*> v2OutBuf(scratch->allocator, scratch->getBufSize(v2Mul.outChannels));
+    ScratchBuf v1OutBuf(scratch, scratch->getBufSizeXY(v1Conv.outChannels));
+    ScratchBuf v1Out2Buf(scratch, scratch->getBufSizeXY(v1Conv.outChannels));
+    ScratchBuf v1MeanBuf(scratch, scratch->getBufSize(v1Conv.outChannels*3));
+    ScratchBuf v2OutBuf(scratch, scratch->getBufSize(v2Mul.outChannels));
 
     TENSORMAP4 v1Out(v1OutBuf.buf, v1Conv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
     TENSORMAP4 v1Out2(v1Out2Buf.buf, v1Conv.outChannels, handle->nnXLen, handle->nnYLen, batchSize);
@@ -1359,13 +1767,13 @@ struct ValueHead {
     v1Conv.apply(handle, trunk, &v1Out, convWorkspace, false);
     v1BN.apply(&v1Out, &v1Out2, mask);
     poolRowsValueHead(&v1Out2, &v1Mean, maskSum);
-    v2Mul.apply(&v1Mean, &v2Out);
+    v2Mul.apply(&v1Mean, &v2Out, convWorkspace);
     v2Bias.apply(&v2Out);
     v2Activation.apply(&v2Out, &v2Out);
-    v3Mul.apply(&v2Out, value);
+    v3Mul.apply(&v2Out, value, convWorkspace);
     v3Bias.apply(value);
 
-    sv3Mul.apply(&v2Out, scoreValue);
+    sv3Mul.apply(&v2Out, scoreValue, convWorkspace);
     sv3Bias.apply(scoreValue);
 
     vOwnershipConv.apply(handle, &v1Out2, ownership, convWorkspace, false);
@@ -1392,7 +1800,7 @@ struct Model {
   Model(const Model&) = delete;
   Model& operator=(const Model&) = delete;
 
-  Model(const ModelDesc& desc, int nnX, int nnY)
+  Model(const ModelDesc& desc, int nnX, int nnY, bool useFP16)
     : name(desc.name),
       version(desc.version),
       numInputChannels(desc.numInputChannels),
@@ -1400,9 +1808,9 @@ struct Model {
       numValueChannels(desc.numValueChannels),
       numScoreValueChannels(desc.numScoreValueChannels),
       numOwnershipChannels(desc.numOwnershipChannels),
-      trunk(desc.trunk,nnX,nnY),
-      policyHead(desc.policyHead,nnX,nnY),
-      valueHead(desc.valueHead,nnX,nnY)
+      trunk(desc.trunk,nnX,nnY,useFP16),
+      policyHead(desc.policyHead,nnX,nnY,useFP16),
+      valueHead(desc.valueHead,nnX,nnY,useFP16)
   {}
 
   size_t requiredConvWorkspaceElts(size_t maxBatchSize) const {
@@ -1413,6 +1821,15 @@ struct Model {
     return maxElts;
   }
 
+  // Trunk buffers are all released before the heads run, so the heads reuse the same arena region.
+  size_t requiredScratchBytes(const ScratchBuffers* scratch) const {
+    size_t maxBytes = 0;
+    maxBytes = std::max(maxBytes,trunk.requiredScratchBytes(scratch));
+    maxBytes = std::max(maxBytes,policyHead.requiredScratchBytes(scratch));
+    maxBytes = std::max(maxBytes,valueHead.requiredScratchBytes(scratch));
+    return maxBytes;
+  }
+
   void apply(
     ComputeHandleInternal* handle,
     ScratchBuffers* scratch,
@@ -1433,6 +1850,7 @@ struct Model {
   ) const {
     *mask = input->chip(0,0);
     computeMaskSum(mask,maskSum);
+    handle->computeBoardExtents(mask);
 
     trunk.apply(
       handle,
@@ -1579,6 +1997,7 @@ ComputeContext* NeuralNet::createComputeContext(
   const string& openCLTunerFile,
   const string& homeDataDirOverride,
   bool openCLReTunePerBoardSize,
+  int eigenDirectConvMaxBatchSize,
   enabled_t useFP16Mode,
   enabled_t useNHWCMode,
   const LoadedModel* loadedModel
@@ -1588,17 +2007,17 @@ ComputeContext* NeuralNet::createComputeContext(
   (void)openCLTunerFile;
   (void)homeDataDirOverride;
   (void)openCLReTunePerBoardSize;
-  (void)loadedModel;
 
+  //FP16 here only affects weight storage, which saves memory bandwidth but costs some precision, so only use it
+  //if explicitly requested.
   bool useFP16 = useFP16Mode == enabled_t::True ? true : false;
   bool useNHWC = useNHWCMode == enabled_t::False ? false : true;
 
-  if(useFP16)
-    throw StringError("Eigen backend: useFP16 = true not supported");
   if(!useNHWC)
     throw StringError("Eigen backend: useNHWC = false not supported");
 
-  ComputeContext* context = new ComputeContext(nnXLen,nnYLen);
+  ComputeContext* context = new ComputeContext(nnXLen,nnYLen,useFP16);
+  context->initDirectConv(loadedModel->modelDesc,eigenDirectConvMaxBatchSize);
   return context;
 }
 
@@ -1620,18 +2039,104 @@ struct ComputeHandle {
   ComputeHandle(const ComputeHandle&) = delete;
   ComputeHandle& operator=(const ComputeHandle&) = delete;
 
-  ComputeHandle(const ComputeContext* ctx, const LoadedModel& loadedModel, int maxBatchSize, bool iNHWC)
+  ComputeHandle(const ComputeContext* ctx, const LoadedModel& loadedModel, int maxBatchSize, bool requireExactNNLen, bool iNHWC)
     : context(ctx),
       inputsUseNHWC(iNHWC),
-      handleInternal(ctx),
-      model(loadedModel.modelDesc,ctx->nnXLen,ctx->nnYLen)
+      handleInternal(ctx,requireExactNNLen),
+      model(loadedModel.modelDesc,ctx->nnXLen,ctx->nnYLen,ctx->useFP16)
   {
     scratch = std::make_unique<ScratchBuffers>(maxBatchSize,ctx->nnXLen,ctx->nnYLen);
+    scratch->allocateArena(model.requiredScratchBytes(scratch.get()),true);
     buffers = std::make_unique<Buffers>(loadedModel.modelDesc,model,maxBatchSize,ctx->nnXLen,ctx->nnYLen);
   }
 
   ~ComputeHandle() {
   }
+
+  // Runs the model on NHWC inputs, leaving the results in buffers.
+  void evaluate(float* spatialInput, float* globalInput, int batchSize) {
+    const int nnXLen = context->nnXLen;
+    const int nnYLen = context->nnYLen;
+    CONSTTENSORMAP4 input(spatialInput, model.numInputChannels, nnXLen, nnYLen, batchSize);
+    CONSTTENSORMAP2 inputGlobal(globalInput, model.numInputGlobalChannels, batchSize);
+
+#define MAP4(NAME) TENSORMAP4 NAME(buffers->NAME.data(), buffers->NAME.dimension(0), buffers->NAME.dimension(1), buffers->NAME.dimension(2), batchSize)
+#define MAP3(NAME) TENSORMAP3 NAME(buffers->NAME.data(), buffers->NAME.dimension(0), buffers->NAME.dimension(1), batchSize)
+#define MAP2(NAME) TENSORMAP2 NAME(buffers->NAME.data(), buffers->NAME.dimension(0), batchSize)
+
+    MAP4(trunk);
+    MAP2(policyPass);
+    MAP4(policy);
+    MAP2(value);
+    MAP2(scoreValue);
+    MAP4(ownership);
+    MAP3(mask);
+    vector<float>& maskSum = buffers->maskSum;
+    computeMaskSum(&mask,maskSum.data());
+    vector<float>& convWorkspace = buffers->convWorkspace;
+
+#undef MAP4
+#undef MAP3
+#undef MAP2
+
+    model.apply(
+      &handleInternal,
+      scratch.get(),
+      &input,
+      &inputGlobal,
+      &trunk,
+      &policyPass,
+      &policy,
+      &value,
+      &scoreValue,
+      &ownership,
+      &mask,
+      maskSum.data(),
+      convWorkspace.data()
+    );
+  }
+
+  // Times the model on an empty board with and without direct 3x3 convolution at batch sizes 1, 2, 4, ... and
+  // maxBatchSize, and returns the last batch size tested where direct convolution was faster, or 0 if none.
+  // Also returns the best times at batch size 1.
+  int tuneDirectConv(int maxBatchSize, double& directSeconds, double& winogradSeconds) {
+    const int nnXLen = context->nnXLen;
+    const int nnYLen = context->nnYLen;
+    vector<float> spatialInput((size_t)model.numInputChannels * nnXLen * nnYLen * maxBatchSize, 0.0f);
+    vector<float> globalInput((size_t)model.numInputGlobalChannels * maxBatchSize, 0.0f);
+    //Channel 0 is the on-board mask
+    for(size_t i = 0; i < spatialInput.size(); i += model.numInputChannels)
+      spatialInput[i] = 1.0f;
+
+    auto timeModel = [&](int batchSize, bool useDirect) {
+      handleInternal.useDirectConv = useDirect;
+      evaluate(spatialInput.data(), globalInput.data(), batchSize);
+      double bestSeconds = 1e30;
+      for(int i = 0; i < 3; i++) {
+        ClockTimer timer;
+        evaluate(spatialInput.data(), globalInput.data(), batchSize);
+        bestSeconds = std::min(bestSeconds, timer.getSeconds());
+      }
+      return bestSeconds;
+    };
+
+    int directMaxBatchSize = 0;
+    for(int batchSize = 1; ; batchSize = std::min(batchSize * 2, maxBatchSize)) {
+      double direct = timeModel(batchSize, true);
+      double winograd = timeModel(batchSize, false);
+      if(batchSize == 1) {
+        directSeconds = direct;
+        winogradSeconds = winograd;
+      }
+      if(direct >= winograd)
+        break;
+      directMaxBatchSize = batchSize;
+      if(batchSize >= maxBatchSize)
+        break;
+    }
+    handleInternal.useDirectConv = false;
+    return directMaxBatchSize;
+  }
 };
 
 ComputeHandle* NeuralNet::createComputeHandle(
@@ -1649,12 +2154,41 @@ ComputeHandle* NeuralNet::createComputeHandle(
     logger->write("Eigen (CPU) backend thread " + Global::intToString(serverThreadIdx) + ": Model name: " + loadedModel->modelDesc.name);
   }
 
-  (void)requireExactNNLen; //We don't bother with mask optimizations if we know exact sizes right now.
   (void)gpuIdxForThisThread; //Doesn't matter
 
   if(!inputsUseNHWC)
     throw StringError("Eigen backend: inputsUseNHWC = false unsupported");
-  return new ComputeHandle(context, *loadedModel, maxBatchSize, inputsUseNHWC);
+  ComputeHandle* handle = new ComputeHandle(context, *loadedModel, maxBatchSize, requireExactNNLen, inputsUseNHWC);
+  bool tunedDirectConv = false;
+  double directSeconds = 0.0;
+  double winogradSeconds = 0.0;
+  {
+    //Server threads create their handles all at once, so only the first one times direct convolution, rather than
+    //all of them at the same time competing for the cpu, and the rest wait for it and use the same result.
+    std::lock_guard<std::mutex> lock(context->directConvMutex);
+    if(context->directConvMaxBatchSize < 0) {
+      context->directConvMaxBatchSize = handle->tuneDirectConv(maxBatchSize, directSeconds, winogradSeconds);
+      if(context->directConvMaxBatchSize == 0)
+        context->directConvKernels.clear();
+      tunedDirectConv = true;
+    }
+    handle->handleInternal.directConvMaxBatchSize = context->directConvMaxBatchSize;
+  }
+  if(logger != NULL) {
+    logger->write(
+      "Eigen (CPU) backend thread " + Global::intToString(serverThreadIdx) + ": Scratch arena " +
+      Global::uint64ToString(handle->scratch->arenaBytes) + " bytes for batch size " + Global::intToString(maxBatchSize) +
+      (handle->scratch->arenaUsesHugePages ? " (huge pages)" : "")
+    );
+    logger->write(
+      "Eigen (CPU) backend thread " + Global::intToString(serverThreadIdx) + ": Direct 3x3 convolution for batch sizes up to " +
+      Global::intToString(handle->handleInternal.directConvMaxBatchSize) +
+      (tunedDirectConv ?
+       ", batch size 1 takes " + Global::strprintf("%.3f", directSeconds * 1000.0) + " ms direct vs " +
+       Global::strprintf("%.3f", winogradSeconds * 1000.0) + " ms winograd" : "")
+    );
+  }
+  return handle;
 }
 
 void NeuralNet::freeComputeHandle(ComputeHandle* gpuHandle) {
@@ -1662,8 +2196,7 @@ void NeuralNet::freeComputeHandle(ComputeHandle* gpuHandle) {
 }
 
 bool NeuralNet::isUsingFP16(const ComputeHandle* handle) {
-  (void)handle;
-  return false;
+  return handle->context->useFP16;
 }
 
 void NeuralNet::getOutput(
@@ -1696,49 +2229,17 @@ void NeuralNet::getOutput(
     SymmetryHelpers::copyInputsWithSymmetry(rowSpatial, rowSpatialInput, 1, nnYLen, nnXLen, numSpatialFeatures, computeHandle->inputsUseNHWC, inputBufs[nIdx]->symmetry);
   }
 
-  Buffers& buffers = *(computeHandle->buffers);
-
-  CONSTTENSORMAP4 input(inputBuffers->spatialInput.data(), numSpatialFeatures, nnXLen, nnYLen, batchSize);
-  CONSTTENSORMAP2 inputGlobal(inputBuffers->globalInput.data(), numGlobalFeatures, batchSize);
-
-#define MAP4(NAME) TENSORMAP4 NAME(buffers.NAME.data(), buffers.NAME.dimension(0), buffers.NAME.dimension(1), buffers.NAME.dimension(2), batchSize)
-#define MAP3(NAME) TENSORMAP3 NAME(buffers.NAME.data(), buffers.NAME.dimension(0), buffers.NAME.dimension(1), batchSize)
-#define MAP2(NAME) TENSORMAP2 NAME(buffers.NAME.data(), buffers.NAME.dimension(0), batchSize)
-
-  MAP4(trunk);
-  MAP2(policyPass);
-  MAP4(policy);
-  MAP2(value);
-  MAP2(scoreValue);
-  MAP4(ownership);
-  MAP3(mask);
-  vector<float>& maskSum = buffers.maskSum;
-  computeMaskSum(&mask,maskSum.data());
-  vector<float>& convWorkspace = buffers.convWorkspace;
-
-  computeHandle->model.apply(
-    &computeHandle->handleInternal,
-    computeHandle->scratch.get(),
-    &input,
-    &inputGlobal,
-    &trunk,
-    &policyPass,
-    &policy,
-    &value,
-    &scoreValue,
-    &ownership,
-    &mask,
-    maskSum.data(),
-    convWorkspace.data()
-  );
+  computeHandle->handleInternal.useDirectConv = batchSize <= computeHandle->handleInternal.directConvMaxBatchSize;
+  computeHandle->evaluate(inputBuffers->spatialInput.data(), inputBuffers->globalInput.data(), batchSize);
 
   assert(outputs.size() == batchSize);
 
-  float* policyData = policy.data();
-  float* policyPassData = policyPass.data();
-  float* valueData = value.data();
-  float* scoreValueData = scoreValue.data();
-  float* ownershipData = ownership.data();
+  Buffers& buffers = *(computeHandle->buffers);
+  float* policyData = buffers.policy.data();
+  float* policyPassData = buffers.policyPass.data();
+  float* valueData = buffers.value.data();
+  float* scoreValueData = buffers.scoreValue.data();
+  float* ownershipData = buffers.ownership.data();
 
   for(int row = 0; row < batchSize; row++) {
     NNOutput* output = outputs[row];
@@ -1805,9 +2306,9 @@ bool NeuralNet::testEvaluateConv(
   const std::vector<float>& inputBuffer,
   std::vector<float>& outputBuffer
 ) {
-  if(!useNHWC || useFP16)
+  if(!useNHWC)
     return false;
-  ConvLayer layer(*desc,nnXLen,nnYLen);
+  ConvLayer layer(*desc,nnXLen,nnYLen,useFP16);
   TENSORMAP4 inTensor(
     (float*)inputBuffer.data(), desc->inChannels, nnXLen, nnYLen, batchSize);
   TENSOR4 outTensorBuf(desc->outChannels, nnXLen, nnYLen, batchSize);
@@ -1815,8 +2316,8 @@ bool NeuralNet::testEvaluateConv(
   size_t convWorkspaceElts = layer.requiredConvWorkspaceElts(batchSize);
   vector<float> convWorkspace(convWorkspaceElts);
 
-  ComputeContext ctx(nnXLen,nnYLen);
-  ComputeHandleInternal handle(&ctx);
+  ComputeContext ctx(nnXLen,nnYLen,useFP16);
+  ComputeHandleInternal handle(&ctx,true);
   layer.apply(&handle, &inTensor, &outTensor, convWorkspace.data(), false);
 
   outputBuffer.resize(outTensorBuf.size());
@@ -1866,9 +2367,9 @@ bool NeuralNet::testEvaluateResidualBlock(
   const std::vector<float>& maskBuffer,
   std::vector<float>& outputBuffer
 ) {
-  if(!useNHWC || useFP16)
+  if(!useNHWC)
     return false;
-  ResidualBlock block(*desc,nnXLen,nnYLen);
+  ResidualBlock block(*desc,nnXLen,nnYLen,useFP16);
   TENSORMAP4 inTensor((float*)inputBuffer.data(), desc->preBN.numChannels, nnXLen, nnYLen, batchSize);
   TENSORMAP3 mask((float*)maskBuffer.data(), nnXLen, nnYLen, batchSize);
   size_t convWorkspaceElts = block.requiredConvWorkspaceElts(batchSize);
@@ -1886,9 +2387,10 @@ bool NeuralNet::testEvaluateResidualBlock(
 
   trunk = inTensor;
 
-  ComputeContext ctx(nnXLen,nnYLen);
-  ComputeHandleInternal handle(&ctx);
+  ComputeContext ctx(nnXLen,nnYLen,useFP16);
+  ComputeHandleInternal handle(&ctx,true);
   ScratchBuffers scratch(batchSize, nnXLen, nnYLen);
+  scratch.allocateArena(block.requiredScratchBytes(&scratch),false);
   block.apply(
     &handle,
     &scratch,
@@ -1914,10 +2416,10 @@ bool NeuralNet::testEvaluateGlobalPoolingResidualBlock(
   const std::vector<float>& inputBuffer,
   const std::vector<float>& maskBuffer,
   std::vector<float>& outputBuffer) {
-  if(!useNHWC || useFP16)
+  if(!useNHWC)
     return false;
 
-  GlobalPoolingResidualBlock block(*desc,nnXLen,nnYLen);
+  GlobalPoolingResidualBlock block(*desc,nnXLen,nnYLen,useFP16);
 
   TENSORMAP4 inTensor((float*)inputBuffer.data(), desc->preBN.numChannels, nnXLen, nnYLen, batchSize);
   TENSORMAP3 mask((float*)maskBuffer.data(), nnXLen, nnYLen, batchSize);
@@ -1947,9 +2449,10 @@ bool NeuralNet::testEvaluateGlobalPoolingResidualBlock(
 
   trunk = inTensor;
 
-  ComputeContext ctx(nnXLen,nnYLen);
-  ComputeHandleInternal handle(&ctx);
+  ComputeContext ctx(nnXLen,nnYLen,useFP16);
+  ComputeHandleInternal handle(&ctx,true);
   ScratchBuffers scratch(batchSize, nnXLen, nnYLen);
+  scratch.allocateArena(block.requiredScratchBytes(&scratch),false);
   block.apply(
     &handle,
     &scratch,
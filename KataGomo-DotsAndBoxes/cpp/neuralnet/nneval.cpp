@@ -1,5 +1,6 @@
 #include "../neuralnet/nneval.h"
 #include "../neuralnet/modelversion.h"
+#include "../core/threadplacement.h"
 #include "../game/gamelogic.h"
 
 using namespace std;
@@ -19,7 +20,11 @@ NNResultBuf::NNResultBuf()
     result(nullptr),
     errorLogLockout(false),
     // If no symmetry is specified, it will use default or random based on config.
-    symmetry(NNInputs::SYMMETRY_NOTSPECIFIED)
+    symmetry(NNInputs::SYMMETRY_NOTSPECIFIED),
+    nnHash(),
+    postprocessPla(C_EMPTY),
+    postprocessPolicyInvTemperature(1.0f),
+    postprocessWinnerBeforeNN(C_WALL)
 {}
 
 NNResultBuf::~NNResultBuf() {
@@ -71,6 +76,7 @@ NNEvaluator::NNEvaluator(
   const string& openCLTunerFile,
   const string& homeDataDirOverride,
   bool openCLReTunePerBoardSize,
+  int eigenDirectConvMaxBatchSize,
   enabled_t useFP16Mode,
   enabled_t useNHWCMode,
   int numThr,
@@ -96,6 +102,8 @@ NNEvaluator::NNEvaluator(
    loadedModel(NULL),
    nnCacheTable(NULL),
    logger(lg),
+   traceRecorder(),
+   traceReplayer(),
    numServerThreadsEverSpawned(0),
    serverThreads(),
    maxNumRows(maxBatchSize),
@@ -160,7 +168,7 @@ NNEvaluator::NNEvaluator(
     inputsVersion = NNModelVersion::getInputsVersion(modelVersion);
     computeContext = NeuralNet::createComputeContext(
       gpuIdxs,logger,nnXLen,nnYLen,
-      openCLTunerFile,homeDataDirOverride,openCLReTunePerBoardSize,
+      openCLTunerFile,homeDataDirOverride,openCLReTunePerBoardSize,eigenDirectConvMaxBatchSize,
       usingFP16Mode,usingNHWCMode,loadedModel
     );
   }
@@ -198,6 +206,14 @@ NNEvaluator::~NNEvaluator() {
   loadedModel = NULL;
 
   delete nnCacheTable;
+
+  if(logger != NULL && traceRecorder != nullptr)
+    logger->write("NN trace recorded " + Global::uint64ToString(traceRecorder->numRecorded()) + " positions");
+  if(logger != NULL && traceReplayer != nullptr)
+    logger->write(
+      "NN trace replay had " + Global::uint64ToString(traceReplayer->numHits()) + " hits and " +
+      Global::uint64ToString(traceReplayer->numMisses()) + " misses"
+    );
 }
 
 string NNEvaluator::getModelName() const {
@@ -323,8 +339,11 @@ static void serveEvals(
   string randSeedThisThread,
   NNEvaluator* nnEval, const LoadedModel* loadedModel,
   int gpuIdxForThisThread,
-  int serverThreadIdx
+  int serverThreadIdx,
+  int numServerThreads
 ) {
+  //Before allocating anything, so that the buffers of this thread are on its own node
+  ThreadPlacement::pinNNServerThread(serverThreadIdx,numServerThreads);
   NNServerBuf* buf = new NNServerBuf(*nnEval,loadedModel);
   Rand rand(randSeedThisThread);
 
@@ -342,6 +361,26 @@ void NNEvaluator::setNumThreads(const vector<int>& gpuIdxByServerThr) {
   gpuIdxByServerThread = gpuIdxByServerThr;
 }
 
+void NNEvaluator::setTraceRecordFile(const string& fileName) {
+  if(serverThreads.size() != 0)
+    throw StringError("NNEvaluator::setTraceRecordFile called when threads were already running!");
+  if(debugSkipNeuralNet)
+    throw StringError("NNEvaluator: cannot record an nn trace without a neural net");
+  traceRecorder = std::make_unique<NNTraceRecorder>(fileName,nnXLen,nnYLen);
+  if(logger != NULL)
+    logger->write("Recording nn trace to " + fileName);
+}
+
+void NNEvaluator::setTraceReplayFile(const string& fileName, double batchLatencySeconds, double rowLatencySeconds) {
+  if(serverThreads.size() != 0)
+    throw StringError("NNEvaluator::setTraceReplayFile called when threads were already running!");
+  if(!debugSkipNeuralNet)
+    throw StringError("NNEvaluator: nn trace replay requires debugSkipNeuralNet");
+  traceReplayer = std::make_unique<NNTraceReplayer>(fileName,nnXLen,nnYLen,batchLatencySeconds,rowLatencySeconds);
+  if(logger != NULL)
+    logger->write("Replaying " + Global::uint64ToString(traceReplayer->size()) + " nn trace positions from " + fileName);
+}
+
 void NNEvaluator::spawnServerThreads() {
   if(serverThreads.size() != 0)
     throw StringError("NNEvaluator::spawnServerThreads called when threads were already running!");
@@ -357,7 +396,7 @@ void NNEvaluator::spawnServerThreads() {
     string randSeedThisThread = randSeed + ":NNEvalServerThread:" + Global::intToString(numServerThreadsEverSpawned);
     numServerThreadsEverSpawned++;
     std::thread* thread = new std::thread(
-      &serveEvals,randSeedThisThread,this,loadedModel,gpuIdxForThisThread,i
+      &serveEvals,randSeedThisThread,this,loadedModel,gpuIdxForThisThread,i,numThreads
     );
     serverThreads.push_back(thread);
   }
@@ -450,7 +489,28 @@ void NNEvaluator::serve(
     int defaultSymmetry = currentDefaultSymmetry;
     lock.unlock();
 
-    if(debugSkipNeuralNet) {
+    if(traceReplayer != nullptr) {
+      traceReplayer->simulateLatency(numRows);
+      m_numRowsProcessed.fetch_add(numRows, std::memory_order_relaxed);
+      m_numBatchesProcessed.fetch_add(1, std::memory_order_relaxed);
+      numRowsHandledThisThread += numRows;
+      numBatchesHandledThisThread += 1;
+
+      for(int row = 0; row < numRows; row++) {
+        assert(buf.resultBufs[row] != NULL);
+        NNResultBuf* resultBuf = buf.resultBufs[row];
+        buf.resultBufs[row] = NULL;
+
+        unique_lock<std::mutex> resultLock(resultBuf->resultMutex);
+        assert(resultBuf->hasResult == false);
+        resultBuf->result = std::make_shared<NNOutput>();
+        traceReplayer->fill(resultBuf->nnHash, resultBuf->boardXSizeForServer, resultBuf->boardYSizeForServer, *(resultBuf->result));
+        resultBuf->hasResult = true;
+        resultBuf->clientWaitingForResult.notify_all();
+        resultLock.unlock();
+      }
+    }
+    else if(debugSkipNeuralNet) {
       for(int row = 0; row < numRows; row++) {
         assert(buf.resultBufs[row] != NULL);
         NNResultBuf* resultBuf = buf.resultBufs[row];
@@ -590,6 +650,21 @@ void NNEvaluator::evaluate(
   const MiscNNInputParams& nnInputParams,
   NNResultBuf& buf,
   bool skipCache
+) {
+  if(prepareEvaluation(board,history,nextPlayer,nnInputParams,buf,skipCache))
+    return;
+  NNResultBuf* bufPtr = &buf;
+  queueEvaluations(&bufPtr,1);
+  waitForResult(buf);
+}
+
+bool NNEvaluator::prepareEvaluation(
+  Board& board,
+  const BoardHistory& history,
+  Player nextPlayer,
+  const MiscNNInputParams& nnInputParams,
+  NNResultBuf& buf,
+  bool skipCache
 ) {
   assert(!isKilled);
   buf.hasResult = false;
@@ -611,11 +686,12 @@ void NNEvaluator::evaluate(
   if(nnCacheTable != NULL && !skipCache && nnCacheTable->get(nnHash,buf.result)) {
     
     buf.hasResult = true;
-    return;
+    return true;
   }
 
   buf.boardXSizeForServer = board.x_size;
   buf.boardYSizeForServer = board.y_size;
+  buf.nnHash = nnHash;
 
   MiscNNInputParams nnInputParamsWithResultsBeforeNN = nnInputParams;
   nnInputParamsWithResultsBeforeNN.resultsBeforeNN.init(board, history, nextPlayer);
@@ -650,31 +726,65 @@ void NNEvaluator::evaluate(
 
   buf.symmetry = nnInputParams.symmetry;
 
+  //Record what postprocessing the result will need, since the board may be gone by the time the result arrives.
+  buf.postprocessPla = nextPlayer;
+  buf.postprocessPolicyInvTemperature = 1.0f / nnInputParams.nnPolicyTemperature;
+  GameLogic::ResultsBeforeNN resultsBeforeNN = nnInputParamsWithResultsBeforeNN.resultsBeforeNN;
+  buf.postprocessWinnerBeforeNN = resultsBeforeNN.winner;
+  if(resultsBeforeNN.myOnlyLoc == Board::NULL_LOC) {
+    for(int i = 0; i < policySize; i++) {
+      Loc loc = NNPos::posToLoc(i, board.x_size, board.y_size, nnXLen, nnYLen);
+      buf.postprocessIsLegal[i] = history.isLegal(board, loc, nextPlayer);
+    }
+  } 
+  else  // assume all other moves are illegal
+  {
+    for(int i = 0; i < policySize; i++) {
+      buf.postprocessIsLegal[i] = false;
+    }
+    buf.postprocessIsLegal[NNPos::locToPos(resultsBeforeNN.myOnlyLoc, board.x_size, nnXLen, nnYLen)] = true;
+    buf.postprocessIsLegal[NNPos::locToPos(Board::PASS_LOC, board.x_size, nnXLen, nnYLen)] = true;
+  }
+  return false;
+}
+
+void NNEvaluator::queueEvaluations(NNResultBuf* const* bufs, int numBufs) {
   unique_lock<std::mutex> lock(bufferMutex);
 
-  m_resultBufss[m_currentResultBufsIdx][m_currentResultBufsLen] = &buf;
-  m_currentResultBufsLen += 1;
-  if(m_currentResultBufsLen == 1 && m_currentResultBufsIdx == m_oldestResultBufsIdx)
-    serverWaitingForBatchStart.notify_one();
+  for(int i = 0; i<numBufs; i++) {
+    m_resultBufss[m_currentResultBufsIdx][m_currentResultBufsLen] = bufs[i];
+    m_currentResultBufsLen += 1;
+    if(m_currentResultBufsLen == 1 && m_currentResultBufsIdx == m_oldestResultBufsIdx)
+      serverWaitingForBatchStart.notify_one();
 
-  bool overlooped = false;
-  if(m_currentResultBufsLen >= maxNumRows) {
-    m_currentResultBufsLen = 0;
-    m_currentResultBufsIdx = (m_currentResultBufsIdx + 1) & numResultBufssMask;
-    overlooped = m_currentResultBufsIdx == m_oldestResultBufsIdx;
+    bool overlooped = false;
+    if(m_currentResultBufsLen >= maxNumRows) {
+      m_currentResultBufsLen = 0;
+      m_currentResultBufsIdx = (m_currentResultBufsIdx + 1) & numResultBufssMask;
+      overlooped = m_currentResultBufsIdx == m_oldestResultBufsIdx;
+    }
+
+    //This should only fire if we have more than maxConcurrentEvals evaluating, such that they wrap the
+    //circular buffer.
+    assert(!overlooped);
+    (void)overlooped; //Avoid unused variable when asserts disabled
   }
-  lock.unlock();
+}
 
-  //This should only fire if we have more than maxConcurrentEvals evaluating, such that they wrap the
-  //circular buffer.
-  assert(!overlooped);
-  (void)overlooped; //Avoid unused variable when asserts disabled
+bool NNEvaluator::isResultReady(NNResultBuf& buf) {
+  lock_guard<std::mutex> resultLock(buf.resultMutex);
+  return buf.hasResult;
+}
 
+void NNEvaluator::waitForResult(NNResultBuf& buf) {
   unique_lock<std::mutex> resultLock(buf.resultMutex);
   while(!buf.hasResult)
     buf.clientWaitingForResult.wait(resultLock);
   resultLock.unlock();
 
+  if(traceRecorder != nullptr)
+    traceRecorder->record(buf.nnHash, *buf.result);
+
   //Perform postprocessing on the result - turn the nn output into probabilities
   //As a hack though, if the only thing we were missing was the ownermap, just grab the old policy and values
   //and use those. This avoids recomputing in a randomly different orientation when we just need the ownermap
@@ -683,31 +793,13 @@ void NNEvaluator::evaluate(
   
     float* policy = buf.result->policyProbs;
 
-    float nnPolicyInvTemperature = 1.0f / nnInputParams.nnPolicyTemperature;
-
-    int xSize = board.x_size;
-    int ySize = board.y_size;
+    float nnPolicyInvTemperature = buf.postprocessPolicyInvTemperature;
+    const bool* isLegal = buf.postprocessIsLegal;
+    const Player nextPlayer = buf.postprocessPla;
 
     float maxPolicy = -1e25f;
-    bool isLegal[NNPos::MAX_NN_POLICY_SIZE];
     int legalCount = 0;
 
-    GameLogic::ResultsBeforeNN resultsBeforeNN = nnInputParamsWithResultsBeforeNN.resultsBeforeNN;
-    if(resultsBeforeNN.myOnlyLoc == Board::NULL_LOC) {
-      for(int i = 0; i < policySize; i++) {
-        Loc loc = NNPos::posToLoc(i, xSize, ySize, nnXLen, nnYLen);
-        isLegal[i] = history.isLegal(board, loc, nextPlayer);
-      }
-    } 
-    else  // assume all other moves are illegal
-    {
-      for(int i = 0; i < policySize; i++) {
-        isLegal[i] = false;
-      }
-      isLegal[NNPos::locToPos(resultsBeforeNN.myOnlyLoc, xSize, nnXLen, nnYLen)] = true;
-      isLegal[NNPos::locToPos(Board::PASS_LOC, xSize, nnXLen, nnYLen)] = true;
-    }
-
     for(int i = 0; i<policySize; i++) {
       float policyValue;
       if(isLegal[i]) {
@@ -731,8 +823,7 @@ void NNEvaluator::evaluate(
     }
 
     if(!isfinite(policySum)) {
-      cout << "Got nonfinite for policy sum" << endl;
-      history.printDebugInfo(cout,board);
+      cout << "Got nonfinite for policy sum, nnHash " << buf.nnHash.toString() << endl;
       throw StringError("Got nonfinite for policy sum");
     }
 
@@ -774,17 +865,17 @@ void NNEvaluator::evaluate(
         double shorttermWinlossErrorPreSoftplus = buf.result->shorttermWinlossError;
 
         
-        if(resultsBeforeNN.winner == C_EMPTY) {  // draw
+        if(buf.postprocessWinnerBeforeNN == C_EMPTY) {  // draw
           winProb = 0.5;
           lossProb = 0.5;
           noResultProb = 0.0;
         } 
-        else if(resultsBeforeNN.winner == nextPlayer) {  // next player win
+        else if(buf.postprocessWinnerBeforeNN == nextPlayer) {  // next player win
           winProb = 1.0;
           lossProb = 0.0;
           noResultProb = 0.0;
         } 
-        else if(resultsBeforeNN.winner == getOpp(nextPlayer)) {  // opp win
+        else if(buf.postprocessWinnerBeforeNN == getOpp(nextPlayer)) {  // opp win
           winProb = 0.0;
           lossProb = 1.0;
           noResultProb = 0.0;
@@ -857,7 +948,7 @@ void NNEvaluator::evaluate(
 
 
   //And record the nnHash in the result and put it into the table
-  buf.result->nnHash = nnHash;
+  buf.result->nnHash = buf.nnHash;
   if(nnCacheTable != NULL)
     nnCacheTable->set(buf.result);
 
@@ -885,7 +976,11 @@ NNCacheTable::NNCacheTable(int sizePowerOfTwo, int mutexPoolSizePowerOfTwo) {
 
   tableSize = ((uint64_t)1) << sizePowerOfTwo;
   tableMask = tableSize-1;
-  entries = new Entry[tableSize];
+  {
+    //Every search thread looks up the cache, so don't put it all on one node
+    ThreadPlacement::InterleavedAllocation interleaved;
+    entries = new Entry[tableSize];
+  }
   uint32_t mutexPoolSize = ((uint32_t)1) << mutexPoolSizePowerOfTwo;
   mutexPoolMask = mutexPoolSize-1;
   mutexPool = new MutexPool(mutexPoolSize);
@@ -11,6 +11,7 @@
 #include "../game/boardhistory.h"
 #include "../neuralnet/nninputs.h"
 #include "../neuralnet/nninterface.h"
+#include "../neuralnet/nntrace.h"
 #include "../search/mutexpool.h"
 
 class NNEvaluator;
@@ -55,6 +56,13 @@ struct NNResultBuf {
   std::shared_ptr<NNOutput> result;
   bool errorLogLockout; //error flag to restrict log to 1 error to prevent spam
   int symmetry; //The symmetry to use for this eval
+  Hash128 nnHash; //The hash of the position being evaluated
+
+  //What postprocessing the result needs, recorded when the evaluation is prepared
+  Player postprocessPla;
+  float postprocessPolicyInvTemperature;
+  Color postprocessWinnerBeforeNN;
+  bool postprocessIsLegal[NNPos::MAX_NN_POLICY_SIZE];
 
   NNResultBuf();
   ~NNResultBuf();
@@ -92,6 +100,7 @@ class NNEvaluator {
     const std::string& openCLTunerFile,
     const std::string& homeDataDirOverride,
     bool openCLReTunePerBoardSize,
+    int eigenDirectConvMaxBatchSize,
     enabled_t useFP16Mode,
     enabled_t useNHWCMode,
     int numThreads,
@@ -142,6 +151,24 @@ class NNEvaluator {
     bool skipCache
   );
 
+  //The same as evaluate, in steps, so that a client can have several evaluations in flight at once.
+  //prepareEvaluation fills in buf for the position and returns true if the result was found in the cache, in which
+  //case it's already in buf. Otherwise, after queueEvaluations, waitForResult waits for and postprocesses the result.
+  //Queueing several bufs in one call puts them in the same batch as far as possible. Every queued buf must be waited
+  //on before it's reused or destroyed. These functions are threadsafe, for different bufs.
+  bool prepareEvaluation(
+    Board& board,
+    const BoardHistory& history,
+    Player nextPlayer,
+    const MiscNNInputParams& nnInputParams,
+    NNResultBuf& buf,
+    bool skipCache
+  );
+  void queueEvaluations(NNResultBuf* const* bufs, int numBufs);
+  void waitForResult(NNResultBuf& buf);
+  //Never blocks. Returns true if the result for a queued buf has arrived, so that waitForResult won't need to wait.
+  bool isResultReady(NNResultBuf& buf);
+
   //If there is at least one evaluate ongoing, wait until at least one finishes.
   //Returns immediately if there isn't one ongoing right now.
   void waitForNextNNEvalIfAny();
@@ -162,6 +189,12 @@ class NNEvaluator {
   //After spawnServerThreads has returned, check if is was using FP16.
   bool isAnyThreadUsingFP16() const;
 
+  //Record the raw output of every evaluation to a trace file, see nntrace.h. Requires a real neural net.
+  //Replay serves evaluations from a previously recorded trace instead, which requires debugSkipNeuralNet.
+  //Only call these if threads are not spawned yet, or have been killed.
+  void setTraceRecordFile(const std::string& fileName);
+  void setTraceReplayFile(const std::string& fileName, double batchLatencySeconds, double rowLatencySeconds);
+
   //These are thread-safe. Setting them in the middle of operation might only affect future
   //neural net evals, rather than any in-flight.
   bool getDoRandomize() const;
@@ -196,6 +229,9 @@ class NNEvaluator {
   NNCacheTable* nnCacheTable;
   Logger* logger;
 
+  std::unique_ptr<NNTraceRecorder> traceRecorder;
+  std::unique_ptr<NNTraceReplayer> traceReplayer;
+
   int modelVersion;
   int inputsVersion;
 
@@ -61,6 +61,8 @@ namespace NeuralNet {
     const std::string& openCLTunerFile,
     const std::string& homeDataDirOverride,
     bool openCLReTunePerBoardSize,
+    //Eigen only. Batches up to this size use direct 3x3 convolution instead of winograd, -1 to time it at startup.
+    int eigenDirectConvMaxBatchSize,
     enabled_t useFP16Mode,
     enabled_t useNHWCMode,
     const LoadedModel* loadedModel
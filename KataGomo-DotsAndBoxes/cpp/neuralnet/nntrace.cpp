@@ -0,0 +1,166 @@
+#include "../neuralnet/nntrace.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "../core/fileutils.h"
+#include "../core/rand.h"
+#include "../game/board.h"
+
+using namespace std;
+
+static const char TRACE_MAGIC[8] = {'K','G','N','N','T','R','C','1'};
+static constexpr size_t RECORD_HEADER_BYTES = 2 * sizeof(uint64_t) + 2 * sizeof(int32_t);
+static constexpr int NUM_VALUE_FLOATS = 5;
+
+int NNTrace::numFloatsPerRecord(int nnXLen, int nnYLen) {
+  return NUM_VALUE_FLOATS + nnXLen * nnYLen + 1;
+}
+
+//------------------------------------------------------------------------------------
+
+NNTraceRecorder::NNTraceRecorder(const string& fileName, int xLen, int yLen)
+  :nnXLen(xLen),
+   nnYLen(yLen),
+   out(),
+   recordBuf(NNTrace::numFloatsPerRecord(xLen,yLen)),
+   mutex(),
+   recordedHashes()
+{
+  FileUtils::open(out, fileName, ios::out | ios::binary | ios::app);
+  out.seekp(0, ios::end);
+  if(out.tellp() == 0)
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  if(!out.good())
+    throw IOError("Could not write nn trace to " + fileName);
+}
+
+NNTraceRecorder::~NNTraceRecorder() {
+  out.close();
+}
+
+void NNTraceRecorder::record(Hash128 nnHash, const NNOutput& rawOutput) {
+  assert(rawOutput.nnXLen == nnXLen);
+  assert(rawOutput.nnYLen == nnYLen);
+  lock_guard<std::mutex> lock(mutex);
+  if(!recordedHashes.insert(nnHash).second)
+    return;
+
+  recordBuf[0] = rawOutput.whiteWinProb;
+  recordBuf[1] = rawOutput.whiteLossProb;
+  recordBuf[2] = rawOutput.whiteNoResultProb;
+  recordBuf[3] = rawOutput.varTimeLeft;
+  recordBuf[4] = rawOutput.shorttermWinlossError;
+  std::copy(rawOutput.policyProbs, rawOutput.policyProbs + nnXLen * nnYLen + 1, recordBuf.begin() + NUM_VALUE_FLOATS);
+
+  uint64_t hashes[2] = {nnHash.hash0, nnHash.hash1};
+  int32_t dims[2] = {nnXLen, nnYLen};
+  out.write((const char*)hashes, sizeof(hashes));
+  out.write((const char*)dims, sizeof(dims));
+  out.write((const char*)recordBuf.data(), sizeof(float) * recordBuf.size());
+  if(!out.good())
+    throw IOError("Failed writing nn trace record");
+}
+
+uint64_t NNTraceRecorder::numRecorded() const {
+  lock_guard<std::mutex> lock(mutex);
+  return recordedHashes.size();
+}
+
+//------------------------------------------------------------------------------------
+
+NNTraceReplayer::NNTraceReplayer(const string& fileName, int xLen, int yLen, double batchLatency, double rowLatency)
+  :nnXLen(xLen),
+   nnYLen(yLen),
+   batchLatencySeconds(batchLatency),
+   rowLatencySeconds(rowLatency),
+   data(),
+   offsetByHash(),
+   hits(0),
+   misses(0)
+{
+  string buf = FileUtils::readFileBinary(fileName);
+  if(buf.size() < sizeof(TRACE_MAGIC) || memcmp(buf.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+    throw IOError("Not a valid nn trace file: " + fileName);
+
+  const size_t floatsPerRecord = NNTrace::numFloatsPerRecord(nnXLen,nnYLen);
+  size_t pos = sizeof(TRACE_MAGIC);
+  while(pos < buf.size()) {
+    if(buf.size() - pos < RECORD_HEADER_BYTES)
+      throw IOError("nn trace file is truncated: " + fileName);
+    uint64_t hashes[2];
+    int32_t dims[2];
+    memcpy(hashes, buf.data() + pos, sizeof(hashes));
+    memcpy(dims, buf.data() + pos + sizeof(hashes), sizeof(dims));
+    if(dims[0] <= 0 || dims[1] <= 0 || dims[0] > NNPos::MAX_BOARD_LEN || dims[1] > NNPos::MAX_BOARD_LEN)
+      throw IOError("nn trace file is corrupt: " + fileName);
+    const size_t recordFloats = NNTrace::numFloatsPerRecord(dims[0],dims[1]);
+    if(buf.size() - pos - RECORD_HEADER_BYTES < sizeof(float) * recordFloats)
+      throw IOError("nn trace file is truncated: " + fileName);
+
+    if(dims[0] == nnXLen && dims[1] == nnYLen) {
+      size_t offset = data.size();
+      data.resize(offset + floatsPerRecord);
+      memcpy(data.data() + offset, buf.data() + pos + RECORD_HEADER_BYTES, sizeof(float) * floatsPerRecord);
+      offsetByHash[Hash128(hashes[0],hashes[1])] = offset;
+    }
+    pos += RECORD_HEADER_BYTES + sizeof(float) * recordFloats;
+  }
+}
+
+NNTraceReplayer::~NNTraceReplayer()
+{}
+
+bool NNTraceReplayer::fill(Hash128 nnHash, int boardXSize, int boardYSize, NNOutput& output) {
+  output.nnXLen = nnXLen;
+  output.nnYLen = nnYLen;
+  float* policyProbs = output.policyProbs;
+  for(int i = 0; i<NNPos::MAX_NN_POLICY_SIZE; i++)
+    policyProbs[i] = 0;
+
+  auto iter = offsetByHash.find(nnHash);
+  if(iter != offsetByHash.end()) {
+    const float* record = data.data() + iter->second;
+    output.whiteWinProb = record[0];
+    output.whiteLossProb = record[1];
+    output.whiteNoResultProb = record[2];
+    output.varTimeLeft = record[3];
+    output.shorttermWinlossError = record[4];
+    std::copy(record + NUM_VALUE_FLOATS, record + NUM_VALUE_FLOATS + nnXLen * nnYLen + 1, policyProbs);
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  //Same distribution as debugSkipNeuralNet in NNEvaluator, but seeded by the hash.
+  Rand rand(nnHash.hash0 ^ nnHash.hash1);
+  for(int y = 0; y<boardYSize; y++) {
+    for(int x = 0; x<boardXSize; x++) {
+      int pos = NNPos::xyToPos(x,y,nnXLen);
+      policyProbs[pos] = (float)rand.nextGaussian();
+    }
+  }
+  policyProbs[NNPos::locToPos(Board::PASS_LOC,boardXSize,nnXLen,nnYLen)] = (float)rand.nextGaussian();
+  output.whiteWinProb = (float)(rand.nextGaussian() * 0.20);
+  output.whiteLossProb = (float)(rand.nextGaussian() * 0.20);
+  output.whiteNoResultProb = (float)(rand.nextGaussian() * 0.20);
+  output.varTimeLeft = (float)(0.5 * boardXSize * boardYSize);
+  output.shorttermWinlossError = 0.0f;
+  misses.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void NNTraceReplayer::simulateLatency(int numRows) const {
+  double seconds = batchLatencySeconds + rowLatencySeconds * numRows;
+  if(seconds > 0)
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+size_t NNTraceReplayer::size() const {
+  return offsetByHash.size();
+}
+uint64_t NNTraceReplayer::numHits() const {
+  return hits.load(std::memory_order_relaxed);
+}
+uint64_t NNTraceReplayer::numMisses() const {
+  return misses.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,82 @@
+#ifndef NEURALNET_NNTRACE_H_
+#define NEURALNET_NNTRACE_H_
+
+#include <fstream>
+#include <unordered_map>
+
+#include "../core/global.h"
+#include "../core/hash.h"
+#include "../core/multithread.h"
+#include "../neuralnet/nninputs.h"
+
+//Recording and replay of raw neural net outputs, keyed by nnHash, so that search can be benchmarked with realistic
+//policies and values on machines with no GPU and no model.
+//
+//File format (native endianness): the 8 byte magic "KGNNTRC1", followed by records of uint64 hash0, uint64 hash1,
+//int32 nnXLen, int32 nnYLen, float whiteWin, whiteLoss, whiteNoResult, varTimeLeft, shorttermWinlossError (all as the
+//raw pre-postprocessing net outputs), then nnXLen*nnYLen+1 float policy logits.
+//Recording appends to an existing trace, so one file can collect several runs and nn sizes, e.g. a GTP session that
+//recreates its nn evaluator whenever the board size changes. Replay only uses the records matching its nn size.
+
+namespace NNTrace {
+  int numFloatsPerRecord(int nnXLen, int nnYLen);
+}
+
+class NNTraceRecorder {
+ public:
+  NNTraceRecorder(const std::string& fileName, int nnXLen, int nnYLen);
+  ~NNTraceRecorder();
+
+  NNTraceRecorder(const NNTraceRecorder& other) = delete;
+  NNTraceRecorder& operator=(const NNTraceRecorder& other) = delete;
+
+  //Threadsafe. Records the raw output of the net for nnHash, unless that hash was already recorded by this recorder.
+  void record(Hash128 nnHash, const NNOutput& rawOutput);
+  uint64_t numRecorded() const;
+
+ private:
+  const int nnXLen;
+  const int nnYLen;
+  std::ofstream out;
+  std::vector<float> recordBuf;
+
+  mutable std::mutex mutex;
+  std::set<Hash128> recordedHashes;
+};
+
+class NNTraceReplayer {
+ public:
+  //Each batch served sleeps for batchLatencySeconds + rowLatencySeconds * numRows, as a crude model of nn eval cost.
+  NNTraceReplayer(const std::string& fileName, int nnXLen, int nnYLen, double batchLatencySeconds, double rowLatencySeconds);
+  ~NNTraceReplayer();
+
+  NNTraceReplayer(const NNTraceReplayer& other) = delete;
+  NNTraceReplayer& operator=(const NNTraceReplayer& other) = delete;
+
+  //Threadsafe. Fills the raw output for nnHash from the trace. On a miss, fills a pseudo-random output that
+  //depends only on nnHash and the board size, so repeated runs stay deterministic. Returns true on a hit.
+  bool fill(Hash128 nnHash, int boardXSize, int boardYSize, NNOutput& output);
+  void simulateLatency(int numRows) const;
+
+  size_t size() const;
+  uint64_t numHits() const;
+  uint64_t numMisses() const;
+
+ private:
+  struct HashHasher {
+    size_t operator()(const Hash128& h) const { return (size_t)h.hash0; }
+  };
+
+  const int nnXLen;
+  const int nnYLen;
+  const double batchLatencySeconds;
+  const double rowLatencySeconds;
+
+  std::vector<float> data;
+  std::unordered_map<Hash128, size_t, HashHasher> offsetByHash;
+
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+};
+
+#endif  // NEURALNET_NNTRACE_H_
@@ -441,10 +441,12 @@ ComputeContext* NeuralNet::createComputeContext(
   const string& openCLTunerFile,
   const string& homeDataDirOverride,
   bool openCLReTunePerBoardSize,
+  int eigenDirectConvMaxBatchSize,
   enabled_t useFP16Mode,
   enabled_t useNHWCMode,
   const LoadedModel* loadedModel
 ) {
+  (void)eigenDirectConvMaxBatchSize;
   if(gpuIdxs.size() <= 0)
     throw StringError("NeuralNet::createComputeContext - specified no gpus to use");
 
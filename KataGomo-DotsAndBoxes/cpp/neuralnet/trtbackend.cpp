@@ -56,6 +56,7 @@ ComputeContext* NeuralNet::createComputeContext(
   const string& openCLTunerFile,
   const string& homeDataDirOverride,
   bool openCLReTunePerBoardSize,
+  int eigenDirectConvMaxBatchSize,
   enabled_t useFP16Mode,
   enabled_t useNHWCMode,
   const LoadedModel* loadedModel) {
@@ -63,6 +64,7 @@ ComputeContext* NeuralNet::createComputeContext(
   (void)logger;
   (void)openCLTunerFile;
   (void)openCLReTunePerBoardSize;
+  (void)eigenDirectConvMaxBatchSize;
   (void)loadedModel;
 
   if(useNHWCMode == enabled_t::True) {
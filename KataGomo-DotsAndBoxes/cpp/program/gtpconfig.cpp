@@ -227,6 +227,24 @@ $$MAX_TIME
 # Ponder on the opponent's turn?
 $$PONDERING
 
+# Limit on the memory of the search tree, in bytes. When the tree grows past
+# this, such as in long ponders or analysis, its least visited parts are
+# trimmed away, keeping what they contributed to the values above them.
+# If commented out or unspecified, the default is to have no limit.
+# maxSearchMemoryBytes = 4000000000
+
+# Stop searching early once more visits are unlikely to change the move.
+# Every earlyStopCheckInterval visits, KataGo measures how much the root's
+# distribution of visits among the moves has shifted since the last check,
+# as KL divergence per visit, and stops if that is below
+# earlyStopKLGainThreshold and the most visited move is unchanged.
+# Larger thresholds stop sooner, values around 0.00001 to 0.0001 are typical.
+# Doesn't apply to pondering. If commented out or unspecified, the default is
+# to never stop early.
+# earlyStopKLGainThreshold = 0.00005
+# earlyStopCheckInterval = 100
+# earlyStopMinVisits = 100
+
 # ------------------------------
 # Other search limits and behavior
 # ------------------------------
@@ -238,6 +256,47 @@ lagBuffer = 1.0
 # Number of threads to use in search
 numSearchThreads = $$NUM_SEARCH_THREADS
 
+# Number of leaves each search thread collects before sending them to the
+# neural net together. Raising this keeps big neural net batches full with
+# fewer search threads, such as on machines with few cores, at some cost in
+# search quality from the extra virtual losses.
+# numLeavesPerSearchThread = 1
+# Instead of waiting for each group of leaves to come back before starting the
+# next, keep that many playouts in flight per thread at all times and start a
+# new one whenever any finishes. Keeps the neural net busier still.
+# useAsyncLeafPlayouts = false
+
+# After each move, free the part of the search tree that is no longer reachable
+# on a background thread, mostly alongside the next search, rather than before
+# acknowledging the move. Makes "play" respond faster after big searches.
+# useBackgroundTreeCollection = false
+
+# Search reproducibly, for comparing the speed of builds or settings with the
+# exact same work. Playouts run in synchronous waves of numSearchThreads *
+# numLeavesPerSearchThread leaves, selected one after another by one thread,
+# evaluated as one neural net batch with a fixed symmetry and backed up in
+# order. With searchRandSeed fixed and only visit or playout limits, searches
+# are then identical for the same settings, but slower than usual. Unless
+# eigenDirectConvMaxBatchSize is set, the Eigen backend then always uses
+# winograd rather than timing which convolution to use.
+# "katago benchmark" prints a hash of the search trees in this mode.
+# useDeterministicWaves = false
+
+# Thread placement, mostly for machines with several CPU sockets (NUMA nodes).
+# Linux only. "numa" pins each thread to one node, search threads filling
+# node after node and neural net server threads spread over them. "cores" pins
+# each to a single cpu. Searches running at the same time, such as the games
+# of a match, take cpus one after another.
+# Buffers of pinned threads are then allocated on their own node. Restrict to
+# some nodes with numaNodes, otherwise all nodes KataGo may run on are used.
+# interleaveSharedTables spreads the neural net cache and the node table,
+# which all threads use, across the nodes. Compare the speed with and
+# without all this using "katago benchmark -compare-thread-placement".
+# searchThreadAffinity = none
+# nnServerThreadAffinity = none
+# numaNodes = 0,1
+# interleaveSharedTables = false
+
 # Play a little faster if the opponent is passing, for human-friendliness.
 # Comment these out to disable them, such as if running a controlled match
 # where you are testing KataGo with fixed compute per move vs other bots.
@@ -250,6 +309,19 @@ searchFactorAfterTwoPass = 0.25
 searchFactorWhenWinning = 0.40
 searchFactorWhenWinningThreshold = 0.95
 
+# Root parallel search - also search each genmove in separate worker
+# processes, each with its own neural net and search tree, and count their
+# visits along with KataGo's own when choosing the move. Start workers with
+# "katago rootparallelworker" with the same config (and for example numactl
+# to put each on its own NUMA node), and they connect to KataGo on this local
+# Unix socket, at any time. If commented out, no workers are used.
+# rootParallelSocket = /tmp/katago-rootparallel.sock
+# How often workers report their root results, in seconds.
+# rootParallelReportPeriod = 0.5
+# How long to wait for workers to stop and send final results, in seconds,
+# before using the last results they reported.
+# rootParallelStopTimeout = 2.0
+
 # ===========================================================================
 # GPU settings
 # ===========================================================================
@@ -275,6 +347,17 @@ nnCacheSizePowerOfTwo = $$NN_CACHE_SIZE_POWER_OF_TWO
 # Size of mutex pool for nnCache is (2 ** this).
 nnMutexPoolSizePowerOfTwo = $$NN_MUTEX_POOL_SIZE_POWER_OF_TWO
 
+# Eigen (CPU) backend only. Batches of at most this many positions use direct
+# 3x3 convolution rather than winograd, which is faster for small batches.
+# By default (-1) this is timed once at startup, which may choose differently
+# from one run to the next. 0 always uses winograd, which is the default
+# with useDeterministicWaves.
+# eigenDirectConvMaxBatchSize = -1
+
+# Eigen (CPU) backend only. Store the convolution and matmul weights in
+# float16, halving their memory. Computation is still done in float32.
+# eigenUseFP16 = false
+
 $$MULTIPLE_GPUS
 
 # ===========================================================================
@@ -387,15 +470,47 @@ $$MULTIPLE_GPUS
 # transpositions.
 # useGraphSearch = true
 
-# How much to shard the node table for search synchronization
+# How many mutexes to use for search node synchronization
 # nodeTableShardsPowerOfTwo = 16
 
+# Solve positions with at most this many undrawn edges exactly with
+# alpha-beta when search reaches them, instead of evaluating them with the
+# neural net. 0 disables. Around 12-16 is cheap, higher values may need a larger
+# node limit, past which search falls back to the neural net.
+# Each search thread has its own solver table of
+# 16 * 2^endgameSolverTableSizePowerOfTwo bytes.
+# endgameSolverMaxEmptyEdges = 0
+# endgameSolverMaxNodes = 100000
+# endgameSolverTableSizePowerOfTwo = 16
+
+# Within the search tree, follow every move by all the box captures that can
+# be taken with no possible loss, so that a whole run of captures is searched as
+# a single move. The choice of whether to double-deal at the end of a chain or
+# loop is still searched. PVs are reported expanded back into single moves.
+# useCaptureMacroMoves = false
+
+# Initial capacity of the node table for graph search. The table grows on its
+# own, raising this only avoids the first few doublings in very long searches.
+# nodeTableCapacityPowerOfTwo = 16
+
 # How many virtual losses to add when a thread descends through a node
 # numVirtualLossesPerThread = 1
+# Instead of virtual losses, count each descent still in flight through a node
+# as a visit when weighing exploration, leaving the values of the moves alone.
+# Holds up better than virtual losses with many search threads.
+# usePendingVisits = false
 
 # Improve the quality of evals under heavy multithreading
 # useNoisePruning = true
 
+# Back up each playout in constant time per node by adding the new leaf value
+# to the stats along the path, rather than recomputing every node on the path
+# from all of its children. Nodes are still fully recomputed every
+# incrementalBackupRecomputeInterval visits, so that noise pruning and value
+# weighting stay approximately in effect. Speeds up search on wide boards.
+# useIncrementalBackup = false
+# incrementalBackupRecomputeInterval = 32
+
 # ===========================================================================
 # Avoid SGF patterns
 # ===========================================================================
@@ -791,7 +791,7 @@ static void recordTreePositionsRec(
   Loc excludeLoc0, Loc excludeLoc1
 ) {
   int childrenCapacity;
-  const SearchChildPointer* children = node->getChildren(childrenCapacity);
+  ConstSearchChildren children = node->getChildren(childrenCapacity);
   int numChildren = SearchNode::iterateAndCountChildrenInArray(children,childrenCapacity);
 
   if(numChildren <= 0)
@@ -210,7 +210,15 @@ string PlayUtils::BenchmarkResults::toString() const {
       << " nnEvals/s = " << Global::strprintf("%.2f",numNNEvals / totalSeconds)
       << " nnBatches/s = " << Global::strprintf("%.2f",numNNBatches / totalSeconds)
       << " avgBatchSize = " << Global::strprintf("%.2f",avgBatchSize)
-      << " (" << Global::strprintf("%.1f", totalSeconds) << " secs)";
+      << " nodes/s = " << Global::strprintf("%.2f",totalNodes / totalSeconds)
+      << " bytes/node = " << Global::strprintf("%.0f",(double)totalNodeBytes / std::max(totalNodes,(int64_t)1))
+      << " nodeTableLoad = " << Global::strprintf("%.2f",maxNodeTableLoad);
+  if(numEndgameSolves > 0)
+    out << " endgameSolves = " << numEndgameSolves
+        << " solverNodes/solve = " << Global::strprintf("%.0f",(double)numEndgameSolverNodes / numEndgameSolves);
+  if(hasTreeHash)
+    out << " treeHash = " << treeHash;
+  out << " (" << Global::strprintf("%.1f", totalSeconds) << " secs)";
   return out.str();
 }
 string PlayUtils::BenchmarkResults::toStringWithElo(const BenchmarkResults* baseline, double secondsPerGameMove) const {
@@ -221,7 +229,15 @@ string PlayUtils::BenchmarkResults::toStringWithElo(const BenchmarkResults* base
       << " nnEvals/s = " << Global::strprintf("%.2f",numNNEvals / totalSeconds)
       << " nnBatches/s = " << Global::strprintf("%.2f",numNNBatches / totalSeconds)
       << " avgBatchSize = " << Global::strprintf("%.2f",avgBatchSize)
-      << " (" << Global::strprintf("%.1f", totalSeconds) << " secs)";
+      << " nodes/s = " << Global::strprintf("%.2f",totalNodes / totalSeconds)
+      << " bytes/node = " << Global::strprintf("%.0f",(double)totalNodeBytes / std::max(totalNodes,(int64_t)1))
+      << " nodeTableLoad = " << Global::strprintf("%.2f",maxNodeTableLoad);
+  if(numEndgameSolves > 0)
+    out << " endgameSolves = " << numEndgameSolves
+        << " solverNodes/solve = " << Global::strprintf("%.0f",(double)numEndgameSolverNodes / numEndgameSolves);
+  if(hasTreeHash)
+    out << " treeHash = " << treeHash;
+  out << " (" << Global::strprintf("%.1f", totalSeconds) << " secs)";
 
   if(baseline == NULL)
     out << " (EloDiff baseline)";
@@ -250,6 +266,18 @@ double PlayUtils::BenchmarkResults::computeEloEffect(double secondsPerGameMove)
   return gain - cost;
 }
 
+double PlayUtils::BenchmarkResults::fractionSameBestMoves(const BenchmarkResults& other) const {
+  size_t numPositions = std::min(bestMoves.size(),other.bestMoves.size());
+  if(numPositions <= 0)
+    return 0.0;
+  int numSame = 0;
+  for(size_t i = 0; i<numPositions; i++) {
+    if(bestMoves[i] == other.bestMoves[i])
+      numSame++;
+  }
+  return (double)numSame / numPositions;
+}
+
 void PlayUtils::BenchmarkResults::printEloComparison(const vector<BenchmarkResults>& results, double secondsPerGameMove) {
   int bestIdx = 0;
   for(int i = 1; i<results.size(); i++) {
@@ -321,7 +349,10 @@ PlayUtils::BenchmarkResults PlayUtils::benchmarkSearchOnPositionsAndPrint(
   nnEval->clearStats();
 
   Rand seedRand;
-  Search* bot = new Search(params,nnEval,nnEval->getLogger(),Global::uint64ToString(seedRand.nextUInt64()));
+  //Same seed every time so that deterministic searches can be compared across runs
+  const string searchRandSeed = params.useDeterministicWaves ? "benchmarkDeterministicSeed" : Global::uint64ToString(seedRand.nextUInt64());
+  Search* bot = new Search(params,nnEval,nnEval->getLogger(),searchRandSeed);
+  results.hasTreeHash = params.useDeterministicWaves;
 
   //Ignore the SGF rules, except for komi. Just use Tromp-taylor.
   Rules initialRules = Rules::getTrompTaylorish();
@@ -360,9 +391,39 @@ PlayUtils::BenchmarkResults PlayUtils::benchmarkSearchOnPositionsAndPrint(
     results.totalPositionsSearched += 1;
     results.totalSeconds += seconds;
     results.totalVisits += bot->getRootVisits();
+    results.maxNodeTableLoad = std::max(results.maxNodeTableLoad, bot->getNodeTableLoadFactor());
+    SearchNodeAllocator::Stats nodeStats = bot->getNodeAllocatorStats();
+    results.totalNodes += (int64_t)nodeStats.numNodes;
+    results.totalNodeBytes += (int64_t)nodeStats.bytesInUse;
+
+    Loc bestMove = Board::NULL_LOC;
+    vector<Loc> locs;
+    vector<double> playSelectionValues;
+    if(bot->getPlaySelectionValues(locs,playSelectionValues,0.0)) {
+      double bestValue = 0.0;
+      for(int j = 0; j<locs.size(); j++) {
+        if(bestMove == Board::NULL_LOC || playSelectionValues[j] > bestValue) {
+          bestValue = playSelectionValues[j];
+          bestMove = locs[j];
+        }
+      }
+    }
+    results.bestMoves.push_back(bestMove);
+
+    if(results.hasTreeHash) {
+      Hash128 treeHash = bot->getTreeHash();
+      results.treeHash = Hash128(
+        Hash::splitMix64(results.treeHash.hash0 ^ treeHash.hash0),
+        Hash::splitMix64(results.treeHash.hash1 ^ treeHash.hash1)
+      );
+    }
   }
 
   results.numNNEvals = nnEval->numRowsProcessed();
+  EndgameSolver::Stats solverStats = bot->getEndgameSolverStats();
+  results.numEndgameSolves = solverStats.numSolves;
+  results.numEndgameSolverNodes = solverStats.numNodes;
+  results.profile = bot->getSearchProfile();
   results.numNNBatches = nnEval->numBatchesProcessed();
   results.avgBatchSize = nnEval->averageProcessedBatchSize();
 
@@ -385,6 +446,8 @@ void PlayUtils::printGenmoveLog(ostream& out, const AsyncBot* bot, const NNEvalu
     out << "Time taken: " << timeTaken << "\n";
   out << "Root visits: " << search->getRootVisits() << "\n";
   out << "New playouts: " << search->lastSearchNumPlayouts << "\n";
+  if(search->lastSearchVisitsSavedByEarlyStop > 0)
+    out << "Visits saved by stopping early: " << search->lastSearchVisitsSavedByEarlyStop << "\n";
   out << "NN rows: " << nnEval->numRowsProcessed() << endl;
   out << "NN batches: " << nnEval->numBatchesProcessed() << endl;
   out << "NN avg batch size: " << nnEval->averageProcessedBatchSize() << endl;
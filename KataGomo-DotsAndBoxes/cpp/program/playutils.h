@@ -67,12 +67,26 @@ namespace PlayUtils {
     int64_t numNNEvals = 0;
     int64_t numNNBatches = 0;
     double avgBatchSize = 0;
+    double maxNodeTableLoad = 0;
+    int64_t totalNodes = 0;
+    int64_t totalNodeBytes = 0;
+    int64_t numEndgameSolves = 0;
+    int64_t numEndgameSolverNodes = 0;
+    //Time spent by the search threads in each phase of the search, over all positions searched
+    SearchProfile profile;
+    //The move with the highest play selection value, for every position searched
+    std::vector<Loc> bestMoves;
+    //With useDeterministicWaves, a hash of the search trees of all the positions, equal only for identical searches
+    bool hasTreeHash = false;
+    Hash128 treeHash;
 
     std::string toStringNotDone() const;
     std::string toString() const;
     std::string toStringWithElo(const BenchmarkResults* baseline, double secondsPerGameMove) const;
 
     double computeEloEffect(double secondsPerGameMove) const;
+    //Fraction of the positions searched by both where this chose the same best move as other
+    double fractionSameBestMoves(const BenchmarkResults& other) const;
 
     static void printEloComparison(const std::vector<BenchmarkResults>& results, double secondsPerGameMove);
   };
@@ -0,0 +1,502 @@
+#include "../program/rootparallel.h"
+
+#include <cstring>
+
+#include "../core/os.h"
+#include "../core/timer.h"
+
+#ifdef OS_IS_UNIX_OR_APPLE
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+using json = nlohmann::json;
+
+//How often the coordinator checks for new workers and for shutting down
+static constexpr int ACCEPT_POLL_MILLISECONDS = 100;
+
+vector<RootParallel::MoveStats> RootParallel::getRootMoveStats(const Search* search) {
+  vector<AnalysisData> buf;
+  const int minMovesToTryToGet = 0;
+  const bool includeWeightFactors = false;
+  const int maxPVDepth = 1;
+  const bool duplicateForSymmetries = false;
+  search->getAnalysisData(buf, minMovesToTryToGet, includeWeightFactors, maxPVDepth, duplicateForSymmetries);
+  vector<MoveStats> stats;
+  for(const AnalysisData& data: buf) {
+    if(data.numVisits <= 0)
+      continue;
+    MoveStats s;
+    s.move = data.move;
+    s.visits = data.numVisits;
+    s.utility = data.utility;
+    s.winLossValue = data.winLossValue;
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+vector<RootParallel::MoveStats> RootParallel::merge(const vector<vector<MoveStats>>& allStats) {
+  vector<MoveStats> merged;
+  std::map<Loc,size_t> idxByMove;
+  for(const vector<MoveStats>& stats: allStats) {
+    for(const MoveStats& s: stats) {
+      if(s.visits <= 0)
+        continue;
+      auto iter = idxByMove.find(s.move);
+      if(iter == idxByMove.end()) {
+        idxByMove[s.move] = merged.size();
+        merged.push_back(s);
+        continue;
+      }
+      MoveStats& m = merged[iter->second];
+      double totalVisits = (double)m.visits + (double)s.visits;
+      m.utility = (m.utility * m.visits + s.utility * s.visits) / totalVisits;
+      m.winLossValue = (m.winLossValue * m.visits + s.winLossValue * s.visits) / totalVisits;
+      m.visits += s.visits;
+    }
+  }
+  return merged;
+}
+
+json RootParallel::toJson(const vector<MoveStats>& stats, const Board& board) {
+  json ret = json::array();
+  for(const MoveStats& s: stats) {
+    json m;
+    m["move"] = Location::toString(s.move, board);
+    m["visits"] = s.visits;
+    m["utility"] = s.utility;
+    m["winLossValue"] = s.winLossValue;
+    ret.push_back(m);
+  }
+  return ret;
+}
+
+vector<RootParallel::MoveStats> RootParallel::ofJson(const json& data, const Board& board) {
+  vector<MoveStats> stats;
+  for(const json& m: data) {
+    MoveStats s;
+    if(!Location::tryOfString(m["move"].get<string>(), board, s.move))
+      throw StringError("Could not parse move in root parallel report: " + m["move"].dump());
+    s.visits = m["visits"].get<int64_t>();
+    s.utility = m["utility"].get<double>();
+    s.winLossValue = m["winLossValue"].get<double>();
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+#ifdef OS_IS_UNIX_OR_APPLE
+
+static sockaddr_un makeSocketAddress(const string& socketPath) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(socketPath.size() <= 0 || socketPath.size() >= sizeof(addr.sun_path))
+    throw StringError("Invalid root parallel socket path, empty or too long: " + socketPath);
+  memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+  return addr;
+}
+
+static int openSocket() {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    throw StringError(string("Could not create root parallel socket: ") + strerror(errno));
+#ifdef SO_NOSIGPIPE
+  //Where MSG_NOSIGNAL isn't available, a peer that went away must not kill us when we write to it
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  return fd;
+}
+
+static bool writeLine(int fd, const string& line) {
+  string s = line + "\n";
+  size_t numWritten = 0;
+  while(numWritten < s.size()) {
+#ifdef MSG_NOSIGNAL
+    ssize_t n = send(fd, s.data() + numWritten, s.size() - numWritten, MSG_NOSIGNAL);
+#else
+    ssize_t n = send(fd, s.data() + numWritten, s.size() - numWritten, 0);
+#endif
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return false;
+    numWritten += (size_t)n;
+  }
+  return true;
+}
+
+//Reads newline-terminated lines from a socket. Returns false once the socket is closed or fails.
+static bool readLine(int fd, string& buf, string& line) {
+  while(true) {
+    size_t pos = buf.find('\n');
+    if(pos != string::npos) {
+      line = buf.substr(0,pos);
+      buf.erase(0,pos+1);
+      return true;
+    }
+    char chunk[4096];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return false;
+    buf.append(chunk, (size_t)n);
+  }
+}
+
+void RootParallel::runWorker(const string& socketPath, AsyncBot* bot, double reportPeriod, Logger& logger) {
+  int fd = openSocket();
+  sockaddr_un addr = makeSocketAddress(socketPath);
+  if(connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+    string err = strerror(errno);
+    close(fd);
+    throw StringError("Could not connect to root parallel coordinator at " + socketPath + ": " + err);
+  }
+  logger.write("Connected to root parallel coordinator at " + socketPath);
+
+  //Reports come from the search thread during search and from this one at the end
+  std::mutex writeMutex;
+  auto send = [&](const json& message) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    writeLine(fd, message.dump());
+  };
+
+  int64_t searchId = -1;
+  bool isSearching = false;
+  string buf;
+  string line;
+  while(readLine(fd, buf, line)) {
+    json input;
+    try {
+      input = json::parse(line);
+    }
+    catch(nlohmann::detail::exception& e) {
+      logger.write("Root parallel worker could not parse message from coordinator: " + string(e.what()));
+      continue;
+    }
+    const string action = input.value("action", string());
+    const int64_t id = input.value("id", (int64_t)-1);
+
+    if(action == "stop") {
+      if(!isSearching || id != searchId)
+        continue;
+      bot->stopAndWait();
+      isSearching = false;
+      const Search* search = bot->getSearch();
+      json report;
+      report["id"] = searchId;
+      report["final"] = true;
+      report["moves"] = toJson(getRootMoveStats(search), search->getRootBoard());
+      send(report);
+    }
+    else if(action == "search") {
+      bot->stopAndWait();
+      isSearching = false;
+      searchId = id;
+      Player pla;
+      Board board;
+      BoardHistory hist;
+      double searchFactor;
+      try {
+        Player initialPla;
+        if(!PlayerIO::tryParsePlayer(input["initialPla"].get<string>(), initialPla) || !PlayerIO::tryParsePlayer(input["pla"].get<string>(), pla))
+          throw StringError("Could not parse player");
+        Rules rules = Rules::parseRules(input["rules"].get<string>());
+        board = Board::ofJson(input["initialBoard"]);
+        hist.clear(board, initialPla, rules);
+        for(const json& move: input["moves"]) {
+          Player movePla;
+          Loc moveLoc;
+          if(!PlayerIO::tryParsePlayer(move[0].get<string>(), movePla) || !Location::tryOfString(move[1].get<string>(), board, moveLoc))
+            throw StringError("Could not parse move " + move.dump());
+          if(!hist.makeBoardMoveTolerant(board, moveLoc, movePla))
+            throw StringError("Illegal move " + move.dump());
+        }
+        if(board.pos_hash.toString() != input["posHash"].get<string>())
+          throw StringError("Position differs from the coordinator's after replaying the moves");
+        searchFactor = input["searchFactor"].get<double>();
+      }
+      catch(const std::exception& e) {
+        json report;
+        report["id"] = searchId;
+        report["error"] = string(e.what());
+        send(report);
+        continue;
+      }
+
+      //Keep the tree from the last search when the new position follows from it, as the gtp engine does
+      const BoardHistory& prevHist = bot->getRootHist();
+      bool canReuseTree =
+        prevHist.initialBoard.pos_hash == hist.initialBoard.pos_hash &&
+        prevHist.initialPla == hist.initialPla &&
+        prevHist.rules == hist.rules &&
+        prevHist.moveHistory.size() <= hist.moveHistory.size();
+      for(size_t i = 0; canReuseTree && i < prevHist.moveHistory.size(); i++) {
+        if(prevHist.moveHistory[i].loc != hist.moveHistory[i].loc || prevHist.moveHistory[i].pla != hist.moveHistory[i].pla)
+          canReuseTree = false;
+      }
+      if(canReuseTree) {
+        for(size_t i = prevHist.moveHistory.size(); canReuseTree && i < hist.moveHistory.size(); i++)
+          canReuseTree = bot->makeMove(hist.moveHistory[i].loc, hist.moveHistory[i].pla);
+      }
+      if(!canReuseTree)
+        bot->setPosition(board.nextPla, board, hist);
+
+      const int64_t thisSearchId = searchId;
+      std::function<void(const Search*)> callback = [thisSearchId,&send](const Search* search) {
+        json report;
+        report["id"] = thisSearchId;
+        report["final"] = false;
+        report["moves"] = toJson(getRootMoveStats(search), search->getRootBoard());
+        send(report);
+      };
+      bot->analyzeAsync(pla, searchFactor, reportPeriod, reportPeriod, callback);
+      isSearching = true;
+    }
+    else {
+      logger.write("Root parallel worker got unknown action from coordinator: " + action);
+    }
+  }
+
+  bot->stopAndWait();
+  close(fd);
+  logger.write("Root parallel coordinator disconnected");
+}
+
+RootParallelCoordinator::RootParallelCoordinator(const string& path, Logger* l)
+  :socketPath(path),
+   logger(l),
+   listenFd(-1),
+   isShuttingDown(false),
+   acceptThread(),
+   mutex(),
+   workerReported(),
+   workers(),
+   currentSearchId(0),
+   currentBoard()
+{
+  sockaddr_un addr = makeSocketAddress(socketPath);
+  listenFd = openSocket();
+  //A socket file left by an earlier coordinator that didn't shut down cleanly would make bind fail
+  unlink(socketPath.c_str());
+  if(bind(listenFd, (const sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 64) != 0) {
+    string err = strerror(errno);
+    close(listenFd);
+    throw StringError("Could not listen for root parallel workers at " + socketPath + ": " + err);
+  }
+  if(logger != NULL)
+    logger->write("Listening for root parallel workers at " + socketPath);
+  acceptThread = std::thread(&RootParallelCoordinator::acceptLoop, this);
+}
+
+RootParallelCoordinator::~RootParallelCoordinator() {
+  isShuttingDown.store(true, std::memory_order_release);
+  acceptThread.join();
+  close(listenFd);
+  unlink(socketPath.c_str());
+
+  //Closing our end makes the workers' reads fail, so they finish their searches and disconnect
+  vector<Worker*> workersToJoin;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    workersToJoin = workers;
+    for(Worker* worker: workers)
+      shutdown(worker->fd, SHUT_RDWR);
+  }
+  for(Worker* worker: workersToJoin) {
+    worker->readThread.join();
+    close(worker->fd);
+    delete worker;
+  }
+}
+
+void RootParallelCoordinator::acceptLoop() {
+  while(!isShuttingDown.load(std::memory_order_acquire)) {
+    pollfd pfd;
+    pfd.fd = listenFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ret = poll(&pfd, 1, ACCEPT_POLL_MILLISECONDS);
+    if(ret <= 0 || (pfd.revents & POLLIN) == 0)
+      continue;
+    int fd = accept(listenFd, NULL, NULL);
+    if(fd < 0)
+      continue;
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    std::lock_guard<std::mutex> lock(mutex);
+    Worker* worker = new Worker();
+    worker->fd = fd;
+    worker->isConnected = true;
+    worker->searchId = -1;
+    worker->isDone = true;
+    worker->hasStats = false;
+    worker->readThread = std::thread(&RootParallelCoordinator::readLoop, this, worker);
+    workers.push_back(worker);
+    if(logger != NULL)
+      logger->write("Root parallel worker connected, now " + Global::intToString((int)workers.size()) + " connections");
+  }
+}
+
+void RootParallelCoordinator::readLoop(Worker* worker) {
+  string buf;
+  string line;
+  while(readLine(worker->fd, buf, line)) {
+    std::lock_guard<std::mutex> lock(mutex);
+    try {
+      json input = json::parse(line);
+      //Ignore late reports from searches that are over
+      if(input["id"].get<int64_t>() != worker->searchId || worker->searchId != currentSearchId)
+        continue;
+      if(input.find("error") != input.end()) {
+        if(logger != NULL)
+          logger->write("WARNING: Root parallel worker could not search: " + input["error"].get<string>());
+        worker->isDone = true;
+      }
+      else {
+        worker->stats = RootParallel::ofJson(input["moves"], currentBoard);
+        worker->hasStats = true;
+        if(input["final"].get<bool>())
+          worker->isDone = true;
+      }
+    }
+    catch(const std::exception& e) {
+      if(logger != NULL)
+        logger->write("WARNING: Could not handle root parallel worker report: " + string(e.what()));
+    }
+    workerReported.notify_all();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  worker->isConnected = false;
+  worker->isDone = true;
+  workerReported.notify_all();
+}
+
+int RootParallelCoordinator::getNumWorkers() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  int numWorkers = 0;
+  for(const Worker* worker: workers) {
+    if(worker->isConnected)
+      numWorkers++;
+  }
+  return numWorkers;
+}
+
+void RootParallelCoordinator::beginSearch(const BoardHistory& hist, Player pla, double searchFactor) {
+  std::lock_guard<std::mutex> lock(mutex);
+  currentSearchId++;
+  currentBoard = hist.getRecentBoard(0);
+
+  json moves = json::array();
+  for(const Move& move: hist.moveHistory)
+    moves.push_back(json::array({PlayerIO::playerToStringShort(move.pla), Location::toString(move.loc, hist.initialBoard)}));
+  json message;
+  message["action"] = "search";
+  message["id"] = currentSearchId;
+  message["initialBoard"] = Board::toJson(hist.initialBoard);
+  message["initialPla"] = PlayerIO::playerToStringShort(hist.initialPla);
+  message["rules"] = hist.rules.toJsonString();
+  message["moves"] = moves;
+  message["pla"] = PlayerIO::playerToStringShort(pla);
+  message["posHash"] = currentBoard.pos_hash.toString();
+  message["searchFactor"] = searchFactor;
+  const string line = message.dump();
+
+  for(Worker* worker: workers) {
+    if(!worker->isConnected)
+      continue;
+    worker->searchId = currentSearchId;
+    worker->isDone = false;
+    worker->hasStats = false;
+    worker->stats.clear();
+    if(!writeLine(worker->fd, line))
+      worker->isDone = true;
+  }
+}
+
+vector<vector<RootParallel::MoveStats>> RootParallelCoordinator::endSearch(double timeoutSeconds) {
+  std::unique_lock<std::mutex> lock(mutex);
+  json message;
+  message["action"] = "stop";
+  message["id"] = currentSearchId;
+  const string line = message.dump();
+  for(Worker* worker: workers) {
+    if(worker->searchId == currentSearchId && !worker->isDone && !writeLine(worker->fd, line))
+      worker->isDone = true;
+  }
+
+  auto allDone = [this]() {
+    for(const Worker* worker: workers) {
+      if(worker->searchId == currentSearchId && !worker->isDone)
+        return false;
+    }
+    return true;
+  };
+  if(!workerReported.wait_for(lock, std::chrono::duration<double>(timeoutSeconds), allDone) && logger != NULL)
+    logger->write("WARNING: Root parallel workers took too long to stop, using their last reports");
+
+  vector<vector<RootParallel::MoveStats>> allStats;
+  for(Worker* worker: workers) {
+    if(worker->searchId == currentSearchId && worker->hasStats)
+      allStats.push_back(worker->stats);
+  }
+  return allStats;
+}
+
+#else
+
+void RootParallel::runWorker(const string& socketPath, AsyncBot* bot, double reportPeriod, Logger& logger) {
+  (void)socketPath;
+  (void)bot;
+  (void)reportPeriod;
+  (void)logger;
+  throw StringError("Root parallel search is not supported on this platform");
+}
+
+RootParallelCoordinator::RootParallelCoordinator(const string& path, Logger* l)
+  :socketPath(path),
+   logger(l),
+   listenFd(-1),
+   isShuttingDown(false),
+   acceptThread(),
+   mutex(),
+   workerReported(),
+   workers(),
+   currentSearchId(0),
+   currentBoard()
+{
+  throw StringError("Root parallel search is not supported on this platform");
+}
+RootParallelCoordinator::~RootParallelCoordinator() {
+}
+void RootParallelCoordinator::acceptLoop() {
+}
+void RootParallelCoordinator::readLoop(Worker* worker) {
+  (void)worker;
+}
+int RootParallelCoordinator::getNumWorkers() const {
+  return 0;
+}
+void RootParallelCoordinator::beginSearch(const BoardHistory& hist, Player pla, double searchFactor) {
+  (void)hist;
+  (void)pla;
+  (void)searchFactor;
+}
+vector<vector<RootParallel::MoveStats>> RootParallelCoordinator::endSearch(double timeoutSeconds) {
+  (void)timeoutSeconds;
+  return vector<vector<RootParallel::MoveStats>>();
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef PROGRAM_ROOTPARALLEL_H_
+#define PROGRAM_ROOTPARALLEL_H_
+
+#include "../core/global.h"
+#include "../core/logger.h"
+#include "../core/multithread.h"
+#include "../game/boardhistory.h"
+#include "../search/asyncbot.h"
+#include "../external/nlohmann_json/json.hpp"
+
+//Root parallel search across several engine processes on one machine. Each worker process searches the same root
+//independently with its own neural net evaluator and search tree, so that none of them share memory, and which can
+//each be pinned to their own NUMA node. Workers connect over a local Unix socket to the coordinator, the gtp engine,
+//which starts them on the position whenever it searches itself for a genmove. Every so often during the search they
+//report the visits and values of the moves at the root, and once the coordinator's own search is done it stops them
+//and chooses its move counting their visits on top of its own, the same way as it would from its own search alone.
+//
+//The protocol is one json object per line. The coordinator sends
+//  {"action":"search","id":ID,"initialBoard":BOARD,"initialPla":PLA,"rules":RULES,"moves":[[PLA,LOC],...],"pla":PLA,
+//   "posHash":HASH,"searchFactor":FACTOR}
+//  {"action":"stop","id":ID}
+//and workers reply to a search with any number of
+//  {"id":ID,"final":BOOL,"moves":[{"move":LOC,"visits":VISITS,"utility":UTILITY,"winLossValue":VALUE},...]}
+//the last of which, sent once stopped, has final true, or with {"id":ID,"error":MESSAGE} if they can't search it.
+namespace RootParallel {
+  //Search results for a move at the root, values from white's perspective
+  struct MoveStats {
+    Loc move;
+    int64_t visits;
+    double utility;
+    double winLossValue;
+  };
+
+  std::vector<MoveStats> getRootMoveStats(const Search* search);
+  //Sums visits of the same move across all the searches, averaging values weighted by visits
+  std::vector<MoveStats> merge(const std::vector<std::vector<MoveStats>>& allStats);
+
+  nlohmann::json toJson(const std::vector<MoveStats>& stats, const Board& board);
+  std::vector<MoveStats> ofJson(const nlohmann::json& data, const Board& board);
+
+  //Connects to the coordinator listening on socketPath and searches with bot whatever it asks for, reporting the
+  //root every reportPeriod seconds, until the coordinator disconnects.
+  void runWorker(const std::string& socketPath, AsyncBot* bot, double reportPeriod, Logger& logger);
+}
+
+class RootParallelCoordinator {
+ public:
+  //Listens for workers on socketPath, replacing any socket file already there.
+  RootParallelCoordinator(const std::string& socketPath, Logger* logger);
+  ~RootParallelCoordinator();
+
+  RootParallelCoordinator(const RootParallelCoordinator&) = delete;
+  RootParallelCoordinator& operator=(const RootParallelCoordinator&) = delete;
+
+  //All functions are threadsafe, but beginSearch and endSearch are meant to be called in pairs from a single thread.
+
+  int getNumWorkers() const;
+  //Starts every connected worker searching the position of hist for pla, returning immediately.
+  void beginSearch(const BoardHistory& hist, Player pla, double searchFactor);
+  //Stops the workers started by the last beginSearch, waiting up to timeoutSeconds for their final reports.
+  //Returns the latest report of each worker that sent any.
+  std::vector<std::vector<RootParallel::MoveStats>> endSearch(double timeoutSeconds);
+
+ private:
+  struct Worker {
+    int fd;
+    std::thread readThread;
+    bool isConnected;
+    int64_t searchId; //The last search it was started on, -1 if none
+    bool isDone; //Whether it sent its final report or an error for searchId
+    bool hasStats;
+    std::vector<RootParallel::MoveStats> stats;
+  };
+
+  const std::string socketPath;
+  Logger* logger;
+  int listenFd;
+  std::atomic<bool> isShuttingDown;
+  std::thread acceptThread;
+
+  mutable std::mutex mutex;
+  std::condition_variable workerReported;
+  std::vector<Worker*> workers;
+  int64_t currentSearchId;
+  Board currentBoard; //For parsing the moves in the reports of the current search
+
+  void acceptLoop();
+  void readLoop(Worker* worker);
+};
+
+#endif  // PROGRAM_ROOTPARALLEL_H_
@@ -2,12 +2,20 @@
 
 #include "../core/datetime.h"
 #include "../core/makedir.h"
+#include "../core/threadplacement.h"
 #include "../neuralnet/nninterface.h"
 
 using namespace std;
 
 void Setup::initializeSession(ConfigParser& cfg) {
-  (void)cfg;
+  const int searchThreadAffinity =
+    cfg.contains("searchThreadAffinity") ? ThreadPlacement::parseAffinity(cfg.getString("searchThreadAffinity")) : ThreadPlacement::AFFINITY_NONE;
+  const int nnServerThreadAffinity =
+    cfg.contains("nnServerThreadAffinity") ? ThreadPlacement::parseAffinity(cfg.getString("nnServerThreadAffinity")) : ThreadPlacement::AFFINITY_NONE;
+  const vector<int> numaNodes = cfg.contains("numaNodes") ? cfg.getInts("numaNodes",0,4095) : vector<int>();
+  const bool interleaveSharedTables = cfg.contains("interleaveSharedTables") ? cfg.getBool("interleaveSharedTables") : false;
+  ThreadPlacement::configure(searchThreadAffinity,nnServerThreadAffinity,numaNodes,interleaveSharedTables);
+
   NeuralNet::globalInitialize();
 }
 
@@ -109,6 +117,30 @@ vector<NNEvaluator*> Setup::initializeNNEvaluators(
       cfg.contains("debugSkipNeuralNet") ? cfg.getBool("debugSkipNeuralNet") :
       debugSkipNeuralNetDefault;
 
+    //Raw nn outputs can be recorded to a trace file, and replayed later in place of the neural net.
+    string nnTraceRecordFile;
+    string nnTraceReplayFile;
+    double nnTraceReplayBatchLatencyMs = 0.0;
+    double nnTraceReplayRowLatencyMs = 0.0;
+    if(setupFor != SETUP_FOR_DISTRIBUTED) {
+      if(cfg.contains("nnTraceRecordFile" + idxStr))
+        nnTraceRecordFile = cfg.getString("nnTraceRecordFile" + idxStr);
+      else if(cfg.contains("nnTraceRecordFile"))
+        nnTraceRecordFile = cfg.getString("nnTraceRecordFile");
+      if(cfg.contains("nnTraceReplayFile" + idxStr))
+        nnTraceReplayFile = cfg.getString("nnTraceReplayFile" + idxStr);
+      else if(cfg.contains("nnTraceReplayFile"))
+        nnTraceReplayFile = cfg.getString("nnTraceReplayFile");
+      if(cfg.contains("nnTraceReplayBatchLatencyMs"))
+        nnTraceReplayBatchLatencyMs = cfg.getDouble("nnTraceReplayBatchLatencyMs", 0.0, 10000.0);
+      if(cfg.contains("nnTraceReplayRowLatencyMs"))
+        nnTraceReplayRowLatencyMs = cfg.getDouble("nnTraceReplayRowLatencyMs", 0.0, 10000.0);
+    }
+    if(nnTraceRecordFile != "" && nnTraceReplayFile != "")
+      throw StringError("Cannot specify both nnTraceRecordFile and nnTraceReplayFile");
+    if(nnTraceReplayFile != "")
+      debugSkipNeuralNet = true;
+
     int nnXLen = std::max(defaultNNXLen,2);
     int nnYLen = std::max(defaultNNYLen,2);
     if(setupFor != SETUP_FOR_DISTRIBUTED) {
@@ -237,6 +269,12 @@ vector<NNEvaluator*> Setup::initializeNNEvaluators(
     bool openCLReTunePerBoardSize = false;
     if(cfg.contains("openclReTunePerBoardSize"))
       openCLReTunePerBoardSize = cfg.getBool("openclReTunePerBoardSize");
+    //Timing the conv algorithm at startup could make deterministic searches round differently from run to run
+    int eigenDirectConvMaxBatchSize = -1;
+    if(cfg.contains("eigenDirectConvMaxBatchSize"))
+      eigenDirectConvMaxBatchSize = cfg.getInt("eigenDirectConvMaxBatchSize",-1,65536);
+    else if(cfg.contains("useDeterministicWaves") && cfg.getBool("useDeterministicWaves"))
+      eigenDirectConvMaxBatchSize = 0;
 
     enabled_t useFP16Mode = enabled_t::Auto;
     if(cfg.contains(backendPrefix+"UseFP16-"+idxStr))
@@ -330,6 +368,7 @@ vector<NNEvaluator*> Setup::initializeNNEvaluators(
       openCLTunerFile,
       homeDataDirOverride,
       openCLReTunePerBoardSize,
+      eigenDirectConvMaxBatchSize,
       useFP16Mode,
       useNHWCMode,
       numNNServerThreadsPerModel,
@@ -339,6 +378,11 @@ vector<NNEvaluator*> Setup::initializeNNEvaluators(
       defaultSymmetry
     );
 
+    if(nnTraceRecordFile != "")
+      nnEval->setTraceRecordFile(nnTraceRecordFile);
+    if(nnTraceReplayFile != "")
+      nnEval->setTraceReplayFile(nnTraceReplayFile, nnTraceReplayBatchLatencyMs * 0.001, nnTraceReplayRowLatencyMs * 0.001);
+
     nnEval->spawnServerThreads();
 
     nnEvals.push_back(nnEval);
@@ -406,6 +450,20 @@ vector<SearchParams> Setup::loadParams(
     else if(cfg.contains("maxTimePondering"))   params.maxTimePondering = cfg.getDouble("maxTimePondering",        0.0, 1.0e20);
     else                                        params.maxTimePondering = 1.0e20;
 
+    if(cfg.contains("maxSearchMemoryBytes"+idxStr)) params.maxSearchMemoryBytes = cfg.getInt64("maxSearchMemoryBytes"+idxStr, (int64_t)0, (int64_t)1 << 50);
+    else if(cfg.contains("maxSearchMemoryBytes"))   params.maxSearchMemoryBytes = cfg.getInt64("maxSearchMemoryBytes",        (int64_t)0, (int64_t)1 << 50);
+    else                                            params.maxSearchMemoryBytes = 0;
+
+    if(cfg.contains("earlyStopKLGainThreshold"+idxStr)) params.earlyStopKLGainThreshold = cfg.getDouble("earlyStopKLGainThreshold"+idxStr, 0.0, 1.0);
+    else if(cfg.contains("earlyStopKLGainThreshold"))   params.earlyStopKLGainThreshold = cfg.getDouble("earlyStopKLGainThreshold",        0.0, 1.0);
+    else                                                params.earlyStopKLGainThreshold = 0.0;
+    if(cfg.contains("earlyStopCheckInterval"+idxStr)) params.earlyStopCheckInterval = cfg.getInt64("earlyStopCheckInterval"+idxStr, (int64_t)1, (int64_t)1 << 30);
+    else if(cfg.contains("earlyStopCheckInterval"))   params.earlyStopCheckInterval = cfg.getInt64("earlyStopCheckInterval",        (int64_t)1, (int64_t)1 << 30);
+    else                                              params.earlyStopCheckInterval = 100;
+    if(cfg.contains("earlyStopMinVisits"+idxStr)) params.earlyStopMinVisits = cfg.getInt64("earlyStopMinVisits"+idxStr, (int64_t)0, (int64_t)1 << 50);
+    else if(cfg.contains("earlyStopMinVisits"))   params.earlyStopMinVisits = cfg.getInt64("earlyStopMinVisits",        (int64_t)0, (int64_t)1 << 50);
+    else                                          params.earlyStopMinVisits = 100;
+
     if(cfg.contains("lagBuffer"+idxStr)) params.lagBuffer = cfg.getDouble("lagBuffer"+idxStr, 0.0, 3600.0);
     else if(cfg.contains("lagBuffer"))   params.lagBuffer = cfg.getDouble("lagBuffer",        0.0, 3600.0);
     else                                 params.lagBuffer = 0.0;
@@ -474,6 +532,12 @@ vector<SearchParams> Setup::loadParams(
     if(cfg.contains("noisePruningCap"+idxStr)) params.noisePruningCap = cfg.getDouble("noisePruningCap"+idxStr, 0.0, 1e50);
     else if(cfg.contains("noisePruningCap"))   params.noisePruningCap = cfg.getDouble("noisePruningCap", 0.0, 1e50);
     else                                       params.noisePruningCap = 1e50;
+    if(cfg.contains("useIncrementalBackup"+idxStr)) params.useIncrementalBackup = cfg.getBool("useIncrementalBackup"+idxStr);
+    else if(cfg.contains("useIncrementalBackup"))   params.useIncrementalBackup = cfg.getBool("useIncrementalBackup");
+    else                                            params.useIncrementalBackup = false;
+    if(cfg.contains("incrementalBackupRecomputeInterval"+idxStr)) params.incrementalBackupRecomputeInterval = cfg.getInt("incrementalBackupRecomputeInterval"+idxStr, 1, 1 << 20);
+    else if(cfg.contains("incrementalBackupRecomputeInterval"))   params.incrementalBackupRecomputeInterval = cfg.getInt("incrementalBackupRecomputeInterval", 1, 1 << 20);
+    else                                                          params.incrementalBackupRecomputeInterval = 32;
 
 
     if(cfg.contains("useUncertainty"+idxStr)) params.useUncertainty = cfg.getBool("useUncertainty"+idxStr);
@@ -499,6 +563,19 @@ vector<SearchParams> Setup::loadParams(
     // else if(cfg.contains("graphSearchCatchUpProp"))   params.graphSearchCatchUpProp = cfg.getDouble("graphSearchCatchUpProp", 0.0, 1.0);
     // else                                              params.graphSearchCatchUpProp = 0.0;
 
+    if(cfg.contains("endgameSolverMaxEmptyEdges"+idxStr)) params.endgameSolverMaxEmptyEdges = cfg.getInt("endgameSolverMaxEmptyEdges"+idxStr, 0, 40);
+    else if(cfg.contains("endgameSolverMaxEmptyEdges"))   params.endgameSolverMaxEmptyEdges = cfg.getInt("endgameSolverMaxEmptyEdges", 0, 40);
+    else                                                  params.endgameSolverMaxEmptyEdges = 0;
+    if(cfg.contains("endgameSolverMaxNodes"+idxStr)) params.endgameSolverMaxNodes = cfg.getInt64("endgameSolverMaxNodes"+idxStr, 1, (int64_t)1 << 40);
+    else if(cfg.contains("endgameSolverMaxNodes"))   params.endgameSolverMaxNodes = cfg.getInt64("endgameSolverMaxNodes", 1, (int64_t)1 << 40);
+    else                                             params.endgameSolverMaxNodes = 100000;
+    if(cfg.contains("endgameSolverTableSizePowerOfTwo"+idxStr)) params.endgameSolverTableSizePowerOfTwo = cfg.getInt("endgameSolverTableSizePowerOfTwo"+idxStr, 8, 30);
+    else if(cfg.contains("endgameSolverTableSizePowerOfTwo"))   params.endgameSolverTableSizePowerOfTwo = cfg.getInt("endgameSolverTableSizePowerOfTwo", 8, 30);
+    else                                                        params.endgameSolverTableSizePowerOfTwo = 16;
+    if(cfg.contains("useCaptureMacroMoves"+idxStr)) params.useCaptureMacroMoves = cfg.getBool("useCaptureMacroMoves"+idxStr);
+    else if(cfg.contains("useCaptureMacroMoves"))   params.useCaptureMacroMoves = cfg.getBool("useCaptureMacroMoves");
+    else                                            params.useCaptureMacroMoves = false;
+
     if(cfg.contains("rootNoiseEnabled"+idxStr)) params.rootNoiseEnabled = cfg.getBool("rootNoiseEnabled"+idxStr);
     else if(cfg.contains("rootNoiseEnabled"))   params.rootNoiseEnabled = cfg.getBool("rootNoiseEnabled");
     else                                        params.rootNoiseEnabled = false;
@@ -598,9 +675,27 @@ vector<SearchParams> Setup::loadParams(
     if(cfg.contains("nodeTableShardsPowerOfTwo"+idxStr)) params.nodeTableShardsPowerOfTwo = cfg.getInt("nodeTableShardsPowerOfTwo"+idxStr, 8, 24);
     else if(cfg.contains("nodeTableShardsPowerOfTwo"))   params.nodeTableShardsPowerOfTwo = cfg.getInt("nodeTableShardsPowerOfTwo",        8, 24);
     else                                                 params.nodeTableShardsPowerOfTwo = 16;
+    if(cfg.contains("nodeTableCapacityPowerOfTwo"+idxStr)) params.nodeTableCapacityPowerOfTwo = cfg.getInt("nodeTableCapacityPowerOfTwo"+idxStr, 8, 30);
+    else if(cfg.contains("nodeTableCapacityPowerOfTwo"))   params.nodeTableCapacityPowerOfTwo = cfg.getInt("nodeTableCapacityPowerOfTwo",        8, 30);
+    else                                                   params.nodeTableCapacityPowerOfTwo = 16;
     if(cfg.contains("numVirtualLossesPerThread"+idxStr)) params.numVirtualLossesPerThread = cfg.getDouble("numVirtualLossesPerThread"+idxStr, 0.01, 1000.0);
     else if(cfg.contains("numVirtualLossesPerThread"))   params.numVirtualLossesPerThread = cfg.getDouble("numVirtualLossesPerThread",        0.01, 1000.0);
     else                                                 params.numVirtualLossesPerThread = 1.0;
+    if(cfg.contains("usePendingVisits"+idxStr)) params.usePendingVisits = cfg.getBool("usePendingVisits"+idxStr);
+    else if(cfg.contains("usePendingVisits"))   params.usePendingVisits = cfg.getBool("usePendingVisits");
+    else                                        params.usePendingVisits = false;
+    if(cfg.contains("numLeavesPerSearchThread"+idxStr)) params.numLeavesPerSearchThread = cfg.getInt("numLeavesPerSearchThread"+idxStr, 1, 1024);
+    else if(cfg.contains("numLeavesPerSearchThread"))   params.numLeavesPerSearchThread = cfg.getInt("numLeavesPerSearchThread",        1, 1024);
+    else                                                params.numLeavesPerSearchThread = 1;
+    if(cfg.contains("useAsyncLeafPlayouts"+idxStr)) params.useAsyncLeafPlayouts = cfg.getBool("useAsyncLeafPlayouts"+idxStr);
+    else if(cfg.contains("useAsyncLeafPlayouts"))   params.useAsyncLeafPlayouts = cfg.getBool("useAsyncLeafPlayouts");
+    else                                            params.useAsyncLeafPlayouts = false;
+    if(cfg.contains("useBackgroundTreeCollection"+idxStr)) params.useBackgroundTreeCollection = cfg.getBool("useBackgroundTreeCollection"+idxStr);
+    else if(cfg.contains("useBackgroundTreeCollection"))   params.useBackgroundTreeCollection = cfg.getBool("useBackgroundTreeCollection");
+    else                                                   params.useBackgroundTreeCollection = false;
+    if(cfg.contains("useDeterministicWaves"+idxStr)) params.useDeterministicWaves = cfg.getBool("useDeterministicWaves"+idxStr);
+    else if(cfg.contains("useDeterministicWaves"))   params.useDeterministicWaves = cfg.getBool("useDeterministicWaves");
+    else                                             params.useDeterministicWaves = false;
 
     if(cfg.contains("treeReuseCarryOverTimeFactor"+idxStr)) params.treeReuseCarryOverTimeFactor = cfg.getDouble("treeReuseCarryOverTimeFactor"+idxStr,0.0,1.0);
     else if(cfg.contains("treeReuseCarryOverTimeFactor"))   params.treeReuseCarryOverTimeFactor = cfg.getDouble("treeReuseCarryOverTimeFactor",0.0,1.0);
@@ -630,14 +725,6 @@ vector<SearchParams> Setup::loadParams(
     else if(cfg.contains("futileVisitsThreshold"))   params.futileVisitsThreshold = cfg.getDouble("futileVisitsThreshold",0.01,1.0);
     else                                             params.futileVisitsThreshold = 0.0;
 
-    if(cfg.contains("finishGameSearchDelayMicroseconds" + idxStr))
-      params.finishGameSearchDelayMicroseconds =
-        cfg.getInt64("finishGameSearchDelayMicroseconds" + idxStr, 0, 10000000);
-    else if(cfg.contains("finishGameSearchDelayMicroseconds"))
-      params.finishGameSearchDelayMicroseconds = cfg.getInt64("finishGameSearchDelayMicroseconds", 0, 10000000);
-    else
-      params.finishGameSearchDelayMicroseconds = 0;
-
 
     //On distributed, tolerate reading mutexPoolSize since older version configs use it.
     if(setupFor == SETUP_FOR_DISTRIBUTED)
@@ -0,0 +1,176 @@
+#include "../search/endgamesolver.h"
+
+using namespace std;
+
+constexpr int EndgameSolver::MAX_EDGES;
+constexpr uint8_t EndgameSolver::BOUND_EXACT;
+constexpr uint8_t EndgameSolver::BOUND_LOWER;
+constexpr uint8_t EndgameSolver::BOUND_UPPER;
+
+EndgameSolver::EndgameSolver(int tableSizePow)
+  :tableSizePowerOfTwo(tableSizePow),
+   tableMask(((uint64_t)1 << tableSizePow) - 1),
+   table(NULL),
+   numEdges(0),
+   allEdgesMask(0),
+   nodeBudget(0),
+   aborted(false)
+{
+  assert(tableSizePow >= 0 && tableSizePow < 40);
+  stats.numSolves = 0;
+  stats.numAborted = 0;
+  stats.numNodes = 0;
+  stats.numTableHits = 0;
+}
+
+EndgameSolver::~EndgameSolver() {
+  delete[] table;
+}
+
+int EndgameSolver::getTableSizePowerOfTwo() const {
+  return tableSizePowerOfTwo;
+}
+size_t EndgameSolver::getTableBytes() const {
+  return table == NULL ? 0 : sizeof(Entry) * (tableMask + 1);
+}
+EndgameSolver::Stats EndgameSolver::getStats() const {
+  return stats;
+}
+
+bool EndgameSolver::solve(const Board& board, int maxEmptyEdges, int64_t maxNodes, Player& winner) {
+  if(maxEmptyEdges > MAX_EDGES)
+    maxEmptyEdges = MAX_EDGES;
+
+  //Index the undrawn edges, and key the drawn ones
+  int edgeIdxOfLoc[Board::MAX_ARR_SIZE];
+  uint64_t baseKey = Board::ZOBRIST_SIZE_X_HASH[board.x_size].hash0 ^ Board::ZOBRIST_SIZE_Y_HASH[board.y_size].hash0;
+  numEdges = 0;
+  for(int y = 0; y < board.y_size; y++) {
+    for(int x = 0; x < board.x_size; x++) {
+      if((x + y) % 2 == 0)
+        continue;
+      Loc loc = Location::getLoc(x,y,board.x_size);
+      edgeIdxOfLoc[loc] = -1;
+      if(board.colors[loc] != C_EMPTY) {
+        baseKey ^= Board::ZOBRIST_BOARD_HASH[loc][C_BLACK].hash0;
+        continue;
+      }
+      if(numEdges >= maxEmptyEdges)
+        return false;
+      edgeIdxOfLoc[loc] = numEdges;
+      edgeKeys[numEdges] = Board::ZOBRIST_BOARD_HASH[loc][C_BLACK].hash0;
+      edgeBoxMasks[numEdges][0] = 0;
+      edgeBoxMasks[numEdges][1] = 0;
+      numEdges++;
+    }
+  }
+  if(numEdges <= 0)
+    return false;
+  allEdgesMask = numEdges >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << numEdges) - 1);
+
+  //Boxes are at odd coordinates, and each one with undrawn sides is attached to each of those sides
+  int numRemainingBoxes = 0;
+  for(int y = 1; y < board.y_size; y += 2) {
+    for(int x = 1; x < board.x_size; x += 2) {
+      Loc loc = Location::getLoc(x,y,board.x_size);
+      uint64_t mask = 0;
+      for(int i = 0; i < 4; i++) {
+        int edgeIdx = edgeIdxOfLoc[loc + board.adj_offsets[i]];
+        if(edgeIdx >= 0)
+          mask |= (uint64_t)1 << edgeIdx;
+      }
+      if(mask != 0)
+        numRemainingBoxes++;
+      for(int i = 0; i < 4; i++) {
+        int edgeIdx = edgeIdxOfLoc[loc + board.adj_offsets[i]];
+        if(edgeIdx >= 0) {
+          int slot = edgeBoxMasks[edgeIdx][0] == 0 ? 0 : 1;
+          edgeBoxMasks[edgeIdx][slot] = mask;
+        }
+      }
+    }
+  }
+
+  if(table == NULL)
+    table = new Entry[tableMask + 1]();
+
+  nodeBudget = stats.numNodes + maxNodes;
+  aborted = false;
+  int margin = negamax(0, baseKey, -numRemainingBoxes-1, numRemainingBoxes+1);
+  if(aborted) {
+    stats.numAborted++;
+    return false;
+  }
+  stats.numSolves++;
+
+  const Player pla = board.nextPla;
+  int plaLead = board.currentScoreBlackMinusWhite - board.komi;
+  if(pla != P_BLACK)
+    plaLead = -plaLead;
+  int finalLead = plaLead + margin;
+  winner = finalLead > 0 ? pla : finalLead < 0 ? getOpp(pla) : C_EMPTY;
+  return true;
+}
+
+int EndgameSolver::countCaptures(int edgeIdx, uint64_t drawnAfter) const {
+  const uint64_t box0 = edgeBoxMasks[edgeIdx][0];
+  const uint64_t box1 = edgeBoxMasks[edgeIdx][1];
+  return (box0 != 0 && (drawnAfter & box0) == box0) + (box1 != 0 && (drawnAfter & box1) == box1);
+}
+
+//Returns the net number of the remaining boxes that the player to move gets, within the usual alpha-beta semantics.
+int EndgameSolver::negamax(uint64_t drawn, uint64_t key, int alpha, int beta) {
+  if(drawn == allEdgesMask)
+    return 0;
+  stats.numNodes++;
+  if(stats.numNodes > nodeBudget) {
+    aborted = true;
+    return 0;
+  }
+
+  const uint64_t slotKey = key == 0 ? 1 : key;
+  Entry& entry = table[slotKey & tableMask];
+  if(entry.key == slotKey) {
+    stats.numTableHits++;
+    int value = entry.value;
+    if(entry.bound == BOUND_EXACT)
+      return value;
+    if(entry.bound == BOUND_LOWER && value > alpha)
+      alpha = value;
+    else if(entry.bound == BOUND_UPPER && value < beta)
+      beta = value;
+    if(alpha >= beta)
+      return value;
+  }
+
+  const int origAlpha = alpha;
+  int best = -(MAX_EDGES+1);
+  //Captures first - they're usually right, and they keep the same player to move so they cut off quickly.
+  for(int pass = 0; pass < 2 && alpha < beta; pass++) {
+    for(int edgeIdx = 0; edgeIdx < numEdges && alpha < beta; edgeIdx++) {
+      if((drawn >> edgeIdx) & 1)
+        continue;
+      const uint64_t drawnAfter = drawn | ((uint64_t)1 << edgeIdx);
+      int numCaptures = countCaptures(edgeIdx, drawnAfter);
+      if((numCaptures > 0) != (pass == 0))
+        continue;
+      const uint64_t keyAfter = key ^ edgeKeys[edgeIdx];
+      int value;
+      if(numCaptures > 0)
+        value = numCaptures + negamax(drawnAfter, keyAfter, alpha - numCaptures, beta - numCaptures);
+      else
+        value = -negamax(drawnAfter, keyAfter, -beta, -alpha);
+      if(aborted)
+        return 0;
+      if(value > best)
+        best = value;
+      if(value > alpha)
+        alpha = value;
+    }
+  }
+
+  entry.key = slotKey;
+  entry.value = (int16_t)best;
+  entry.bound = best <= origAlpha ? BOUND_UPPER : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+  return best;
+}
@@ -0,0 +1,68 @@
+#ifndef SEARCH_ENDGAMESOLVER_H_
+#define SEARCH_ENDGAMESOLVER_H_
+
+#include "../core/global.h"
+#include "../game/board.h"
+
+//Exact alpha-beta solver for positions with few undrawn edges, used by search at new leaves in place of a neural
+//net evaluation. NOT threadsafe, every search thread owns its own.
+//Positions are solved for the net number of the remaining boxes that the player to move gets under perfect play.
+//That depends only on which edges are drawn, not on the score or on whose turn it is, so the transposition table is
+//keyed by the set of drawn edges alone and its entries stay valid across positions and searches.
+class EndgameSolver {
+ public:
+  static constexpr int MAX_EDGES = 64;
+
+  struct Stats {
+    int64_t numSolves; //Solves that found the result
+    int64_t numAborted; //Solves that gave up on reaching the node limit
+    int64_t numNodes;
+    int64_t numTableHits;
+  };
+
+  EndgameSolver(int tableSizePowerOfTwo);
+  ~EndgameSolver();
+
+  EndgameSolver(const EndgameSolver&) = delete;
+  EndgameSolver& operator=(const EndgameSolver&) = delete;
+
+  //Returns false if the board has more than maxEmptyEdges undrawn edges, or if solving it would take more than
+  //maxNodes nodes. Otherwise, sets winner to the winner under perfect play, or C_EMPTY for a draw.
+  bool solve(const Board& board, int maxEmptyEdges, int64_t maxNodes, Player& winner);
+
+  int getTableSizePowerOfTwo() const;
+  size_t getTableBytes() const;
+  Stats getStats() const;
+
+ private:
+  static constexpr uint8_t BOUND_EXACT = 0;
+  static constexpr uint8_t BOUND_LOWER = 1;
+  static constexpr uint8_t BOUND_UPPER = 2;
+
+  struct Entry {
+    uint64_t key; //0 means empty
+    int16_t value;
+    uint8_t bound;
+  };
+
+  const int tableSizePowerOfTwo;
+  const uint64_t tableMask;
+  //Allocated on first use, so that a solver that's never used costs nothing
+  Entry* table;
+
+  //Per-solve state
+  int numEdges;
+  uint64_t allEdgesMask;
+  uint64_t edgeKeys[MAX_EDGES];
+  //Masks of the undrawn edges of the (up to two) boxes adjacent to each edge, 0 if none
+  uint64_t edgeBoxMasks[MAX_EDGES][2];
+  int64_t nodeBudget;
+  bool aborted;
+
+  Stats stats;
+
+  int countCaptures(int edgeIdx, uint64_t drawnAfter) const;
+  int negamax(uint64_t drawn, uint64_t key, int alpha, int beta);
+};
+
+#endif  // SEARCH_ENDGAMESOLVER_H_
@@ -6,10 +6,12 @@
 #include "../search/search.h"
 
 #include <algorithm>
+#include <cstring>
 #include <numeric>
 
 #include "../core/fancymath.h"
 #include "../core/timer.h"
+#include "../game/gamelogic.h"
 #include "../game/graphhash.h"
 #include "../search/distributiontable.h"
 #include "../search/searchnode.h"
@@ -38,16 +40,25 @@ SearchThread::SearchThread(int tIdx, const Search& search)
    pla(search.rootPla),board(search.rootBoard),
    history(search.rootHistory),
    graphHash(search.rootGraphHash),
-   graphPath(),
+   graphPathLen(0),
    rand(makeSeed(search,tIdx)),
+   nodeAlloc(search.nodeAllocator->getThreadCache(std::max(tIdx,0))),
+   endgameSolver(*search.endgameSolvers[std::max(tIdx,0)]),
+   profile(*search.profileCounters[std::max(tIdx,0)]),
    nnResultBuf(),
    statsBuf(),
+   childSelectionBuf(),
+   deferredLeaves(),
+   deferringLeaf(NULL),
    upperBoundVisitsLeft(1e30),
+   hasLeafValue(false),
+   leafWinLossValue(0.0),
+   leafNoResultValue(0.0),
+   leafWeight(0.0),
    oldNNOutputsToCleanUp(),
    illegalMoveHashes()
 {
   statsBuf.resize(NNPos::MAX_NN_POLICY_SIZE);
-  graphPath.reserve(256);
 
   //Reserving even this many is almost certainly overkill but should guarantee that we never have hit allocation here.
   oldNNOutputsToCleanUp.reserve(8);
@@ -56,12 +67,80 @@ SearchThread::~SearchThread() {
   for(size_t i = 0; i<oldNNOutputsToCleanUp.size(); i++)
     delete oldNNOutputsToCleanUp[i];
   oldNNOutputsToCleanUp.resize(0);
+  for(size_t i = 0; i<deferredLeaves.size(); i++)
+    delete deferredLeaves[i];
 }
 
+static constexpr size_t CHILD_SELECTION_BUF_ALIGNMENT = 64;
+
+static size_t childSelectionArrayBytes(size_t eltBytes) {
+  size_t n = eltBytes * NNPos::MAX_NN_POLICY_SIZE;
+  return (n + CHILD_SELECTION_BUF_ALIGNMENT - 1) / CHILD_SELECTION_BUF_ALIGNMENT * CHILD_SELECTION_BUF_ALIGNMENT;
+}
+
+ChildSelectionBuf::ChildSelectionBuf()
+  :moveLoc(NULL),
+   policyProb(NULL),
+   weight(NULL),
+   utility(NULL),
+   selectionValue(NULL),
+   virtualLosses(NULL),
+   hasUtility(NULL),
+   rawMem(NULL)
+{
+  const size_t totalBytes =
+    childSelectionArrayBytes(sizeof(Loc)) +
+    4 * childSelectionArrayBytes(sizeof(double)) +
+    childSelectionArrayBytes(sizeof(int32_t)) +
+    childSelectionArrayBytes(sizeof(uint8_t));
+  //new only guarantees the alignment of fundamental types before C++17, so align by hand
+  rawMem = new char[totalBytes + CHILD_SELECTION_BUF_ALIGNMENT];
+  size_t misalignment = (size_t)((uintptr_t)rawMem % CHILD_SELECTION_BUF_ALIGNMENT);
+  char* p = rawMem + (misalignment == 0 ? 0 : CHILD_SELECTION_BUF_ALIGNMENT - misalignment);
+  std::memset(p, 0, totalBytes);
+
+  moveLoc = reinterpret_cast<Loc*>(p);
+  p += childSelectionArrayBytes(sizeof(Loc));
+  policyProb = reinterpret_cast<double*>(p);
+  p += childSelectionArrayBytes(sizeof(double));
+  weight = reinterpret_cast<double*>(p);
+  p += childSelectionArrayBytes(sizeof(double));
+  utility = reinterpret_cast<double*>(p);
+  p += childSelectionArrayBytes(sizeof(double));
+  selectionValue = reinterpret_cast<double*>(p);
+  p += childSelectionArrayBytes(sizeof(double));
+  virtualLosses = reinterpret_cast<int32_t*>(p);
+  p += childSelectionArrayBytes(sizeof(int32_t));
+  hasUtility = reinterpret_cast<uint8_t*>(p);
+}
+ChildSelectionBuf::~ChildSelectionBuf() {
+  delete[] rawMem;
+}
+
+SearchDeferredLeaf::SearchDeferredLeaf()
+  :leaf(NULL),
+   hasNNResult(false),
+   queued(false),
+   path(),
+   nnResultBuf()
+{}
+SearchDeferredLeaf::~SearchDeferredLeaf()
+{}
+
+EarlyStopState::EarlyStopState()
+  :nextCheckVisits(0),
+   prevChildVisits(),
+   prevTotalVisits(0.0),
+   prevBestIdx(-1)
+{}
+
 //-----------------------------------------------------------------------------------------
 
 static const double VALUE_WEIGHT_DEGREES_OF_FREEDOM = 3.0;
 
+//Fraction of searchParams.maxSearchMemoryBytes to trim the tree down to, so that it isn't trimmed again right away
+static constexpr double SEARCH_MEMORY_TRIM_TARGET = 0.75;
+
 Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const string& rSeed)
   :rootPla(P_BLACK),
    rootBoard(),
@@ -74,6 +153,7 @@ Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const strin
    searchParams(params),numSearchesBegun(0),searchNodeAge(0),
    plaThatSearchIsFor(C_EMPTY),plaThatSearchIsForLastSearch(C_EMPTY),
    lastSearchNumPlayouts(0),
+   lastSearchVisitsSavedByEarlyStop(0),
    effectiveSearchTimeCarriedOver(0.0),
    randSeed(rSeed),
    valueWeightDistribution(NULL),
@@ -85,11 +165,20 @@ Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const strin
    policySize(),
    rootNode(NULL),
    nodeTable(NULL),
+   nodeAllocator(NULL),
+   endgameSolvers(),
+   profileCounters(),
    mutexPool(NULL),
    numThreadsSpawned(0),
    threads(NULL),
    threadTasks(NULL),
    threadTasksRemaining(NULL),
+   treeCollectorThread(NULL),
+   treeCollectorMutex(),
+   treeCollectorUnlinkedCondVar(),
+   treeCollectorUnlinked(true),
+   treeCollectionBacklog(0),
+   treeCollectionNeedsReclaim(false),
    oldNNOutputsToCleanUpMutex(),
    oldNNOutputsToCleanUp()
 {
@@ -110,8 +199,11 @@ Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const strin
   );
 
   rootNode = NULL;
-  nodeTable = new SearchNodeTable(params.nodeTableShardsPowerOfTwo);
-  mutexPool = new MutexPool(nodeTable->mutexPool->getNumMutexes());
+  nodeTable = new SearchNodeTable(params.nodeTableCapacityPowerOfTwo);
+  nodeAllocator = new SearchNodeAllocator(params.numThreads);
+  ensureEndgameSolvers(params.numThreads);
+  ensureProfileCounters(params.numThreads);
+  mutexPool = new MutexPool((uint32_t)1 << params.nodeTableShardsPowerOfTwo);
 
   rootHistory.clear(rootBoard,rootPla,Rules());
 }
@@ -122,6 +214,11 @@ Search::~Search() {
   delete valueWeightDistribution;
 
   delete nodeTable;
+  delete nodeAllocator;
+  for(EndgameSolver* solver: endgameSolvers)
+    delete solver;
+  for(SearchProfile::ThreadCounters* counters: profileCounters)
+    delete counters;
   delete mutexPool;
   killThreads();
 }
@@ -221,14 +318,17 @@ void Search::setNNEval(NNEvaluator* nnEval) {
 }
 
 void Search::clearSearch() {
+  finishTreeCollection();
   effectiveSearchTimeCarriedOver = 0.0;
   if(rootNode != NULL) {
     deleteAllTableNodesMulithreaded();
     //Root is not stored in node table
     if(rootNode != NULL) {
-      delete rootNode;
+      rootNode->~SearchNode();
       rootNode = NULL;
     }
+    //All nodes are destroyed, release all their memory at once.
+    nodeAllocator->reset();
   }
   clearOldNNOutputs();
   searchNodeAge = 0;
@@ -257,13 +357,25 @@ bool Search::makeMove(Loc moveLoc, Player movePla) {
 
   if(movePla != rootPla)
     setPlayerAndClearHistory(movePla);
+  finishTreeCollection();
+
+  //With capture macro moves, the children of the root are reached by the move plus the captures after it, which the
+  //game will only play one at a time, so none of them is the new root.
+  if(rootNode != NULL && searchParams.useCaptureMacroMoves) {
+    Board board(rootBoard);
+    BoardHistory hist(rootHistory);
+    vector<Loc> captures;
+    playMoveForSearch(board,hist,moveLoc,rootPla,&captures);
+    if(captures.size() > 0)
+      clearSearch();
+  }
 
   if(rootNode != NULL) {
     bool foundChild = false;
     int foundChildIdx = -1;
 
     int childrenCapacity;
-    SearchChildPointer* children = rootNode->getChildren(childrenCapacity);
+    SearchChildren children = rootNode->getChildren(childrenCapacity);
     int numChildren = 0;
     for(int i = 0; i<childrenCapacity; i++) {
       SearchNode* child = children[i].getIfAllocated();
@@ -303,12 +415,20 @@ bool Search::makeMove(Loc moveLoc, Player movePla) {
 
       //Okay, this is now our new root! Create a copy so as to keep the root out of the node table.
       const bool forceNonTerminal = true;
-      rootNode = new SearchNode(*child, forceNonTerminal);
-      //Sweep over the new root marking it as good (calling NULL function), and then delete anything unmarked.
-      //This will include the old root node and the old copy of the child that we promoted to root.
-      applyRecursivelyAnyOrderMulithreaded({rootNode}, NULL);
-      bool old = true;
-      deleteAllOldOrAllNewTableNodesMulithreaded(old);
+      SearchNode* oldRootNode = rootNode;
+      rootNode = SearchNode::allocateCopy(nodeAllocator->getThreadCache(0), *child, forceNonTerminal);
+      //The old root is not in the node table, so the sweep won't get it.
+      SearchNode::destroy(nodeAllocator->getThreadCache(0), oldRootNode);
+      if(searchParams.useBackgroundTreeCollection) {
+        startTreeCollection();
+      }
+      else {
+        //Sweep over the new root marking it as good (calling NULL function), and then delete anything unmarked.
+        //This will include the old copy of the child that we promoted to root.
+        applyRecursivelyAnyOrderMulithreaded({rootNode}, NULL);
+        bool old = true;
+        deleteAllOldOrAllNewTableNodesMulithreaded(old);
+      }
     }
     else {
       clearSearch();
@@ -414,11 +534,23 @@ void Search::runWholeSearch(
     upperBoundVisitsLeftDueToTime.store(upperBoundVisits, std::memory_order_release);
   }
 
+  //Set when the tree is over searchParams.maxSearchMemoryBytes, for the threads to stop so that it can be trimmed.
+  std::atomic<bool> shouldTrimNow(false);
+
+  //Only used by thread 0
+  const bool useEarlyStop = !pondering && searchParams.earlyStopKLGainThreshold > 0;
+  EarlyStopState earlyStopState;
+  earlyStopState.nextCheckVisits = std::max(numNonPlayoutVisits, searchParams.earlyStopMinVisits);
+  lastSearchVisitsSavedByEarlyStop = 0;
+
   std::function<void(int)> searchLoop = [
     this,&timer,&numPlayoutsShared,numNonPlayoutVisits,&tcMaxTime,&upperBoundVisitsLeftDueToTime,&tc,
-    &hasMaxTime,&hasTc,
-    &shouldStopNow,maxVisits,maxPlayouts,maxTime,pondering,searchFactor
+    &hasMaxTime,&hasTc,useEarlyStop,&earlyStopState,
+    &shouldStopNow,&shouldTrimNow,maxVisits,maxPlayouts,maxTime,pondering,searchFactor
   ](int threadIdx) {
+    //Thread 0 alone runs the waves, since what the threads would select depends on their timing
+    if(searchParams.useDeterministicWaves && threadIdx != 0)
+      return;
     SearchThread* stbuf = new SearchThread(threadIdx,*this);
 
     int64_t numPlayouts = numPlayoutsShared.load(std::memory_order_relaxed);
@@ -441,12 +573,35 @@ void Search::runWholeSearch(
           shouldStop = true;
         if(hasTc && numPlayouts >= 2 && timeUsed >= tcMaxTimeLimit)
           shouldStop = true;
+        //Nothing more to learn once the root is solved
+        if(rootNode->isProven())
+          shouldStop = true;
+
+        //Thread 0 alone checks whether more visits would still change anything
+        if(
+          useEarlyStop && threadIdx == 0 && !shouldStop &&
+          numPlayouts + numNonPlayoutVisits >= earlyStopState.nextCheckVisits &&
+          shouldStopEarly(earlyStopState, numPlayouts + numNonPlayoutVisits)
+        ) {
+          double visitsLeft = std::min((double)maxPlayouts - numPlayouts, (double)maxVisits - numPlayouts - numNonPlayoutVisits);
+          if(hasTc || hasMaxTime)
+            visitsLeft = std::min(visitsLeft, upperBoundVisitsLeftDueToTime.load(std::memory_order_acquire));
+          //No meaningful count with no limit but the time and no estimate yet of the visits it allows
+          lastSearchVisitsSavedByEarlyStop = visitsLeft < 1e15 ? (int64_t)std::max(visitsLeft, 0.0) : 0;
+          shouldStop = true;
+        }
 
         if(shouldStop || shouldStopNow.load(std::memory_order_relaxed)) {
           shouldStopNow.store(true,std::memory_order_relaxed);
           break;
         }
 
+        //Thread 0 alone watches the memory use of the tree. Trimming it needs all threads out of the tree.
+        if(threadIdx == 0 && searchParams.maxSearchMemoryBytes > 0 && getSearchMemoryBytes() > searchParams.maxSearchMemoryBytes)
+          shouldTrimNow.store(true,std::memory_order_relaxed);
+        if(shouldTrimNow.load(std::memory_order_relaxed))
+          break;
+
         //Thread 0 alone is responsible for recomputing time limits every once in a while
         //Cap of 10 times per second.
         if(!pondering && (hasTc || hasMaxTime) && threadIdx == 0 && timeUsed >= lastTimeUsedRecomputingTcLimit + 0.1) {
@@ -466,10 +621,18 @@ void Search::runWholeSearch(
         upperBoundVisitsLeft = std::min(upperBoundVisitsLeft, (double)maxPlayouts - numPlayouts);
         upperBoundVisitsLeft = std::min(upperBoundVisitsLeft, (double)maxVisits - numPlayouts - numNonPlayoutVisits);
 
-        bool finishedPlayout = runSinglePlayout(*stbuf, upperBoundVisitsLeft);
-        if(finishedPlayout) {
-          numPlayouts = numPlayoutsShared.fetch_add((int64_t)1, std::memory_order_relaxed);
-          numPlayouts += 1;
+        int64_t numFinishedPlayouts;
+        if(searchParams.useDeterministicWaves)
+          numFinishedPlayouts = runMultiLeafPlayouts(*stbuf, upperBoundVisitsLeft, searchParams.numThreads * searchParams.numLeavesPerSearchThread);
+        else if(searchParams.numLeavesPerSearchThread > 1 && searchParams.useAsyncLeafPlayouts)
+          numFinishedPlayouts = runAsyncLeafPlayouts(*stbuf, upperBoundVisitsLeft);
+        else if(searchParams.numLeavesPerSearchThread > 1)
+          numFinishedPlayouts = runMultiLeafPlayouts(*stbuf, upperBoundVisitsLeft, searchParams.numLeavesPerSearchThread);
+        else
+          numFinishedPlayouts = runSinglePlayout(*stbuf, upperBoundVisitsLeft) ? 1 : 0;
+        if(numFinishedPlayouts > 0) {
+          numPlayouts = numPlayoutsShared.fetch_add(numFinishedPlayouts, std::memory_order_relaxed);
+          numPlayouts += numFinishedPlayouts;
         }
         else {
           //In the case that we didn't finish a playout, give other threads a chance to run before we try again
@@ -477,10 +640,27 @@ void Search::runWholeSearch(
           std::this_thread::yield();
         }
       }
+      //Playouts still in flight hold virtual losses and nodes mid-evaluation, so they must be finished before the search ends.
+      int64_t numFinishedPlayouts = finishAllDeferredLeaves(*stbuf);
+      if(numFinishedPlayouts > 0)
+        numPlayoutsShared.fetch_add(numFinishedPlayouts, std::memory_order_relaxed);
     }
     catch(...) {
-      transferOldNNOutputs(*stbuf);
-      delete stbuf;
+      //Same for a thread that failed, and the nn evaluator may also still be writing their results into stbuf.
+      //Leaves it failed to queue are abandoned rather than waited on, see finishAllDeferredLeaves.
+      //If they can't be finished either, leaking stbuf is better than freeing it under the nn evaluator.
+      bool finishedDeferredLeaves = false;
+      try {
+        finishAllDeferredLeaves(*stbuf);
+        finishedDeferredLeaves = true;
+      }
+      catch(...) {
+        logger->write("ERROR: Could not finish the deferred leaves of a failed search thread");
+      }
+      if(finishedDeferredLeaves) {
+        transferOldNNOutputs(*stbuf);
+        delete stbuf;
+      }
       throw;
     }
 
@@ -489,7 +669,19 @@ void Search::runWholeSearch(
   };
 
   double actualSearchStartTime = timer.getSeconds();
-  performTaskWithThreads(&searchLoop);
+  while(true) {
+    performTaskWithThreads(&searchLoop);
+    if(!shouldTrimNow.load(std::memory_order_relaxed) || shouldStopNow.load(std::memory_order_relaxed))
+      break;
+    shouldTrimNow.store(false,std::memory_order_relaxed);
+    trimSearchTree((int64_t)(searchParams.maxSearchMemoryBytes * SEARCH_MEMORY_TRIM_TARGET));
+    //Better to stop than to keep growing past the limit
+    if(getSearchMemoryBytes() > searchParams.maxSearchMemoryBytes) {
+      logger->write("WARNING: Search tree cannot be trimmed to within maxSearchMemoryBytes, stopping search");
+      shouldStopNow.store(true,std::memory_order_relaxed);
+      break;
+    }
+  }
 
   //Relaxed load is fine since numPlayoutsShared should be synchronized already due to the joins
   lastSearchNumPlayouts = numPlayoutsShared.load(std::memory_order_relaxed);
@@ -505,6 +697,13 @@ void Search::beginSearch(bool pondering) {
                       " nnYLen = " + Global::intToString(nnYLen) + " but was asked to search board with larger x or y size");
 
   rootBoard.checkConsistency();
+  waitForTreeCollectionUnlinked();
+  if(treeCollectorThread != NULL && treeCollectionBacklog.load(std::memory_order_acquire) <= 0)
+    finishTreeCollection();
+  if(treeCollectorThread == NULL && treeCollectionNeedsReclaim) {
+    nodeAllocator->reclaimEmptySlabs();
+    treeCollectionNeedsReclaim = false;
+  }
 
   numSearchesBegun++;
 
@@ -550,15 +749,15 @@ void Search::beginSearch(bool pondering) {
     //Avoid storing the root node in the nodeTable, guarantee that it never is part of a cycle, allocate it directly.
     //Also force that it is non-terminal.
     const bool forceNonTerminal = true;
-    rootNode = new SearchNode(rootPla, forceNonTerminal, createMutexIdxForNode(dummyThread));
+    rootNode = SearchNode::allocate(dummyThread.nodeAlloc, rootPla, forceNonTerminal, createMutexIdxForNode(dummyThread));
   }
   else {
     //If the root node has any existing children, then prune things down if there are moves that should not be allowed at the root.
     SearchNode& node = *rootNode;
     int childrenCapacity;
-    SearchChildPointer* children = node.getChildren(childrenCapacity);
+    SearchChildren children = node.getChildren(childrenCapacity);
     bool anyFiltered = false;
-    if(childrenCapacity > 0 && children != NULL) {
+    if(childrenCapacity > 0) {
 
       //This filtering, by deleting children, doesn't conform to the normal invariants that hold during search.
       //However nothing else should be running at this time and the search hasn't actually started yet, so this is okay.
@@ -613,19 +812,7 @@ void Search::beginSearch(bool pondering) {
         //spawned will of course be synchronized with any writes we make here,
         //including the current state of the node, so if we've moved on to a
         //higher-capacity array the lower ones will never be accessed.
-        if(children == node.children2) {
-          delete[] node.children1;
-          node.children1 = NULL;
-          delete[] node.children0;
-          node.children0 = NULL;
-        }
-        else if(children == node.children1) {
-          delete[] node.children0;
-          node.children0 = NULL;
-        }
-        else {
-          assert(children == node.children0);
-        }
+        node.freeOutgrownChildren(dummyThread.nodeAlloc);
 
         //For the node's own visit itself
         newNumVisits += 1;
@@ -675,33 +862,15 @@ SearchNode* Search::allocateOrFindNode(SearchThread& thread, Player nextPla, Loc
     childHash = thread.board.pos_hash ^ Hash128(thread.rand.nextUInt64(),thread.rand.nextUInt64());
   }
 
-  uint32_t nodeTableIdx = nodeTable->getIndex(childHash.hash0);
-  std::mutex& mutex = nodeTable->mutexPool->getMutex(nodeTableIdx);
-  std::lock_guard<std::mutex> lock(mutex);
-
   SearchNode* child = NULL;
-  std::map<Hash128,SearchNode*>& nodeMap = nodeTable->entries[nodeTableIdx];
-
   while(true) {
-    auto insertLoc = nodeMap.lower_bound(childHash);
-
-    if(insertLoc != nodeMap.end() && insertLoc->first == childHash) {
-      //Attempt to transpose to invalid node - rerandomize hash and just store this node somewhere arbitrary.
-      if(insertLoc->second->nextPla != nextPla) {
-        childHash = thread.board.pos_hash ^ Hash128(thread.rand.nextUInt64(),thread.rand.nextUInt64());
-        continue;
-      }
-      child = insertLoc->second;
-    }
-    else {
-      child = new SearchNode(nextPla, forceNonTerminal, createMutexIdxForNode(thread));
-
-      //Also perform subtree value bias and pattern bonus handling under the mutex. These parameters are no atomic, so
-      //if the node is accessed concurrently by other nodes through the table, we need to make sure these parameters are fully
-      //fully-formed before we make the node accessible to anyone.
-
-      //Insert into map! Use insertLoc as hint.
-      nodeMap.insert(insertLoc, std::make_pair(childHash,child));
+    child = nodeTable->findOrInsert(childHash, [&]() {
+      return SearchNode::allocate(thread.nodeAlloc, nextPla, forceNonTerminal, createMutexIdxForNode(thread));
+    });
+    //Attempt to transpose to invalid node - rerandomize hash and just store this node somewhere arbitrary.
+    if(child->nextPla != nextPla) {
+      childHash = thread.board.pos_hash ^ Hash128(thread.rand.nextUInt64(),thread.rand.nextUInt64());
+      continue;
     }
     break;
   }
@@ -723,44 +892,203 @@ void Search::transferOldNNOutputs(SearchThread& thread) {
 //Delete ALL nodes where nodeAge < searchNodeAge if old is true, else all nodes where nodeAge >= searchNodeAge
 //Also clears subtreevaluebias for deleted nodes.
 void Search::deleteAllOldOrAllNewTableNodesMulithreaded(bool old) {
+  finishTreeCollection();
   int numAdditionalThreads = numAdditionalThreadsToUseForTasks();
   assert(numAdditionalThreads >= 0);
+  nodeTable->beginSweep(numAdditionalThreads+1);
   std::function<void(int)> g = [&](int threadIdx) {
-    size_t idx0 = (size_t)((uint64_t)(threadIdx) * nodeTable->entries.size() / (numAdditionalThreads+1));
-    size_t idx1 = (size_t)((uint64_t)(threadIdx+1) * nodeTable->entries.size() / (numAdditionalThreads+1));
-    for(size_t i = idx0; i<idx1; i++) {
-      std::map<Hash128,SearchNode*>& nodeMap = nodeTable->entries[i];
-      for(auto it = nodeMap.cbegin(); it != nodeMap.cend();) {
-        SearchNode* node = it->second;
-        if(old == (node->nodeAge.load(std::memory_order_acquire) < searchNodeAge)) {
-          delete node;
-          it = nodeMap.erase(it);
-        }
-        else
-          ++it;
+    SearchNodeAllocator::ThreadCache& alloc = nodeAllocator->getThreadCache(threadIdx);
+    nodeTable->sweep(threadIdx, [&](SearchNode* node) {
+      if(old == (node->nodeAge.load(std::memory_order_acquire) < searchNodeAge)) {
+        SearchNode::destroy(alloc, node);
+        return true;
       }
-    }
+      return false;
+    });
   };
   performTaskWithThreads(&g);
+  nodeTable->endSweep();
+  nodeAllocator->reclaimEmptySlabs();
 }
 
-//Delete ALL nodes. More efficient than deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded if deleting everything.
-//Doesn't clear subtree value bias.
+//Collects what deleteAllOldOrAllNewTableNodesMulithreaded would after a move, on a thread of its own, so that
+//makeMove can return right away. Marking the tree and taking the unreachable nodes out of the node table has to be
+//done before the next search begins, but freeing them can go on alongside it, since nothing can reach them anymore.
+void Search::startTreeCollection() {
+  assert(treeCollectorThread == NULL);
+  treeCollectorUnlinked = false;
+  //The age is taken here rather than on the collector thread, since searchNodeAge keeps changing on this one.
+  searchNodeAge += 1;
+  treeCollectorThread = new std::thread(&Search::runTreeCollection, this, searchNodeAge);
+}
+
+void Search::runTreeCollection(uint32_t collectionAge) {
+  //Mark everything reachable from the root, single-threaded so as to stay off the thread pool.
+  vector<SearchNode*> stack;
+  rootNode->nodeAge.store(collectionAge,std::memory_order_release);
+  stack.push_back(rootNode);
+  while(stack.size() > 0) {
+    SearchNode* node = stack.back();
+    stack.pop_back();
+    int childrenCapacity;
+    SearchChildren children = node->getChildren(childrenCapacity);
+    for(int i = 0; i<childrenCapacity; i++) {
+      SearchNode* child = children[i].getIfAllocated();
+      if(child == NULL)
+        break;
+      if(child->nodeAge.exchange(collectionAge,std::memory_order_acq_rel) != collectionAge)
+        stack.push_back(child);
+    }
+  }
+
+  vector<SearchNode*> unreachable;
+  nodeTable->beginSweep(1);
+  nodeTable->sweep(0, [&](SearchNode* node) {
+    if(node->nodeAge.load(std::memory_order_acquire) < collectionAge) {
+      unreachable.push_back(node);
+      return true;
+    }
+    return false;
+  });
+  nodeTable->endSweep();
+  treeCollectionBacklog.store((int64_t)unreachable.size(),std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(treeCollectorMutex);
+    treeCollectorUnlinked = true;
+  }
+  treeCollectorUnlinkedCondVar.notify_all();
+
+  //Free in chunks, yielding in between to stay out of the way of any search running meanwhile.
+  SearchNodeAllocator::ThreadCache& alloc = nodeAllocator->getBackgroundCache();
+  const size_t chunkSize = 1024;
+  for(size_t i = 0; i<unreachable.size(); i++) {
+    SearchNode::destroy(alloc, unreachable[i]);
+    if((i+1) % chunkSize == 0 || i+1 == unreachable.size()) {
+      treeCollectionBacklog.store((int64_t)(unreachable.size() - (i+1)),std::memory_order_release);
+      std::this_thread::yield();
+    }
+  }
+}
+
+void Search::waitForTreeCollectionUnlinked() {
+  std::unique_lock<std::mutex> lock(treeCollectorMutex);
+  while(!treeCollectorUnlinked)
+    treeCollectorUnlinkedCondVar.wait(lock);
+}
+
+//Waits for any tree collection to be entirely done, and hands the memory it freed to the search threads. That has to be
+//done here before another collection can start, but returning slabs to the pool waits for the next beginSearch, so as
+//not to spend the time here in makeMove.
+void Search::finishTreeCollection() {
+  if(treeCollectorThread == NULL)
+    return;
+  treeCollectorThread->join();
+  delete treeCollectorThread;
+  treeCollectorThread = NULL;
+  nodeAllocator->releaseBackgroundCache();
+  treeCollectionNeedsReclaim = true;
+}
+
+//Trims the subtrees of the least visited nodes until the search tree takes about targetBytes. Each node trimmed keeps
+//its stats, and keeps them in SearchNode::trimmedStats too, so that recomputing them from any children it grows again doesn't
+//lose what the trimmed ones had contributed. NOT threadsafe with search.
+void Search::trimSearchTree(int64_t targetBytes) {
+  finishTreeCollection();
+  const int64_t bytesBefore = getSearchMemoryBytes();
+  if(rootNode == NULL || bytesBefore <= targetBytes)
+    return;
+  const int64_t numNodesBefore = std::max(nodeAllocator->getNumInUse(SearchNodeAllocator::SIZE_CLASS_NODE),(int64_t)1);
+  const int64_t numNodesToFree = (int64_t)ceil((double)(bytesBefore - targetBytes) / bytesBefore * numNodesBefore);
+
+  //Every node apart from the root that has any children, along with the visits of the first parent found for it.
+  struct TrimCandidate {
+    SearchNode* node;
+    int64_t visits;
+    int64_t parentVisits;
+  };
+  vector<TrimCandidate> candidates;
+  searchNodeAge += 1;
+  vector<SearchNode*> stack;
+  rootNode->nodeAge.store(searchNodeAge,std::memory_order_release);
+  stack.push_back(rootNode);
+  while(stack.size() > 0) {
+    SearchNode* node = stack.back();
+    stack.pop_back();
+    int64_t visits = node->stats.visits.load(std::memory_order_acquire);
+    int childrenCapacity;
+    SearchChildren children = node->getChildren(childrenCapacity);
+    for(int i = 0; i<childrenCapacity; i++) {
+      SearchNode* child = children[i].getIfAllocated();
+      if(child == NULL)
+        break;
+      if(child->nodeAge.exchange(searchNodeAge,std::memory_order_acq_rel) == searchNodeAge)
+        continue;
+      stack.push_back(child);
+      int grandchildrenCapacity;
+      SearchChildren grandchildren = child->getChildren(grandchildrenCapacity);
+      if(grandchildrenCapacity > 0 && grandchildren[0].getIfAllocated() != NULL)
+        candidates.push_back(TrimCandidate{child, child->stats.visits.load(std::memory_order_acquire), visits});
+    }
+  }
+
+  //Trim below the nodes with at most maxVisits visits whose parents have more, which are the roots of the least visited
+  //subtrees. A subtree has about one node per visit, so double maxVisits until that frees enough.
+  auto isTrimmed = [](const TrimCandidate& candidate, int64_t maxVisits) {
+    return candidate.visits <= maxVisits && candidate.parentVisits > maxVisits;
+  };
+  const int64_t rootVisits = rootNode->stats.visits.load(std::memory_order_acquire);
+  int64_t maxVisits = 1;
+  while(maxVisits * 2 < rootVisits) {
+    int64_t numNodesBelow = 0;
+    for(const TrimCandidate& candidate: candidates) {
+      if(isTrimmed(candidate,maxVisits))
+        numNodesBelow += candidate.visits - 1;
+    }
+    if(numNodesBelow >= numNodesToFree)
+      break;
+    maxVisits *= 2;
+  }
+
+  SearchNodeAllocator::ThreadCache& alloc = nodeAllocator->getThreadCache(0);
+  int64_t numTrimmed = 0;
+  for(const TrimCandidate& candidate: candidates) {
+    if(!isTrimmed(candidate,maxVisits))
+      continue;
+    SearchNode* node = candidate.node;
+    node->setTrimmedStats(NodeStats(node->stats), alloc);
+    node->freeChildren(alloc);
+    node->initializeChildren(alloc);
+    node->state.store(SearchNode::STATE_EXPANDED0,std::memory_order_release);
+    numTrimmed++;
+  }
+
+  //Delete everything no longer reachable, which leaves any node also reachable some other way.
+  applyRecursivelyAnyOrderMulithreaded({rootNode}, NULL);
+  bool old = true;
+  deleteAllOldOrAllNewTableNodesMulithreaded(old);
+
+  const int64_t bytesAfter = getSearchMemoryBytes();
+  logger->write(
+    "Trimmed search tree from " + Global::int64ToString(bytesBefore / 1000000) + " MB to " +
+    Global::int64ToString(bytesAfter / 1000000) + " MB, below " + Global::int64ToString(numTrimmed) +
+    " nodes with at most " + Global::int64ToString(maxVisits) + " visits"
+  );
+}
+
+//Destroy ALL nodes. More efficient than deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded if deleting everything.
+//Doesn't clear subtree value bias. Doesn't free the memory of the nodes, the caller should reset the allocator.
 void Search::deleteAllTableNodesMulithreaded() {
   int numAdditionalThreads = numAdditionalThreadsToUseForTasks();
   assert(numAdditionalThreads >= 0);
+  nodeTable->beginSweep(numAdditionalThreads+1);
   std::function<void(int)> g = [&](int threadIdx) {
-    size_t idx0 = (size_t)((uint64_t)(threadIdx) * nodeTable->entries.size() / (numAdditionalThreads+1));
-    size_t idx1 = (size_t)((uint64_t)(threadIdx+1) * nodeTable->entries.size() / (numAdditionalThreads+1));
-    for(size_t i = idx0; i<idx1; i++) {
-      std::map<Hash128,SearchNode*>& nodeMap = nodeTable->entries[i];
-      for(auto it = nodeMap.cbegin(); it != nodeMap.cend(); ++it) {
-        delete it->second;
-      }
-      nodeMap.clear();
-    }
+    nodeTable->sweep(threadIdx, [](SearchNode* node) {
+      node->~SearchNode();
+      return true;
+    });
   };
   performTaskWithThreads(&g);
+  nodeTable->endSweep();
 }
 
 //This function should NOT ever be called concurrently with any other threads modifying the search tree.
@@ -769,6 +1097,9 @@ void Search::deleteAllTableNodesMulithreaded() {
 void Search::recursivelyRecomputeStats(SearchNode& n) {
   int numAdditionalThreads = numAdditionalThreadsToUseForTasks();
   std::vector<SearchThread*> dummyThreads(numAdditionalThreads+1, NULL);
+  nodeAllocator->ensureNumThreads(numAdditionalThreads+1);
+  ensureEndgameSolvers(numAdditionalThreads+1);
+  ensureProfileCounters(numAdditionalThreads+1);
   for(int threadIdx = 0; threadIdx<numAdditionalThreads+1; threadIdx++)
     dummyThreads[threadIdx] = new SearchThread(threadIdx, *this);
 
@@ -778,7 +1109,7 @@ void Search::recursivelyRecomputeStats(SearchNode& n) {
 
     bool foundAnyChildren = false;
     int childrenCapacity;
-    SearchChildPointer* children = node->getChildren(childrenCapacity);
+    SearchChildren children = node->getChildren(childrenCapacity);
     int i = 0;
     for(; i<childrenCapacity; i++) {
       SearchNode* child = children[i].getIfAllocated();
@@ -828,8 +1159,8 @@ void Search::recursivelyRecomputeStats(SearchNode& n) {
         double newUtilitySqAvg = newUtilityAvg * newUtilityAvg;
 
         while(node->statsLock.test_and_set(std::memory_order_acquire));
-        node->stats.utilityAvg.store(newUtilityAvg,std::memory_order_release);
-        node->stats.utilitySqAvg.store(newUtilitySqAvg,std::memory_order_release);
+        node->stats.utilityAvg.store((NodeStatsAvgFloat)newUtilityAvg,std::memory_order_release);
+        node->stats.utilitySqAvg.store((NodeStatsAvgFloat)newUtilitySqAvg,std::memory_order_release);
         node->statsLock.clear(std::memory_order_release);
       }
     }
@@ -851,23 +1182,233 @@ void Search::recursivelyRecomputeStats(SearchNode& n) {
 bool Search::runSinglePlayout(SearchThread& thread, double upperBoundVisitsLeft) {
   //Store this value, used for futile-visit pruning this thread's root children selections.
   thread.upperBoundVisitsLeft = upperBoundVisitsLeft;
+  thread.hasLeafValue = false;
 
-  bool posesWithChildBuf[NNPos::MAX_NN_POLICY_SIZE];
-  bool finishedPlayout = playoutDescend(thread,*rootNode,posesWithChildBuf,true);
+  bool finishedPlayout = playoutDescend(thread,*rootNode,true);
 
   //Restore thread state back to the root state
   thread.pla = rootPla;
   thread.board = rootBoard;
   thread.history = rootHistory;
   thread.graphHash = rootGraphHash;
-  thread.graphPath.clear();
+  thread.graphPathLen = 0;
 
   return finishedPlayout;
 }
 
+int Search::runMultiLeafPlayouts(SearchThread& thread, double upperBoundVisitsLeft, int numLeaves) {
+  int numLeavesToCollect = numLeaves;
+  if(upperBoundVisitsLeft < numLeavesToCollect)
+    numLeavesToCollect = std::max(1, (int)upperBoundVisitsLeft);
+  while((int)thread.deferredLeaves.size() < numLeavesToCollect)
+    thread.deferredLeaves.push_back(new SearchDeferredLeaf());
+
+  int numFinished = 0;
+  int numDeferred = 0;
+  for(int i = 0; i<numLeavesToCollect; i++) {
+    SearchDeferredLeaf* leaf = thread.deferredLeaves[numDeferred];
+    thread.deferringLeaf = leaf;
+    bool finishedPlayout = runSinglePlayout(thread, upperBoundVisitsLeft - numFinished - numDeferred);
+    thread.deferringLeaf = NULL;
+    if(leaf->leaf != NULL)
+      numDeferred++;
+    else if(finishedPlayout)
+      numFinished++;
+    //Most likely we ran into a leaf that is already waiting on the nn, probably one of our own. Rather than spin,
+    //send off what we have.
+    else
+      break;
+  }
+
+  vector<NNResultBuf*> bufsToQueue;
+  for(int i = 0; i<numDeferred; i++) {
+    if(!thread.deferredLeaves[i]->hasNNResult)
+      bufsToQueue.push_back(&(thread.deferredLeaves[i]->nnResultBuf));
+  }
+  if(bufsToQueue.size() > 0) {
+    uint64_t startTicks = SearchProfile::getTicks();
+    nnEvaluator->queueEvaluations(bufsToQueue.data(), (int)bufsToQueue.size());
+    thread.profile.add(SearchProfile::PHASE_NN_QUEUE, startTicks);
+    for(int i = 0; i<numDeferred; i++) {
+      if(!thread.deferredLeaves[i]->hasNNResult)
+        thread.deferredLeaves[i]->queued = true;
+    }
+  }
+
+  for(int i = 0; i<numDeferred; i++) {
+    finishDeferredLeaf(thread, *thread.deferredLeaves[i]);
+    numFinished++;
+  }
+  return numFinished;
+}
+
+int Search::runAsyncLeafPlayouts(SearchThread& thread, double upperBoundVisitsLeft) {
+  const int maxInFlight = searchParams.numLeavesPerSearchThread;
+  while((int)thread.deferredLeaves.size() < maxInFlight)
+    thread.deferredLeaves.push_back(new SearchDeferredLeaf());
+
+  //Back up every playout whose evaluation has arrived
+  int numFinished = 0;
+  int numInFlight = 0;
+  for(SearchDeferredLeaf* leaf: thread.deferredLeaves) {
+    if(leaf->leaf == NULL)
+      continue;
+    if(nnEvaluator->isResultReady(leaf->nnResultBuf)) {
+      finishDeferredLeaf(thread, *leaf);
+      numFinished++;
+    }
+    else
+      numInFlight++;
+  }
+
+  //Start new playouts in the free slots. Bound the attempts, since playouts that finish without the nn don't
+  //use up a slot and we need to get back to checking whether to stop.
+  vector<SearchDeferredLeaf*> leavesToQueue;
+  vector<NNResultBuf*> bufsToQueue;
+  const double maxToStart = std::max(1.0, upperBoundVisitsLeft);
+  size_t slot = 0;
+  for(int attempt = 0; attempt < maxInFlight; attempt++) {
+    while(slot < thread.deferredLeaves.size() && thread.deferredLeaves[slot]->leaf != NULL)
+      slot++;
+    if(slot >= thread.deferredLeaves.size() || numFinished + numInFlight >= maxToStart)
+      break;
+    SearchDeferredLeaf* leaf = thread.deferredLeaves[slot];
+    thread.deferringLeaf = leaf;
+    bool finishedPlayout = runSinglePlayout(thread, upperBoundVisitsLeft - numFinished - numInFlight);
+    thread.deferringLeaf = NULL;
+    if(leaf->leaf != NULL) {
+      if(leaf->hasNNResult) {
+        finishDeferredLeaf(thread, *leaf);
+        numFinished++;
+      }
+      else {
+        leavesToQueue.push_back(leaf);
+        bufsToQueue.push_back(&(leaf->nnResultBuf));
+        numInFlight++;
+      }
+    }
+    else if(finishedPlayout)
+      numFinished++;
+    else
+      break;
+  }
+  if(bufsToQueue.size() > 0) {
+    uint64_t startTicks = SearchProfile::getTicks();
+    nnEvaluator->queueEvaluations(bufsToQueue.data(), (int)bufsToQueue.size());
+    thread.profile.add(SearchProfile::PHASE_NN_QUEUE, startTicks);
+    for(SearchDeferredLeaf* leaf: leavesToQueue)
+      leaf->queued = true;
+  }
+
+  //Nothing more can happen until the nn returns something, so wait on it rather than spin.
+  if(numFinished == 0 && numInFlight > 0) {
+    for(SearchDeferredLeaf* leaf: thread.deferredLeaves) {
+      if(leaf->leaf != NULL) {
+        finishDeferredLeaf(thread, *leaf);
+        numFinished++;
+        break;
+      }
+    }
+  }
+  return numFinished;
+}
+
+int Search::finishAllDeferredLeaves(SearchThread& thread) {
+  int numFinished = 0;
+  for(SearchDeferredLeaf* leaf: thread.deferredLeaves) {
+    if(leaf->leaf == NULL)
+      continue;
+    if(leaf->hasNNResult || leaf->queued) {
+      finishDeferredLeaf(thread, *leaf);
+      numFinished++;
+    }
+    else
+      abandonDeferredLeaf(*leaf);
+  }
+  return numFinished;
+}
+
+void Search::finishDeferredLeaf(SearchThread& thread, SearchDeferredLeaf& leaf) {
+  SearchNode& node = *leaf.leaf;
+  if(!leaf.hasNNResult) {
+    uint64_t startTicks = SearchProfile::getTicks();
+    nnEvaluator->waitForResult(leaf.nnResultBuf);
+    thread.profile.add(SearchProfile::PHASE_NN_WAIT, startTicks);
+  }
+
+  //Same as initNodeNNOutput and the rest of the new leaf case of playoutDescend
+  std::shared_ptr<NNOutput>* result = new std::shared_ptr<NNOutput>(std::move(leaf.nnResultBuf.result));
+  node.nodeAge.store(searchNodeAge,std::memory_order_release);
+  if(node.storeNNOutputIfNull(result))
+    addCurrentNNOutputAsLeafValue(node,true);
+  else
+    delete result;
+  node.initializeChildren(thread.nodeAlloc);
+  node.state.store(SearchNode::STATE_EXPANDED0, std::memory_order_seq_cst);
+  thread.hasLeafValue = false;
+  setPlayoutLeafValueFromNNOutput(thread,node);
+
+  //And the same as playoutDescend after returning from each level of recursion
+  for(const SearchDeferredLeaf::PathStep& step: leaf.path) {
+    int nodeState = step.node->state.load(std::memory_order_acquire);
+    int childrenCapacity;
+    SearchChildren children = step.node->getChildren(nodeState,childrenCapacity);
+    children[step.childIdx].addEdgeVisits(1);
+    if(step.child->getProvenWinner() == step.node->nextPla && setNodeProven(*step.node, step.node->nextPla))
+      thread.hasLeafValue = false;
+    updateStatsAfterPlayout(*step.node,thread,step.isRoot);
+    step.child->virtualLosses.fetch_add(-1,std::memory_order_release);
+  }
+
+  leaf.leaf = NULL;
+  leaf.queued = false;
+  leaf.path.clear();
+}
+
+void Search::abandonDeferredLeaf(SearchDeferredLeaf& leaf) {
+  assert(!leaf.queued);
+  for(const SearchDeferredLeaf::PathStep& step: leaf.path)
+    step.child->virtualLosses.fetch_add(-1,std::memory_order_release);
+  //Nothing was stored in the node while it was EVALUATING, so this is the same as never having claimed it.
+  leaf.leaf->state.store(SearchNode::STATE_UNEVALUATED, std::memory_order_seq_cst);
+  leaf.leaf = NULL;
+  leaf.path.clear();
+}
+
+bool Search::maybeSolveEndgameLeaf(SearchThread& thread, SearchNode& node) {
+  if(searchParams.endgameSolverMaxEmptyEdges <= 0 || node.forceNonTerminal)
+    return false;
+  Player winner;
+  uint64_t startTicks = SearchProfile::getTicks();
+  bool solved = thread.endgameSolver.solve(thread.board, searchParams.endgameSolverMaxEmptyEdges, searchParams.endgameSolverMaxNodes, winner);
+  thread.profile.add(SearchProfile::PHASE_ENDGAME_SOLVE, startTicks);
+  if(!solved)
+    return false;
+  double winLossValue = getProvenWinLossValue(winner);
+  double noResultValue = 0.0;
+  double weight = (searchParams.useUncertainty && nnEvaluator->supportsShorttermError()) ? searchParams.uncertaintyMaxWeight : 1.0;
+  addLeafValue(node, winLossValue, noResultValue, weight, true, false);
+  node.setProvenWinner(winner);
+  setPlayoutLeafValue(thread, winLossValue, noResultValue, weight);
+  return true;
+}
+
+void Search::playMoveForSearch(Board& board, BoardHistory& hist, Loc moveLoc, Player movePla, vector<Loc>* capturesBuf) const {
+  hist.makeBoardMoveAssumeLegal(board,moveLoc,movePla);
+  if(!searchParams.useCaptureMacroMoves)
+    return;
+  while(!hist.isGameFinished) {
+    Loc captureLoc = GameLogic::getForcedCaptureLoc(board);
+    if(captureLoc == Board::NULL_LOC)
+      break;
+    hist.makeBoardMoveAssumeLegal(board,captureLoc,board.nextPla);
+    if(capturesBuf != NULL)
+      capturesBuf->push_back(captureLoc);
+  }
+}
+
 bool Search::playoutDescend(
   SearchThread& thread, SearchNode& node,
-  bool posesWithChildBuf[NNPos::MAX_NN_POLICY_SIZE],
   bool isRoot
 ) {
   //Hit terminal node, finish
@@ -877,25 +1418,26 @@ bool Search::playoutDescend(
   //Note that we also carefully clear the search when a pass from the root would be terminal, so nodes should never need to switch
   //status after tree reuse in the latter case.
   if(thread.history.isGameFinished && !node.forceNonTerminal) {
-    //Avoid running "too fast", by making sure that a leaf evaluation takes roughly the same time as a genuine nn eval
-    //This stops a thread from building a silly number of visits to distort MCTS statistics while other threads are stuck on the GPU.
-
-    if(searchParams.finishGameSearchDelayMicroseconds > 0) {
-      uint64_t usToDelay = thread.rand.nextUInt64(searchParams.finishGameSearchDelayMicroseconds * 2);
-      std::this_thread::sleep_for(std::chrono::microseconds(usToDelay));
-    }
-    
-    nnEvaluator->waitForNextNNEvalIfAny();
-   
-      double winLossValue = thread.history.winner == C_WHITE ? 1.0 : thread.history.winner == C_BLACK ? -1.0 : 0.0;
-      double noResultValue = 0.0;
-      double weight = (searchParams.useUncertainty && nnEvaluator->supportsShorttermError()) ? searchParams.uncertaintyMaxWeight : 1.0;
-      addLeafValue(node, winLossValue, noResultValue, weight, true, false);
-      return true;
-    
+    //Mark the node as solved, so that the parent stops selecting it rather than piling visits into a finished game.
+    double winLossValue = getProvenWinLossValue(thread.history.winner);
+    double noResultValue = 0.0;
+    double weight = (searchParams.useUncertainty && nnEvaluator->supportsShorttermError()) ? searchParams.uncertaintyMaxWeight : 1.0;
+    addLeafValue(node, winLossValue, noResultValue, weight, true, false);
+    node.setProvenWinner(thread.history.winner);
+    setPlayoutLeafValue(thread, winLossValue, noResultValue, weight);
+    return true;
   }
 
   int nodeState = node.state.load(std::memory_order_acquire);
+  //Small enough endgames are solved outright instead of being evaluated by the nn, and then treated just like terminal nodes.
+  if(nodeState == SearchNode::STATE_UNEVALUATED && !isRoot && maybeSolveEndgameLeaf(thread,node))
+    return true;
+  if(nodeState == SearchNode::STATE_UNEVALUATED && thread.deferringLeaf != NULL && !isRoot) {
+    //Claim the leaf and prepare its nn evaluation, the playout gets finished by finishDeferredLeaf.
+    if(node.state.compare_exchange_strong(nodeState, SearchNode::STATE_EVALUATING, std::memory_order_seq_cst))
+      deferLeafNNEvaluation(thread,node);
+    return false;
+  }
   if(nodeState == SearchNode::STATE_UNEVALUATED) {
     //Always attempt to set a new nnOutput. That way, if some GPU is slow and malfunctioning, we don't get blocked by it.
     {
@@ -914,8 +1456,9 @@ bool Search::playoutDescend(
     }
     else {
       //Perform the nn evaluation and finish!
-      node.initializeChildren();
+      node.initializeChildren(thread.nodeAlloc);
       node.state.store(SearchNode::STATE_EXPANDED0, std::memory_order_seq_cst);
+      setPlayoutLeafValueFromNNOutput(thread,node);
       return true;
     }
   }
@@ -934,7 +1477,9 @@ bool Search::playoutDescend(
 
   SearchNode* child = NULL;
   while(true) {
-    selectBestChildToDescend(thread,node,nodeState,numChildrenFound,bestChildIdx,bestChildMoveLoc,posesWithChildBuf,isRoot);
+    uint64_t startTicks = SearchProfile::getTicks();
+    selectBestChildToDescend(thread,node,nodeState,numChildrenFound,bestChildIdx,bestChildMoveLoc,isRoot);
+    thread.profile.add(SearchProfile::PHASE_SELECTION, startTicks);
 
     //The absurdly rare case that the move chosen is not legal
     //(this should only happen either on a bug or where the nnHash doesn't have full legality information or when there's an actual hash collision).
@@ -964,7 +1509,9 @@ bool Search::playoutDescend(
 
       //As isReInit is true, we don't return, just keep going, since we didn't count this as a true visit in the node stats
       nodeState = node.state.load(std::memory_order_acquire);
-      selectBestChildToDescend(thread,node,nodeState,numChildrenFound,bestChildIdx,bestChildMoveLoc,posesWithChildBuf,isRoot);
+      startTicks = SearchProfile::getTicks();
+      selectBestChildToDescend(thread,node,nodeState,numChildrenFound,bestChildIdx,bestChildMoveLoc,isRoot);
+      thread.profile.add(SearchProfile::PHASE_SELECTION, startTicks);
 
       if(bestChildIdx >= 0) {
         //New child
@@ -980,18 +1527,26 @@ bool Search::playoutDescend(
           //An illegal move should make it into the tree only in case of cycle or bad transposition
           //We want the search to continue as best it can, so we increment visits so other search branches will still make progress.
           int childrenCapacity;
-          SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
+          SearchChildren children = node.getChildren(nodeState,childrenCapacity);
           assert(childrenCapacity > bestChildIdx);
           children[bestChildIdx].addEdgeVisits(1);
+          thread.hasLeafValue = false;
           return true;
         }
       }
     }
 
     if(bestChildIdx <= -1) {
+      //Maybe every move left to search is solved, so this node is solved too.
+      if(maybeSetProvenFromChildren(thread, node, isRoot) || node.isProven()) {
+        thread.hasLeafValue = false;
+        updateStatsAfterPlayout(node,thread,isRoot);
+        return true;
+      }
       //This might happen if all moves have been forbidden. The node will just get stuck counting visits without expanding
       //and we won't do any search.
       addCurrentNNOutputAsLeafValue(node,false);
+      setPlayoutLeafValueFromNNOutput(thread,node);
       return true;
     }
 
@@ -999,7 +1554,7 @@ bool Search::playoutDescend(
     if(bestChildIdx >= numChildrenFound) {
       assert(bestChildIdx == numChildrenFound);
       assert(bestChildIdx < NNPos::MAX_NN_POLICY_SIZE);
-      bool suc = node.maybeExpandChildrenCapacityForNewChild(nodeState, numChildrenFound+1);
+      bool suc = node.maybeExpandChildrenCapacityForNewChild(nodeState, numChildrenFound+1, thread.nodeAlloc);
       //Someone else is expanding. Loop again trying to select the best child to explore.
       if(!suc) {
         std::this_thread::yield();
@@ -1008,11 +1563,11 @@ bool Search::playoutDescend(
       }
 
       int childrenCapacity;
-      SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
+      SearchChildren children = node.getChildren(nodeState,childrenCapacity);
       assert(childrenCapacity > bestChildIdx);
 
       //Make the move! We need to make the move before we create the node so we can see the new state and get the right graphHash.
-      thread.history.makeBoardMoveAssumeLegal(thread.board,bestChildMoveLoc,thread.pla);
+      playMoveForSearch(thread.board,thread.history,bestChildMoveLoc,thread.pla,NULL);
       thread.pla = thread.board.nextPla;
       if(searchParams.useGraphSearch)
         thread.graphHash = GraphHash::getGraphHash(
@@ -1021,7 +1576,9 @@ bool Search::playoutDescend(
 
       //If conservative pass, passing from the root is always non-terminal
       const bool forceNonTerminal = false;
+      startTicks = SearchProfile::getTicks();
       child = allocateOrFindNode(thread, thread.pla, bestChildMoveLoc, forceNonTerminal, thread.graphHash);
+      thread.profile.add(SearchProfile::PHASE_NODE_TABLE, startTicks);
       child->virtualLosses.fetch_add(1,std::memory_order_release);
 
       {
@@ -1046,6 +1603,7 @@ bool Search::playoutDescend(
       //If edge visits is too much smaller than the child's visits, we can avoid descending.
       //Instead just add edge visits and treat that as a visit.
       if(maybeCatchUpEdgeVisits(thread, node, child, nodeState, bestChildIdx)) {
+        thread.hasLeafValue = false;
         updateStatsAfterPlayout(node,thread,isRoot);
         child->virtualLosses.fetch_add(-1,std::memory_order_release);
         return true;
@@ -1054,7 +1612,7 @@ bool Search::playoutDescend(
     //Searching an existing child
     else {
       int childrenCapacity;
-      SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
+      SearchChildren children = node.getChildren(nodeState,childrenCapacity);
       child = children[bestChildIdx].getIfAllocated();
       assert(child != NULL);
 
@@ -1063,13 +1621,14 @@ bool Search::playoutDescend(
       //If edge visits is too much smaller than the child's visits, we can avoid descending.
       //Instead just add edge visits and treat that as a visit.
       if(maybeCatchUpEdgeVisits(thread, node, child, nodeState, bestChildIdx)) {
+        thread.hasLeafValue = false;
         updateStatsAfterPlayout(node,thread,isRoot);
         child->virtualLosses.fetch_add(-1,std::memory_order_release);
         return true;
       }
 
       //Make the move!
-      thread.history.makeBoardMoveAssumeLegal(thread.board,bestChildMoveLoc,thread.pla);
+      playMoveForSearch(thread.board,thread.history,bestChildMoveLoc,thread.pla,NULL);
       thread.pla = thread.board.nextPla;
       if(searchParams.useGraphSearch)
         thread.graphHash = GraphHash::getGraphHash(thread.history, thread.pla
@@ -1082,27 +1641,39 @@ bool Search::playoutDescend(
   //If somehow we find ourselves in a cycle, increment edge visits and terminate the playout.
   //Basically if the search likes a cycle... just reinforce playing around the cycle and hope we return something
   //reasonable in the end of the search.
-  {
-    std::pair<std::unordered_set<SearchNode*>::iterator,bool> result = thread.graphPath.insert(child);
-    //No insertion, child was already there
-    if(!result.second) {
+  if(searchParams.useGraphSearch && GameLogic::POSITIONS_CAN_REPEAT) {
+    //Paths too long to track are cut off the same way
+    bool isCycle = thread.graphPathLen >= SearchThread::MAX_GRAPH_PATH_LEN;
+    for(int i = 0; i<thread.graphPathLen && !isCycle; i++)
+      isCycle = thread.graphPath[i] == child;
+    if(isCycle) {
       int childrenCapacity;
-      SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
+      SearchChildren children = node.getChildren(nodeState,childrenCapacity);
       children[bestChildIdx].addEdgeVisits(1);
+      thread.hasLeafValue = false;
       updateStatsAfterPlayout(node,thread,isRoot);
       child->virtualLosses.fetch_add(-1,std::memory_order_release);
       return true;
     }
+    thread.graphPath[thread.graphPathLen++] = child;
   }
 
   //Recurse!
-  bool finishedPlayout = playoutDescend(thread,*child,posesWithChildBuf,false);
+  bool finishedPlayout = playoutDescend(thread,*child,false);
+  //The leaf is waiting on the nn, so keep our virtual loss and record what finishDeferredLeaf needs to update this node.
+  if(thread.deferringLeaf != NULL && thread.deferringLeaf->leaf != NULL) {
+    thread.deferringLeaf->path.push_back(SearchDeferredLeaf::PathStep{&node, bestChildIdx, child, isRoot});
+    return false;
+  }
   //Update this node stats
   if(finishedPlayout) {
     nodeState = node.state.load(std::memory_order_acquire);
     int childrenCapacity;
-    SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
+    SearchChildren children = node.getChildren(nodeState,childrenCapacity);
     children[bestChildIdx].addEdgeVisits(1);
+    //A move that wins by force solves this node.
+    if(child->getProvenWinner() == node.nextPla && setNodeProven(node, node.nextPla))
+      thread.hasLeafValue = false;
     updateStatsAfterPlayout(node,thread,isRoot);
   }
   child->virtualLosses.fetch_add(-1,std::memory_order_release);
@@ -1117,7 +1688,7 @@ bool Search::maybeCatchUpEdgeVisits(SearchThread& thread, SearchNode& node, Sear
   //Don't need to do this since we already are pretty recent as of finding the best child.
   //nodeState = node.state.load(std::memory_order_acquire);
   int childrenCapacity;
-  SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
+  SearchChildren children = node.getChildren(nodeState,childrenCapacity);
 
   // int64_t maxNumToAdd = 1;
   // if(searchParams.graphSearchCatchUpProp > 0.0) {
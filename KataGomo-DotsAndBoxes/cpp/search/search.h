@@ -15,9 +15,12 @@
 #include "../game/rules.h"
 #include "../neuralnet/nneval.h"
 #include "../search/analysisdata.h"
+#include "../search/endgamesolver.h"
 #include "../search/mutexpool.h"
 #include "../search/reportedsearchvalues.h"
+#include "../search/searchnodeallocator.h"
 #include "../search/searchparams.h"
+#include "../search/searchprofile.h"
 #include "../search/searchprint.h"
 #include "../search/timecontrols.h"
 
@@ -29,10 +32,66 @@ struct Search;
 struct DistributionTable;
 struct PolicySortEntry;
 struct MoreNodeStats;
+struct NodeStats;
 struct ReportedSearchValues;
 struct SearchChildPointer;
 struct SearchNodeTable;
 
+//The children of a node as seen by selectBestChildToDescend, one array per value, so that the selection values of all
+//of them can be computed by a single simple loop that the compiler can vectorize. Every array has room for
+//NNPos::MAX_NN_POLICY_SIZE children and starts on its own cache line.
+struct ChildSelectionBuf {
+  Loc* moveLoc;
+  double* policyProb; //Negative for children not to select, illegal or proven
+  double* weight;
+  double* utility;
+  double* selectionValue;
+  int32_t* virtualLosses; //Descents currently in flight through the child
+  uint8_t* hasUtility; //1 if utility is set, 0 if the child has no value yet and gets the fpu value
+
+  ChildSelectionBuf();
+  ~ChildSelectionBuf();
+  ChildSelectionBuf(const ChildSelectionBuf&) = delete;
+  ChildSelectionBuf& operator=(const ChildSelectionBuf&) = delete;
+
+ private:
+  char* rawMem;
+};
+
+//A playout that has reached a new leaf and is waiting on its nn evaluation, see searchParams.numLeavesPerSearchThread.
+struct SearchDeferredLeaf {
+  struct PathStep {
+    SearchNode* node;
+    int childIdx;
+    SearchNode* child;
+    bool isRoot;
+  };
+
+  SearchNode* leaf; //NULL if none
+  bool hasNNResult; //True if the result came from the nn cache, so it doesn't need to be queued
+  bool queued; //True once nnResultBuf is queued on the nn evaluator, so that its result will arrive
+  //The steps of the playout down to the leaf, from the parent of the leaf up to the root
+  std::vector<PathStep> path;
+  NNResultBuf nnResultBuf;
+
+  SearchDeferredLeaf();
+  ~SearchDeferredLeaf();
+
+  SearchDeferredLeaf(const SearchDeferredLeaf&) = delete;
+  SearchDeferredLeaf& operator=(const SearchDeferredLeaf&) = delete;
+};
+
+//What the stopping rule of searchParams.earlyStopKLGainThreshold remembers between its checks during a search
+struct EarlyStopState {
+  int64_t nextCheckVisits;
+  //Edge visits of each child of the root at the last check, empty if none yet
+  std::vector<double> prevChildVisits;
+  double prevTotalVisits;
+  int prevBestIdx;
+
+  EarlyStopState();
+};
+
 //Per-thread state
 struct SearchThread {
   int threadIdx;
@@ -41,16 +100,39 @@ struct SearchThread {
   Board board;
   BoardHistory history;
   Hash128 graphHash;
-  //The path we trace down the graph as we do a playout
-  std::unordered_set<SearchNode*> graphPath;
+  //The path we trace down the graph as we do a playout, to catch cycles. Only tracked when there can be any, which
+  //needs graph search and a game where positions can repeat.
+  static constexpr int MAX_GRAPH_PATH_LEN = Board::MAX_ARR_SIZE;
+  SearchNode* graphPath[MAX_GRAPH_PATH_LEN];
+  int graphPathLen;
 
   Rand rand;
 
+  //Allocation of nodes and children arrays by this thread
+  SearchNodeAllocator::ThreadCache& nodeAlloc;
+  //Exact solving of small endgames at new leaves, see searchParams.endgameSolverMaxEmptyEdges
+  EndgameSolver& endgameSolver;
+  //Time spent in each phase of the playouts of this thread
+  SearchProfile::ThreadCounters& profile;
+
   NNResultBuf nnResultBuf;
   std::vector<MoreNodeStats> statsBuf;
+  ChildSelectionBuf childSelectionBuf;
+
+  //The leaves being collected when searchParams.numLeavesPerSearchThread > 1, and the one the current playout should
+  //defer its new leaf into, or NULL if it should evaluate it right away.
+  std::vector<SearchDeferredLeaf*> deferredLeaves;
+  SearchDeferredLeaf* deferringLeaf;
 
   double upperBoundVisitsLeft;
 
+  //The value added at the leaf of the current playout, for searchParams.useIncrementalBackup.
+  //Invalid if the playout finished without adding a new leaf value, in which case the nodes on the path are recomputed in full.
+  bool hasLeafValue;
+  double leafWinLossValue;
+  double leafNoResultValue;
+  double leafWeight;
+
   //Occasionally we may need to swap out an NNOutput from a node mid-search.
   //However, to prevent access-after-delete races, the thread that swaps one out stores
   //it here instead of deleting it, so that pointers and accesses to it remain valid.
@@ -97,6 +179,9 @@ struct Search {
   Player plaThatSearchIsFor;
   Player plaThatSearchIsForLastSearch;
   int64_t lastSearchNumPlayouts;
+  //How many more visits the limits would have allowed when the last search stopped early due to
+  //searchParams.earlyStopKLGainThreshold, 0 if it didn't
+  int64_t lastSearchVisitsSavedByEarlyStop;
   double effectiveSearchTimeCarriedOver; //Effective search time carried over from previous moves due to ponder/tree reuse
 
   std::string randSeed;
@@ -128,6 +213,11 @@ struct Search {
 
   SearchNode* rootNode;
   SearchNodeTable* nodeTable;
+  SearchNodeAllocator* nodeAllocator;
+  //One per thread index, kept across searches so that their tables stay warm
+  std::vector<EndgameSolver*> endgameSolvers;
+  //One per thread index, kept across searches until cleared with clearSearchProfile
+  std::vector<SearchProfile::ThreadCounters*> profileCounters;
   MutexPool* mutexPool;
 
   //Thread pool
@@ -136,6 +226,14 @@ struct Search {
   ThreadSafeQueue<std::function<void(int)>*>* threadTasks;
   ThreadSafeCounter* threadTasksRemaining;
 
+  //Collection of the nodes left unreachable by makeMove in the background, see searchParams.useBackgroundTreeCollection.
+  std::thread* treeCollectorThread; //NULL if none running or waiting to be joined
+  std::mutex treeCollectorMutex;
+  std::condition_variable treeCollectorUnlinkedCondVar;
+  bool treeCollectorUnlinked; //True once the unreachable nodes are out of the node table, so that a search may begin
+  std::atomic<int64_t> treeCollectionBacklog; //Nodes out of the node table that are still to be freed
+  bool treeCollectionNeedsReclaim; //A finished collection freed memory whose empty slabs haven't been pooled yet
+
   //Occasionally we may need to swap out an NNOutput from a node mid-search.
   //However, to prevent access-after-delete races, this vector collects them after a thread exits, and is cleaned up
   //very lazily only when a new search begins or the search is cleared.
@@ -202,6 +300,16 @@ struct Search {
   bool isLegalTolerant(Loc moveLoc, Player movePla) const;
   bool isLegalStrict(Loc moveLoc, Player movePla) const;
 
+  //Writes the whole search graph with the stats of every node and edge to a compact binary file, along with the nn
+  //outputs of the nodes if includeNNOutputs, so that searching can be continued from it later or on another machine.
+  //searchcheckpoint.cpp
+  void saveTree(const std::string& fileName, bool includeNNOutputs);
+  //Replaces the search tree with the one saved in fileName, which must be for the current root position reached by the
+  //same history, and saved with the same useCaptureMacroMoves and useGraphSearch. Recomputes any nn outputs that were
+  //not saved. Throws StringError if the file is unusable, in which case the search is left as it was.
+  //searchcheckpoint.cpp
+  void loadTree(const std::string& fileName);
+
   //Run an entire search from start to finish
   Loc runWholeSearchAndGetMove(Player movePla);
   void runWholeSearch(Player movePla);
@@ -223,6 +331,17 @@ struct Search {
   //Expert manual playout-by-playout interface
   void beginSearch(bool pondering);
   bool runSinglePlayout(SearchThread& thread, double upperBoundVisitsLeft);
+  //Runs up to numLeaves playouts one after another, sending the nn evaluations of their leaves together and backing
+  //them up in the same order once they arrive. Returns the number of playouts finished.
+  int runMultiLeafPlayouts(SearchThread& thread, double upperBoundVisitsLeft, int numLeaves);
+  //With searchParams.useAsyncLeafPlayouts, keeps up to searchParams.numLeavesPerSearchThread playouts in flight across
+  //calls instead. Backs up those whose nn evaluation has arrived and starts new ones in their place, waiting on the nn
+  //only if that made no progress. Returns the number of playouts finished.
+  int runAsyncLeafPlayouts(SearchThread& thread, double upperBoundVisitsLeft);
+  //Waits for and backs up every playout still in flight. Returns the number of playouts finished.
+  //Playouts whose evaluation never got queued, which only happens if the search thread failed while collecting them,
+  //are abandoned instead since no result will ever arrive for them.
+  int finishAllDeferredLeaves(SearchThread& thread);
 
   //================================================================================================================
   // SEARCH RESULTS AND TREE INSPECTION METHODS
@@ -241,6 +360,9 @@ struct Search {
   //Choose a move at the root of the tree, with randomization, if possible.
   //Might return Board::NULL_LOC if there is no root, or no legal moves that aren't forcibly pruned, etc.
   Loc getChosenMoveLoc();
+  //Same, but also counting extraVisits[i] more visits for extraLocs[i] from other searches of this same root position,
+  //such as root parallel workers. These are ignored if anything at the root is already solved.
+  Loc getChosenMoveLoc(const std::vector<Loc>& extraLocs, const std::vector<double>& extraVisits);
   //Get the vector of values (e.g. modified visit counts) used to select a move.
   //Does take into account chosenMoveSubtract but does NOT apply temperature.
   //If somehow the max value is less than scaleMaxToAtLeast, scale it to at least that value.
@@ -278,6 +400,24 @@ struct Search {
 
   //Get the number of visits recorded for the root node
   int64_t getRootVisits() const;
+  //Get the fraction of slots in use in the graph search node table, over all tables chained while it grows
+  double getNodeTableLoadFactor() const;
+  //Get a hash of the moves, visits and values throughout the search tree, for checking that two searches did the same.
+  Hash128 getTreeHash() const;
+  //Get the memory use of the search tree
+  SearchNodeAllocator::Stats getNodeAllocatorStats() const;
+  //Get the work done by the endgame solvers, summed over all threads and searches so far
+  EndgameSolver::Stats getEndgameSolverStats() const;
+  //Get the number of nodes left unreachable by earlier moves that the background tree collection has yet to free
+  int64_t getTreeCollectionBacklog() const;
+  //Get the approximate memory use of the search tree, counting nodes, children arrays and neural net outputs.
+  //Threadsafe, including during search.
+  int64_t getSearchMemoryBytes() const;
+  //Get the time spent by the search threads in each phase of their playouts, summed over all threads and over all
+  //searches since the last clearSearchProfile. Threadsafe, including during search.
+  SearchProfile getSearchProfile() const;
+  //NOT threadsafe with search.
+  void clearSearchProfile();
   //Get the root node's policy prediction
   bool getPolicy(float policyProbs[NNPos::MAX_NN_POLICY_SIZE]) const;
   bool getPolicy(const SearchNode* node, float policyProbs[NNPos::MAX_NN_POLICY_SIZE]) const;
@@ -331,6 +471,7 @@ struct Search {
     const Player perspective,
     int analysisPVLen, bool includePolicy,
     bool includePVVisits,
+    bool includeSearchProfile,
     nlohmann::json& ret
   ) const;
 
@@ -382,6 +523,11 @@ private:
   int numAdditionalThreadsToUseForTasks() const;
   void spawnThreadsIfNeeded();
   void killThreads();
+  //NOT threadsafe with anything else. Makes sure that endgame solvers with the currently configured table size exist
+  //for thread indices [0,numThreads).
+  void ensureEndgameSolvers(int numThreads);
+  //NOT threadsafe with anything else. Makes sure that profile counters exist for thread indices [0,numThreads).
+  void ensureProfileCounters(int numThreads);
   void performTaskWithThreads(std::function<void(int)>* task);
 
   void applyRecursivelyPostOrderMulithreaded(const std::vector<SearchNode*>& nodes, std::function<void(SearchNode*,int)>* f);
@@ -406,11 +552,14 @@ private:
     int64_t rootVisits, double timeUsed, double plannedTimeLimit
   );
   double recomputeSearchTimeLimit(const TimeControls& tc, double timeUsed, double searchFactor, int64_t rootVisits);
+  //Checks the root visit distribution for searchParams.earlyStopKLGainThreshold, returns true if the search should stop.
+  bool shouldStopEarly(EarlyStopState& state, int64_t rootVisits) const;
 
   //----------------------------------------------------------------------------------------
   // Neural net queries
   // searchnnhelpers.cpp
   //----------------------------------------------------------------------------------------
+  MiscNNInputParams getNNInputParams(Player pla) const;
   void computeRootNNEvaluation(NNResultBuf& nnResultBuf);
   bool initNodeNNOutput(
     SearchThread& thread, SearchNode& node,
@@ -419,6 +568,8 @@ private:
   void maybeRecomputeExistingNNOutput(
     SearchThread& thread, SearchNode& node, bool isRoot
   );
+  //Leaves node EVALUATING with no nnOutput until finishDeferredLeaf, so other threads skip it rather than evaluating it again.
+  void deferLeafNNEvaluation(SearchThread& thread, SearchNode& node);
 
   //----------------------------------------------------------------------------------------
   // Move selection during search
@@ -473,7 +624,6 @@ private:
   void selectBestChildToDescend(
     SearchThread& thread, const SearchNode& node, int nodeState,
     int& numChildrenFound, int& bestChildIdx, Loc& bestChildMoveLoc,
-    bool posesWithChildBuf[NNPos::MAX_NN_POLICY_SIZE],
     bool isRoot
   ) const;
 
@@ -495,6 +645,14 @@ private:
   double computeWeightFromNNOutput(const NNOutput* nnOutput) const;
 
   void updateStatsAfterPlayout(SearchNode& node, SearchThread& thread, bool isRoot);
+  void updateStatsAfterPlayoutUnprofiled(SearchNode& node, SearchThread& thread, bool isRoot);
+  bool maybeUpdateStatsIncrementally(SearchNode& node, SearchThread& thread, bool isRoot);
+  void setPlayoutLeafValue(SearchThread& thread, double winLossValue, double noResultValue, double weight) const;
+  void setPlayoutLeafValueFromNNOutput(SearchThread& thread, const SearchNode& node) const;
+
+  static double getProvenWinLossValue(Player winner);
+  bool setNodeProven(SearchNode& node, Player winner);
+  bool maybeSetProvenFromChildren(const SearchThread& thread, SearchNode& node, bool isRoot);
   void recomputeNodeStats(SearchNode& node, SearchThread& thread, int32_t numVisitsToAdd, bool isRoot);
 
   void downweightBadChildrenAndNormalizeWeight(
@@ -518,6 +676,11 @@ private:
   void transferOldNNOutputs(SearchThread& thread);
   void deleteAllOldOrAllNewTableNodesMulithreaded(bool old);
   void deleteAllTableNodesMulithreaded();
+  void startTreeCollection();
+  void runTreeCollection(uint32_t collectionAge);
+  void waitForTreeCollectionUnlinked();
+  void finishTreeCollection();
+  void trimSearchTree(int64_t targetBytes);
 
   //----------------------------------------------------------------------------------------
   // Initialization and core search logic
@@ -528,10 +691,17 @@ private:
 
   bool playoutDescend(
     SearchThread& thread, SearchNode& node,
-    bool posesWithChildBuf[NNPos::MAX_NN_POLICY_SIZE],
     bool isRoot
   );
 
+  bool maybeSolveEndgameLeaf(SearchThread& thread, SearchNode& node);
+  void finishDeferredLeaf(SearchThread& thread, SearchDeferredLeaf& leaf);
+  //Undoes the virtual losses of a leaf that never got queued and puts it back to unevaluated, for another playout to redo.
+  void abandonDeferredLeaf(SearchDeferredLeaf& leaf);
+  //Plays a move of the tree, which with searchParams.useCaptureMacroMoves means the move followed by the run of forced
+  //captures after it. Those captures are appended to capturesBuf if not NULL.
+  void playMoveForSearch(Board& board, BoardHistory& hist, Loc moveLoc, Player movePla, std::vector<Loc>* capturesBuf) const;
+
   bool maybeCatchUpEdgeVisits(SearchThread& thread, SearchNode& node, SearchNode* child, const int& nodeState, const int bestChildIdx);
 
   //----------------------------------------------------------------------------------------
@@ -552,6 +722,9 @@ private:
   ) const;
 
   void printPV(std::ostream& out, const std::vector<Loc>& buf) const;
+  //Expand the macro moves of a PV from the root into single moves, repeating the visits of each macro move for every
+  //capture that it stands for. Does nothing unless searchParams.useCaptureMacroMoves.
+  void expandCaptureMacroMovesFromRoot(std::vector<Loc>& pv, std::vector<int64_t>* visitsBuf, std::vector<int64_t>* edgeVisitsBuf) const;
 
   void printTreeHelper(
     std::ostream& out, const SearchNode* node, const PrintTreeOptions& options,
@@ -0,0 +1,575 @@
+#include "../search/search.h"
+
+#include <cstring>
+#include <unordered_map>
+
+#include "../core/fileutils.h"
+#include "../core/os.h"
+#include "../core/timer.h"
+#include "../game/graphhash.h"
+#include "../search/searchnode.h"
+#include "../search/searchnodetable.h"
+
+#ifdef OS_IS_UNIX_OR_APPLE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+//A tree file is, all in native byte order:
+//A TreeFileHeader.
+//numNodes TreeFileNode, numbered breadth first from the root, so that every node but the root comes after the parent
+//it was first reached from.
+//numEdges TreeFileEdge, those of each node together and in the order of its children.
+//numNNOutputs nn outputs of nnOutputBytes each, see nnOutputToBytes.
+//numTrimmedStats TreeFileTrimmedStats, for SearchNode::trimmedStats.
+
+static const char TREE_FILE_MAGIC[8] = {'K','G','T','R','E','E','\0','\0'};
+static const uint64_t TREE_FILE_VERSION = 2;
+
+struct TreeFileHeader {
+  char magic[8];
+  uint64_t version;
+  uint64_t rootHash0;
+  uint64_t rootHash1;
+  uint64_t numNodes;
+  uint64_t numEdges;
+  uint64_t numNNOutputs;
+  uint64_t numTrimmedStats;
+  int32_t nnXLen;
+  int32_t nnYLen;
+  int32_t policySize;
+  int32_t nnOutputBytes;
+  //The root position and how it was reached, see getRootHistoryHash. The tree is only valid for the exact same root.
+  uint64_t rootHistoryHash0;
+  uint64_t rootHistoryHash1;
+  int32_t rootXSize;
+  int32_t rootYSize;
+  int8_t rootPla;
+  //Search params that change what the nodes and edges of the tree mean
+  int8_t useCaptureMacroMoves;
+  int8_t useGraphSearch;
+  int8_t padding[5];
+};
+
+struct TreeFileNode {
+  uint64_t hash0; //The hash of the node in the node table, unused for the root which isn't in it
+  uint64_t hash1;
+  uint64_t firstEdge;
+  int64_t nnOutputIdx; //-1 if none
+  int64_t visits;
+  double winLossValueAvg;
+  double noResultValueAvg;
+  double utilityAvg;
+  double utilitySqAvg;
+  double weightSum;
+  double weightSqSum;
+  int32_t numEdges;
+  int32_t state;
+  int8_t nextPla;
+  int8_t forceNonTerminal;
+  int8_t provenWinner;
+  int8_t padding[5];
+};
+
+struct TreeFileEdge {
+  uint64_t childIdx;
+  int64_t edgeVisits;
+  int32_t moveLoc;
+  int32_t padding;
+};
+
+struct TreeFileTrimmedStats {
+  uint64_t nodeIdx;
+  int64_t visits;
+  double winLossValueAvg;
+  double noResultValueAvg;
+  double utilityAvg;
+  double utilitySqAvg;
+  double weightSum;
+  double weightSqSum;
+};
+
+static_assert(sizeof(TreeFileHeader) % 8 == 0, "");
+static_assert(sizeof(TreeFileNode) % 8 == 0, "");
+static_assert(sizeof(TreeFileEdge) % 8 == 0, "");
+static_assert(sizeof(TreeFileTrimmedStats) % 8 == 0, "");
+
+//The graph hash of the root only identifies the current situation, so also hash the initial board and every move
+//made since, which the search consults through rootHistory.
+static Hash128 getRootHistoryHash(const BoardHistory& hist) {
+  Hash128 hash = hist.initialBoard.pos_hash;
+  hash.hash0 = Hash::murmurMix(hash.hash0 ^ (uint64_t)hist.initialPla);
+  hash.hash1 = Hash::murmurMix(hash.hash1 + (uint64_t)hist.moveHistory.size());
+  for(size_t i = 0; i<hist.moveHistory.size(); i++) {
+    uint64_t move = ((uint64_t)(uint32_t)hist.moveHistory[i].loc << 8) | (uint64_t)(uint8_t)hist.moveHistory[i].pla;
+    hash.hash0 = Hash::murmurMix(hash.hash0 ^ move);
+    hash.hash1 = Hash::murmurMix(hash.hash1 + hash.hash0);
+  }
+  return hash;
+}
+
+static const size_t NN_OUTPUT_HEADER_BYTES = 2 * sizeof(uint64_t) + 5 * sizeof(float);
+
+static int getNNOutputBytes(int policySize) {
+  return (int)((NN_OUTPUT_HEADER_BYTES + sizeof(float) * policySize + 7) / 8 * 8);
+}
+
+static void nnOutputToBytes(const NNOutput& nnOutput, int policySize, char* buf) {
+  float values[5] = {
+    nnOutput.whiteWinProb, nnOutput.whiteLossProb, nnOutput.whiteNoResultProb,
+    nnOutput.varTimeLeft, nnOutput.shorttermWinlossError
+  };
+  std::memcpy(buf, &nnOutput.nnHash.hash0, sizeof(uint64_t));
+  std::memcpy(buf + sizeof(uint64_t), &nnOutput.nnHash.hash1, sizeof(uint64_t));
+  std::memcpy(buf + 2 * sizeof(uint64_t), values, sizeof(values));
+  std::memcpy(buf + NN_OUTPUT_HEADER_BYTES, nnOutput.policyProbs, sizeof(float) * policySize);
+}
+
+static void nnOutputFromBytes(const char* buf, int policySize, int nnXLen, int nnYLen, NNOutput& nnOutput) {
+  float values[5];
+  std::memcpy(&nnOutput.nnHash.hash0, buf, sizeof(uint64_t));
+  std::memcpy(&nnOutput.nnHash.hash1, buf + sizeof(uint64_t), sizeof(uint64_t));
+  std::memcpy(values, buf + 2 * sizeof(uint64_t), sizeof(values));
+  nnOutput.whiteWinProb = values[0];
+  nnOutput.whiteLossProb = values[1];
+  nnOutput.whiteNoResultProb = values[2];
+  nnOutput.varTimeLeft = values[3];
+  nnOutput.shorttermWinlossError = values[4];
+  std::memcpy(nnOutput.policyProbs, buf + NN_OUTPUT_HEADER_BYTES, sizeof(float) * policySize);
+  nnOutput.nnXLen = nnXLen;
+  nnOutput.nnYLen = nnYLen;
+}
+
+//Records in the file aren't necessarily aligned, so copy them out rather than casting.
+template<typename T>
+static T readRecord(const char* section, uint64_t idx) {
+  T record;
+  std::memcpy(&record, section + idx * sizeof(T), sizeof(T));
+  return record;
+}
+
+//States that only exist in the middle of a playout, saved as the state the node would go back to.
+static int32_t getStateToSave(int state) {
+  if(state == SearchNode::STATE_EVALUATING)
+    return SearchNode::STATE_UNEVALUATED;
+  if(state == SearchNode::STATE_GROWING1)
+    return SearchNode::STATE_EXPANDED0;
+  if(state == SearchNode::STATE_GROWING2)
+    return SearchNode::STATE_EXPANDED1;
+  return state;
+}
+
+static int getCapacityOfSavedState(int32_t state) {
+  if(state == SearchNode::STATE_EXPANDED2)
+    return SearchNode::CHILDREN2SIZE;
+  if(state == SearchNode::STATE_EXPANDED1)
+    return SearchNode::CHILDREN1SIZE;
+  if(state == SearchNode::STATE_EXPANDED0)
+    return SearchNode::CHILDREN0SIZE;
+  if(state == SearchNode::STATE_UNEVALUATED)
+    return 0;
+  return -1;
+}
+
+//Read-only view of a whole file, memory-mapped where possible so that nothing has to be read until it's used.
+struct MappedTreeFile {
+  const char* data;
+  size_t size;
+  void* mapped;
+  string buffer;
+
+  MappedTreeFile(const string& fileName)
+    :data(NULL),size(0),mapped(NULL),buffer()
+  {
+#ifdef OS_IS_UNIX_OR_APPLE
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+      throw StringError("Could not open search tree file " + fileName);
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw StringError("Could not read search tree file " + fileName);
+    }
+    size = (size_t)st.st_size;
+    if(size > 0) {
+      mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(mapped == MAP_FAILED) {
+        mapped = NULL;
+        ::close(fd);
+        throw StringError("Could not memory-map search tree file " + fileName);
+      }
+      data = static_cast<const char*>(mapped);
+    }
+    ::close(fd);
+#else
+    std::ifstream in;
+    FileUtils::open(in, fileName, std::ios::in | std::ios::binary);
+    buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+#endif
+  }
+
+  ~MappedTreeFile() {
+#ifdef OS_IS_UNIX_OR_APPLE
+    if(mapped != NULL)
+      munmap(mapped, size);
+#endif
+  }
+
+  MappedTreeFile(const MappedTreeFile&) = delete;
+  MappedTreeFile& operator=(const MappedTreeFile&) = delete;
+};
+
+void Search::saveTree(const string& fileName, bool includeNNOutputs) {
+  finishTreeCollection();
+  if(rootNode == NULL)
+    throw StringError("No search tree to save");
+  ClockTimer timer;
+
+  //The table knows the hash of every node but the root, which isn't in it.
+  std::unordered_map<const SearchNode*,Hash128> hashOfNode;
+  nodeTable->forEach([&](Hash128 hash, SearchNode* node) {
+    hashOfNode[node] = hash;
+  });
+
+  std::unordered_map<const SearchNode*,uint64_t> idxOfNode;
+  vector<const SearchNode*> nodes;
+  idxOfNode[rootNode] = 0;
+  nodes.push_back(rootNode);
+  for(size_t i = 0; i<nodes.size(); i++) {
+    int childrenCapacity;
+    ConstSearchChildren children = nodes[i]->getChildren(childrenCapacity);
+    for(int j = 0; j<childrenCapacity; j++) {
+      const SearchNode* child = children[j].getIfAllocated();
+      if(child == NULL)
+        break;
+      if(idxOfNode.emplace(child,(uint64_t)nodes.size()).second)
+        nodes.push_back(child);
+    }
+  }
+
+  vector<TreeFileNode> nodeRecords(nodes.size());
+  vector<TreeFileEdge> edgeRecords;
+  vector<const NNOutput*> nnOutputs;
+  for(size_t i = 0; i<nodes.size(); i++) {
+    const SearchNode* node = nodes[i];
+    TreeFileNode& record = nodeRecords[i];
+    std::memset(&record, 0, sizeof(TreeFileNode));
+    if(node != rootNode) {
+      auto iter = hashOfNode.find(node);
+      if(iter == hashOfNode.end())
+        throw StringError("Search tree node missing from the node table, cannot save");
+      record.hash0 = iter->second.hash0;
+      record.hash1 = iter->second.hash1;
+    }
+    NodeStats stats(node->stats);
+    record.visits = stats.visits;
+    record.winLossValueAvg = stats.winLossValueAvg;
+    record.noResultValueAvg = stats.noResultValueAvg;
+    record.utilityAvg = stats.utilityAvg;
+    record.utilitySqAvg = stats.utilitySqAvg;
+    record.weightSum = stats.weightSum;
+    record.weightSqSum = stats.weightSqSum;
+    record.state = getStateToSave(node->state.load(std::memory_order_acquire));
+    record.nextPla = (int8_t)node->nextPla;
+    record.forceNonTerminal = node->forceNonTerminal ? 1 : 0;
+    record.provenWinner = node->provenWinner.load(std::memory_order_acquire);
+
+    record.nnOutputIdx = -1;
+    const NNOutput* nnOutput = node->getNNOutput();
+    if(includeNNOutputs && nnOutput != NULL) {
+      record.nnOutputIdx = (int64_t)nnOutputs.size();
+      nnOutputs.push_back(nnOutput);
+    }
+
+    record.firstEdge = edgeRecords.size();
+    int childrenCapacity;
+    ConstSearchChildren children = node->getChildren(record.state,childrenCapacity);
+    for(int j = 0; j<childrenCapacity; j++) {
+      const SearchNode* child = children[j].getIfAllocated();
+      if(child == NULL)
+        break;
+      TreeFileEdge edge;
+      edge.childIdx = idxOfNode[child];
+      edge.edgeVisits = children[j].getEdgeVisits();
+      edge.moveLoc = children[j].getMoveLoc();
+      edge.padding = 0;
+      edgeRecords.push_back(edge);
+      record.numEdges++;
+    }
+  }
+
+  vector<TreeFileTrimmedStats> trimmedStatsRecords;
+  for(size_t i = 0; i<nodes.size(); i++) {
+    if(nodes[i]->trimmedStats == NULL)
+      continue;
+    const NodeStats& stats = *(nodes[i]->trimmedStats);
+    TreeFileTrimmedStats record;
+    record.nodeIdx = i;
+    record.visits = stats.visits;
+    record.winLossValueAvg = stats.winLossValueAvg;
+    record.noResultValueAvg = stats.noResultValueAvg;
+    record.utilityAvg = stats.utilityAvg;
+    record.utilitySqAvg = stats.utilitySqAvg;
+    record.weightSum = stats.weightSum;
+    record.weightSqSum = stats.weightSqSum;
+    trimmedStatsRecords.push_back(record);
+  }
+
+  TreeFileHeader header;
+  std::memset(&header, 0, sizeof(TreeFileHeader));
+  std::memcpy(header.magic, TREE_FILE_MAGIC, sizeof(header.magic));
+  header.version = TREE_FILE_VERSION;
+  Hash128 rootHash = GraphHash::getGraphHash(rootHistory, rootPla);
+  header.rootHash0 = rootHash.hash0;
+  header.rootHash1 = rootHash.hash1;
+  header.numNodes = nodeRecords.size();
+  header.numEdges = edgeRecords.size();
+  header.numNNOutputs = nnOutputs.size();
+  header.numTrimmedStats = trimmedStatsRecords.size();
+  header.nnXLen = nnXLen;
+  header.nnYLen = nnYLen;
+  header.policySize = policySize;
+  header.nnOutputBytes = getNNOutputBytes(policySize);
+  Hash128 rootHistoryHash = getRootHistoryHash(rootHistory);
+  header.rootHistoryHash0 = rootHistoryHash.hash0;
+  header.rootHistoryHash1 = rootHistoryHash.hash1;
+  header.rootXSize = rootBoard.x_size;
+  header.rootYSize = rootBoard.y_size;
+  header.rootPla = (int8_t)rootPla;
+  header.useCaptureMacroMoves = searchParams.useCaptureMacroMoves ? 1 : 0;
+  header.useGraphSearch = searchParams.useGraphSearch ? 1 : 0;
+
+  std::ofstream out;
+  FileUtils::open(out, fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(TreeFileHeader));
+  out.write(reinterpret_cast<const char*>(nodeRecords.data()), sizeof(TreeFileNode) * nodeRecords.size());
+  out.write(reinterpret_cast<const char*>(edgeRecords.data()), sizeof(TreeFileEdge) * edgeRecords.size());
+  vector<char> nnOutputBuf(header.nnOutputBytes, 0);
+  for(const NNOutput* nnOutput: nnOutputs) {
+    nnOutputToBytes(*nnOutput, policySize, nnOutputBuf.data());
+    out.write(nnOutputBuf.data(), nnOutputBuf.size());
+  }
+  out.write(reinterpret_cast<const char*>(trimmedStatsRecords.data()), sizeof(TreeFileTrimmedStats) * trimmedStatsRecords.size());
+  out.close();
+  if(!out)
+    throw StringError("Error writing search tree file " + fileName);
+
+  logger->write(
+    "Saved search tree of " + Global::uint64ToString(header.numNodes) + " nodes and " +
+    Global::uint64ToString(header.numEdges) + " edges to " + fileName + " in " +
+    Global::doubleToString(timer.getSeconds()) + " seconds"
+  );
+}
+
+void Search::loadTree(const string& fileName) {
+  ClockTimer timer;
+  MappedTreeFile file(fileName);
+
+  TreeFileHeader header;
+  if(file.size < sizeof(TreeFileHeader))
+    throw StringError("Search tree file " + fileName + " is truncated");
+  std::memcpy(&header, file.data, sizeof(TreeFileHeader));
+  if(std::memcmp(header.magic, TREE_FILE_MAGIC, sizeof(header.magic)) != 0)
+    throw StringError("File " + fileName + " is not a search tree file");
+  if(header.version != TREE_FILE_VERSION)
+    throw StringError("Search tree file " + fileName + " has unsupported version " + Global::uint64ToString(header.version));
+  if(Hash128(header.rootHash0,header.rootHash1) != GraphHash::getGraphHash(rootHistory, rootPla))
+    throw StringError("Search tree file " + fileName + " was not saved from the current position");
+  if(header.rootXSize != rootBoard.x_size || header.rootYSize != rootBoard.y_size || header.rootPla != (int8_t)rootPla ||
+     Hash128(header.rootHistoryHash0,header.rootHistoryHash1) != getRootHistoryHash(rootHistory))
+    throw StringError("Search tree file " + fileName + " was saved from the current position reached by a different history");
+  if(header.useCaptureMacroMoves != (searchParams.useCaptureMacroMoves ? 1 : 0))
+    throw StringError(
+      "Search tree file " + fileName + " was saved with useCaptureMacroMoves = " +
+      (header.useCaptureMacroMoves != 0 ? "true" : "false") + ", which differs from the current search"
+    );
+  if(header.useGraphSearch != (searchParams.useGraphSearch ? 1 : 0))
+    throw StringError(
+      "Search tree file " + fileName + " was saved with useGraphSearch = " +
+      (header.useGraphSearch != 0 ? "true" : "false") + ", which differs from the current search"
+    );
+  if(header.numNNOutputs > 0 && (header.nnXLen != nnXLen || header.nnYLen != nnYLen || header.policySize != policySize))
+    throw StringError("Search tree file " + fileName + " has nn outputs for a different nn board size");
+  if(header.numNNOutputs > 0 && header.nnOutputBytes != getNNOutputBytes(policySize))
+    throw StringError("Search tree file " + fileName + " is corrupt");
+
+  //Check the sizes of the sections against the file without overflowing on garbage counts
+  uint64_t bytesLeft = file.size - sizeof(TreeFileHeader);
+  auto takeSection = [&](uint64_t numRecords, uint64_t recordBytes) {
+    if(recordBytes > 0 && numRecords > bytesLeft / recordBytes)
+      throw StringError("Search tree file " + fileName + " is truncated");
+    bytesLeft -= numRecords * recordBytes;
+  };
+  takeSection(header.numNodes, sizeof(TreeFileNode));
+  takeSection(header.numEdges, sizeof(TreeFileEdge));
+  takeSection(header.numNNOutputs, header.numNNOutputs > 0 ? (uint64_t)header.nnOutputBytes : 0);
+  takeSection(header.numTrimmedStats, sizeof(TreeFileTrimmedStats));
+  if(header.numNodes <= 0)
+    throw StringError("Search tree file " + fileName + " has no nodes");
+
+  const uint64_t numNodes = header.numNodes;
+  const char* nodesSection = file.data + sizeof(TreeFileHeader);
+  const char* edgesSection = nodesSection + sizeof(TreeFileNode) * numNodes;
+  const char* nnOutputsSection = edgesSection + sizeof(TreeFileEdge) * header.numEdges;
+  const char* trimmedStatsSection = nnOutputsSection + (uint64_t)header.nnOutputBytes * header.numNNOutputs;
+
+  //Validate everything before touching the current search. Also find for every node but the root the parent that
+  //it was first reached from, which is earlier in the file.
+  vector<int64_t> parentIdxs(numNodes, -1);
+  vector<Loc> parentMoveLocs(numNodes, Board::NULL_LOC);
+  for(uint64_t idx = 0; idx<numNodes; idx++) {
+    TreeFileNode record = readRecord<TreeFileNode>(nodesSection, idx);
+    int capacity = getCapacityOfSavedState(record.state);
+    bool valid =
+      (idx == 0 || parentIdxs[idx] >= 0) &&
+      (record.nextPla == P_BLACK || record.nextPla == P_WHITE) &&
+      (record.provenWinner == SearchNode::PROVEN_NONE || record.provenWinner == C_EMPTY ||
+       record.provenWinner == P_BLACK || record.provenWinner == P_WHITE) &&
+      capacity >= 0 && record.numEdges >= 0 && record.numEdges <= capacity &&
+      record.firstEdge <= header.numEdges && (uint64_t)record.numEdges <= header.numEdges - record.firstEdge &&
+      record.nnOutputIdx >= -1 && record.nnOutputIdx < (int64_t)header.numNNOutputs;
+    if(!valid)
+      throw StringError("Search tree file " + fileName + " is corrupt");
+    for(int i = 0; i<record.numEdges; i++) {
+      TreeFileEdge edge = readRecord<TreeFileEdge>(edgesSection, record.firstEdge + i);
+      if(edge.childIdx == 0 || edge.childIdx >= numNodes || edge.moveLoc < 0 || edge.moveLoc >= Board::MAX_ARR_SIZE)
+        throw StringError("Search tree file " + fileName + " is corrupt");
+      if(parentIdxs[edge.childIdx] < 0) {
+        parentIdxs[edge.childIdx] = (int64_t)idx;
+        parentMoveLocs[edge.childIdx] = (Loc)edge.moveLoc;
+      }
+    }
+  }
+  for(uint64_t i = 0; i<header.numTrimmedStats; i++) {
+    if(readRecord<TreeFileTrimmedStats>(trimmedStatsSection, i).nodeIdx >= numNodes)
+      throw StringError("Search tree file " + fileName + " is corrupt");
+  }
+
+  clearSearch();
+  const int numThreads = numAdditionalThreadsToUseForTasks() + 1;
+  vector<SearchNode*> nodes(numNodes, NULL);
+
+  std::function<void(int)> allocateNodes = [&](int threadIdx) {
+    SearchNodeAllocator::ThreadCache& alloc = nodeAllocator->getThreadCache(threadIdx);
+    const uint64_t idx0 = numNodes * threadIdx / numThreads;
+    const uint64_t idx1 = numNodes * (threadIdx+1) / numThreads;
+    for(uint64_t idx = idx0; idx < idx1; idx++) {
+      TreeFileNode record = readRecord<TreeFileNode>(nodesSection, idx);
+      const uint32_t mutexIdx = (uint32_t)(Hash::murmurMix(idx) & (mutexPool->getNumMutexes()-1));
+      bool allocated = false;
+      auto allocate = [&]() {
+        allocated = true;
+        return SearchNode::allocate(alloc, record.nextPla, record.forceNonTerminal != 0, mutexIdx);
+      };
+      //Root is not stored in node table
+      if(idx == 0) {
+        nodes[idx] = allocate();
+        continue;
+      }
+      Hash128 hash(record.hash0, record.hash1);
+      while(true) {
+        SearchNode* node = nodeTable->findOrInsert(hash, allocate);
+        if(allocated) {
+          nodes[idx] = node;
+          break;
+        }
+        //Some other node already has this hash, as can rarely happen when the table grows, so just store this one
+        //somewhere arbitrary.
+        hash ^= Hash128(Hash::murmurMix(hash.hash0 + idx), Hash::murmurMix(hash.hash1 + idx));
+      }
+    }
+  };
+  performTaskWithThreads(&allocateNodes);
+
+  std::function<void(int)> restoreNodes = [&](int threadIdx) {
+    SearchNodeAllocator::ThreadCache& alloc = nodeAllocator->getThreadCache(threadIdx);
+    const uint64_t idx0 = numNodes * threadIdx / numThreads;
+    const uint64_t idx1 = numNodes * (threadIdx+1) / numThreads;
+    for(uint64_t idx = idx0; idx < idx1; idx++) {
+      TreeFileNode record = readRecord<TreeFileNode>(nodesSection, idx);
+      SearchNode* node = nodes[idx];
+      node->stats.visits.store(record.visits,std::memory_order_relaxed);
+      node->stats.winLossValueAvg.store((NodeStatsAvgFloat)record.winLossValueAvg,std::memory_order_relaxed);
+      node->stats.noResultValueAvg.store((NodeStatsAvgFloat)record.noResultValueAvg,std::memory_order_relaxed);
+      node->stats.utilityAvg.store((NodeStatsAvgFloat)record.utilityAvg,std::memory_order_relaxed);
+      node->stats.utilitySqAvg.store((NodeStatsAvgFloat)record.utilitySqAvg,std::memory_order_relaxed);
+      node->stats.weightSum.store(record.weightSum,std::memory_order_relaxed);
+      node->stats.weightSqSum.store(record.weightSqSum,std::memory_order_relaxed);
+      node->provenWinner.store(record.provenWinner,std::memory_order_relaxed);
+
+      if(record.nnOutputIdx >= 0) {
+        NNOutput* nnOutput = new NNOutput();
+        nnOutputFromBytes(nnOutputsSection + (uint64_t)header.nnOutputBytes * record.nnOutputIdx, policySize, nnXLen, nnYLen, *nnOutput);
+        node->storeNNOutputIfNull(new std::shared_ptr<NNOutput>(nnOutput));
+      }
+
+      node->initializeChildrenForState(record.state, alloc);
+      int childrenCapacity;
+      SearchChildren children = node->getChildren(childrenCapacity);
+      for(int i = 0; i<record.numEdges; i++) {
+        TreeFileEdge edge = readRecord<TreeFileEdge>(edgesSection, record.firstEdge + i);
+        children[i].setMoveLocRelaxed((Loc)edge.moveLoc);
+        children[i].setEdgeVisitsRelaxed(edge.edgeVisits);
+        children[i].storeRelaxed(nodes[edge.childIdx]);
+      }
+    }
+  };
+  performTaskWithThreads(&restoreNodes);
+
+  for(uint64_t i = 0; i<header.numTrimmedStats; i++) {
+    TreeFileTrimmedStats record = readRecord<TreeFileTrimmedStats>(trimmedStatsSection, i);
+    NodeStats stats;
+    stats.visits = record.visits;
+    stats.winLossValueAvg = record.winLossValueAvg;
+    stats.noResultValueAvg = record.noResultValueAvg;
+    stats.utilityAvg = record.utilityAvg;
+    stats.utilitySqAvg = record.utilitySqAvg;
+    stats.weightSum = record.weightSum;
+    stats.weightSqSum = record.weightSqSum;
+    nodes[record.nodeIdx]->setTrimmedStats(stats, nodeAllocator->getThreadCache(0));
+  }
+
+  //Expanded nodes whose nn outputs weren't saved need them again, from their position as reached from the root.
+  std::atomic<int64_t> numNNOutputsComputed(0);
+  std::function<void(int)> computeNNOutputs = [&](int threadIdx) {
+    NNResultBuf nnResultBuf;
+    vector<Loc> moveLocs;
+    for(uint64_t idx = threadIdx; idx < numNodes; idx += numThreads) {
+      SearchNode* node = nodes[idx];
+      if(node->state.load(std::memory_order_acquire) < SearchNode::STATE_EXPANDED0 || node->getNNOutput() != NULL)
+        continue;
+      moveLocs.clear();
+      for(int64_t i = (int64_t)idx; i != 0; i = parentIdxs[i])
+        moveLocs.push_back(parentMoveLocs[i]);
+      Board board = rootBoard;
+      BoardHistory hist = rootHistory;
+      Player pla = rootPla;
+      for(auto iter = moveLocs.rbegin(); iter != moveLocs.rend(); ++iter) {
+        playMoveForSearch(board,hist,*iter,pla,NULL);
+        pla = board.nextPla;
+      }
+      MiscNNInputParams nnInputParams = getNNInputParams(pla);
+      bool skipCache = false;
+      nnEvaluator->evaluate(board, hist, pla, nnInputParams, nnResultBuf, skipCache);
+      node->storeNNOutputIfNull(new std::shared_ptr<NNOutput>(std::move(nnResultBuf.result)));
+      numNNOutputsComputed.fetch_add(1,std::memory_order_relaxed);
+    }
+  };
+  performTaskWithThreads(&computeNNOutputs);
+
+  rootNode = nodes[0];
+  logger->write(
+    "Loaded search tree of " + Global::uint64ToString(numNodes) + " nodes and " +
+    Global::uint64ToString(header.numEdges) + " edges from " + fileName + " in " +
+    Global::doubleToString(timer.getSeconds()) + " seconds, recomputing " +
+    Global::int64ToString(numNNOutputsComputed.load(std::memory_order_relaxed)) + " nn outputs"
+  );
+}
@@ -1,7 +1,13 @@
 #include "../search/search.h"
 
+#include <cstring>
+
 #include "../search/searchnode.h"
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 //------------------------
 #include "../core/using.h"
 //------------------------
@@ -117,7 +123,11 @@ double Search::getExploreSelectionValueOfChild(
   }
 
   //Virtual losses to direct threads down different paths
-  if(childVirtualLosses > 0) {
+  if(childVirtualLosses > 0 && searchParams.usePendingVisits) {
+    //Or as pending visits, which only make the child look more explored
+    childWeight += childVirtualLosses * parentWeightPerVisit;
+  }
+  else if(childVirtualLosses > 0) {
     double virtualLossWeight = childVirtualLosses * searchParams.numVirtualLossesPerThread;
 
     double utilityRadius = searchParams.winLossUtilityFactor;
@@ -149,7 +159,7 @@ double Search::getExploreSelectionValueOfChild(
     if(rootHintLoc != Board::NULL_LOC && moveLoc == rootHintLoc) {
       double averageWeightPerVisit = (childWeight + parentWeightPerVisit) / (childVisits + 1.0);
       int childrenCapacity;
-      const SearchChildPointer* children = parent.getChildren(childrenCapacity);
+      ConstSearchChildren children = parent.getChildren(childrenCapacity);
       for(int i = 0; i<childrenCapacity; i++) {
         const SearchNode* c = children[i].getIfAllocated();
         if(c == NULL)
@@ -285,10 +295,11 @@ double Search::getFpuValueForChildrenAssumeVisited(
 }
 
 
+static constexpr int POSES_WITH_CHILD_WORDS = (NNPos::MAX_NN_POLICY_SIZE + 63) / 64;
+
 void Search::selectBestChildToDescend(
   SearchThread& thread, const SearchNode& node, int nodeState,
   int& numChildrenFound, int& bestChildIdx, Loc& bestChildMoveLoc,
-  bool posesWithChildBuf[NNPos::MAX_NN_POLICY_SIZE],
   bool isRoot) const
 {
   assert(thread.pla == node.nextPla);
@@ -298,31 +309,64 @@ void Search::selectBestChildToDescend(
   bestChildMoveLoc = Board::NULL_LOC;
 
   int childrenCapacity;
-  const SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
+  ConstSearchChildren children = node.getChildren(nodeState,childrenCapacity);
+
+  //Bit per policy pos, for the moves that already have a child
+  uint64_t posesWithChild[POSES_WITH_CHILD_WORDS];
+  const int numPosWords = (policySize + 63) / 64;
+  std::fill(posesWithChild,posesWithChild+numPosWords,(uint64_t)0);
+
+  //Take one snapshot of all the children, loading each atomic once
+  ChildSelectionBuf& buf = thread.childSelectionBuf;
+  Loc* __restrict childMoveLoc = buf.moveLoc;
+  double* __restrict childPolicyProb = buf.policyProb;
+  double* __restrict childWeightBuf = buf.weight;
+  double* __restrict childUtility = buf.utility;
+  double* __restrict childSelectionValue = buf.selectionValue;
+  int32_t* __restrict childVirtualLosses = buf.virtualLosses;
+  uint8_t* __restrict childHasUtility = buf.hasUtility;
 
   double policyProbMassVisited = 0.0;
   double maxChildWeight = 0.0;
   double totalChildWeight = 0.0;
+  double totalChildVirtualLosses = 0.0;
   const NNOutput* nnOutput = node.getNNOutput();
   assert(nnOutput != NULL);
   const float* policyProbs = nnOutput->getPolicyProbsMaybeNoised();
+  numChildrenFound = 0;
   for(int i = 0; i<childrenCapacity; i++) {
     const SearchNode* child = children[i].getIfAllocated();
     if(child == NULL)
       break;
+    numChildrenFound++;
     Loc moveLoc = children[i].getMoveLocRelaxed();
     int movePos = getPos(moveLoc);
+    posesWithChild[movePos >> 6] |= (uint64_t)1 << (movePos & 63);
     float nnPolicyProb = policyProbs[movePos];
-    if(nnPolicyProb < 0)
-      continue;
-    policyProbMassVisited += nnPolicyProb;
 
     int64_t edgeVisits = children[i].getEdgeVisits();
-    double childWeight = child->stats.getChildWeight(edgeVisits);
+    int64_t childVisits = child->stats.visits.load(std::memory_order_acquire);
+    double childWeight = child->stats.getChildWeight(edgeVisits,childVisits);
+    int32_t virtualLosses = child->virtualLosses.load(std::memory_order_acquire);
+    if(nnPolicyProb >= 0) {
+      policyProbMassVisited += nnPolicyProb;
+      totalChildWeight += childWeight;
+      totalChildVirtualLosses += virtualLosses;
+      if(childWeight > maxChildWeight)
+        maxChildWeight = childWeight;
+    }
 
-    totalChildWeight += childWeight;
-    if(childWeight > maxChildWeight)
-      maxChildWeight = childWeight;
+    childMoveLoc[i] = moveLoc;
+    //Solved children need no more visits
+    childPolicyProb[i] = child->isProven() ? -1.0 : nnPolicyProb;
+    childWeightBuf[i] = childWeight;
+    childUtility[i] = child->stats.utilityAvg.load(std::memory_order_acquire);
+    //It's possible that childVisits is actually 0 here with multithreading because we're visiting this node while a child has
+    //been expanded but its thread not yet finished its first visit.
+    //It's also possible that we observe childWeight <= 0 even though childVisits >= due to multithreading, the two could
+    //be out of sync briefly since they are separate atomics.
+    childHasUtility[i] = (childVisits <= 0 || childWeight <= 0.0) ? 0 : 1;
+    childVirtualLosses[i] = virtualLosses;
   }
   //Probability mass should not sum to more than 1, giving a generous allowance
   //for floating point error.
@@ -337,43 +381,95 @@ void Search::selectBestChildToDescend(
     parentUtility, parentWeightPerVisit, parentUtilityStdevFactor
   );
 
-  std::fill(posesWithChildBuf,posesWithChildBuf+NNPos::MAX_NN_POLICY_SIZE,false);
-
-  double exploreScaling = getExploreScaling(totalChildWeight, parentUtilityStdevFactor);
+  //Pending visits count towards the parent's visits too, as in the exploration term of every child
+  double exploreScaling = searchParams.usePendingVisits ?
+    getExploreScaling(totalChildWeight + totalChildVirtualLosses * parentWeightPerVisit, parentUtilityStdevFactor) :
+    getExploreScaling(totalChildWeight, parentUtilityStdevFactor);
 
   //Try all existing children
-  //Also count how many children we actually find
-  numChildrenFound = 0;
-  for(int i = 0; i<childrenCapacity; i++) {
-    const SearchNode* child = children[i].getIfAllocated();
-    if(child == NULL)
-      break;
-    numChildrenFound++;
-    int64_t childEdgeVisits = children[i].getEdgeVisits();
-
-    Loc moveLoc = children[i].getMoveLocRelaxed();
-    bool isDuringSearch = true;
-    double selectionValue = getExploreSelectionValueOfChild(
-      node,policyProbs,child,
-      moveLoc,
-      exploreScaling,
-      totalChildWeight,childEdgeVisits,fpuValue,
-      parentUtility,parentWeightPerVisit,
-      isDuringSearch,maxChildWeight,&thread
-    );
-    if(selectionValue > maxSelectionValue) {
-      // if(child->state.load(std::memory_order_seq_cst) == SearchNode::STATE_EVALUATING) {
-      //   selectionValue -= EVALUATING_SELECTION_VALUE_PENALTY;
-      //   if(isRoot && child->prevMoveLoc == Location::ofString("K4",thread.board)) {
-      //     out << "ouch" << "\n";
-      //   }
-      // }
-      maxSelectionValue = selectionValue;
+  if(isRoot) {
+    //The root has extra rules that need more than the snapshot, so go through getExploreSelectionValueOfChild.
+    for(int i = 0; i<numChildrenFound; i++) {
+      const SearchNode* child = children[i].getIfAllocated();
+      if(child->isProven()) {
+        childSelectionValue[i] = POLICY_ILLEGAL_SELECTION_VALUE;
+        continue;
+      }
+      int64_t childEdgeVisits = children[i].getEdgeVisits();
+      bool isDuringSearch = true;
+      childSelectionValue[i] = getExploreSelectionValueOfChild(
+        node,policyProbs,child,
+        childMoveLoc[i],
+        exploreScaling,
+        totalChildWeight,childEdgeVisits,fpuValue,
+        parentUtility,parentWeightPerVisit,
+        isDuringSearch,maxChildWeight,&thread
+      );
+    }
+  }
+  else {
+    //Same as getExploreSelectionValueOfChild away from the root, except for the children to skip, which are left to the
+    //loop below. With AVX2 this is done four children at a time, the compiler doesn't vectorize it at -O2.
+    const double utilitySign = node.nextPla == P_WHITE ? 1.0 : -1.0;
+    const double virtualLossUtility = node.nextPla == P_WHITE ? -searchParams.winLossUtilityFactor : searchParams.winLossUtilityFactor;
+    //Pending visits are virtual losses that add weight at the parent's weight per visit, and leave the utility alone
+    const double weightPerVirtualLoss = searchParams.usePendingVisits ? parentWeightPerVisit : searchParams.numVirtualLossesPerThread;
+    const double virtualLossUtilityScale = searchParams.usePendingVisits ? 0.0 : 1.0;
+    int i = 0;
+#ifdef __AVX2__
+    //Four children at a time, the same operations in the same order as the loop below, so the values are identical.
+    //Every array starts on a cache line, so the loads are aligned.
+    const __m256d fpuValueV = _mm256_set1_pd(fpuValue);
+    const __m256d weightPerVirtualLossV = _mm256_set1_pd(weightPerVirtualLoss);
+    const __m256d virtualLossUtilityScaleV = _mm256_set1_pd(virtualLossUtilityScale);
+    const __m256d virtualLossUtilityV = _mm256_set1_pd(virtualLossUtility);
+    const __m256d exploreScalingV = _mm256_set1_pd(exploreScaling);
+    const __m256d utilitySignV = _mm256_set1_pd(utilitySign);
+    const __m256d quarterV = _mm256_set1_pd(0.25);
+    const __m256d oneV = _mm256_set1_pd(1.0);
+    for(; i + 4 <= numChildrenFound; i += 4) {
+      __m256d childWeight = _mm256_load_pd(childWeightBuf + i);
+      __m256d utility = _mm256_load_pd(childUtility + i);
+      int32_t hasUtilityBytes;
+      std::memcpy(&hasUtilityBytes, childHasUtility + i, sizeof(hasUtilityBytes));
+      __m256i hasUtility = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(hasUtilityBytes));
+      __m256d noUtilityMask = _mm256_castsi256_pd(_mm256_cmpeq_epi64(hasUtility, _mm256_setzero_si256()));
+      utility = _mm256_blendv_pd(utility, fpuValueV, noUtilityMask);
+      __m256d virtualLossWeight = _mm256_mul_pd(
+        _mm256_cvtepi32_pd(_mm_load_si128(reinterpret_cast<const __m128i*>(childVirtualLosses + i))), weightPerVirtualLossV
+      );
+      __m256d virtualLossWeightFrac = _mm256_div_pd(
+        _mm256_mul_pd(virtualLossUtilityScaleV, virtualLossWeight),
+        _mm256_add_pd(virtualLossWeight, _mm256_max_pd(quarterV, childWeight))
+      );
+      utility = _mm256_add_pd(utility, _mm256_mul_pd(_mm256_sub_pd(virtualLossUtilityV, utility), virtualLossWeightFrac));
+      childWeight = _mm256_add_pd(childWeight, virtualLossWeight);
+      __m256d selectionValue = _mm256_add_pd(
+        _mm256_div_pd(_mm256_mul_pd(exploreScalingV, _mm256_load_pd(childPolicyProb + i)), _mm256_add_pd(oneV, childWeight)),
+        _mm256_mul_pd(utilitySignV, utility)
+      );
+      _mm256_store_pd(childSelectionValue + i, selectionValue);
+    }
+#endif
+    for(; i<numChildrenFound; i++) {
+      double childWeight = childWeightBuf[i];
+      double utility = childUtility[i];
+      utility = childHasUtility[i] != 0 ? utility : fpuValue;
+      //Virtual losses to direct threads down different paths, a no-op when there are none
+      double virtualLossWeight = childVirtualLosses[i] * weightPerVirtualLoss;
+      double virtualLossWeightFrac = virtualLossUtilityScale * virtualLossWeight / (virtualLossWeight + std::max(0.25,childWeight));
+      utility = utility + (virtualLossUtility - utility) * virtualLossWeightFrac;
+      childWeight += virtualLossWeight;
+      childSelectionValue[i] = exploreScaling * childPolicyProb[i] / (1.0 + childWeight) + utilitySign * utility;
+    }
+  }
+  for(int i = 0; i<numChildrenFound; i++) {
+    //Negative policy marks the children not to select, whose selection value is meaningless
+    if(childPolicyProb[i] >= 0 && childSelectionValue[i] > maxSelectionValue) {
+      maxSelectionValue = childSelectionValue[i];
       bestChildIdx = i;
-      bestChildMoveLoc = moveLoc;
+      bestChildMoveLoc = childMoveLoc[i];
     }
-
-    posesWithChildBuf[getPos(moveLoc)] = true;
   }
 
   const std::vector<int>& avoidMoveUntilByLoc = thread.pla == P_BLACK ? avoidMoveUntilByLocBlack : avoidMoveUntilByLocWhite;
@@ -382,7 +478,13 @@ void Search::selectBestChildToDescend(
   Loc bestNewMoveLoc = Board::NULL_LOC;
   float bestNewNNPolicyProb = -1.0f;
   for(int movePos = 0; movePos<policySize; movePos++) {
-    bool alreadyTried = posesWithChildBuf[movePos];
+    uint64_t posWord = posesWithChild[movePos >> 6];
+    //Skip whole words of moves that all have children
+    if(posWord == ~(uint64_t)0) {
+      movePos |= 63;
+      continue;
+    }
+    bool alreadyTried = ((posWord >> (movePos & 63)) & 1) != 0;
     if(alreadyTried)
       continue;
 
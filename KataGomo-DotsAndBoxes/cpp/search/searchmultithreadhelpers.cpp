@@ -2,11 +2,14 @@
 
 #include "../search/searchnode.h"
 
+#include "../core/threadplacement.h"
+
 //------------------------
 #include "../core/using.h"
 //------------------------
 
-static void threadTaskLoop(Search* search, int threadIdx) {
+static void threadTaskLoop(Search* search, int threadIdx, int numThreads, int placementOffset) {
+  ThreadPlacement::pinSearchThread(threadIdx,numThreads,placementOffset);
   while(true) {
     std::function<void(int)>* task;
     bool suc = search->threadTasks[threadIdx-1].waitPop(task);
@@ -48,8 +51,9 @@ void Search::spawnThreadsIfNeeded() {
   threadTasks = new ThreadSafeQueue<std::function<void(int)>*>[desiredNumAdditionalThreads];
   threadTasksRemaining = new ThreadSafeCounter();
   threads = new std::thread[desiredNumAdditionalThreads];
+  const int placementOffset = ThreadPlacement::reserveSearchThreads(desiredNumAdditionalThreads+1);
   for(int i = 0; i<desiredNumAdditionalThreads; i++)
-    threads[i] = std::thread(threadTaskLoop,this,i+1);
+    threads[i] = std::thread(threadTaskLoop,this,i+1,desiredNumAdditionalThreads+1,placementOffset);
   numThreadsSpawned = desiredNumAdditionalThreads;
 }
 
@@ -74,9 +78,29 @@ void Search::respawnThreads() {
   spawnThreadsIfNeeded();
 }
 
+void Search::ensureEndgameSolvers(int numThreads) {
+  //Params may have changed between searches, in which case the old tables are simply dropped.
+  for(size_t i = 0; i<endgameSolvers.size(); i++) {
+    if(endgameSolvers[i]->getTableSizePowerOfTwo() != searchParams.endgameSolverTableSizePowerOfTwo) {
+      delete endgameSolvers[i];
+      endgameSolvers[i] = new EndgameSolver(searchParams.endgameSolverTableSizePowerOfTwo);
+    }
+  }
+  while((int)endgameSolvers.size() < numThreads)
+    endgameSolvers.push_back(new EndgameSolver(searchParams.endgameSolverTableSizePowerOfTwo));
+}
+
+void Search::ensureProfileCounters(int numThreads) {
+  while((int)profileCounters.size() < numThreads)
+    profileCounters.push_back(new SearchProfile::ThreadCounters());
+}
+
 void Search::performTaskWithThreads(std::function<void(int)>* task) {
   spawnThreadsIfNeeded();
   int numAdditionalThreadsToUse = numAdditionalThreadsToUseForTasks();
+  nodeAllocator->ensureNumThreads(numAdditionalThreadsToUse+1);
+  ensureEndgameSolvers(numAdditionalThreadsToUse+1);
+  ensureProfileCounters(numAdditionalThreadsToUse+1);
   if(numAdditionalThreadsToUse <= 0) {
     (*task)(0);
   }
@@ -152,7 +176,7 @@ void Search::applyRecursivelyPostOrderMulithreadedHelper(
 
   //Recurse on all children
   int childrenCapacity;
-  SearchChildPointer* children = node->getChildren(childrenCapacity);
+  SearchChildren children = node->getChildren(childrenCapacity);
   int numChildren = SearchNode::iterateAndCountChildrenInArray(children,childrenCapacity);
 
   if(numChildren > 0) {
@@ -225,7 +249,7 @@ void Search::applyRecursivelyAnyOrderMulithreadedHelper(
 
   //Recurse on all children
   int childrenCapacity;
-  SearchChildPointer* children = node->getChildren(childrenCapacity);
+  SearchChildren children = node->getChildren(childrenCapacity);
   int numChildren = SearchNode::iterateAndCountChildrenInArray(children,childrenCapacity);
 
   if(numChildren > 0) {
@@ -251,6 +275,7 @@ void Search::applyRecursivelyAnyOrderMulithreadedHelper(
 
 //Mainly for testing
 std::vector<SearchNode*> Search::enumerateTreePostOrder() {
+  waitForTreeCollectionUnlinked();
   std::atomic<int64_t> sizeCounter(0);
   std::function<void(SearchNode*,int)> f = [&](SearchNode* node, int threadIdx) {
     (void)node;
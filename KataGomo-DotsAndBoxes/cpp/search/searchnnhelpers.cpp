@@ -6,20 +6,28 @@
 #include "../core/using.h"
 //------------------------
 
-void Search::computeRootNNEvaluation(NNResultBuf& nnResultBuf) {
-  Board board = rootBoard;
-  const BoardHistory& hist = rootHistory;
-  Player pla = rootPla;
-  bool skipCache = false;
+MiscNNInputParams Search::getNNInputParams(Player pla) const {
   MiscNNInputParams nnInputParams;
   nnInputParams.noResultUtilityForWhite = searchParams.noResultUtilityForWhite;
   nnInputParams.nnPolicyTemperature = searchParams.nnPolicyTemperature;
+  //Otherwise nnRandomize picks a symmetry with the rand of whichever nn server thread gets the batch
+  if(searchParams.useDeterministicWaves)
+    nnInputParams.symmetry = 0;
   if(searchParams.playoutDoublingAdvantage != 0) {
     Player playoutDoublingAdvantagePla = getPlayoutDoublingAdvantagePla();
     nnInputParams.playoutDoublingAdvantage = (
       getOpp(pla) == playoutDoublingAdvantagePla ? -searchParams.playoutDoublingAdvantage : searchParams.playoutDoublingAdvantage
     );
   }
+  return nnInputParams;
+}
+
+void Search::computeRootNNEvaluation(NNResultBuf& nnResultBuf) {
+  Board board = rootBoard;
+  const BoardHistory& hist = rootHistory;
+  Player pla = rootPla;
+  bool skipCache = false;
+  MiscNNInputParams nnInputParams = getNNInputParams(pla);
   nnEvaluator->evaluate(
     board, hist, pla,
     nnInputParams,
@@ -35,15 +43,7 @@ bool Search::initNodeNNOutput(
   SearchThread& thread, SearchNode& node,
   bool isRoot, bool skipCache, bool isReInit
 ) {
-  MiscNNInputParams nnInputParams;
-  nnInputParams.noResultUtilityForWhite = searchParams.noResultUtilityForWhite;
-  nnInputParams.nnPolicyTemperature = searchParams.nnPolicyTemperature;
-  if(searchParams.playoutDoublingAdvantage != 0) {
-    Player playoutDoublingAdvantagePla = getPlayoutDoublingAdvantagePla();
-    nnInputParams.playoutDoublingAdvantage = (
-      getOpp(thread.pla) == playoutDoublingAdvantagePla ? -searchParams.playoutDoublingAdvantage : searchParams.playoutDoublingAdvantage
-    );
-  }
+  MiscNNInputParams nnInputParams = getNNInputParams(thread.pla);
 
   std::shared_ptr<NNOutput>* result;
   if(isRoot && searchParams.rootNumSymmetriesToSample > 1) {
@@ -64,11 +64,23 @@ bool Search::initNodeNNOutput(
     result = new std::shared_ptr<NNOutput>(new NNOutput(ptrs));
   }
   else {
-    nnEvaluator->evaluate(
+    //Same as nnEvaluator->evaluate, split up to profile the time queueing apart from the time waiting
+    uint64_t startTicks = SearchProfile::getTicks();
+    bool hasResult = nnEvaluator->prepareEvaluation(
       thread.board, thread.history, thread.pla,
       nnInputParams,
       thread.nnResultBuf, skipCache
     );
+    if(!hasResult) {
+      NNResultBuf* bufPtr = &thread.nnResultBuf;
+      nnEvaluator->queueEvaluations(&bufPtr,1);
+      thread.profile.add(SearchProfile::PHASE_NN_QUEUE, startTicks);
+      startTicks = SearchProfile::getTicks();
+      nnEvaluator->waitForResult(thread.nnResultBuf);
+      thread.profile.add(SearchProfile::PHASE_NN_WAIT, startTicks);
+    }
+    else
+      thread.profile.add(SearchProfile::PHASE_NN_QUEUE, startTicks);
     result = new std::shared_ptr<NNOutput>(std::move(thread.nnResultBuf.result));
   }
 
@@ -103,6 +115,23 @@ bool Search::initNodeNNOutput(
 }
 
 
+//Prepares the nn evaluation of a new leaf for thread.deferringLeaf, to be queued together with the others.
+void Search::deferLeafNNEvaluation(SearchThread& thread, SearchNode& node) {
+  SearchDeferredLeaf& leaf = *thread.deferringLeaf;
+  MiscNNInputParams nnInputParams = getNNInputParams(thread.pla);
+  bool skipCache = false;
+  uint64_t startTicks = SearchProfile::getTicks();
+  leaf.hasNNResult = nnEvaluator->prepareEvaluation(
+    thread.board, thread.history, thread.pla,
+    nnInputParams,
+    leaf.nnResultBuf, skipCache
+  );
+  thread.profile.add(SearchProfile::PHASE_NN_QUEUE, startTicks);
+  leaf.queued = false;
+  leaf.leaf = &node;
+  leaf.path.clear();
+}
+
 //Assumes node already has an nnOutput
 void Search::maybeRecomputeExistingNNOutput(
   SearchThread& thread, SearchNode& node, bool isRoot
@@ -138,62 +138,138 @@ void SearchChildPointer::setMoveLocRelaxed(Loc loc) {
 //-----------------------------------------------------------------------------------------
 
 
+#ifndef COMPACT_SEARCH_NODES
+
+size_t SearchNode::childrenArrayBytes(int capacity) {
+  return sizeof(SearchChildPointer) * capacity;
+}
+
+static SearchChildArray* allocateChildrenArray(SearchNodeAllocator::ThreadCache& alloc, int sizeClass, int capacity) {
+  SearchChildPointer* children = static_cast<SearchChildPointer*>(alloc.allocate(sizeClass));
+  for(int i = 0; i<capacity; i++)
+    new (children+i) SearchChildPointer();
+  return children;
+}
+
+static inline SearchChildren makeChildren(SearchChildArray* arr, int capacity) {
+  (void)capacity;
+  return arr;
+}
+static inline ConstSearchChildren makeChildren(const SearchChildArray* arr, int capacity) {
+  (void)capacity;
+  return arr;
+}
+
+#else
+
+size_t SearchNode::childrenArrayBytes(int capacity) {
+  return (sizeof(std::atomic<SearchNode*>) + sizeof(std::atomic<int64_t>) + sizeof(std::atomic<Loc>)) * capacity;
+}
+
+static SearchChildArray* allocateChildrenArray(SearchNodeAllocator::ThreadCache& alloc, int sizeClass, int capacity) {
+  char* mem = static_cast<char*>(alloc.allocate(sizeClass));
+  std::atomic<SearchNode*>* data = reinterpret_cast<std::atomic<SearchNode*>*>(mem);
+  std::atomic<int64_t>* edgeVisits = reinterpret_cast<std::atomic<int64_t>*>(data + capacity);
+  std::atomic<Loc>* moveLoc = reinterpret_cast<std::atomic<Loc>*>(edgeVisits + capacity);
+  for(int i = 0; i<capacity; i++) {
+    new (data+i) std::atomic<SearchNode*>(NULL);
+    new (edgeVisits+i) std::atomic<int64_t>(0);
+    new (moveLoc+i) std::atomic<Loc>(Board::NULL_LOC);
+  }
+  return reinterpret_cast<SearchChildArray*>(mem);
+}
+
+static inline SearchChildren makeChildren(SearchChildArray* arr, int capacity) {
+  return SearchChildren(arr, capacity);
+}
+static inline ConstSearchChildren makeChildren(const SearchChildArray* arr, int capacity) {
+  return ConstSearchChildren(arr, capacity);
+}
+
+#endif
+
 //Makes a search node resulting from prevPla playing prevLoc
 SearchNode::SearchNode(Player pla, bool fnt, uint32_t mIdx)
   :nextPla(pla),
    forceNonTerminal(fnt),
+   provenWinner(PROVEN_NONE),
    mutexIdx(mIdx),
    state(SearchNode::STATE_UNEVALUATED),
-   nnOutput(),
    nodeAge(0),
+   nnOutput(),
    children0(NULL),
    children1(NULL),
    children2(NULL),
    stats(),
    virtualLosses(0),
-   dirtyCounter(0)
+   dirtyCounter(0),
+   trimmedStats(NULL)
 {
 }
 
-SearchNode::SearchNode(const SearchNode& other, bool fnt)
+SearchNode::SearchNode(const SearchNode& other, bool fnt, SearchNodeAllocator::ThreadCache& alloc)
   :nextPla(other.nextPla),
    forceNonTerminal(fnt),
+   //A terminal node that becomes a forced non-terminal root is no longer solved.
+   provenWinner(fnt == other.forceNonTerminal ? other.provenWinner.load(std::memory_order_acquire) : PROVEN_NONE),
    mutexIdx(other.mutexIdx),
    state(other.state.load(std::memory_order_acquire)),
-   nnOutput(new std::shared_ptr<NNOutput>(*(other.nnOutput.load(std::memory_order_acquire)))),
    nodeAge(other.nodeAge.load(std::memory_order_acquire)),
+   nnOutput(new std::shared_ptr<NNOutput>(*(other.nnOutput.load(std::memory_order_acquire)))),
    children0(NULL),
    children1(NULL),
    children2(NULL),
    stats(other.stats),
    virtualLosses(other.virtualLosses.load(std::memory_order_acquire)),
-   dirtyCounter(other.dirtyCounter.load(std::memory_order_acquire))
+   dirtyCounter(other.dirtyCounter.load(std::memory_order_acquire)),
+   trimmedStats(NULL)
 {
+  if(other.trimmedStats != NULL)
+    setTrimmedStats(*other.trimmedStats, alloc);
   if(other.children0 != NULL) {
-    children0 = new SearchChildPointer[CHILDREN0SIZE];
+    children0 = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN0, CHILDREN0SIZE);
+    SearchChildren dst = makeChildren(children0, CHILDREN0SIZE);
+    ConstSearchChildren src = makeChildren((const SearchChildArray*)other.children0, CHILDREN0SIZE);
     for(int i = 0; i<CHILDREN0SIZE; i++)
-      children0[i].storeAll(other.children0[i]);
+      dst[i].storeAll(src[i]);
   }
   if(other.children1 != NULL) {
-    children1 = new SearchChildPointer[CHILDREN1SIZE];
+    children1 = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN1, CHILDREN1SIZE);
+    SearchChildren dst = makeChildren(children1, CHILDREN1SIZE);
+    ConstSearchChildren src = makeChildren((const SearchChildArray*)other.children1, CHILDREN1SIZE);
     for(int i = 0; i<CHILDREN1SIZE; i++)
-      children1[i].storeAll(other.children1[i]);
+      dst[i].storeAll(src[i]);
   }
   if(other.children2 != NULL) {
-    children2 = new SearchChildPointer[CHILDREN2SIZE];
+    children2 = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN2, CHILDREN2SIZE);
+    SearchChildren dst = makeChildren(children2, CHILDREN2SIZE);
+    ConstSearchChildren src = makeChildren((const SearchChildArray*)other.children2, CHILDREN2SIZE);
     for(int i = 0; i<CHILDREN2SIZE; i++)
-      children2[i].storeAll(other.children2[i]);
+      dst[i].storeAll(src[i]);
   }
 }
 
-SearchChildPointer* SearchNode::getChildren(int& childrenCapacity) {
+SearchChildren SearchNode::getChildren(int& childrenCapacity) {
   return getChildren(state.load(std::memory_order_acquire),childrenCapacity);
 }
-const SearchChildPointer* SearchNode::getChildren(int& childrenCapacity) const {
+ConstSearchChildren SearchNode::getChildren(int& childrenCapacity) const {
   return getChildren(state.load(std::memory_order_acquire),childrenCapacity);
 }
 
-int SearchNode::iterateAndCountChildrenInArray(const SearchChildPointer* children, int childrenCapacity) {
+constexpr int8_t SearchNode::PROVEN_NONE;
+
+bool SearchNode::isProven() const {
+  return provenWinner.load(std::memory_order_acquire) != PROVEN_NONE;
+}
+Player SearchNode::getProvenWinner() const {
+  return provenWinner.load(std::memory_order_acquire);
+}
+bool SearchNode::setProvenWinner(Player winner) {
+  int8_t expected = PROVEN_NONE;
+  return provenWinner.compare_exchange_strong(expected, winner, std::memory_order_acq_rel);
+}
+
+int SearchNode::iterateAndCountChildrenInArray(ConstSearchChildren children, int childrenCapacity) {
   int numChildren = 0;
   for(int i = 0; i<childrenCapacity; i++) {
     if(children[i].getIfAllocated() == NULL)
@@ -205,7 +281,7 @@ int SearchNode::iterateAndCountChildrenInArray(const SearchChildPointer* childre
 
 int SearchNode::iterateAndCountChildren() const {
   int childrenCapacity;
-  const SearchChildPointer* children = getChildren(childrenCapacity);
+  ConstSearchChildren children = getChildren(childrenCapacity);
   return iterateAndCountChildrenInArray(children,childrenCapacity);
 }
 
@@ -216,11 +292,11 @@ int SearchNode::iterateAndCountChildren() const {
 //Returns true: node state, stateValue, children arrays are all updated if needed so that they are large enough.
 //Returns false: failure since another thread is handling it.
 //Thread-safe.
-bool SearchNode::maybeExpandChildrenCapacityForNewChild(int& stateValue, int numChildrenFullPlusOne) {
+bool SearchNode::maybeExpandChildrenCapacityForNewChild(int& stateValue, int numChildrenFullPlusOne, SearchNodeAllocator::ThreadCache& alloc) {
   int capacity = getChildrenCapacity(stateValue);
   if(capacity < numChildrenFullPlusOne) {
     assert(capacity == numChildrenFullPlusOne-1);
-    return tryExpandingChildrenCapacityAssumeFull(stateValue);
+    return tryExpandingChildrenCapacityAssumeFull(stateValue, alloc);
   }
   return true;
 }
@@ -235,14 +311,26 @@ int SearchNode::getChildrenCapacity(int stateValue) const {
   return 0;
 }
 
-void SearchNode::initializeChildren() {
+void SearchNode::initializeChildren(SearchNodeAllocator::ThreadCache& alloc) {
   assert(children0 == NULL);
-  children0 = new SearchChildPointer[SearchNode::CHILDREN0SIZE];
+  children0 = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN0, SearchNode::CHILDREN0SIZE);
+}
+
+void SearchNode::initializeChildrenForState(int stateValue, SearchNodeAllocator::ThreadCache& alloc) {
+  assert(children0 == NULL && children1 == NULL && children2 == NULL);
+  assert(stateValue == STATE_UNEVALUATED || stateValue == STATE_EXPANDED0 || stateValue == STATE_EXPANDED1 || stateValue == STATE_EXPANDED2);
+  if(stateValue >= SearchNode::STATE_EXPANDED2)
+    children2 = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN2, SearchNode::CHILDREN2SIZE);
+  else if(stateValue >= SearchNode::STATE_EXPANDED1)
+    children1 = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN1, SearchNode::CHILDREN1SIZE);
+  else if(stateValue >= SearchNode::STATE_EXPANDED0)
+    children0 = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN0, SearchNode::CHILDREN0SIZE);
+  state.store(stateValue,std::memory_order_release);
 }
 
 //Precondition: Assumes that we have actually checked the childen array that stateValue suggests that
 //we should use, and that every slot in it is full.
-bool SearchNode::tryExpandingChildrenCapacityAssumeFull(int& stateValue) {
+bool SearchNode::tryExpandingChildrenCapacityAssumeFull(int& stateValue, SearchNodeAllocator::ThreadCache& alloc) {
   if(stateValue < SearchNode::STATE_EXPANDED1) {
     if(stateValue == SearchNode::STATE_GROWING1)
       return false;
@@ -251,8 +339,9 @@ bool SearchNode::tryExpandingChildrenCapacityAssumeFull(int& stateValue) {
     if(!suc) return false;
     stateValue = SearchNode::STATE_GROWING1;
 
-    SearchChildPointer* children = new SearchChildPointer[SearchNode::CHILDREN1SIZE];
-    SearchChildPointer* oldChildren = children0;
+    SearchChildArray* newChildren = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN1, SearchNode::CHILDREN1SIZE);
+    SearchChildren children = makeChildren(newChildren, SearchNode::CHILDREN1SIZE);
+    SearchChildren oldChildren = makeChildren(children0, SearchNode::CHILDREN0SIZE);
     for(int i = 0; i<SearchNode::CHILDREN0SIZE; i++) {
       //Loading relaxed is fine since by precondition, we've already observed that all of these
       //are non-null, so loading again it must be still true and we don't need any other synchronization.
@@ -270,7 +359,7 @@ bool SearchNode::tryExpandingChildrenCapacityAssumeFull(int& stateValue) {
       children[i].setMoveLocRelaxed(oldChildren[i].getMoveLocRelaxed());
     }
     assert(children1 == NULL);
-    children1 = children;
+    children1 = newChildren;
     state.store(SearchNode::STATE_EXPANDED1,std::memory_order_release);
     stateValue = SearchNode::STATE_EXPANDED1;
   }
@@ -282,8 +371,9 @@ bool SearchNode::tryExpandingChildrenCapacityAssumeFull(int& stateValue) {
     if(!suc) return false;
     stateValue = SearchNode::STATE_GROWING2;
 
-    SearchChildPointer* children = new SearchChildPointer[SearchNode::CHILDREN2SIZE];
-    SearchChildPointer* oldChildren = children1;
+    SearchChildArray* newChildren = allocateChildrenArray(alloc, SearchNodeAllocator::SIZE_CLASS_CHILDREN2, SearchNode::CHILDREN2SIZE);
+    SearchChildren children = makeChildren(newChildren, SearchNode::CHILDREN2SIZE);
+    SearchChildren oldChildren = makeChildren(children1, SearchNode::CHILDREN1SIZE);
     for(int i = 0; i<SearchNode::CHILDREN1SIZE; i++) {
       //Loading relaxed is fine since by precondition, we've already observed that all of these
       //are non-null, so loading again it must be still true and we don't need any other synchronization.
@@ -301,7 +391,7 @@ bool SearchNode::tryExpandingChildrenCapacityAssumeFull(int& stateValue) {
       children[i].setMoveLocRelaxed(oldChildren[i].getMoveLocRelaxed());
     }
     assert(children2 == NULL);
-    children2 = children;
+    children2 = newChildren;
     state.store(SearchNode::STATE_EXPANDED2,std::memory_order_release);
     stateValue = SearchNode::STATE_EXPANDED2;
   }
@@ -311,37 +401,37 @@ bool SearchNode::tryExpandingChildrenCapacityAssumeFull(int& stateValue) {
   return true;
 }
 
-const SearchChildPointer* SearchNode::getChildren(int stateValue, int& childrenCapacity) const {
+ConstSearchChildren SearchNode::getChildren(int stateValue, int& childrenCapacity) const {
   if(stateValue >= SearchNode::STATE_EXPANDED2) {
     childrenCapacity = SearchNode::CHILDREN2SIZE;
-    return children2;
+    return makeChildren((const SearchChildArray*)children2, SearchNode::CHILDREN2SIZE);
   }
   if(stateValue >= SearchNode::STATE_EXPANDED1) {
     childrenCapacity = SearchNode::CHILDREN1SIZE;
-    return children1;
+    return makeChildren((const SearchChildArray*)children1, SearchNode::CHILDREN1SIZE);
   }
   if(stateValue >= SearchNode::STATE_EXPANDED0) {
     childrenCapacity = SearchNode::CHILDREN0SIZE;
-    return children0;
+    return makeChildren((const SearchChildArray*)children0, SearchNode::CHILDREN0SIZE);
   }
   childrenCapacity = 0;
-  return NULL;
+  return ConstSearchChildren();
 }
-SearchChildPointer* SearchNode::getChildren(int stateValue, int& childrenCapacity) {
+SearchChildren SearchNode::getChildren(int stateValue, int& childrenCapacity) {
   if(stateValue >= SearchNode::STATE_EXPANDED2) {
     childrenCapacity = SearchNode::CHILDREN2SIZE;
-    return children2;
+    return makeChildren(children2, SearchNode::CHILDREN2SIZE);
   }
   if(stateValue >= SearchNode::STATE_EXPANDED1) {
     childrenCapacity = SearchNode::CHILDREN1SIZE;
-    return children1;
+    return makeChildren(children1, SearchNode::CHILDREN1SIZE);
   }
   if(stateValue >= SearchNode::STATE_EXPANDED0) {
     childrenCapacity = SearchNode::CHILDREN0SIZE;
-    return children0;
+    return makeChildren(children0, SearchNode::CHILDREN0SIZE);
   }
   childrenCapacity = 0;
-  return NULL;
+  return SearchChildren();
 }
 
 NNOutput* SearchNode::getNNOutput() {
@@ -372,14 +462,57 @@ bool SearchNode::storeNNOutputIfNull(std::shared_ptr<NNOutput>* newNNOutput) {
   return nnOutput.compare_exchange_strong(expected, newNNOutput, std::memory_order_acq_rel);
 }
 
-SearchNode::~SearchNode() {
+void SearchNode::freeChildren(SearchNodeAllocator::ThreadCache& alloc) {
   //Do NOT recursively delete children
   if(children2 != NULL)
-    delete[] children2;
+    alloc.free(children2, SearchNodeAllocator::SIZE_CLASS_CHILDREN2);
   if(children1 != NULL)
-    delete[] children1;
+    alloc.free(children1, SearchNodeAllocator::SIZE_CLASS_CHILDREN1);
   if(children0 != NULL)
-    delete[] children0;
+    alloc.free(children0, SearchNodeAllocator::SIZE_CLASS_CHILDREN0);
+  children2 = NULL;
+  children1 = NULL;
+  children0 = NULL;
+}
+
+void SearchNode::freeOutgrownChildren(SearchNodeAllocator::ThreadCache& alloc) {
+  int stateValue = state.load(std::memory_order_acquire);
+  if(stateValue >= SearchNode::STATE_EXPANDED2) {
+    if(children1 != NULL)
+      alloc.free(children1, SearchNodeAllocator::SIZE_CLASS_CHILDREN1);
+    children1 = NULL;
+  }
+  if(stateValue >= SearchNode::STATE_EXPANDED1) {
+    if(children0 != NULL)
+      alloc.free(children0, SearchNodeAllocator::SIZE_CLASS_CHILDREN0);
+    children0 = NULL;
+  }
+}
+
+void SearchNode::setTrimmedStats(const NodeStats& newTrimmedStats, SearchNodeAllocator::ThreadCache& alloc) {
+  if(trimmedStats == NULL)
+    trimmedStats = new (alloc.allocate(SearchNodeAllocator::SIZE_CLASS_TRIMMED_STATS)) NodeStats(newTrimmedStats);
+  else
+    *trimmedStats = newTrimmedStats;
+}
+
+SearchNode* SearchNode::allocate(SearchNodeAllocator::ThreadCache& alloc, Player prevPla, bool fnt, uint32_t mIdx) {
+  return new (alloc.allocate(SearchNodeAllocator::SIZE_CLASS_NODE)) SearchNode(prevPla, fnt, mIdx);
+}
+SearchNode* SearchNode::allocateCopy(SearchNodeAllocator::ThreadCache& alloc, const SearchNode& other, bool fnt) {
+  return new (alloc.allocate(SearchNodeAllocator::SIZE_CLASS_NODE)) SearchNode(other, fnt, alloc);
+}
+void SearchNode::destroy(SearchNodeAllocator::ThreadCache& alloc, SearchNode* node) {
+  node->freeChildren(alloc);
+  if(node->trimmedStats != NULL) {
+    node->trimmedStats->~NodeStats();
+    alloc.free(node->trimmedStats, SearchNodeAllocator::SIZE_CLASS_TRIMMED_STATS);
+  }
+  node->~SearchNode();
+  alloc.free(node, SearchNodeAllocator::SIZE_CLASS_NODE);
+}
+
+SearchNode::~SearchNode() {
   if(nnOutput != NULL)
     delete nnOutput;
 }
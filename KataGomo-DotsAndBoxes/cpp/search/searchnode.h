@@ -6,16 +6,24 @@
 #include "../core/multithread.h"
 #include "../game/boardhistory.h"
 #include "../neuralnet/nneval.h"
+#include "../search/searchnodeallocator.h"
 
 struct SearchNode;
 struct SearchThread;
 
+#ifdef COMPACT_SEARCH_NODES
+//Averages are bounded, so single precision is plenty for them. Visits and weight sums grow without bound and stay wide.
+typedef float NodeStatsAvgFloat;
+#else
+typedef double NodeStatsAvgFloat;
+#endif
+
 struct NodeStatsAtomic {
   std::atomic<int64_t> visits;
-  std::atomic<double> winLossValueAvg;
-  std::atomic<double> noResultValueAvg;
-  std::atomic<double> utilityAvg;
-  std::atomic<double> utilitySqAvg;
+  std::atomic<NodeStatsAvgFloat> winLossValueAvg;
+  std::atomic<NodeStatsAvgFloat> noResultValueAvg;
+  std::atomic<NodeStatsAvgFloat> utilityAvg;
+  std::atomic<NodeStatsAvgFloat> utilitySqAvg;
   std::atomic<double> weightSum;
   std::atomic<double> weightSqSum;
 
@@ -127,6 +135,113 @@ public:
   void setMoveLocRelaxed(Loc loc);
 };
 
+#ifndef COMPACT_SEARCH_NODES
+
+//A children array is simply an array of SearchChildPointer.
+typedef SearchChildPointer SearchChildArray;
+typedef SearchChildPointer* SearchChildren;
+typedef const SearchChildPointer* ConstSearchChildren;
+
+#else
+
+//Compact layout - a children array of capacity n is stored structure-of-arrays, n node pointers followed by n edge
+//visit counts followed by n move locs, so that scans over the children touch contiguous memory and no padding.
+//SearchChildArray is only an opaque pointer to the start of such a block, SearchChildren and ConstSearchChildren
+//are views on one that hand out references with the same interface as SearchChildPointer.
+struct SearchChildArray;
+
+struct ConstSearchChildRef {
+  const std::atomic<SearchNode*>* data;
+  const std::atomic<int64_t>* edgeVisits;
+  const std::atomic<Loc>* moveLoc;
+
+  const SearchNode* getIfAllocated() const { return data->load(std::memory_order_acquire); }
+  int64_t getEdgeVisits() const { return edgeVisits->load(std::memory_order_acquire); }
+  int64_t getEdgeVisitsRelaxed() const { return edgeVisits->load(std::memory_order_relaxed); }
+  Loc getMoveLoc() const { return moveLoc->load(std::memory_order_acquire); }
+  Loc getMoveLocRelaxed() const { return moveLoc->load(std::memory_order_relaxed); }
+};
+
+struct SearchChildRef {
+  std::atomic<SearchNode*>* data;
+  std::atomic<int64_t>* edgeVisits;
+  std::atomic<Loc>* moveLoc;
+
+  void storeAll(const ConstSearchChildRef& other) const {
+    SearchNode* d = const_cast<SearchNode*>(other.data->load(std::memory_order_acquire));
+    int64_t e = other.edgeVisits->load(std::memory_order_acquire);
+    Loc m = other.moveLoc->load(std::memory_order_acquire);
+    moveLoc->store(m,std::memory_order_release);
+    edgeVisits->store(e,std::memory_order_release);
+    data->store(d,std::memory_order_release);
+  }
+
+  SearchNode* getIfAllocated() const { return data->load(std::memory_order_acquire); }
+  SearchNode* getIfAllocatedRelaxed() const { return data->load(std::memory_order_relaxed); }
+  void store(SearchNode* node) const { data->store(node, std::memory_order_release); }
+  void storeRelaxed(SearchNode* node) const { data->store(node, std::memory_order_relaxed); }
+  bool storeIfNull(SearchNode* node) const {
+    SearchNode* expected = NULL;
+    return data->compare_exchange_strong(expected, node, std::memory_order_acq_rel);
+  }
+
+  int64_t getEdgeVisits() const { return edgeVisits->load(std::memory_order_acquire); }
+  int64_t getEdgeVisitsRelaxed() const { return edgeVisits->load(std::memory_order_relaxed); }
+  void setEdgeVisits(int64_t x) const { edgeVisits->store(x, std::memory_order_release); }
+  void setEdgeVisitsRelaxed(int64_t x) const { edgeVisits->store(x, std::memory_order_relaxed); }
+  void addEdgeVisits(int64_t delta) const { edgeVisits->fetch_add(delta, std::memory_order_acq_rel); }
+  bool compexweakEdgeVisits(int64_t& expected, int64_t desired) const {
+    return edgeVisits->compare_exchange_weak(expected, desired, std::memory_order_acq_rel);
+  }
+
+  Loc getMoveLoc() const { return moveLoc->load(std::memory_order_acquire); }
+  Loc getMoveLocRelaxed() const { return moveLoc->load(std::memory_order_relaxed); }
+  void setMoveLoc(Loc loc) const { moveLoc->store(loc, std::memory_order_release); }
+  void setMoveLocRelaxed(Loc loc) const { moveLoc->store(loc, std::memory_order_relaxed); }
+};
+
+class SearchChildren {
+  std::atomic<SearchNode*>* data;
+  std::atomic<int64_t>* edgeVisits;
+  std::atomic<Loc>* moveLoc;
+ public:
+  SearchChildren()
+    :data(NULL),edgeVisits(NULL),moveLoc(NULL)
+  {}
+  SearchChildren(SearchChildArray* arr, int capacity)
+    :data(reinterpret_cast<std::atomic<SearchNode*>*>(arr)),
+     edgeVisits(reinterpret_cast<std::atomic<int64_t>*>(data + capacity)),
+     moveLoc(reinterpret_cast<std::atomic<Loc>*>(edgeVisits + capacity))
+  {}
+  SearchChildRef operator[](int i) const {
+    return SearchChildRef{data+i, edgeVisits+i, moveLoc+i};
+  }
+  friend class ConstSearchChildren;
+};
+
+class ConstSearchChildren {
+  const std::atomic<SearchNode*>* data;
+  const std::atomic<int64_t>* edgeVisits;
+  const std::atomic<Loc>* moveLoc;
+ public:
+  ConstSearchChildren()
+    :data(NULL),edgeVisits(NULL),moveLoc(NULL)
+  {}
+  ConstSearchChildren(const SearchChildren& other)
+    :data(other.data),edgeVisits(other.edgeVisits),moveLoc(other.moveLoc)
+  {}
+  ConstSearchChildren(const SearchChildArray* arr, int capacity)
+    :data(reinterpret_cast<const std::atomic<SearchNode*>*>(arr)),
+     edgeVisits(reinterpret_cast<const std::atomic<int64_t>*>(data + capacity)),
+     moveLoc(reinterpret_cast<const std::atomic<Loc>*>(edgeVisits + capacity))
+  {}
+  ConstSearchChildRef operator[](int i) const {
+    return ConstSearchChildRef{data+i, edgeVisits+i, moveLoc+i};
+  }
+};
+
+#endif
+
 struct SearchNode {
   //Locks------------------------------------------------------------------------------
   mutable std::atomic_flag statsLock = ATOMIC_FLAG_INIT;
@@ -134,10 +249,17 @@ struct SearchNode {
   //Constant during search--------------------------------------------------------------
   const Player nextPla;
   const bool forceNonTerminal;
+  //MCTS-solver status. Mutable, but kept here where it fits in padding.
+  //PROVEN_NONE until the result of the game under perfect play from this node is known, after which it holds the winner,
+  //or C_EMPTY for a draw, and never changes again. Proven nodes are no longer selected by search.
+  std::atomic<int8_t> provenWinner;
+  static constexpr int8_t PROVEN_NONE = -1;
   const uint32_t mutexIdx; // For lookup into mutex pool
 
   //Mutable---------------------------------------------------------------------------
   //During search, only ever transitions forward.
+  //A node only has its nnOutput for sure once EXPANDED0. A leaf whose nn evaluation is deferred stays EVALUATING with a
+  //NULL nnOutput and no children until it arrives, so anything reading nodes during search must allow for that.
   std::atomic<int> state;
   static constexpr int STATE_UNEVALUATED = 0;
   static constexpr int STATE_EVALUATING = 1;
@@ -147,23 +269,24 @@ struct SearchNode {
   static constexpr int STATE_GROWING2 = 5;
   static constexpr int STATE_EXPANDED2 = 6;
 
+  //Used to coordinate various multithreaded updates.
+  //During search, for updating nnOutput when it needs recomputation at the root if it wasn't updated yet.
+  //During various other events - for coordinating recursive updates of the tree or subtree value bias cleanup
+  std::atomic<uint32_t> nodeAge;
+
   //During search, will only ever transition from NULL -> non-NULL.
   //Guaranteed to be non-NULL once state >= STATE_EXPANDED0.
   //After this is non-NULL, might rarely change mid-search, but it is guaranteed that old values remain
   //valid to access for the duration of the search and will not be deallocated.
   std::atomic<std::shared_ptr<NNOutput>*> nnOutput;
 
-  //Used to coordinate various multithreaded updates.
-  //During search, for updating nnOutput when it needs recomputation at the root if it wasn't updated yet.
-  //During various other events - for coordinating recursive updates of the tree or subtree value bias cleanup
-  std::atomic<uint32_t> nodeAge;
-
   //During search, each will only ever transition from NULL -> non-NULL.
   //We get progressive resizing of children array simply by moving on to a later array.
   //Mutex pool guards insertion of children at a node. Reading of children is always fine.
-  SearchChildPointer* children0; //Guaranteed to be non-NULL once state >= STATE_EXPANDED0
-  SearchChildPointer* children1; //Guaranteed to be non-NULL once state >= STATE_EXPANDED1
-  SearchChildPointer* children2; //Guaranteed to be non-NULL once state >= STATE_EXPANDED2
+  //The arrays are owned by the node, but allocated from and freed to the search's SearchNodeAllocator.
+  SearchChildArray* children0; //Guaranteed to be non-NULL once state >= STATE_EXPANDED0
+  SearchChildArray* children1; //Guaranteed to be non-NULL once state >= STATE_EXPANDED1
+  SearchChildArray* children2; //Guaranteed to be non-NULL once state >= STATE_EXPANDED2
 
   static constexpr int CHILDREN0SIZE = 8;
   static constexpr int CHILDREN1SIZE = 64;
@@ -177,9 +300,15 @@ struct SearchNode {
 
   std::atomic<int32_t> dirtyCounter;
 
+  //For a node whose subtree was trimmed away to stay within searchParams.maxSearchMemoryBytes, its stats at the time,
+  //so that recomputing them from any children it grows again doesn't lose what the trimmed ones had contributed.
+  //NULL for every other node. Owned by the node, allocated from and freed to the SearchNodeAllocator.
+  NodeStats* trimmedStats;
+
   //--------------------------------------------------------------------------------
   SearchNode(Player prevPla, bool forceNonTerminal, uint32_t mutexIdx);
-  SearchNode(const SearchNode&, bool forceNonTerminal);
+  SearchNode(const SearchNode&, bool forceNonTerminal, SearchNodeAllocator::ThreadCache& alloc);
+  //Does NOT free the children arrays, use freeChildren or reset the allocator.
   ~SearchNode();
 
   SearchNode& operator=(const SearchNode&) = delete;
@@ -188,13 +317,21 @@ struct SearchNode {
 
   //The array returned by these is guaranteed not to be deallocated during the lifetime of a search or even
   //any time up until a new operation is peformed (such as starting a new search, or making a move, or setting params).
-  SearchChildPointer* getChildren(int& childrenCapacity);
-  const SearchChildPointer* getChildren(int& childrenCapacity) const;
-  SearchChildPointer* getChildren(int state, int& childrenCapacity);
-  const SearchChildPointer* getChildren(int state, int& childrenCapacity) const;
+  SearchChildren getChildren(int& childrenCapacity);
+  ConstSearchChildren getChildren(int& childrenCapacity) const;
+  SearchChildren getChildren(int state, int& childrenCapacity);
+  ConstSearchChildren getChildren(int state, int& childrenCapacity) const;
+
+  bool isProven() const;
+  Player getProvenWinner() const;
+  //Returns true if this call was the one that set the proven result.
+  bool setProvenWinner(Player winner);
 
   int iterateAndCountChildren() const;
-  static int iterateAndCountChildrenInArray(const SearchChildPointer* children, int childrenCapacity);
+  static int iterateAndCountChildrenInArray(ConstSearchChildren children, int childrenCapacity);
+
+  //Bytes of memory for a children array of the given capacity
+  static size_t childrenArrayBytes(int capacity);
 
   //The NNOutput returned by these is guaranteed not to be deallocated during the lifetime of a search or even
   //any time up until a new operation is peformed (such as starting a new search, or making a move, or setting params).
@@ -208,12 +345,28 @@ struct SearchNode {
   bool storeNNOutputIfNull(std::shared_ptr<NNOutput>* newNNOutput);
 
   //Used within search to update state and allocate children arrays
-  void initializeChildren();
-  bool maybeExpandChildrenCapacityForNewChild(int& stateValue, int numChildrenFullPlusOne);
+  void initializeChildren(SearchNodeAllocator::ThreadCache& alloc);
+  bool maybeExpandChildrenCapacityForNewChild(int& stateValue, int numChildrenFullPlusOne, SearchNodeAllocator::ThreadCache& alloc);
+
+  //NOT threadsafe. For restoring a node saved elsewhere, sets the state and allocates only the children array it uses.
+  void initializeChildrenForState(int stateValue, SearchNodeAllocator::ThreadCache& alloc);
+
+  //NOT threadsafe. Frees all the children arrays of this node.
+  void freeChildren(SearchNodeAllocator::ThreadCache& alloc);
+  //NOT threadsafe. Frees the children arrays smaller than the one currently in use, which won't ever be accessed again.
+  void freeOutgrownChildren(SearchNodeAllocator::ThreadCache& alloc);
+
+  //NOT threadsafe. Sets trimmedStats, allocating it if there is none yet.
+  void setTrimmedStats(const NodeStats& newTrimmedStats, SearchNodeAllocator::ThreadCache& alloc);
+
+  //Construct a node in memory from alloc, and destroy and free one, including its children arrays.
+  static SearchNode* allocate(SearchNodeAllocator::ThreadCache& alloc, Player prevPla, bool forceNonTerminal, uint32_t mutexIdx);
+  static SearchNode* allocateCopy(SearchNodeAllocator::ThreadCache& alloc, const SearchNode& other, bool forceNonTerminal);
+  static void destroy(SearchNodeAllocator::ThreadCache& alloc, SearchNode* node);
 
 private:
   int getChildrenCapacity(int stateValue) const;
-  bool tryExpandingChildrenCapacityAssumeFull(int& stateValue);
+  bool tryExpandingChildrenCapacityAssumeFull(int& stateValue, SearchNodeAllocator::ThreadCache& alloc);
 };
 
 
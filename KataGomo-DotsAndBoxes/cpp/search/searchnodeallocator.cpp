@@ -0,0 +1,299 @@
+#include "../search/searchnodeallocator.h"
+
+#include "../search/searchnode.h"
+
+using namespace std;
+
+#ifndef COMPACT_SEARCH_NODES
+//Cache line alignment, so that nodes and children arrays used by different threads never share a line
+static constexpr size_t BLOCK_ALIGNMENT = 64;
+#else
+//Same alignment as malloc would give, the compact layout trades false sharing for not rounding every small block up
+//to whole cache lines.
+static constexpr size_t BLOCK_ALIGNMENT = 16;
+#endif
+static constexpr size_t MIN_SLAB_BYTES = (size_t)1 << 20;
+static constexpr size_t MIN_BLOCKS_PER_SLAB = 32;
+
+static size_t roundUpToBlockAlignment(size_t n) {
+  return (n + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+}
+
+SearchNodeAllocator::ThreadCache::ThreadCache(SearchNodeAllocator& a)
+  :allocator(a)
+{
+  for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++) {
+    freeLists[sizeClass] = NULL;
+    freeListTails[sizeClass] = NULL;
+    numFree[sizeClass] = 0;
+    carving[sizeClass] = NULL;
+    numInUse[sizeClass].store(0,std::memory_order_relaxed);
+  }
+}
+SearchNodeAllocator::ThreadCache::~ThreadCache()
+{}
+
+void* SearchNodeAllocator::ThreadCache::allocate(int sizeClass) {
+  assert(sizeClass >= 0 && sizeClass < NUM_SIZE_CLASSES);
+  numInUse[sizeClass].store(numInUse[sizeClass].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  void* p = freeLists[sizeClass];
+  if(p != NULL) {
+    freeLists[sizeClass] = *reinterpret_cast<void**>(p);
+    if(freeLists[sizeClass] == NULL)
+      freeListTails[sizeClass] = NULL;
+    numFree[sizeClass] -= 1;
+    return p;
+  }
+  Slab* slab = carving[sizeClass];
+  if(slab == NULL || slab->numCarved >= allocator.blocksPerSlab[sizeClass]) {
+    slab = allocator.acquireSlab(sizeClass);
+    carving[sizeClass] = slab;
+  }
+  p = slab->mem + slab->numCarved * allocator.blockBytes[sizeClass];
+  slab->numCarved += 1;
+  return p;
+}
+
+void SearchNodeAllocator::ThreadCache::free(void* p, int sizeClass) {
+  assert(sizeClass >= 0 && sizeClass < NUM_SIZE_CLASSES);
+  numInUse[sizeClass].store(numInUse[sizeClass].load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+  *reinterpret_cast<void**>(p) = freeLists[sizeClass];
+  if(freeLists[sizeClass] == NULL)
+    freeListTails[sizeClass] = p;
+  freeLists[sizeClass] = p;
+  numFree[sizeClass] += 1;
+}
+
+//------------------------------------------------------------------------------------
+
+SearchNodeAllocator::SearchNodeAllocator(int numThreads)
+  :threadCaches(),
+   backgroundCache(NULL),
+   numBackgroundReleases(0),
+   slabMutex(),
+   slabs(),
+   pooledSlabs()
+{
+  blockBytes[SIZE_CLASS_NODE] = roundUpToBlockAlignment(sizeof(SearchNode));
+  blockBytes[SIZE_CLASS_CHILDREN0] = roundUpToBlockAlignment(SearchNode::childrenArrayBytes(SearchNode::CHILDREN0SIZE));
+  blockBytes[SIZE_CLASS_CHILDREN1] = roundUpToBlockAlignment(SearchNode::childrenArrayBytes(SearchNode::CHILDREN1SIZE));
+  blockBytes[SIZE_CLASS_CHILDREN2] = roundUpToBlockAlignment(SearchNode::childrenArrayBytes(SearchNode::CHILDREN2SIZE));
+  blockBytes[SIZE_CLASS_TRIMMED_STATS] = roundUpToBlockAlignment(sizeof(NodeStats));
+  static_assert(alignof(SearchNode) <= BLOCK_ALIGNMENT, "");
+  static_assert(alignof(NodeStats) <= BLOCK_ALIGNMENT, "");
+  static_assert(alignof(SearchChildPointer) <= BLOCK_ALIGNMENT, "");
+  static_assert(alignof(std::atomic<int64_t>) <= BLOCK_ALIGNMENT, "");
+
+  //All slabs are the same size so that a pooled slab can be recarved for any size class.
+  slabBytes = std::max(MIN_SLAB_BYTES, blockBytes[SIZE_CLASS_CHILDREN2] * MIN_BLOCKS_PER_SLAB);
+  for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++)
+    blocksPerSlab[sizeClass] = (uint32_t)(slabBytes / blockBytes[sizeClass]);
+
+  backgroundCache = new ThreadCache(*this);
+  ensureNumThreads(numThreads);
+}
+
+SearchNodeAllocator::~SearchNodeAllocator() {
+  for(ThreadCache* cache: threadCaches)
+    delete cache;
+  delete backgroundCache;
+  for(Slab* slab: slabs) {
+    delete[] slab->rawMem;
+    delete slab;
+  }
+}
+
+void SearchNodeAllocator::ensureNumThreads(int numThreads) {
+  while((int)threadCaches.size() < std::max(numThreads,1))
+    threadCaches.push_back(new ThreadCache(*this));
+}
+
+SearchNodeAllocator::ThreadCache& SearchNodeAllocator::getThreadCache(int threadIdx) {
+  assert(threadIdx >= 0 && threadIdx < (int)threadCaches.size());
+  return *(threadCaches[threadIdx]);
+}
+
+SearchNodeAllocator::ThreadCache& SearchNodeAllocator::getBackgroundCache() {
+  return *backgroundCache;
+}
+
+vector<SearchNodeAllocator::ThreadCache*> SearchNodeAllocator::getAllCaches() const {
+  vector<ThreadCache*> caches(threadCaches);
+  caches.push_back(backgroundCache);
+  return caches;
+}
+
+size_t SearchNodeAllocator::getBlockBytes(int sizeClass) const {
+  assert(sizeClass >= 0 && sizeClass < NUM_SIZE_CLASSES);
+  return blockBytes[sizeClass];
+}
+
+SearchNodeAllocator::Slab* SearchNodeAllocator::acquireSlab(int sizeClass) {
+  std::lock_guard<std::mutex> lock(slabMutex);
+  Slab* slab;
+  if(pooledSlabs.size() > 0) {
+    slab = pooledSlabs.back();
+    pooledSlabs.pop_back();
+  }
+  else {
+    slab = new Slab();
+    slab->rawMem = new char[slabBytes + BLOCK_ALIGNMENT];
+    size_t misalignment = (size_t)((uintptr_t)slab->rawMem % BLOCK_ALIGNMENT);
+    slab->mem = slab->rawMem + (misalignment == 0 ? 0 : BLOCK_ALIGNMENT - misalignment);
+    slabs.push_back(slab);
+  }
+  slab->sizeClass = sizeClass;
+  slab->numCarved = 0;
+  slab->numFree = 0;
+  return slab;
+}
+
+void SearchNodeAllocator::reset() {
+  for(ThreadCache* cache: getAllCaches()) {
+    for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++) {
+      cache->freeLists[sizeClass] = NULL;
+      cache->freeListTails[sizeClass] = NULL;
+      cache->numFree[sizeClass] = 0;
+      cache->carving[sizeClass] = NULL;
+      cache->numInUse[sizeClass].store(0,std::memory_order_relaxed);
+    }
+  }
+  pooledSlabs.clear();
+  for(Slab* slab: slabs) {
+    slab->sizeClass = -1;
+    slab->numCarved = 0;
+    slab->numFree = 0;
+    pooledSlabs.push_back(slab);
+  }
+}
+
+void SearchNodeAllocator::releaseBackgroundCache() {
+  for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++) {
+    if(backgroundCache->freeLists[sizeClass] == NULL)
+      continue;
+    ThreadCache* cache = threadCaches[(numBackgroundReleases + sizeClass) % threadCaches.size()];
+    *reinterpret_cast<void**>(backgroundCache->freeListTails[sizeClass]) = cache->freeLists[sizeClass];
+    if(cache->freeLists[sizeClass] == NULL)
+      cache->freeListTails[sizeClass] = backgroundCache->freeListTails[sizeClass];
+    cache->freeLists[sizeClass] = backgroundCache->freeLists[sizeClass];
+    cache->numFree[sizeClass] += backgroundCache->numFree[sizeClass];
+    backgroundCache->freeLists[sizeClass] = NULL;
+    backgroundCache->freeListTails[sizeClass] = NULL;
+    backgroundCache->numFree[sizeClass] = 0;
+  }
+  numBackgroundReleases++;
+}
+
+void SearchNodeAllocator::reclaimEmptySlabs() {
+  uint64_t carvedBytes = 0;
+  uint64_t freeBytes = 0;
+  vector<Slab*> activeSlabs;
+  for(Slab* slab: slabs) {
+    if(slab->sizeClass < 0)
+      continue;
+    carvedBytes += (uint64_t)slab->numCarved * blockBytes[slab->sizeClass];
+    slab->numFree = 0;
+    activeSlabs.push_back(slab);
+  }
+  for(ThreadCache* cache: getAllCaches()) {
+    for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++)
+      freeBytes += cache->numFree[sizeClass] * blockBytes[sizeClass];
+  }
+  //Walking the free lists isn't free, only bother once a good fraction of carved memory is sitting on them.
+  if(freeBytes * 4 < carvedBytes)
+    return;
+
+  std::sort(activeSlabs.begin(), activeSlabs.end(), [](const Slab* a, const Slab* b) { return a->mem < b->mem; });
+  auto findSlab = [&](const void* p) {
+    auto iter = std::upper_bound(
+      activeSlabs.begin(), activeSlabs.end(), (const char*)p,
+      [](const char* q, const Slab* slab) { return q < slab->mem; }
+    );
+    assert(iter != activeSlabs.begin());
+    return *(iter-1);
+  };
+  auto isEmpty = [](const Slab* slab) {
+    return slab->numFree == slab->numCarved;
+  };
+
+  for(ThreadCache* cache: getAllCaches()) {
+    for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++) {
+      for(void* p = cache->freeLists[sizeClass]; p != NULL; p = *reinterpret_cast<void**>(p))
+        findSlab(p)->numFree += 1;
+    }
+  }
+
+  //Drop all blocks of empty slabs from the free lists.
+  for(ThreadCache* cache: getAllCaches()) {
+    for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++) {
+      void* head = NULL;
+      void* tail = NULL;
+      uint64_t numFree = 0;
+      void* p = cache->freeLists[sizeClass];
+      while(p != NULL) {
+        void* next = *reinterpret_cast<void**>(p);
+        if(!isEmpty(findSlab(p))) {
+          *reinterpret_cast<void**>(p) = head;
+          if(head == NULL)
+            tail = p;
+          head = p;
+          numFree++;
+        }
+        p = next;
+      }
+      cache->freeLists[sizeClass] = head;
+      cache->freeListTails[sizeClass] = tail;
+      cache->numFree[sizeClass] = numFree;
+    }
+  }
+
+  //Empty slabs that a thread is still carving from just start over, the rest go back to the pool.
+  for(ThreadCache* cache: getAllCaches()) {
+    for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++) {
+      Slab* slab = cache->carving[sizeClass];
+      if(slab != NULL && isEmpty(slab)) {
+        slab->numCarved = 0;
+        slab->numFree = 0;
+      }
+    }
+  }
+  for(Slab* slab: activeSlabs) {
+    if(slab->numCarved > 0 && isEmpty(slab)) {
+      slab->sizeClass = -1;
+      slab->numCarved = 0;
+      slab->numFree = 0;
+      pooledSlabs.push_back(slab);
+    }
+  }
+}
+
+SearchNodeAllocator::Stats SearchNodeAllocator::getStats() const {
+  Stats stats;
+  stats.numSlabs = slabs.size();
+  stats.numPooledSlabs = pooledSlabs.size();
+  stats.bytesReserved = stats.numSlabs * slabBytes;
+  stats.bytesInUse = 0;
+  stats.numNodes = 0;
+  for(const Slab* slab: slabs) {
+    if(slab->sizeClass < 0)
+      continue;
+    stats.bytesInUse += (uint64_t)slab->numCarved * blockBytes[slab->sizeClass];
+    if(slab->sizeClass == SIZE_CLASS_NODE)
+      stats.numNodes += slab->numCarved;
+  }
+  for(const ThreadCache* cache: getAllCaches()) {
+    for(int sizeClass = 0; sizeClass<NUM_SIZE_CLASSES; sizeClass++)
+      stats.bytesInUse -= cache->numFree[sizeClass] * blockBytes[sizeClass];
+    stats.numNodes -= cache->numFree[SIZE_CLASS_NODE];
+  }
+  return stats;
+}
+
+int64_t SearchNodeAllocator::getNumInUse(int sizeClass) const {
+  assert(sizeClass >= 0 && sizeClass < NUM_SIZE_CLASSES);
+  int64_t numInUse = 0;
+  for(const ThreadCache* cache: threadCaches)
+    numInUse += cache->numInUse[sizeClass].load(std::memory_order_relaxed);
+  numInUse += backgroundCache->numInUse[sizeClass].load(std::memory_order_relaxed);
+  return std::max(numInUse,(int64_t)0);
+}
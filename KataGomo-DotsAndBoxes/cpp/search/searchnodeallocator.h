@@ -0,0 +1,120 @@
+#ifndef SEARCH_SEARCHNODEALLOCATOR_H_
+#define SEARCH_SEARCHNODEALLOCATOR_H_
+
+#include "../core/global.h"
+#include "../core/multithread.h"
+
+struct SearchNode;
+struct SearchChildPointer;
+
+//Slab allocator for SearchNode, the three sizes of children arrays, and the stats kept by trimmed nodes.
+//Memory is carved out of fixed-size slabs, each slab holding blocks of only one size class. Every thread allocates
+//and frees through its own ThreadCache, with its own free lists and partially carved slab per size class, so the only
+//synchronization is when a thread needs a fresh slab from the shared pool.
+//Blocks freed by one thread go on that thread's free lists, so memory may migrate between threads, which is fine as
+//long as no two threads ever use the same ThreadCache concurrently.
+//
+//Tree teardown doesn't need to free blocks individually - reset() returns all slabs to the pool at once.
+//When only part of the tree is freed, as on tree reuse after a move, reclaimEmptySlabs() returns slabs whose blocks are
+//all free back to the pool so that they can be recarved for any size class, rather than leaving the memory
+//stranded on the free lists of a size class the next search may not need.
+class SearchNodeAllocator {
+ public:
+  static constexpr int SIZE_CLASS_NODE = 0;
+  static constexpr int SIZE_CLASS_CHILDREN0 = 1;
+  static constexpr int SIZE_CLASS_CHILDREN1 = 2;
+  static constexpr int SIZE_CLASS_CHILDREN2 = 3;
+  static constexpr int SIZE_CLASS_TRIMMED_STATS = 4;
+  static constexpr int NUM_SIZE_CLASSES = 5;
+
+  struct Slab {
+    char* rawMem;
+    char* mem;
+    int sizeClass; //-1 if in the pool
+    uint32_t numCarved;
+    uint32_t numFree; //Scratch for reclaimEmptySlabs
+  };
+
+  class ThreadCache {
+   public:
+    ThreadCache(SearchNodeAllocator& allocator);
+    ~ThreadCache();
+
+    ThreadCache(const ThreadCache&) = delete;
+    ThreadCache& operator=(const ThreadCache&) = delete;
+
+    void* allocate(int sizeClass);
+    void free(void* p, int sizeClass);
+
+   private:
+    SearchNodeAllocator& allocator;
+    void* freeLists[NUM_SIZE_CLASSES];
+    void* freeListTails[NUM_SIZE_CLASSES]; //The block at the end of each free list, so that lists can be joined at once
+    uint64_t numFree[NUM_SIZE_CLASSES];
+    Slab* carving[NUM_SIZE_CLASSES];
+    //Blocks allocated minus blocks freed through this cache, which may be negative since blocks can be freed through
+    //a different cache than they were allocated from. Only written by the thread using the cache, read by any.
+    std::atomic<int64_t> numInUse[NUM_SIZE_CLASSES];
+
+    friend class SearchNodeAllocator;
+  };
+
+  struct Stats {
+    uint64_t numSlabs;
+    uint64_t numPooledSlabs;
+    uint64_t bytesReserved;
+    uint64_t bytesInUse;
+    uint64_t numNodes;
+  };
+
+  SearchNodeAllocator(int numThreads);
+  ~SearchNodeAllocator();
+
+  SearchNodeAllocator(const SearchNodeAllocator&) = delete;
+  SearchNodeAllocator& operator=(const SearchNodeAllocator&) = delete;
+
+  //NOT threadsafe with anything else. Makes sure that caches exist for thread indices [0,numThreads).
+  void ensureNumThreads(int numThreads);
+  //Threadsafe, as long as ensureNumThreads isn't running.
+  ThreadCache& getThreadCache(int threadIdx);
+  //A cache apart from those of all the thread indices, for a single background thread to free through while the search
+  //threads use theirs.
+  ThreadCache& getBackgroundCache();
+
+  //NOT threadsafe with anything else. Every block allocated becomes invalid, callers are responsible for having
+  //already run any destructors that matter.
+  void reset();
+  //NOT threadsafe with anything else. Hands the blocks freed through the background cache over to the thread caches,
+  //since the background cache never allocates and they would otherwise stay unused until reset(). Takes constant time,
+  //each free list goes whole to one thread cache, rotating between them from one call to the next.
+  void releaseBackgroundCache();
+  //NOT threadsafe with anything else. Pools slabs all of whose blocks are free. Cheap to call when there is little
+  //to reclaim, since it only walks the free lists once they hold a sizable fraction of all carved memory.
+  void reclaimEmptySlabs();
+
+  //NOT threadsafe with allocation or freeing.
+  Stats getStats() const;
+  //Threadsafe, as long as ensureNumThreads isn't running. Number of blocks of the size class allocated and not yet freed,
+  //only approximate while threads are allocating or freeing.
+  int64_t getNumInUse(int sizeClass) const;
+
+  size_t getBlockBytes(int sizeClass) const;
+
+ private:
+  size_t blockBytes[NUM_SIZE_CLASSES];
+  uint32_t blocksPerSlab[NUM_SIZE_CLASSES];
+  size_t slabBytes;
+
+  std::vector<ThreadCache*> threadCaches;
+  ThreadCache* backgroundCache;
+  uint64_t numBackgroundReleases;
+
+  std::mutex slabMutex;
+  std::vector<Slab*> slabs;
+  std::vector<Slab*> pooledSlabs;
+
+  Slab* acquireSlab(int sizeClass);
+  std::vector<ThreadCache*> getAllCaches() const;
+};
+
+#endif  // SEARCH_SEARCHNODEALLOCATOR_H_
@@ -1,18 +1,181 @@
+
 #include "../search/searchnodetable.h"
 
-#include "../core/rand.h"
+#include "../core/threadplacement.h"
+
+constexpr double SearchNodeTable::maxLoadFactor;
 
-SearchNodeTable::SearchNodeTable(int numShardsPowerOfTwo) {
-  numShards = (uint32_t)1 << numShardsPowerOfTwo;
-  mutexPool = new MutexPool(numShards);
-  entries.resize(numShards);
+SearchNodeTable::Generation::Generation(uint64_t cap, Generation* old)
+  :slots(NULL),
+   capacity(cap),
+   mask(cap-1),
+   numEntries(0),
+   older(old),
+   numWriters(0),
+   migrated(old == NULL)
+{
+  assert((cap & (cap-1)) == 0);
+  //Shared by all search threads, so spread over the nodes rather than on the node of whichever thread grew it
+  ThreadPlacement::InterleavedAllocation interleaved;
+  slots = new Slot[cap]();
+}
+SearchNodeTable::Generation::~Generation() {
+  delete[] slots;
 }
+
+SearchNodeTable::SearchNodeTable(int capacityPowerOfTwo)
+  :newest(new Generation((uint64_t)1 << capacityPowerOfTwo, NULL)),
+   growthMutex(),
+   sweepBoundaries(),
+   sweepNumThreads(0)
+{}
 SearchNodeTable::~SearchNodeTable() {
-  delete mutexPool;
+  Generation* gen = newest.load(std::memory_order_acquire);
+  while(gen != NULL) {
+    Generation* older = gen->older;
+    delete gen;
+    gen = older;
+  }
+}
+
+void SearchNodeTable::grow(Generation* full) {
+  std::lock_guard<std::mutex> lock(growthMutex);
+  if(newest.load(std::memory_order_acquire) != full)
+    return;
+  Generation* gen = new Generation(full->capacity * 2, full);
+  newest.store(gen, std::memory_order_seq_cst);
+  //Once the inserts already under way are done, there will be no more into full, see findOrInsert.
+  while(full->numWriters.load(std::memory_order_seq_cst) > 0)
+    std::this_thread::yield();
+  for(uint64_t i = 0; i < full->capacity; i++) {
+    const Slot& slot = full->slots[i];
+    uint64_t h0 = slot.hash0.load(std::memory_order_acquire);
+    if(h0 == 0)
+      continue;
+    insertExisting(gen, h0, slot.hash1.load(std::memory_order_relaxed), slot.node.load(std::memory_order_acquire));
+  }
+  gen->migrated.store(true, std::memory_order_release);
+}
+
+void SearchNodeTable::insertExisting(Generation* gen, uint64_t h0, uint64_t h1, SearchNode* node) {
+  uint64_t idx = h0 & gen->mask;
+  while(true) {
+    Slot& slot = gen->slots[idx];
+    uint64_t k = 0;
+    if(slot.hash0.compare_exchange_strong(k, h0, std::memory_order_acq_rel)) {
+      slot.hash1.store(h1, std::memory_order_relaxed);
+      slot.node.store(node, std::memory_order_release);
+      gen->numEntries.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    idx = (idx + 1) & gen->mask;
+  }
+}
+
+void SearchNodeTable::beginSweep(int numThreads) {
+  assert(numThreads > 0);
+  sweepNumThreads = numThreads;
+  Generation* gen = newest.load(std::memory_order_acquire);
+  //Every growth finished moving its entries over before returning, so the older generations only hold copies.
+  assert(gen->migrated.load(std::memory_order_acquire));
+  Generation* older = gen->older;
+  while(older != NULL) {
+    Generation* next = older->older;
+    delete older;
+    older = next;
+  }
+  gen->older = NULL;
+
+  //Sweep in place. Each thread starts its range at an empty slot, so every probe cluster is handled by exactly one
+  //thread and entries only ever move within their own cluster. Boundaries are linear indices that may run past the
+  //end of the table, to be taken modulo the capacity.
+  sweepBoundaries.resize(numThreads+1);
+  for(int threadIdx = 0; threadIdx < numThreads; threadIdx++) {
+    uint64_t idx = (uint64_t)threadIdx * gen->capacity / numThreads;
+    while(gen->slots[idx & gen->mask].hash0.load(std::memory_order_relaxed) != 0)
+      idx++;
+    sweepBoundaries[threadIdx] = idx;
+  }
+  sweepBoundaries[numThreads] = sweepBoundaries[0] + gen->capacity;
 }
 
-uint32_t SearchNodeTable::getIndex(uint64_t hash) const {
-  uint32_t mutexPoolMask = numShards-1; //Always a power of two
-  return (uint32_t)(hash & mutexPoolMask);
+void SearchNodeTable::sweep(int threadIdx, const std::function<bool(SearchNode*)>& shouldRemove) {
+  assert(threadIdx >= 0 && threadIdx < sweepNumThreads);
+  Generation* gen = newest.load(std::memory_order_acquire);
+
+  struct Entry {
+    uint64_t hash0;
+    uint64_t hash1;
+    SearchNode* node;
+  };
+  std::vector<Entry> survivors;
+  uint64_t numRemoved = 0;
+  const uint64_t end = sweepBoundaries[threadIdx+1];
+  uint64_t i = sweepBoundaries[threadIdx];
+  while(i < end) {
+    if(gen->slots[i & gen->mask].hash0.load(std::memory_order_relaxed) == 0) {
+      i++;
+      continue;
+    }
+    const uint64_t clusterStart = i;
+    survivors.clear();
+    for(; gen->slots[i & gen->mask].hash0.load(std::memory_order_relaxed) != 0; i++) {
+      Slot& slot = gen->slots[i & gen->mask];
+      SearchNode* node = slot.node.load(std::memory_order_relaxed);
+      if(!shouldRemove(node))
+        survivors.push_back(Entry{slot.hash0.load(std::memory_order_relaxed), slot.hash1.load(std::memory_order_relaxed), node});
+    }
+    const uint64_t clusterEnd = i;
+    if(survivors.size() == clusterEnd - clusterStart)
+      continue;
+    numRemoved += (clusterEnd - clusterStart) - survivors.size();
+
+    //Clear the cluster and reinsert the survivors in their original order. Every survivor's home slot lies within
+    //the cluster at or before its old position, so it lands at or before its old position, and never past clusterEnd.
+    for(uint64_t j = clusterStart; j < clusterEnd; j++) {
+      Slot& slot = gen->slots[j & gen->mask];
+      slot.hash0.store(0, std::memory_order_relaxed);
+      slot.hash1.store(0, std::memory_order_relaxed);
+      slot.node.store(NULL, std::memory_order_relaxed);
+    }
+    for(const Entry& entry: survivors) {
+      uint64_t pos = clusterStart + (((entry.hash0 & gen->mask) - clusterStart) & gen->mask);
+      while(gen->slots[pos & gen->mask].hash0.load(std::memory_order_relaxed) != 0)
+        pos++;
+      assert(pos < clusterEnd);
+      Slot& slot = gen->slots[pos & gen->mask];
+      slot.hash0.store(entry.hash0, std::memory_order_relaxed);
+      slot.hash1.store(entry.hash1, std::memory_order_relaxed);
+      slot.node.store(entry.node, std::memory_order_relaxed);
+    }
+  }
+  gen->numEntries.fetch_sub(numRemoved, std::memory_order_relaxed);
 }
 
+void SearchNodeTable::endSweep() {
+  sweepBoundaries.clear();
+  sweepNumThreads = 0;
+}
+
+void SearchNodeTable::forEach(const std::function<void(Hash128,SearchNode*)>& f) const {
+  const Generation* gen = newest.load(std::memory_order_acquire);
+  for(uint64_t i = 0; i < gen->capacity; i++) {
+    const Slot& slot = gen->slots[i];
+    uint64_t h0 = slot.hash0.load(std::memory_order_relaxed);
+    if(h0 == 0)
+      continue;
+    f(Hash128(h0, slot.hash1.load(std::memory_order_relaxed)), slot.node.load(std::memory_order_relaxed));
+  }
+}
+
+SearchNodeTable::Stats SearchNodeTable::getStats() const {
+  Stats stats;
+  const Generation* gen = newest.load(std::memory_order_acquire);
+  stats.capacity = gen->capacity;
+  stats.numEntries = gen->numEntries.load(std::memory_order_relaxed);
+  stats.numGenerations = 0;
+  for(const Generation* g = gen; g != NULL; g = g->older)
+    stats.numGenerations += 1;
+  stats.loadFactor = (double)stats.numEntries / stats.capacity;
+  return stats;
+}
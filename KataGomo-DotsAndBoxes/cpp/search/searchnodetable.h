@@ -5,21 +5,171 @@
 #include "../core/hash.h"
 #include "../core/multithread.h"
 #include "../game/board.h"
-#include "../search/mutexpool.h"
 
 struct SearchNode;
 
+//Transposition table from node hash to SearchNode for graph search.
+//Open addressing with linear probing. Lookups and inserts are lock-free - a slot is claimed by CAS on hash0, after
+//which hash1 and then the node pointer are published. Entries are never removed while the search is running.
+//When the load factor of the table grows past maxLoadFactor, a new table of twice the size replaces it, and the thread
+//that grew it moves every entry over, so that lookups only ever probe one table once that is done. The old tables
+//stay allocated for threads that may still be reading them until the next sweep.
 struct SearchNodeTable {
-  std::vector<std::map<Hash128,SearchNode*>> entries;
-  MutexPool* mutexPool;
-  uint32_t numShards;
+  struct Slot {
+    std::atomic<uint64_t> hash0; //0 means empty
+    std::atomic<uint64_t> hash1;
+    std::atomic<SearchNode*> node;
+  };
+  struct Generation {
+    Slot* slots;
+    uint64_t capacity;
+    uint64_t mask;
+    std::atomic<uint64_t> numEntries;
+    Generation* older;
+    //Inserts into this generation under way, which a growth waits out before moving the entries to the next one
+    std::atomic<int32_t> numWriters;
+    //False while the entries of older are still being moved into this generation
+    std::atomic<bool> migrated;
 
-  SearchNodeTable(int numShardsPowerOfTwo);
+    Generation(uint64_t cap, Generation* old);
+    ~Generation();
+    Generation(const Generation&) = delete;
+    Generation& operator=(const Generation&) = delete;
+  };
+  struct Stats {
+    uint64_t capacity; //Of the newest generation, which holds every entry
+    uint64_t numEntries;
+    int numGenerations; //Including the replaced ones not yet freed
+    double loadFactor;
+  };
+
+  static constexpr double maxLoadFactor = 0.5;
+
+  std::atomic<Generation*> newest;
+  std::mutex growthMutex;
+
+  //State for an ongoing sweep, see beginSweep.
+  std::vector<uint64_t> sweepBoundaries;
+  int sweepNumThreads;
+
+  SearchNodeTable(int capacityPowerOfTwo);
   ~SearchNodeTable();
 
-  uint32_t getIndex(uint64_t hash) const;
+  SearchNodeTable(const SearchNodeTable&) = delete;
+  SearchNodeTable& operator=(const SearchNodeTable&) = delete;
+
+  //Threadsafe. Returns the node stored under hash, or if there is none yet, calls allocate() to create one,
+  //stores it, and returns it. Concurrent callers with the same hash wait for and receive the same node.
+  template<typename Allocate>
+  SearchNode* findOrInsert(Hash128 hash, Allocate allocate);
+
+  //NOT threadsafe with findOrInsert - remove entries from the table in bulk, parallelized over numThreads.
+  //Call beginSweep once, then sweep(threadIdx,...) for every threadIdx in [0,numThreads) concurrently, then endSweep.
+  //shouldRemove is called exactly once on every node in the table, those for which it returns true are removed
+  //(the caller is responsible for freeing them). Deletion shifts later entries of the same probe cluster backward,
+  //so no tombstones are ever left behind. The replaced generations are freed.
+  void beginSweep(int numThreads);
+  void sweep(int threadIdx, const std::function<bool(SearchNode*)>& shouldRemove);
+  void endSweep();
+
+  //NOT threadsafe with findOrInsert or sweeping. Calls f on the hash and node of every entry in the table.
+  void forEach(const std::function<void(Hash128,SearchNode*)>& f) const;
+
+  Stats getStats() const;
+
+ private:
+  static uint64_t slotHash0(Hash128 hash);
+  void grow(Generation* full);
+  static SearchNode* find(const Generation* gen, uint64_t h0, uint64_t h1);
+  static void insertExisting(Generation* gen, uint64_t h0, uint64_t h1, SearchNode* node);
 };
 
-#endif
+inline uint64_t SearchNodeTable::slotHash0(Hash128 hash) {
+  //Reserve 0 for empty slots. Equality still also checks hash1.
+  return hash.hash0 == 0 ? 1 : hash.hash0;
+}
 
+inline SearchNode* SearchNodeTable::find(const Generation* gen, uint64_t h0, uint64_t h1) {
+  uint64_t idx = h0 & gen->mask;
+  while(true) {
+    const Slot& slot = gen->slots[idx];
+    uint64_t k = slot.hash0.load(std::memory_order_acquire);
+    if(k == 0)
+      return NULL;
+    if(k == h0) {
+      SearchNode* node;
+      while((node = slot.node.load(std::memory_order_acquire)) == NULL)
+        std::this_thread::yield();
+      if(slot.hash1.load(std::memory_order_relaxed) == h1)
+        return node;
+    }
+    idx = (idx + 1) & gen->mask;
+  }
+}
 
+template<typename Allocate>
+SearchNode* SearchNodeTable::findOrInsert(Hash128 hash, Allocate allocate) {
+  const uint64_t h0 = slotHash0(hash);
+  const uint64_t h1 = hash.hash1;
+  Generation* gen = newest.load(std::memory_order_acquire);
+  //Only right after a growth, until its entries have all been moved over. A thread inserting here meanwhile can miss
+  //an entry that an insert already under way in the older generation is about to add, so rarely a node for the same
+  //hash gets inserted twice, which just costs a missed transposition.
+  if(!gen->migrated.load(std::memory_order_acquire)) {
+    SearchNode* node = find(gen->older, h0, h1);
+    if(node != NULL)
+      return node;
+  }
+
+  uint64_t idx = h0 & gen->mask;
+  uint64_t numProbes = 0;
+  bool isWriter = false;
+  while(true) {
+    Slot& slot = gen->slots[idx];
+    uint64_t k = slot.hash0.load(std::memory_order_acquire);
+    if(k == 0) {
+      //Before claiming a slot, either register so that a growth waits for this insert before moving the entries,
+      //or see that the growth already happened and insert into the new generation instead.
+      if(!isWriter) {
+        gen->numWriters.fetch_add(1, std::memory_order_seq_cst);
+        isWriter = true;
+        if(newest.load(std::memory_order_seq_cst) != gen) {
+          gen->numWriters.fetch_sub(1, std::memory_order_release);
+          return findOrInsert(hash, allocate);
+        }
+      }
+      if(slot.hash0.compare_exchange_strong(k, h0, std::memory_order_acq_rel)) {
+        slot.hash1.store(h1, std::memory_order_relaxed);
+        SearchNode* node = allocate();
+        slot.node.store(node, std::memory_order_release);
+        gen->numWriters.fetch_sub(1, std::memory_order_release);
+        uint64_t numEntries = gen->numEntries.fetch_add(1, std::memory_order_relaxed) + 1;
+        if(numEntries > (uint64_t)(gen->capacity * maxLoadFactor))
+          grow(gen);
+        return node;
+      }
+      //Lost the race for this slot, k now holds the winner's hash0.
+    }
+    if(k == h0) {
+      SearchNode* node;
+      while((node = slot.node.load(std::memory_order_acquire)) == NULL)
+        std::this_thread::yield();
+      if(slot.hash1.load(std::memory_order_relaxed) == h1) {
+        if(isWriter)
+          gen->numWriters.fetch_sub(1, std::memory_order_release);
+        return node;
+      }
+    }
+    idx = (idx + 1) & gen->mask;
+    numProbes++;
+    //Table is full. Only possible if many threads raced past the growth threshold at once, so wait for the growth.
+    if(numProbes >= gen->capacity) {
+      if(isWriter)
+        gen->numWriters.fetch_sub(1, std::memory_order_release);
+      grow(gen);
+      return findOrInsert(hash, allocate);
+    }
+  }
+}
+
+#endif
@@ -23,6 +23,8 @@ SearchParams::SearchParams()
    useNoisePruning(false),
    noisePruneUtilityScale(0.15),
    noisePruningCap(1e50),
+   useIncrementalBackup(false),
+   incrementalBackupRecomputeInterval(32),
    useUncertainty(false),
    uncertaintyCoeff(0.2),
    uncertaintyExponent(1.0),
@@ -30,6 +32,10 @@ SearchParams::SearchParams()
    useGraphSearch(false),
    graphSearchCatchUpLeakProb(0.0),
    //graphSearchCatchUpProp(0.0),
+   endgameSolverMaxEmptyEdges(0),
+   endgameSolverMaxNodes(100000),
+   endgameSolverTableSizePowerOfTwo(16),
+   useCaptureMacroMoves(false),
    rootNoiseEnabled(false),
    rootDirichletNoiseTotalConcentration(10.83),
    rootDirichletNoiseWeight(0.25),
@@ -55,7 +61,13 @@ SearchParams::SearchParams()
    playoutDoublingAdvantagePla(C_EMPTY),
    nnPolicyTemperature(1.0f),
    nodeTableShardsPowerOfTwo(16),
+   nodeTableCapacityPowerOfTwo(16),
    numVirtualLossesPerThread(3.0),
+   usePendingVisits(false),
+   numLeavesPerSearchThread(1),
+   useAsyncLeafPlayouts(false),
+   useBackgroundTreeCollection(false),
+   useDeterministicWaves(false),
    numThreads(1),
    maxVisits(((int64_t)1) << 50),
    maxPlayouts(((int64_t)1) << 50),
@@ -63,6 +75,10 @@ SearchParams::SearchParams()
    maxVisitsPondering(((int64_t)1) << 50),
    maxPlayoutsPondering(((int64_t)1) << 50),
    maxTimePondering(1.0e20),
+   maxSearchMemoryBytes(0),
+   earlyStopKLGainThreshold(0.0),
+   earlyStopCheckInterval(100),
+   earlyStopMinVisits(100),
    lagBuffer(0.0),
    treeReuseCarryOverTimeFactor(0.0),
    overallocateTimeFactor(1.0),
@@ -72,8 +88,7 @@ SearchParams::SearchParams()
    obviousMovesTimeFactor(1.0),
    obviousMovesPolicyEntropyTolerance(0.30),
    obviousMovesPolicySurpriseTolerance(0.15),
-   futileVisitsThreshold(0.0),
-   finishGameSearchDelayMicroseconds(0)
+   futileVisitsThreshold(0.0)
 {}
 
 SearchParams::~SearchParams()
@@ -124,9 +139,15 @@ void SearchParams::failIfParamsDifferOnUnchangeableParameter(const SearchParams&
   if(dynamic.numThreads > initial.numThreads) {
     throw StringError("Cannot increase number of search threads after initialization since this is used to initialize neural net buffer capacity");
   }
+  if(dynamic.numLeavesPerSearchThread > initial.numLeavesPerSearchThread) {
+    throw StringError("Cannot increase numLeavesPerSearchThread after initialization since this is used to initialize neural net buffer capacity");
+  }
   if(dynamic.nodeTableShardsPowerOfTwo != initial.nodeTableShardsPowerOfTwo) {
     throw StringError("Cannot change nodeTableShardsPowerOfTwo after initialization");
   }
+  if(dynamic.nodeTableCapacityPowerOfTwo != initial.nodeTableCapacityPowerOfTwo) {
+    throw StringError("Cannot change nodeTableCapacityPowerOfTwo after initialization");
+  }
 }
 
 
@@ -157,6 +178,8 @@ void SearchParams::printParams(std::ostream& out) {
   PRINTPARAM(useNoisePruning);
   PRINTPARAM(noisePruneUtilityScale);
   PRINTPARAM(noisePruningCap);
+  PRINTPARAM(useIncrementalBackup);
+  PRINTPARAM(incrementalBackupRecomputeInterval);
 
 
   PRINTPARAM(useUncertainty);
@@ -168,6 +191,11 @@ void SearchParams::printParams(std::ostream& out) {
   PRINTPARAM(useGraphSearch);
   PRINTPARAM(graphSearchCatchUpLeakProb);
 
+  PRINTPARAM(endgameSolverMaxEmptyEdges);
+  PRINTPARAM(endgameSolverMaxNodes);
+  PRINTPARAM(endgameSolverTableSizePowerOfTwo);
+  PRINTPARAM(useCaptureMacroMoves);
+
 
 
   PRINTPARAM(rootNoiseEnabled);
@@ -207,7 +235,13 @@ void SearchParams::printParams(std::ostream& out) {
 
 
   PRINTPARAM(nodeTableShardsPowerOfTwo);
+  PRINTPARAM(nodeTableCapacityPowerOfTwo);
   PRINTPARAM(numVirtualLossesPerThread);
+  PRINTPARAM(usePendingVisits);
+  PRINTPARAM(numLeavesPerSearchThread);
+  PRINTPARAM(useAsyncLeafPlayouts);
+  PRINTPARAM(useBackgroundTreeCollection);
+  PRINTPARAM(useDeterministicWaves);
 
 
   PRINTPARAM(numThreads);
@@ -219,6 +253,10 @@ void SearchParams::printParams(std::ostream& out) {
   PRINTPARAM(maxVisitsPondering);
   PRINTPARAM(maxPlayoutsPondering);
   PRINTPARAM(maxTimePondering);
+  PRINTPARAM(maxSearchMemoryBytes);
+  PRINTPARAM(earlyStopKLGainThreshold);
+  PRINTPARAM(earlyStopCheckInterval);
+  PRINTPARAM(earlyStopMinVisits);
 
 
   PRINTPARAM(lagBuffer);
@@ -30,6 +30,8 @@ struct SearchParams {
   bool useNoisePruning; //For computation of value, prune out weight that greatly exceeds what is justified by policy prior
   double noisePruneUtilityScale; //The scale of the utility difference at which useNoisePruning has effect
   double noisePruningCap; //Maximum amount of weight that noisePruning can remove
+  bool useIncrementalBackup; //Back up each playout by adding its leaf value along the path instead of recomputing from all children
+  int incrementalBackupRecomputeInterval; //With useIncrementalBackup, still fully recompute a node's stats every this many visits
 
   //Uncertainty weighting
   bool useUncertainty; //Weight visits by uncertainty
@@ -42,6 +44,12 @@ struct SearchParams {
   double graphSearchCatchUpLeakProb; //Chance to perform a visit to deepen a branch anyways despite being behind on visit count.
   //double graphSearchCatchUpProp; //When sufficiently far behind on visits on a transposition, catch up extra by adding up to this fraction of parents visits at once.
 
+  //Endgame solving
+  int endgameSolverMaxEmptyEdges; //Solve new leaves exactly instead of evaluating them with the nn when at most this many edges are undrawn, 0 disables
+  int64_t endgameSolverMaxNodes; //Fall back to the nn if solving one leaf would take more than this many nodes
+  int endgameSolverTableSizePowerOfTwo; //Entries in each search thread's endgame solver transposition table
+  bool useCaptureMacroMoves; //Follow every move in the tree by the captures that are safe to take, so that a run of them is one edge
+
   //Root parameters
   bool rootNoiseEnabled;
   double rootDirichletNoiseTotalConcentration; //Same as alpha * board size, to match alphazero this might be 0.03 * 361, total number of balls in the urn
@@ -78,8 +86,14 @@ struct SearchParams {
   float nnPolicyTemperature; //Scale neural net policy probabilities by this temperature, applies everywhere in the tree
 
   //Threading-related
-  int nodeTableShardsPowerOfTwo; //Controls number of shards of node table for graph search transposition lookup
+  int nodeTableShardsPowerOfTwo; //Controls number of mutexes in the pool shared by search nodes
+  int nodeTableCapacityPowerOfTwo; //Initial capacity of node table for graph search transposition lookup, grows as needed
   double numVirtualLossesPerThread; //Number of virtual losses for one thread to add
+  bool usePendingVisits; //Count descents still in flight as visits in the exploration term only, instead of as virtual losses
+  int numLeavesPerSearchThread; //Number of leaves each search thread collects and sends to the nn together before backing them up
+  bool useAsyncLeafPlayouts; //Keep numLeavesPerSearchThread playouts in flight per thread, replacing each as it finishes, rather than waiting on them in groups
+  bool useBackgroundTreeCollection; //Free the part of the tree a move makes unreachable on a background thread instead of within makeMove
+  bool useDeterministicWaves; //Search in synchronous waves of numThreads * numLeavesPerSearchThread leaves, reproducibly given the seed
 
   //Asyncbot
   int numThreads; //Number of threads
@@ -92,6 +106,17 @@ struct SearchParams {
   int64_t maxPlayoutsPondering;
   double maxTimePondering;
 
+  //If positive, trim the least visited parts of the tree whenever its memory use grows past this many bytes
+  int64_t maxSearchMemoryBytes;
+
+  //If positive, stop searching early when not pondering once more visits are unlikely to change the move. Every
+  //earlyStopCheckInterval root visits, the KL divergence of the previous root visit distribution from the current one
+  //is divided by the visits in between, and the search stops if this is below the threshold and the most visited
+  //move hasn't changed.
+  double earlyStopKLGainThreshold;
+  int64_t earlyStopCheckInterval;
+  int64_t earlyStopMinVisits; //Never stop early before the root has this many visits
+
   //Amount of time to reserve for lag when using a time control
   double lagBuffer;
 
@@ -106,7 +131,6 @@ struct SearchParams {
   double obviousMovesPolicySurpriseTolerance; //What logits of surprise does the search result need to be at most to be (1/e) obvious?
 
   double futileVisitsThreshold; //If a move would not be able to match this proportion of the max visits move in the time or visit or playout cap remaining, prune it.
-  int64_t finishGameSearchDelayMicroseconds; //Avoid running "too fast" at the end of the game, to cost less CPU
 
   SearchParams();
   ~SearchParams();
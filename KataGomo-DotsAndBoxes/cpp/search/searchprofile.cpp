@@ -0,0 +1,133 @@
+#include "../search/searchprofile.h"
+
+#include <thread>
+
+#include "../core/timer.h"
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+using json = nlohmann::json;
+
+SearchProfile::ThreadCounters::ThreadCounters() {
+  clear();
+}
+SearchProfile::ThreadCounters::~ThreadCounters() {
+}
+
+void SearchProfile::ThreadCounters::clear() {
+  for(int phase = 0; phase<NUM_PHASES; phase++) {
+    count[phase].store(0,std::memory_order_relaxed);
+    totalTicks[phase].store(0,std::memory_order_relaxed);
+    for(int bucket = 0; bucket<NUM_BUCKETS; bucket++)
+      histogram[phase][bucket].store(0,std::memory_order_relaxed);
+  }
+}
+
+SearchProfile::SearchProfile() {
+  for(int phase = 0; phase<NUM_PHASES; phase++) {
+    phases[phase].count = 0;
+    phases[phase].seconds = 0.0;
+    phases[phase].p50Seconds = 0.0;
+    phases[phase].p99Seconds = 0.0;
+  }
+}
+SearchProfile::~SearchProfile() {
+}
+
+double SearchProfile::getTicksPerSecond() {
+  static const double ticksPerSecond = []() {
+    ClockTimer timer;
+    uint64_t startTicks = getTicks();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t endTicks = getTicks();
+    double seconds = timer.getSeconds();
+    if(endTicks <= startTicks || seconds <= 0.0)
+      return 1e9;
+    return (double)(endTicks - startTicks) / seconds;
+  }();
+  return ticksPerSecond;
+}
+
+SearchProfile SearchProfile::aggregate(const vector<ThreadCounters*>& counters) {
+  SearchProfile profile;
+  double secondsPerTick = 1.0 / getTicksPerSecond();
+  for(int phase = 0; phase<NUM_PHASES; phase++) {
+    uint64_t count = 0;
+    uint64_t totalTicks = 0;
+    uint64_t histogram[NUM_BUCKETS];
+    std::fill(histogram, histogram + NUM_BUCKETS, (uint64_t)0);
+    for(const ThreadCounters* c: counters) {
+      count += c->count[phase].load(std::memory_order_relaxed);
+      totalTicks += c->totalTicks[phase].load(std::memory_order_relaxed);
+      for(int bucket = 0; bucket<NUM_BUCKETS; bucket++)
+        histogram[bucket] += c->histogram[phase][bucket].load(std::memory_order_relaxed);
+    }
+
+    //Read separately from the count, so use the histogram's own total for the quantiles
+    uint64_t histogramTotal = 0;
+    for(int bucket = 0; bucket<NUM_BUCKETS; bucket++)
+      histogramTotal += histogram[bucket];
+    auto getQuantileSeconds = [&](double quantile) {
+      if(histogramTotal <= 0)
+        return 0.0;
+      uint64_t target = (uint64_t)ceil(quantile * (double)histogramTotal);
+      uint64_t cumulative = 0;
+      for(int bucket = 0; bucket<NUM_BUCKETS; bucket++) {
+        cumulative += histogram[bucket];
+        if(cumulative >= target)
+          return (double)((uint64_t)1 << bucket) * secondsPerTick;
+      }
+      return (double)((uint64_t)1 << (NUM_BUCKETS-1)) * secondsPerTick;
+    };
+
+    profile.phases[phase].count = (int64_t)count;
+    profile.phases[phase].seconds = (double)totalTicks * secondsPerTick;
+    profile.phases[phase].p50Seconds = getQuantileSeconds(0.50);
+    profile.phases[phase].p99Seconds = getQuantileSeconds(0.99);
+  }
+  return profile;
+}
+
+const char* SearchProfile::getPhaseName(int phase) {
+  switch(phase) {
+  case PHASE_SELECTION: return "selection";
+  case PHASE_NODE_TABLE: return "nodeTable";
+  case PHASE_ENDGAME_SOLVE: return "endgameSolve";
+  case PHASE_NN_QUEUE: return "nnQueue";
+  case PHASE_NN_WAIT: return "nnWait";
+  case PHASE_BACKUP: return "backup";
+  case PHASE_STATS_LOCK: return "statsLock";
+  default: ASSERT_UNREACHABLE; return "";
+  }
+}
+
+json SearchProfile::toJson() const {
+  json ret;
+  for(int phase = 0; phase<NUM_PHASES; phase++) {
+    json p;
+    p["count"] = phases[phase].count;
+    p["seconds"] = phases[phase].seconds;
+    p["p50Us"] = phases[phase].p50Seconds * 1e6;
+    p["p99Us"] = phases[phase].p99Seconds * 1e6;
+    ret[getPhaseName(phase)] = p;
+  }
+  return ret;
+}
+
+void SearchProfile::print(ostream& out) const {
+  out << Global::strprintf("%-14s %12s %10s %10s %10s %10s", "Phase", "Count", "Seconds", "AvgUs", "P50Us<=", "P99Us<=") << "\n";
+  for(int phase = 0; phase<NUM_PHASES; phase++) {
+    const PhaseSummary& p = phases[phase];
+    out << Global::strprintf(
+      "%-14s %12lld %10.3f %10.2f %10.2f %10.2f",
+      getPhaseName(phase),
+      (long long)p.count,
+      p.seconds,
+      p.count > 0 ? p.seconds / (double)p.count * 1e6 : 0.0,
+      p.p50Seconds * 1e6,
+      p.p99Seconds * 1e6
+    ) << "\n";
+  }
+}
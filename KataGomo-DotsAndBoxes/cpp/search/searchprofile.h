@@ -0,0 +1,113 @@
+#ifndef SEARCH_SEARCHPROFILE_H_
+#define SEARCH_SEARCHPROFILE_H_
+
+#include <chrono>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "../core/global.h"
+#include "../core/multithread.h"
+#include "../external/nlohmann_json/json.hpp"
+
+//Time spent by the search threads in each phase of a playout, for finding out where the search spends its time.
+//Each search thread accumulates into its own ThreadCounters with nothing more than a timestamp counter read and a few
+//unsynchronized increments per phase, and the counters of all threads are only summed up when a profile is asked for.
+//Phases may nest - the time waiting on a node's stats lock is also part of the backup phase it happens in.
+class SearchProfile {
+ public:
+  static constexpr int PHASE_SELECTION = 0; //Choosing the child to descend to
+  static constexpr int PHASE_NODE_TABLE = 1; //Finding or allocating a new child in the node table
+  static constexpr int PHASE_ENDGAME_SOLVE = 2; //Solving new leaves exactly with the endgame solver
+  static constexpr int PHASE_NN_QUEUE = 3; //Looking up the nn cache, building inputs and queueing nn evaluations
+  static constexpr int PHASE_NN_WAIT = 4; //Waiting on queued nn evaluations
+  static constexpr int PHASE_BACKUP = 5; //Updating the stats of the nodes on the path of a playout
+  static constexpr int PHASE_STATS_LOCK = 6; //Waiting on the stats lock of a node held by another thread
+  static constexpr int NUM_PHASES = 7;
+
+  //Histogram bucket b counts the phases that took [2^(b-1),2^b) ticks, the last bucket also counts anything longer.
+  static constexpr int NUM_BUCKETS = 48;
+
+  //The counters of one search thread. Written only by the thread that owns them, so that adding to them needs no
+  //atomic read-modify-write, read by any thread.
+  class ThreadCounters {
+   public:
+    ThreadCounters();
+    ~ThreadCounters();
+
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+    //Record that phase ran from startTicks, as returned by getTicks, until now.
+    inline void add(int phase, uint64_t startTicks) {
+      uint64_t ticks = getTicks() - startTicks;
+      increment(count[phase], 1);
+      increment(totalTicks[phase], ticks);
+      increment(histogram[phase][getBucket(ticks)], 1);
+    }
+    //Not threadsafe with the owning thread adding.
+    void clear();
+
+   private:
+    std::atomic<uint64_t> count[NUM_PHASES];
+    std::atomic<uint64_t> totalTicks[NUM_PHASES];
+    std::atomic<uint64_t> histogram[NUM_PHASES][NUM_BUCKETS];
+
+    static inline void increment(std::atomic<uint64_t>& x, uint64_t amount) {
+      x.store(x.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    static inline int getBucket(uint64_t ticks) {
+#if defined(__GNUC__) || defined(__clang__)
+      int bucket = ticks == 0 ? 0 : 64 - __builtin_clzll(ticks);
+#else
+      int bucket = 0;
+      while(ticks > 0) {
+        ticks >>= 1;
+        bucket++;
+      }
+#endif
+      return bucket < NUM_BUCKETS ? bucket : NUM_BUCKETS-1;
+    }
+
+    friend class SearchProfile;
+  };
+
+  struct PhaseSummary {
+    int64_t count;
+    double seconds;
+    //Upper bounds from the histogram on the median and the 99th percentile of the time taken by the phase
+    double p50Seconds;
+    double p99Seconds;
+  };
+
+  PhaseSummary phases[NUM_PHASES];
+
+  SearchProfile();
+  ~SearchProfile();
+
+  //Sum up the counters of all the threads. Threadsafe with them adding, the result is only approximate if they are.
+  static SearchProfile aggregate(const std::vector<ThreadCounters*>& counters);
+
+  static const char* getPhaseName(int phase);
+
+  nlohmann::json toJson() const;
+  void print(std::ostream& out) const;
+
+  //A cheap timestamp, the cycle counter of the cpu where available and the steady clock otherwise.
+  static inline uint64_t getTicks() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+#endif
+  }
+  //Measured against the steady clock the first time this is called, which takes a few tens of milliseconds.
+  static double getTicksPerSecond();
+};
+
+#endif  // SEARCH_SEARCHPROFILE_H_
@@ -6,9 +6,11 @@
 #include "../search/search.h"
 
 #include <cinttypes>
+#include <cstring>
 
 #include "../program/playutils.h"
 #include "../search/searchnode.h"
+#include "../search/searchnodetable.h"
 
 using namespace std;
 using nlohmann::json;
@@ -20,6 +22,91 @@ int64_t Search::getRootVisits() const {
   return n;
 }
 
+double Search::getNodeTableLoadFactor() const {
+  return nodeTable->getStats().loadFactor;
+}
+
+Hash128 Search::getTreeHash() const {
+  Hash128 hash;
+  auto mix = [&hash](uint64_t x) {
+    hash.hash0 = Hash::splitMix64(hash.hash0 ^ x);
+    hash.hash1 = Hash::nasam(hash.hash1 + Hash::murmurMix(x));
+  };
+  auto mixDouble = [&mix](double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    mix(bits);
+  };
+  if(rootNode == NULL)
+    return hash;
+
+  //Depth first in child order, each node of the graph once
+  std::unordered_set<const SearchNode*> visited;
+  vector<const SearchNode*> stack;
+  stack.push_back(rootNode);
+  visited.insert(rootNode);
+  while(stack.size() > 0) {
+    const SearchNode* node = stack.back();
+    stack.pop_back();
+    mix((uint64_t)node->stats.visits.load(std::memory_order_acquire));
+    mixDouble(node->stats.winLossValueAvg.load(std::memory_order_acquire));
+    mixDouble(node->stats.utilityAvg.load(std::memory_order_acquire));
+    mixDouble(node->stats.weightSum.load(std::memory_order_acquire));
+
+    int childrenCapacity;
+    ConstSearchChildren children = node->getChildren(childrenCapacity);
+    for(int i = childrenCapacity-1; i >= 0; i--) {
+      const SearchNode* child = children[i].getIfAllocated();
+      if(child == NULL)
+        continue;
+      mix((uint64_t)children[i].getMoveLoc());
+      mix((uint64_t)children[i].getEdgeVisits());
+      if(visited.insert(child).second)
+        stack.push_back(child);
+    }
+  }
+  return hash;
+}
+
+SearchNodeAllocator::Stats Search::getNodeAllocatorStats() const {
+  return nodeAllocator->getStats();
+}
+int64_t Search::getTreeCollectionBacklog() const {
+  return treeCollectionBacklog.load(std::memory_order_acquire);
+}
+int64_t Search::getSearchMemoryBytes() const {
+  int64_t bytes = 0;
+  for(int sizeClass = 0; sizeClass<SearchNodeAllocator::NUM_SIZE_CLASSES; sizeClass++)
+    bytes += nodeAllocator->getNumInUse(sizeClass) * (int64_t)nodeAllocator->getBlockBytes(sizeClass);
+  //Count an NNOutput for every node, along with its shared_ptr and control block, although terminal nodes have none
+  //and the nn cache may hold on to them regardless.
+  const int64_t nnOutputBytes = (int64_t)(sizeof(NNOutput) + sizeof(std::shared_ptr<NNOutput>) + 2 * sizeof(void*));
+  bytes += nodeAllocator->getNumInUse(SearchNodeAllocator::SIZE_CLASS_NODE) * nnOutputBytes;
+  return bytes;
+}
+EndgameSolver::Stats Search::getEndgameSolverStats() const {
+  EndgameSolver::Stats stats;
+  stats.numSolves = 0;
+  stats.numAborted = 0;
+  stats.numNodes = 0;
+  stats.numTableHits = 0;
+  for(const EndgameSolver* solver: endgameSolvers) {
+    EndgameSolver::Stats s = solver->getStats();
+    stats.numSolves += s.numSolves;
+    stats.numAborted += s.numAborted;
+    stats.numNodes += s.numNodes;
+    stats.numTableHits += s.numTableHits;
+  }
+  return stats;
+}
+SearchProfile Search::getSearchProfile() const {
+  return SearchProfile::aggregate(profileCounters);
+}
+void Search::clearSearchProfile() {
+  for(SearchProfile::ThreadCounters* counters: profileCounters)
+    counters->clear();
+}
+
 bool Search::getPlaySelectionValues(
   vector<Loc>& locs, vector<double>& playSelectionValues, double scaleMaxToAtLeast
 ) const {
@@ -77,7 +164,7 @@ bool Search::getPlaySelectionValues(
 
   //Store up basic weights
   int childrenCapacity;
-  const SearchChildPointer* children = node.getChildren(childrenCapacity);
+  ConstSearchChildren children = node.getChildren(childrenCapacity);
   for(int i = 0; i<childrenCapacity; i++) {
     const SearchNode* child = children[i].getIfAllocated();
     if(child == NULL)
@@ -208,6 +295,30 @@ bool Search::getPlaySelectionValues(
     }
   }
 
+  //Solved moves override the visit-based choice. Play a move that wins by force if there is one, and otherwise avoid
+  //moves that lose by force as long as there is something else with weight to play.
+  if(numChildren > 0) {
+    const Player pla = node.nextPla;
+    double maxValue = 0.0;
+    bool anyWin = false;
+    bool anyNonLossWithWeight = false;
+    for(int i = 0; i<numChildren; i++) {
+      Player winner = children[i].getIfAllocated()->getProvenWinner();
+      maxValue = std::max(maxValue, playSelectionValues[i]);
+      if(winner == pla)
+        anyWin = true;
+      else if(winner != getOpp(pla) && playSelectionValues[i] > 0)
+        anyNonLossWithWeight = true;
+    }
+    for(int i = 0; i<numChildren; i++) {
+      Player winner = children[i].getIfAllocated()->getProvenWinner();
+      if(anyWin)
+        playSelectionValues[i] = winner == pla ? playSelectionValues[i] + maxValue + 1.0 : 0.0;
+      else if(anyNonLossWithWeight && winner == getOpp(pla))
+        playSelectionValues[i] = 0.0;
+    }
+  }
+
   const NNOutput* nnOutput = node.getNNOutput();
 
   //If we have no children, then use the policy net directly. Only for the root, though, if calling this on any subtree
@@ -385,7 +496,7 @@ const SearchNode* Search::getChildForMove(const SearchNode* node, Loc moveLoc) c
   if(node == NULL)
     return NULL;
   int childrenCapacity;
-  const SearchChildPointer* children = node->getChildren(childrenCapacity);
+  ConstSearchChildren children = node->getChildren(childrenCapacity);
   for(int i = 0; i<childrenCapacity; i++) {
     const SearchNode* child = children[i].getIfAllocated();
     if(child == NULL)
@@ -398,6 +509,11 @@ const SearchNode* Search::getChildForMove(const SearchNode* node, Loc moveLoc) c
 }
 
 Loc Search::getChosenMoveLoc() {
+  return getChosenMoveLoc(vector<Loc>(),vector<double>());
+}
+
+Loc Search::getChosenMoveLoc(const vector<Loc>& extraLocs, const vector<double>& extraVisits) {
+  assert(extraLocs.size() == extraVisits.size());
   if(rootNode == NULL)
     return Board::NULL_LOC;
 
@@ -409,6 +525,31 @@ Loc Search::getChosenMoveLoc() {
 
   assert(locs.size() == playSelectionValues.size());
 
+  //Solved moves already decided the play selection values, and other searches' visits shouldn't outweigh them
+  bool anyProven = rootNode->isProven();
+  int childrenCapacity;
+  ConstSearchChildren children = rootNode->getChildren(childrenCapacity);
+  for(int i = 0; i<childrenCapacity && !anyProven; i++) {
+    const SearchNode* child = children[i].getIfAllocated();
+    if(child == NULL)
+      break;
+    anyProven = child->isProven();
+  }
+  if(!anyProven) {
+    for(size_t i = 0; i<extraLocs.size(); i++) {
+      Loc moveLoc = extraLocs[i];
+      if(extraVisits[i] <= 0 || !rootHistory.isLegal(rootBoard,moveLoc,rootPla) || !isAllowedRootMove(moveLoc))
+        continue;
+      auto iter = std::find(locs.begin(),locs.end(),moveLoc);
+      if(iter != locs.end())
+        playSelectionValues[iter - locs.begin()] += extraVisits[i];
+      else {
+        locs.push_back(moveLoc);
+        playSelectionValues.push_back(extraVisits[i]);
+      }
+    }
+  }
+
   double temperature = interpolateEarly(
     searchParams.chosenMoveTemperatureHalflife, searchParams.chosenMoveTemperatureEarly, searchParams.chosenMoveTemperature
   );
@@ -590,7 +731,7 @@ void Search::appendPVForMove(
       return;
 
     int childrenCapacity;
-    const SearchChildPointer* children = node->getChildren(childrenCapacity);
+    ConstSearchChildren children = node->getChildren(childrenCapacity);
     assert(bestChildIdx <= childrenCapacity);
     assert(scratchValues.size() <= childrenCapacity);
 
@@ -615,9 +756,51 @@ void Search::printPV(ostream& out, const SearchNode* n, int maxDepth) const {
   vector<Loc> scratchLocs;
   vector<double> scratchValues;
   appendPV(buf,visitsBuf,edgeVisitsBuf,scratchLocs,scratchValues,n,maxDepth);
+  if(n == rootNode)
+    expandCaptureMacroMovesFromRoot(buf,NULL,NULL);
   printPV(out,buf);
 }
 
+void Search::expandCaptureMacroMovesFromRoot(vector<Loc>& pv, vector<int64_t>* visitsBuf, vector<int64_t>* edgeVisitsBuf) const {
+  if(!searchParams.useCaptureMacroMoves)
+    return;
+  Board board(rootBoard);
+  BoardHistory hist(rootHistory);
+  vector<Loc> expanded;
+  vector<int64_t> expandedVisits;
+  vector<int64_t> expandedEdgeVisits;
+  vector<Loc> captures;
+  for(size_t i = 0; i<pv.size(); i++) {
+    captures.clear();
+    //Should not happen, but if it does, just leave the PV as it is from here on
+    bool legal = !hist.isGameFinished && hist.isLegal(board,pv[i],board.nextPla);
+    if(legal)
+      playMoveForSearch(board,hist,pv[i],board.nextPla,&captures);
+    for(size_t j = 0; j<captures.size()+1; j++) {
+      expanded.push_back(j == 0 ? pv[i] : captures[j-1]);
+      if(visitsBuf != NULL)
+        expandedVisits.push_back((*visitsBuf)[i]);
+      if(edgeVisitsBuf != NULL)
+        expandedEdgeVisits.push_back((*edgeVisitsBuf)[i]);
+    }
+    if(!legal) {
+      for(size_t k = i+1; k<pv.size(); k++) {
+        expanded.push_back(pv[k]);
+        if(visitsBuf != NULL)
+          expandedVisits.push_back((*visitsBuf)[k]);
+        if(edgeVisitsBuf != NULL)
+          expandedEdgeVisits.push_back((*edgeVisitsBuf)[k]);
+      }
+      break;
+    }
+  }
+  pv.swap(expanded);
+  if(visitsBuf != NULL)
+    visitsBuf->swap(expandedVisits);
+  if(edgeVisitsBuf != NULL)
+    edgeVisitsBuf->swap(expandedEdgeVisits);
+}
+
 void Search::printPV(ostream& out, const vector<Loc>& buf) const {
   bool printedAnything = false;
   for(int i = 0; i<buf.size(); i++) {
@@ -706,6 +889,10 @@ void Search::getAnalysisData(
   if(rootNode == NULL)
     return;
   getAnalysisData(*rootNode, buf, minMovesToTryToGet, includeWeightFactors, maxPVDepth, duplicateForSymmetries);
+  if(searchParams.useCaptureMacroMoves) {
+    for(AnalysisData& data: buf)
+      expandCaptureMacroMovesFromRoot(data.pv, &data.pvVisits, &data.pvEdgeVisits);
+  }
 }
 
 void Search::getAnalysisData(
@@ -727,7 +914,7 @@ void Search::getAnalysisData(
   float policyProbs[NNPos::MAX_NN_POLICY_SIZE];
   {
     int childrenCapacity;
-    const SearchChildPointer* childrenArr = node.getChildren(childrenCapacity);
+    ConstSearchChildren childrenArr = node.getChildren(childrenCapacity);
     for(int i = 0; i<childrenCapacity; i++) {
       const SearchNode* child = childrenArr[i].getIfAllocated();
       if(child == NULL)
@@ -906,6 +1093,8 @@ void Search::printPVForMove(ostream& out, const SearchNode* n, Loc move, int max
   vector<Loc> scratchLocs;
   vector<double> scratchValues;
   appendPVForMove(buf,visitsBuf,edgeVisitsBuf,scratchLocs,scratchValues,n,move,maxDepth);
+  if(n == rootNode)
+    expandCaptureMacroMovesFromRoot(buf,NULL,NULL);
   for(int i = 0; i<buf.size(); i++) {
     if(i > 0)
       out << " ";
@@ -1106,7 +1295,7 @@ double Search::getAverageShorttermWLErrorHelper(const SearchNode* node) const {
   }
 
   int childrenCapacity;
-  const SearchChildPointer* children = node->getChildren(childrenCapacity);
+  ConstSearchChildren children = node->getChildren(childrenCapacity);
 
   int numChildren = 0;
   for(int i = 0; i<childrenCapacity; i++) {
@@ -1143,6 +1332,7 @@ bool Search::getAnalysisJson(
   int analysisPVLen,
   bool includePolicy,
   bool includePVVisits,
+  bool includeSearchProfile,
   json& ret
 ) const {
   vector<AnalysisData> buf;
@@ -1254,6 +1444,10 @@ bool Search::getAnalysisJson(
     rootInfo["thisHash"] = Global::uint64ToHexString(thisHash.hash1) + Global::uint64ToHexString(thisHash.hash0);
     rootInfo["symHash"] = Global::uint64ToHexString(symHash.hash1) + Global::uint64ToHexString(symHash.hash0);
     rootInfo["currentPlayer"] = PlayerIO::playerToStringShort(rootPla);
+    if(rootNode != NULL && rootNode->isProven()) {
+      Player provenWinner = rootNode->getProvenWinner();
+      rootInfo["provenWinner"] = provenWinner == C_EMPTY ? string("draw") : PlayerIO::playerToStringShort(provenWinner);
+    }
 
     ret["rootInfo"] = rootInfo;
   }
@@ -1277,6 +1471,8 @@ bool Search::getAnalysisJson(
     ret["policy"] = policy;
   }
 
+  if(includeSearchProfile)
+    ret["searchProfile"] = getSearchProfile().toJson();
 
   return true;
 }
@@ -1292,7 +1488,7 @@ bool Search::getPrunedNodeValues(const SearchNode* nodePtr, ReportedSearchValues
     return false;
   const SearchNode& node = *nodePtr;
   int childrenCapacity;
-  const SearchChildPointer* children = node.getChildren(childrenCapacity);
+  ConstSearchChildren children = node.getChildren(childrenCapacity);
 
   vector<double> playSelectionValues;
   vector<Loc> locs; // not used
@@ -147,3 +147,48 @@ double Search::recomputeSearchTimeLimit(
 
   return tcRec;
 }
+
+bool Search::shouldStopEarly(EarlyStopState& state, int64_t rootVisits) const {
+  state.nextCheckVisits = rootVisits + searchParams.earlyStopCheckInterval;
+  if(rootNode == NULL)
+    return false;
+
+  vector<double> childVisits;
+  double totalVisits = 0.0;
+  int bestIdx = -1;
+  int childrenCapacity;
+  ConstSearchChildren children = rootNode->getChildren(childrenCapacity);
+  for(int i = 0; i<childrenCapacity; i++) {
+    if(children[i].getIfAllocated() == NULL)
+      break;
+    double edgeVisits = (double)children[i].getEdgeVisits();
+    childVisits.push_back(edgeVisits);
+    totalVisits += edgeVisits;
+    if(bestIdx < 0 || edgeVisits > childVisits[bestIdx])
+      bestIdx = i;
+  }
+
+  bool shouldStop = false;
+  //Children are only ever added at the end and their visits only grow, so every move with visits at the previous check
+  //still has them, and the divergence is finite.
+  if(
+    state.prevChildVisits.size() > 0 && childVisits.size() >= state.prevChildVisits.size() &&
+    totalVisits > state.prevTotalVisits && bestIdx == state.prevBestIdx
+  ) {
+    double kl = 0.0;
+    for(size_t i = 0; i<state.prevChildVisits.size(); i++) {
+      if(state.prevChildVisits[i] <= 0)
+        continue;
+      double prevProb = state.prevChildVisits[i] / state.prevTotalVisits;
+      double prob = std::max(childVisits[i], state.prevChildVisits[i]) / totalVisits;
+      kl += prevProb * log(prevProb / prob);
+    }
+    double klGainPerVisit = kl / (totalVisits - state.prevTotalVisits);
+    shouldStop = klGainPerVisit < searchParams.earlyStopKLGainThreshold;
+  }
+
+  state.prevChildVisits = childVisits;
+  state.prevTotalVisits = totalVisits;
+  state.prevBestIdx = bestIdx;
+  return shouldStop;
+}
@@ -27,10 +27,10 @@ void Search::addLeafValue(
 
   if(assumeNoExistingWeight) {
     while(node.statsLock.test_and_set(std::memory_order_acquire));
-    node.stats.winLossValueAvg.store(winLossValue,std::memory_order_release);
-    node.stats.noResultValueAvg.store(noResultValue,std::memory_order_release);
-    node.stats.utilityAvg.store(utility,std::memory_order_release);
-    node.stats.utilitySqAvg.store(utilitySq,std::memory_order_release);
+    node.stats.winLossValueAvg.store((NodeStatsAvgFloat)winLossValue,std::memory_order_release);
+    node.stats.noResultValueAvg.store((NodeStatsAvgFloat)noResultValue,std::memory_order_release);
+    node.stats.utilityAvg.store((NodeStatsAvgFloat)utility,std::memory_order_release);
+    node.stats.utilitySqAvg.store((NodeStatsAvgFloat)utilitySq,std::memory_order_release);
     node.stats.weightSqSum.store(weightSq,std::memory_order_release);
     node.stats.weightSum.store(weight,std::memory_order_release);
     int64_t oldVisits = node.stats.visits.fetch_add(1,std::memory_order_release);
@@ -48,10 +48,10 @@ void Search::addLeafValue(
     double oldWeightSum = node.stats.weightSum.load(std::memory_order_relaxed);
     double newWeightSum = oldWeightSum + weight;
 
-    node.stats.winLossValueAvg.store((node.stats.winLossValueAvg.load(std::memory_order_relaxed) * oldWeightSum + winLossValue * weight)/newWeightSum,std::memory_order_release);
-    node.stats.noResultValueAvg.store((node.stats.noResultValueAvg.load(std::memory_order_relaxed) * oldWeightSum + noResultValue * weight)/newWeightSum,std::memory_order_release);
-    node.stats.utilityAvg.store((node.stats.utilityAvg.load(std::memory_order_relaxed) * oldWeightSum + utility * weight)/newWeightSum,std::memory_order_release);
-    node.stats.utilitySqAvg.store((node.stats.utilitySqAvg.load(std::memory_order_relaxed) * oldWeightSum + utilitySq * weight)/newWeightSum,std::memory_order_release);
+    node.stats.winLossValueAvg.store((NodeStatsAvgFloat)((node.stats.winLossValueAvg.load(std::memory_order_relaxed) * oldWeightSum + winLossValue * weight)/newWeightSum),std::memory_order_release);
+    node.stats.noResultValueAvg.store((NodeStatsAvgFloat)((node.stats.noResultValueAvg.load(std::memory_order_relaxed) * oldWeightSum + noResultValue * weight)/newWeightSum),std::memory_order_release);
+    node.stats.utilityAvg.store((NodeStatsAvgFloat)((node.stats.utilityAvg.load(std::memory_order_relaxed) * oldWeightSum + utility * weight)/newWeightSum),std::memory_order_release);
+    node.stats.utilitySqAvg.store((NodeStatsAvgFloat)((node.stats.utilitySqAvg.load(std::memory_order_relaxed) * oldWeightSum + utilitySq * weight)/newWeightSum),std::memory_order_release);
     node.stats.weightSqSum.store(node.stats.weightSqSum.load(std::memory_order_relaxed) + weightSq,std::memory_order_release);
     node.stats.weightSum.store(newWeightSum,std::memory_order_release);
     node.stats.visits.fetch_add(1,std::memory_order_release);
@@ -93,7 +93,54 @@ double Search::computeWeightFromNNOutput(const NNOutput* nnOutput) const {
 }
 
 
+void Search::setPlayoutLeafValue(SearchThread& thread, double winLossValue, double noResultValue, double weight) const {
+  thread.hasLeafValue = true;
+  thread.leafWinLossValue = winLossValue;
+  thread.leafNoResultValue = noResultValue;
+  thread.leafWeight = weight;
+}
+
+void Search::setPlayoutLeafValueFromNNOutput(SearchThread& thread, const SearchNode& node) const {
+  const NNOutput* nnOutput = node.getNNOutput();
+  assert(nnOutput != NULL);
+  setPlayoutLeafValue(
+    thread,
+    (double)nnOutput->whiteWinProb - (double)nnOutput->whiteLossProb,
+    (double)nnOutput->whiteNoResultProb,
+    computeWeightFromNNOutput(nnOutput)
+  );
+}
+
+//With useIncrementalBackup, add the playout's leaf value directly into the stats of this node, which is exactly what a
+//full recompute would give for a tree with no transpositions, no noise pruning and no value weighting.
+//Nodes still get a full recompute when there is no leaf value to add, when they have few enough visits that a recompute
+//is cheap, every incrementalBackupRecomputeInterval visits to correct the drift from all of the above, and always at
+//the root, whose value is what gets reported. Proven nodes too, since a playout that passed through before the node got
+//proven must not add its leaf value onto the exact one, and they get no further visits that would recompute it later.
+//Returns false if the caller should do a full recompute instead.
+bool Search::maybeUpdateStatsIncrementally(SearchNode& node, SearchThread& thread, bool isRoot) {
+  if(!searchParams.useIncrementalBackup || !thread.hasLeafValue || isRoot || node.isProven())
+    return false;
+  int64_t newVisits = node.stats.visits.load(std::memory_order_acquire) + 1;
+  int64_t interval = searchParams.incrementalBackupRecomputeInterval;
+  if(newVisits <= interval || newVisits % interval == 0)
+    return false;
+  //Someone is in the middle of recomputing this node, let them pick up our visit.
+  if(node.dirtyCounter.load(std::memory_order_acquire) > 0)
+    return false;
+  addLeafValue(node, thread.leafWinLossValue, thread.leafNoResultValue, thread.leafWeight, false, false);
+  return true;
+}
+
 void Search::updateStatsAfterPlayout(SearchNode& node, SearchThread& thread, bool isRoot) {
+  uint64_t startTicks = SearchProfile::getTicks();
+  updateStatsAfterPlayoutUnprofiled(node,thread,isRoot);
+  thread.profile.add(SearchProfile::PHASE_BACKUP, startTicks);
+}
+
+void Search::updateStatsAfterPlayoutUnprofiled(SearchNode& node, SearchThread& thread, bool isRoot) {
+  if(maybeUpdateStatsIncrementally(node,thread,isRoot))
+    return;
   //The thread that grabs a 0 from this peforms the recomputation of stats.
   int32_t oldDirtyCounter = node.dirtyCounter.fetch_add(1,std::memory_order_acq_rel);
   assert(oldDirtyCounter >= 0);
@@ -127,7 +174,7 @@ void Search::recomputeNodeStats(SearchNode& node, SearchThread& thread, int numV
   int numGoodChildren = 0;
 
   int childrenCapacity;
-  const SearchChildPointer* children = node.getChildren(childrenCapacity);
+  ConstSearchChildren children = node.getChildren(childrenCapacity);
   double origTotalChildWeight = 0.0;
   for(int i = 0; i<childrenCapacity; i++) {
     const SearchNode* child = children[i].getIfAllocated();
@@ -204,8 +251,18 @@ void Search::recomputeNodeStats(SearchNode& node, SearchThread& thread, int numV
     weightSqSum += weightScaling * weightScaling * stats.weightSqSum;
   }
 
-  //Also add in the direct evaluation of this node.
-  {
+  //Also add in the direct evaluation of this node, or for a node whose subtree was trimmed, all that it had before,
+  //which includes that evaluation.
+  if(node.trimmedStats != NULL) {
+    const NodeStats& stats = *node.trimmedStats;
+    winLossValueSum += stats.winLossValueAvg * stats.weightSum;
+    noResultValueSum += stats.noResultValueAvg * stats.weightSum;
+    utilitySum += stats.utilityAvg * stats.weightSum;
+    utilitySqSum += stats.utilitySqAvg * stats.weightSum;
+    weightSqSum += stats.weightSqSum;
+    weightSum += stats.weightSum;
+  }
+  else {
     const NNOutput* nnOutput = node.getNNOutput();
     assert(nnOutput != NULL);
     double winProb = (double)nnOutput->whiteWinProb;
@@ -231,18 +288,100 @@ void Search::recomputeNodeStats(SearchNode& node, SearchThread& thread, int numV
   double oldUtilityAvg = utilityAvg;
   utilitySqAvg = utilitySqAvg + (utilityAvg * utilityAvg - oldUtilityAvg * oldUtilityAvg);
 
+  //A solved node's value is exact, regardless of how the visits below it happened to turn out.
+  Player provenWinner = node.getProvenWinner();
+  if(provenWinner != SearchNode::PROVEN_NONE) {
+    winLossValueAvg = getProvenWinLossValue(provenWinner);
+    noResultValueAvg = 0.0;
+    utilityAvg = getResultUtility(winLossValueAvg, noResultValueAvg);
+    utilitySqAvg = utilityAvg * utilityAvg;
+  }
+
   //TODO statslock may be unnecessary now with the dirtyCounter mechanism?
-  while(node.statsLock.test_and_set(std::memory_order_acquire));
-  node.stats.winLossValueAvg.store(winLossValueAvg,std::memory_order_release);
-  node.stats.noResultValueAvg.store(noResultValueAvg,std::memory_order_release);
-  node.stats.utilityAvg.store(utilityAvg,std::memory_order_release);
-  node.stats.utilitySqAvg.store(utilitySqAvg,std::memory_order_release);
+  if(node.statsLock.test_and_set(std::memory_order_acquire)) {
+    uint64_t startTicks = SearchProfile::getTicks();
+    while(node.statsLock.test_and_set(std::memory_order_acquire));
+    thread.profile.add(SearchProfile::PHASE_STATS_LOCK, startTicks);
+  }
+  node.stats.winLossValueAvg.store((NodeStatsAvgFloat)winLossValueAvg,std::memory_order_release);
+  node.stats.noResultValueAvg.store((NodeStatsAvgFloat)noResultValueAvg,std::memory_order_release);
+  node.stats.utilityAvg.store((NodeStatsAvgFloat)utilityAvg,std::memory_order_release);
+  node.stats.utilitySqAvg.store((NodeStatsAvgFloat)utilitySqAvg,std::memory_order_release);
   node.stats.weightSqSum.store(weightSqSum,std::memory_order_release);
   node.stats.weightSum.store(weightSum,std::memory_order_release);
   node.stats.visits.fetch_add(numVisitsToAdd,std::memory_order_release);
   node.statsLock.clear(std::memory_order_release);
 }
 
+double Search::getProvenWinLossValue(Player winner) {
+  return winner == P_WHITE ? 1.0 : winner == P_BLACK ? -1.0 : 0.0;
+}
+
+//Returns true if this call was the one that solved the node. The node's values are set to the exact result, while its
+//visits and weight are kept so that parents continue to weight it as before.
+bool Search::setNodeProven(SearchNode& node, Player winner) {
+  if(!node.setProvenWinner(winner))
+    return false;
+  double winLossValue = getProvenWinLossValue(winner);
+  double utility = getResultUtility(winLossValue, 0.0);
+  while(node.statsLock.test_and_set(std::memory_order_acquire));
+  node.stats.winLossValueAvg.store((NodeStatsAvgFloat)winLossValue,std::memory_order_release);
+  node.stats.noResultValueAvg.store((NodeStatsAvgFloat)0.0,std::memory_order_release);
+  node.stats.utilityAvg.store((NodeStatsAvgFloat)utility,std::memory_order_release);
+  node.stats.utilitySqAvg.store((NodeStatsAvgFloat)(utility * utility),std::memory_order_release);
+  node.statsLock.clear(std::memory_order_release);
+  return true;
+}
+
+//For a node where search has no move left to select, i.e. every move either has a child that is already solved or
+//has been excluded. A solved winning child solves the node, but a loss or draw needs every legal move to have a solved
+//child, since a move excluded by avoidMoveUntilByLoc or the like might be the one that wins. The exception is moves
+//pruned at the root as symmetric duplicates of another, which must have the same result.
+//thread.board and thread.history must be at the node.
+bool Search::maybeSetProvenFromChildren(const SearchThread& thread, SearchNode& node, bool isRoot) {
+  if(node.isProven())
+    return false;
+  const Player pla = node.nextPla;
+  int childrenCapacity;
+  ConstSearchChildren children = node.getChildren(childrenCapacity);
+  int numChildren = 0;
+  bool anyUnproven = false;
+  bool anyDraw = false;
+  bool hasChild[Board::MAX_ARR_SIZE] = {};
+  for(int i = 0; i<childrenCapacity; i++) {
+    const SearchNode* child = children[i].getIfAllocated();
+    if(child == NULL)
+      break;
+    numChildren++;
+    hasChild[children[i].getMoveLoc()] = true;
+    Player winner = child->getProvenWinner();
+    if(winner == pla)
+      return setNodeProven(node, pla);
+    if(winner == SearchNode::PROVEN_NONE)
+      anyUnproven = true;
+    else if(winner == C_EMPTY)
+      anyDraw = true;
+  }
+  if(anyUnproven || numChildren <= 0)
+    return false;
+
+  const NNOutput* nnOutput = node.getNNOutput();
+  if(nnOutput == NULL)
+    return false;
+  const float* policyProbs = nnOutput->getPolicyProbsMaybeNoised();
+  for(int movePos = 0; movePos<policySize; movePos++) {
+    if(policyProbs[movePos] < 0)
+      continue;
+    Loc moveLoc = NNPos::posToLoc(movePos,thread.board.x_size,thread.board.y_size,nnXLen,nnYLen);
+    if(moveLoc == Board::NULL_LOC || hasChild[moveLoc])
+      continue;
+    if(isRoot && searchParams.rootSymmetryPruning && moveLoc != Board::PASS_LOC && rootSymDupLoc[moveLoc])
+      continue;
+    return false;
+  }
+  return setNodeProven(node, anyDraw ? C_EMPTY : getOpp(pla));
+}
+
 void Search::downweightBadChildrenAndNormalizeWeight(
   int numChildren,
   double currentTotalWeight, //The current sum of statsBuf[i].weightAdjusted
@@ -0,0 +1,113 @@
+#include "../tests/tests.h"
+
+#include "../game/gamelogic.h"
+#include "../search/endgamesolver.h"
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+//Plain minimax over every order of the remaining edges, only usable with very few of them
+static Player bruteForceWinner(const Board& board, const BoardHistory& hist) {
+  Player pla = board.nextPla;
+  bool canDraw = false;
+  for(int y = 0; y<board.y_size; y++) {
+    for(int x = 0; x<board.x_size; x++) {
+      Loc loc = Location::getLoc(x,y,board.x_size);
+      if(!board.isLegal(loc,pla))
+        continue;
+      Board copy(board);
+      copy.playMoveAssumeLegal(loc,pla);
+      Color winner = GameLogic::checkWinnerAfterPlayed(copy,hist,pla,loc);
+      if(winner == C_WALL)
+        winner = bruteForceWinner(copy,hist);
+      if(winner == pla)
+        return pla;
+      if(winner == C_EMPTY)
+        canDraw = true;
+    }
+  }
+  return canDraw ? C_EMPTY : getOpp(pla);
+}
+
+static int numEmptyEdges(const Board& board) {
+  int n = 0;
+  for(int y = 0; y<board.y_size; y++)
+    for(int x = 0; x<board.x_size; x++)
+      n += (x+y) % 2 == 1 && board.colors[Location::getLoc(x,y,board.x_size)] == C_EMPTY;
+  return n;
+}
+
+bool Tests::runEndgameSolverTest(Logger& logger, int boardSize, bool verbose) {
+  const int numGames = 40;
+  const int maxSolverEdges = 16;
+  const int maxBruteForceEdges = 8;
+  const int64_t maxNodes = (int64_t)1 << 40;
+
+  Rand rand("Tests::runEndgameSolverTest rand");
+  EndgameSolver solver(16);
+  int64_t numBruteForceChecks = 0;
+  int64_t numBruteForceMismatches = 0;
+  int64_t numForcedCaptureChecks = 0;
+  int64_t numForcedCaptureMismatches = 0;
+  std::vector<Loc> legalLocs;
+  for(int gameIdx = 0; gameIdx<numGames; gameIdx++) {
+    Board board(boardSize,boardSize);
+    BoardHistory hist(board,P_BLACK,Rules::getTrompTaylorish());
+    while(!hist.isGameFinished) {
+      if(numEmptyEdges(board) <= maxSolverEdges) {
+        Player winner;
+        if(!solver.solve(board,maxSolverEdges,maxNodes,winner))
+          throw StringError("Endgame solver test: solver gave up on a position within its limits");
+
+        if(numEmptyEdges(board) <= maxBruteForceEdges) {
+          numBruteForceChecks++;
+          if(bruteForceWinner(board,hist) != winner)
+            numBruteForceMismatches++;
+        }
+
+        //Taking the forced captures the way search does must never change the result
+        if(GameLogic::getForcedCaptureLoc(board) != Board::NULL_LOC) {
+          Board capturedBoard(board);
+          BoardHistory capturedHist(hist);
+          while(!capturedHist.isGameFinished) {
+            Loc captureLoc = GameLogic::getForcedCaptureLoc(capturedBoard);
+            if(captureLoc == Board::NULL_LOC)
+              break;
+            capturedHist.makeBoardMoveAssumeLegal(capturedBoard,captureLoc,capturedBoard.nextPla);
+          }
+          Player capturedWinner = capturedHist.winner;
+          if(!capturedHist.isGameFinished && !solver.solve(capturedBoard,maxSolverEdges,maxNodes,capturedWinner))
+            throw StringError("Endgame solver test: solver gave up on a position within its limits");
+          numForcedCaptureChecks++;
+          if(capturedWinner != winner)
+            numForcedCaptureMismatches++;
+        }
+      }
+
+      legalLocs.clear();
+      for(int y = 0; y<board.y_size; y++) {
+        for(int x = 0; x<board.x_size; x++) {
+          Loc loc = Location::getLoc(x,y,board.x_size);
+          if(hist.isLegal(board,loc,board.nextPla))
+            legalLocs.push_back(loc);
+        }
+      }
+      if(legalLocs.size() <= 0)
+        break;
+      hist.makeBoardMoveAssumeLegal(board,legalLocs[rand.nextUInt((uint32_t)legalLocs.size())],board.nextPla);
+    }
+  }
+
+  if(verbose) {
+    logger.write(
+      "Endgame solver on " + Global::intToString(boardSize) + "x" + Global::intToString(boardSize) + ": " +
+      Global::int64ToString(numBruteForceMismatches) + " of " + Global::int64ToString(numBruteForceChecks) +
+      " positions differ from brute force, " +
+      Global::int64ToString(numForcedCaptureMismatches) + " of " + Global::int64ToString(numForcedCaptureChecks) +
+      " positions change result after forced captures"
+    );
+  }
+  return numBruteForceChecks > 0 && numForcedCaptureChecks > 0 &&
+    numBruteForceMismatches == 0 && numForcedCaptureMismatches == 0;
+}
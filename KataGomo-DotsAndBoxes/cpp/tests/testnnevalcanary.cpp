@@ -402,4 +402,81 @@ bool Tests::runFP16Test(NNEvaluator* nnEval, NNEvaluator* nnEval32, Logger& logg
     return success;
   }
 #endif
-}
\ No newline at end of file
+}
+
+bool Tests::runPaddedNNLenTest(NNEvaluator* nnEvalPadded, NNEvaluator* nnEvalExact, Logger& logger, int boardSize, bool verbose) {
+  if(nnEvalExact->getNNXLen() != boardSize || nnEvalExact->getNNYLen() != boardSize)
+    throw StringError("Exact nn buffer for padded nn len test does not match the board size");
+  if(nnEvalPadded->getNNXLen() < boardSize || nnEvalPadded->getNNYLen() < boardSize)
+    throw StringError("Padded nn buffer for padded nn len test is smaller than the board size");
+
+  //Positions from a few random games, from the empty board to near the end
+  Rand rand("Tests::runPaddedNNLenTest rand");
+  std::vector<Board> boards;
+  std::vector<BoardHistory> hists;
+  const int numGames = 4;
+  const int positionsPerGame = 8;
+  for(int gameIdx = 0; gameIdx<numGames; gameIdx++) {
+    Board board(boardSize,boardSize);
+    BoardHistory hist(board,P_BLACK,Rules::getTrompTaylorish());
+    std::vector<Loc> legalLocs;
+    //Every move fills one line, so the number of legal moves on the empty board is the game length
+    double sampleProb = -1.0;
+    while(!hist.isGameFinished) {
+      legalLocs.clear();
+      for(int y = 0; y<board.y_size; y++) {
+        for(int x = 0; x<board.x_size; x++) {
+          Loc loc = Location::getLoc(x,y,board.x_size);
+          if(hist.isLegal(board,loc,board.nextPla))
+            legalLocs.push_back(loc);
+        }
+      }
+      if(legalLocs.size() <= 0)
+        break;
+      if(sampleProb < 0.0)
+        sampleProb = std::min(1.0, (double)positionsPerGame / legalLocs.size());
+      if(rand.nextBool(sampleProb)) {
+        boards.push_back(board);
+        hists.push_back(hist);
+      }
+      hist.makeBoardMoveAssumeLegal(board,legalLocs[rand.nextUInt((uint32_t)legalLocs.size())],board.nextPla);
+    }
+  }
+
+  double maxValueDiff = 0.0;
+  double maxPolicyDiff = 0.0;
+  for(size_t i = 0; i<boards.size(); i++) {
+    Board board = boards[i];
+    MiscNNInputParams nnInputParams;
+    nnInputParams.symmetry = 0;
+    bool skipCache = true;
+    NNResultBuf paddedBuf;
+    NNResultBuf exactBuf;
+    nnEvalPadded->evaluate(board,hists[i],board.nextPla,nnInputParams,paddedBuf,skipCache);
+    nnEvalExact->evaluate(board,hists[i],board.nextPla,nnInputParams,exactBuf,skipCache);
+    const NNOutput& padded = *paddedBuf.result;
+    const NNOutput& exact = *exactBuf.result;
+
+    maxValueDiff = std::max(maxValueDiff, (double)std::abs(padded.whiteWinProb - exact.whiteWinProb));
+    maxValueDiff = std::max(maxValueDiff, (double)std::abs(padded.whiteLossProb - exact.whiteLossProb));
+    maxValueDiff = std::max(maxValueDiff, (double)std::abs(padded.whiteNoResultProb - exact.whiteNoResultProb));
+    //Policy is indexed by pos, which depends on the nn buffer size, so compare by loc
+    for(int y = 0; y<board.y_size; y++) {
+      for(int x = 0; x<board.x_size; x++) {
+        Loc loc = Location::getLoc(x,y,board.x_size);
+        maxPolicyDiff = std::max(maxPolicyDiff, (double)std::abs(padded.policyProbs[padded.getPos(loc,board)] - exact.policyProbs[exact.getPos(loc,board)]));
+      }
+    }
+  }
+
+  if(verbose) {
+    logger.write(
+      "Padded nn buffer " + Global::intToString(nnEvalPadded->getNNXLen()) + "x" + Global::intToString(nnEvalPadded->getNNYLen()) +
+      " vs exact " + Global::intToString(boardSize) + "x" + Global::intToString(boardSize) + " on " +
+      Global::uint64ToString((uint64_t)boards.size()) + " positions, max value diff " +
+      Global::strprintf("%.3g",maxValueDiff) + " max policy diff " + Global::strprintf("%.3g",maxPolicyDiff)
+    );
+  }
+  //Only float rounding may differ, the board is the same
+  return boards.size() > 0 && maxValueDiff <= 1e-4 && maxPolicyDiff <= 1e-4;
+}
@@ -25,6 +25,21 @@ namespace Tests {
     bool verbose,
     bool quickTest,
     bool& fp32BatchSuccessBuf);
+  //Evaluates positions of random games on a boardSize board with both evaluators, nnEvalPadded having a larger nn
+  //buffer and not requiring the exact size, nnEvalExact having a buffer of exactly boardSize. Returns true if the
+  //outputs agree.
+  bool runPaddedNNLenTest(
+    NNEvaluator* nnEvalPadded,
+    NNEvaluator* nnEvalExact,
+    Logger& logger,
+    int boardSize,
+    bool verbose);
+
+  // testendgamesolver.cpp
+  //Solves the endgames of random games on a boardSize board, checking the solver against brute force on the smallest
+  //ones, and checking that taking the forced captures the way search does never changes the result. Returns true if
+  //there are no mismatches.
+  bool runEndgameSolverTest(Logger& logger, int boardSize, bool verbose);
 
 }
 